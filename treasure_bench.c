@@ -0,0 +1,858 @@
+#include "treasure_protocol.h"
+#include "treasure_fec.h"
+#include "treasure_compressao.h"
+#include "treasure_escrita.h"
+#include "treasure_tarefas.h"
+#include "treasure_mundo.h"
+#include "treasure_tela.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+// Micro-benchmarks das rotinas críticas do protocolo.
+// Uso: make bench
+
+#define BYTES_POR_MEDIDA (64 * 1024 * 1024)  // Volume processado em cada medida
+
+static volatile uint32_t sorvedouro; // Impede que o compilador descarte os cálculos
+
+// Tempo monotônico em nanossegundos
+static long long agora_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// Verificação de hoje: cabeçalho e dados copiados para um buffer temporário
+// antes da soma de 8 bits
+static uint32_t soma_com_copia(unsigned char *quadro, int tam_dados) {
+    unsigned char temp_buffer[TAM_MAX_QUADRO];
+    memcpy(temp_buffer, quadro + 1, 3);
+    memcpy(temp_buffer + 3, quadro + 5, tam_dados);
+    return calcula_checksum(temp_buffer, 3 + tam_dados);
+}
+
+// Soma de 8 bits por partes, direto no quadro
+static uint32_t soma_no_lugar(unsigned char *quadro, int tam_dados) {
+    return (unsigned char)(calcula_checksum(quadro + 1, 3) + calcula_checksum(quadro + 5, tam_dados));
+}
+
+// CRC32C do cabeçalho estendido mais os dados, direto no quadro
+static uint32_t crc_no_lugar(unsigned char *quadro, int tam_dados) {
+    return crc32c(crc32c(0, quadro + 1, 7), quadro + TAM_CABECALHO_EXT, tam_dados);
+}
+
+// CRC32C pelas tabelas, mesmo com a instrução disponível
+static uint32_t crc_tabela_no_lugar(unsigned char *quadro, int tam_dados) {
+    return crc32c_software(crc32c_software(0, quadro + 1, 7), quadro + TAM_CABECALHO_EXT, tam_dados);
+}
+
+// Mede o custo por byte de uma rotina de verificação
+static double medir_ns_por_byte(uint32_t (*verificar)(unsigned char *, int), 
+                                unsigned char *quadro, int tam_dados) {
+    long long repeticoes = BYTES_POR_MEDIDA / tam_dados;
+    uint32_t acumulado = 0;
+    
+    long long inicio = agora_ns();
+    for (long long i = 0; i < repeticoes; i++) {
+        quadro[5] = (unsigned char)i; // Evita que o resultado seja sempre o mesmo
+        acumulado ^= verificar(quadro, tam_dados);
+    }
+    long long fim = agora_ns();
+    
+    sorvedouro = acumulado;
+    return (double)(fim - inicio) / (repeticoes * tam_dados);
+}
+
+// Compara a soma com cópia (formato atual) com o CRC32C calculado no lugar
+static bool bench_verificacao() {
+    // Vetor de teste padrão do CRC32C
+    const unsigned char *teste = (const unsigned char *)"123456789";
+    if (crc32c(0, teste, 9) != 0xE3069283 || crc32c_software(0, teste, 9) != 0xE3069283) {
+        printf("ERRO: CRC32C não confere com o vetor de teste.\n");
+        return false;
+    }
+    
+    // Combinação usada com as verificações pré-calculadas do cache de tesouros
+    if (crc32c_combinar(crc32c(0, teste, 4), crc32c(0, teste + 4, 5), 5) != 0xE3069283) {
+        printf("ERRO: combinação de CRC32C não confere com o vetor de teste.\n");
+        return false;
+    }
+    
+    printf("Verificação de integridade (CRC32C %s)\n", 
+           crc32c_acelerado() ? "com SSE4.2" : "apenas por tabelas");
+    printf("%8s %14s %14s %14s %14s\n", "dados", "soma+cópia", "soma", "crc32c", "crc32c tabela");
+    
+    static unsigned char quadro[TAM_MAX_QUADRO];
+    for (size_t i = 0; i < sizeof(quadro); i++) {
+        quadro[i] = (unsigned char)(i * 31 + 7);
+    }
+    
+    int tamanhos[] = {TAM_MAX_DADOS, TAM_MAX_PACOTE - TAM_CABECALHO_EXT, TAM_MAX_DADOS_EXT};
+    bool crc_mais_rapido = true;
+    
+    for (size_t i = 0; i < sizeof(tamanhos) / sizeof(tamanhos[0]); i++) {
+        int tam = tamanhos[i];
+        double antigo = medir_ns_por_byte(soma_com_copia, quadro, tam);
+        double soma = medir_ns_por_byte(soma_no_lugar, quadro, tam);
+        double crc = medir_ns_por_byte(crc_no_lugar, quadro, tam);
+        double tabela = medir_ns_por_byte(crc_tabela_no_lugar, quadro, tam);
+        
+        printf("%8d %11.3f ns %11.3f ns %11.3f ns %11.3f ns   (por byte)\n", 
+               tam, antigo, soma, crc, tabela);
+        
+        if (crc > antigo) {
+            crc_mais_rapido = false;
+        }
+    }
+    
+    printf("CRC32C no lugar %s a soma com cópia.\n\n", 
+           crc_mais_rapido ? "não é mais lento que" : "é MAIS LENTO que");
+    return crc_mais_rapido;
+}
+
+// Codifica um bloco, apaga os M primeiros chunks e os reconstrói pelas
+// paridades. Retorna false se algum chunk reconstruído não confere.
+static bool rodada_fec(unsigned char *const *dados, const int *tamanhos, int k, int m, 
+                       BlocoFEC *bloco, unsigned char paridades[][TAM_MAX_SIMBOLO_FEC]) {
+    int tam_simbolo = 0;
+    for (int linha = 0; linha < m; linha++) {
+        tam_simbolo = fec_codificar(paridades[linha], linha, m, dados, tamanhos, k);
+    }
+    
+    bloco->ativo = true;
+    bloco->recebidos = 0;
+    bloco->paridades = 0;
+    bloco->tam_simbolo = 0;
+    for (int i = m; i < k; i++) {
+        fec_acumular(bloco, m, i, dados[i], tamanhos[i]);
+    }
+    for (int linha = 0; linha < m; linha++) {
+        fec_guardar_paridade(bloco, m, linha, k, paridades[linha], tam_simbolo);
+    }
+    
+    ChunkRecuperado recuperados[MAX_PARIDADE_FEC];
+    if (fec_recuperar(bloco, m, recuperados) != m) {
+        return false;
+    }
+    for (int i = 0; i < m; i++) {
+        int indice = recuperados[i].indice;
+        if (recuperados[i].tam_dados != tamanhos[indice] || 
+            memcmp(recuperados[i].dados, dados[indice], tamanhos[indice]) != 0) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// Custo da FEC por byte de dados protegido: codificação no servidor mais a
+// soma e a reconstrução no cliente, com M chunks perdidos em cada bloco
+static bool bench_fec() {
+    static unsigned char chunks[MAX_BLOCO_FEC][TAM_MAX_PACOTE];
+    static unsigned char paridades[MAX_PARIDADE_FEC][TAM_MAX_SIMBOLO_FEC];
+    static BlocoFEC bloco;
+    unsigned char *dados[MAX_BLOCO_FEC];
+    int tamanhos[MAX_BLOCO_FEC];
+    int tam_chunk = TAM_MAX_PACOTE - TAM_CABECALHO_EXT - REDUCAO_CHUNK_FEC;
+    
+    for (int i = 0; i < MAX_BLOCO_FEC; i++) {
+        for (int j = 0; j < tam_chunk; j++) {
+            chunks[i][j] = (unsigned char)(i * 131 + j * 7);
+        }
+        dados[i] = chunks[i];
+        tamanhos[i] = tam_chunk - (i % 5); // O último chunk de um arquivo costuma ser menor
+    }
+    
+    int configuracoes[][2] = {{8, 1}, {16, 1}, {8, 2}, {16, 4}, {64, 4}};
+    bool ok = true;
+    
+    printf("Correção de erros adiante (%d bytes por chunk)\n", tam_chunk);
+    printf("%4s %4s %14s %12s\n", "K", "M", "redundância", "custo");
+    
+    for (size_t c = 0; c < sizeof(configuracoes) / sizeof(configuracoes[0]); c++) {
+        int k = configuracoes[c][0];
+        int m = configuracoes[c][1];
+        long long repeticoes = BYTES_POR_MEDIDA / (k * tam_chunk) / 8;
+        
+        long long inicio = agora_ns();
+        for (long long r = 0; r < repeticoes; r++) {
+            chunks[m][0] = (unsigned char)r;
+            if (!rodada_fec(dados, tamanhos, k, m, &bloco, paridades)) {
+                ok = false;
+                break;
+            }
+        }
+        long long fim = agora_ns();
+        
+        printf("%4d %4d %13.1f%% %9.3f ns   (por byte)\n", k, m, 100.0 * m / k, 
+               (double)(fim - inicio) / (repeticoes * k * tam_chunk));
+    }
+    
+    printf("Reconstrução %s.\n\n", ok ? "confere com os chunks originais" : "NÃO CONFERE");
+    return ok;
+}
+
+static bool gravar_em_arquivo(const unsigned char *dados, int tam, void *contexto) {
+    return fwrite(dados, 1, tam, (FILE *)contexto) == (size_t)tam;
+}
+
+// Compressão de um arquivo em blocos: taxa, vazão de ida e volta e
+// conferência com o original. Sem o arquivo, usa texto sintético.
+static bool bench_compressao(const char *caminho) {
+    static unsigned char original[4 * 1024 * 1024];
+    static unsigned char comprimido[4 * 1024 * 1024 + 1024];
+    static Descompressor descompressor;
+    size_t tam_original = 0;
+    
+    FILE *arquivo = fopen(caminho, "rb");
+    if (arquivo != NULL) {
+        tam_original = fread(original, 1, sizeof(original), arquivo);
+        fclose(arquivo);
+    }
+    if (tam_original == 0) {
+        caminho = "texto sintético";
+        while (tam_original + 64 < sizeof(original)) {
+            tam_original += sprintf((char *)original + tam_original, 
+                                    "linha %zu do tesouro: posição (%zu, %zu)\n", 
+                                    tam_original / 40, tam_original % 8, tam_original % 7);
+        }
+    }
+    
+    int repeticoes = BYTES_POR_MEDIDA / tam_original / 4 + 1;
+    size_t tam_comprimido = 0;
+    
+    long long inicio = agora_ns();
+    for (int r = 0; r < repeticoes; r++) {
+        tam_comprimido = 0;
+        for (size_t pos = 0; pos < tam_original; pos += TAM_BLOCO_COMPRESSAO) {
+            size_t tam_bloco = (tam_original - pos < TAM_BLOCO_COMPRESSAO) ? tam_original - pos : TAM_BLOCO_COMPRESSAO;
+            tam_comprimido += comprimir_bloco(original + pos, tam_bloco, comprimido + tam_comprimido);
+        }
+    }
+    long long meio = agora_ns();
+    
+    // A descompressão escreve em /dev/null, como o cliente escreveria no disco
+    FILE *destino = fopen("/dev/null", "wb");
+    bool ok = destino != NULL;
+    for (int r = 0; ok && r < repeticoes; r++) {
+        descompressor_iniciar(&descompressor);
+        ok = descompressor_alimentar(&descompressor, comprimido, tam_comprimido, gravar_em_arquivo, destino) && 
+             descompressor_completo(&descompressor) && descompressor.bytes_escritos == tam_original;
+    }
+    long long fim = agora_ns();
+    if (destino != NULL) {
+        fclose(destino);
+    }
+    
+    // Conferência byte a byte, bloco por bloco
+    for (size_t pos = 0, lido = 0; ok && pos < tam_original; pos += TAM_BLOCO_COMPRESSAO) {
+        size_t tam_bloco = (tam_original - pos < TAM_BLOCO_COMPRESSAO) ? tam_original - pos : TAM_BLOCO_COMPRESSAO;
+        const unsigned char *bloco = comprimido + lido;
+        int tam_conteudo = ((bloco[1] << 16) | (bloco[2] << 8) | bloco[3]);
+        
+        if (bloco[0] & (BLOCO_COMPRIMIDO >> 24)) {
+            ok = lz_descomprimir(bloco + TAM_CABECALHO_BLOCO, tam_conteudo, descompressor.saida, 
+                                 TAM_BLOCO_COMPRESSAO) == (int)tam_bloco && 
+                 memcmp(descompressor.saida, original + pos, tam_bloco) == 0;
+        } else {
+            ok = memcmp(bloco + TAM_CABECALHO_BLOCO, original + pos, tam_bloco) == 0;
+        }
+        lido += TAM_CABECALHO_BLOCO + tam_conteudo;
+    }
+    
+    double megabytes = (double)tam_original * repeticoes / 1e6;
+    printf("Compressão de %s (%zu bytes em blocos de %d)\n", caminho, tam_original, TAM_BLOCO_COMPRESSAO);
+    printf("  tamanho comprimido: %zu bytes (%.1f%%)\n", tam_comprimido, 100.0 * tam_comprimido / tam_original);
+    printf("  compressão:   %8.1f MB/s\n", megabytes / ((meio - inicio) / 1e9));
+    printf("  descompressão: %7.1f MB/s\n", megabytes / ((fim - meio) / 1e9));
+    printf("Ida e volta %s.\n\n", ok ? "confere com o original" : "NÃO CONFERE");
+    return ok;
+}
+
+// Escrita de um arquivo recebido, chunk a chunk: fwrite na própria thread
+// contra o escritor em lotes. Mede o tempo que a thread de recepção gasta e
+// o total até o arquivo estar gravado, e confere o conteúdo.
+static bool bench_escrita(const char *caminho) {
+    static unsigned char chunk[TAM_MAX_DADOS_EXT];
+    static unsigned char lido[TAM_MAX_DADOS_EXT];
+    int tam_chunk = 1488;
+    long long num_chunks = BYTES_POR_MEDIDA / tam_chunk;
+    
+    // fwrite de cada chunk, como o cliente fazia
+    FILE *arquivo = fopen(caminho, "wb");
+    if (!arquivo) {
+        perror("Erro ao criar arquivo do benchmark");
+        return false;
+    }
+    // O total inclui o fsync: sem ele, mede-se só a cópia para o cache de
+    // páginas, e a medida seguinte pagaria pela gravação desta
+    sync();
+    long long inicio = agora_ns();
+    for (long long i = 0; i < num_chunks; i++) {
+        memset(chunk, (unsigned char)i, tam_chunk);
+        fwrite(chunk, 1, tam_chunk, arquivo);
+    }
+    long long meio = agora_ns();
+    fflush(arquivo);
+    fsync(fileno(arquivo));
+    fclose(arquivo);
+    long long fim = agora_ns();
+    
+    // Escritor em lotes: a recepção só copia para o lote atual
+    EscritorArquivo escritor;
+    remove(caminho);
+    int fd = open(caminho, O_WRONLY | O_CREAT, 0644);
+    if (fd == -1 || !escritor_iniciar(&escritor)) {
+        perror("Erro ao preparar o escritor do benchmark");
+        return false;
+    }
+    sync();
+    long long inicio_lotes = agora_ns();
+    escritor_abrir(&escritor, fd, 0, (uint64_t)num_chunks * tam_chunk);
+    bool ok = true;
+    for (long long i = 0; ok && i < num_chunks; i++) {
+        memset(chunk, (unsigned char)i, tam_chunk);
+        ok = escritor_escrever(&escritor, chunk, tam_chunk);
+    }
+    long long meio_lotes = agora_ns();
+    ok = escritor_concluir(&escritor) && ok;
+    fsync(fd);
+    close(fd);
+    long long fim_lotes = agora_ns();
+    
+    // Conferência do arquivo gravado pelo escritor
+    arquivo = fopen(caminho, "rb");
+    for (long long i = 0; ok && arquivo != NULL && i < num_chunks; i++) {
+        memset(chunk, (unsigned char)i, tam_chunk);
+        ok = fread(lido, 1, tam_chunk, arquivo) == (size_t)tam_chunk && memcmp(lido, chunk, tam_chunk) == 0;
+    }
+    if (arquivo != NULL) {
+        fclose(arquivo);
+    }
+    remove(caminho);
+    
+    printf("Escrita de %lld chunks de %d bytes (%s)\n", num_chunks, tam_chunk, caminho);
+    double ns_fwrite = (double)(meio - inicio) / num_chunks;
+    double ns_lotes = (double)(meio_lotes - inicio_lotes) / num_chunks;
+    printf("  fwrite por chunk: %6.0f ns por chunk na recepção, %6.1f ms no total\n", 
+           ns_fwrite, (fim - inicio) / 1e6);
+    printf("  lotes de %d KiB:  %6.0f ns por chunk na recepção, %6.1f ms no total, %lu chamadas a pwritev, "
+           "até %d lotes, %lu esperas\n", TAM_LOTE_ESCRITA / 1024, ns_lotes, (fim_lotes - inicio_lotes) / 1e6, 
+           escritor.chamadas, escritor.pico_lotes, escritor.esperas);
+    printf("Arquivo gravado em lotes %s.\n", ok ? "confere com os chunks" : "NÃO CONFERE");
+    printf("A recepção com lotes %s que com fwrite.\n\n", ns_lotes < ns_fwrite ? "custa menos" : "custa MAIS");
+    ok = ok && ns_lotes < ns_fwrite;
+    escritor_finalizar(&escritor);
+    return ok;
+}
+
+// Bloco do arquivo comprimido pelo pool, como no envio do servidor
+typedef struct {
+    Tarefa tarefa;
+    const unsigned char *original;
+    int tam_original;
+    unsigned char comprimido[TAM_MAX_BLOCO_COMPRIMIDO];
+    int tam_comprimido;
+} BlocoBench;
+
+static void comprimir_bloco_bench(void *contexto) {
+    BlocoBench *bloco = contexto;
+    bloco->tam_comprimido = comprimir_bloco(bloco->original, bloco->tam_original, bloco->comprimido);
+}
+
+// Comprime 'tam' bytes em blocos pelo pool, com até 'adiante' blocos pedidos
+// à frente do que está sendo usado, e junta os resultados na ordem do
+// arquivo. Retorna o tamanho comprimido.
+static size_t comprimir_com_pool(PoolTarefas *pool, BlocoBench *blocos, int adiante, 
+                                 const unsigned char *original, size_t tam, unsigned char *saida) {
+    size_t pedidos = 0, usados = 0, pos = 0, tam_saida = 0;
+    
+    while (true) {
+        while (pedidos - usados < (size_t)adiante && pos < tam) {
+            BlocoBench *bloco = &blocos[pedidos % adiante];
+            bloco->original = original + pos;
+            bloco->tam_original = (tam - pos < TAM_BLOCO_COMPRESSAO) ? tam - pos : TAM_BLOCO_COMPRESSAO;
+            pos += bloco->tam_original;
+            tarefas_enviar(pool, &bloco->tarefa, comprimir_bloco_bench, bloco, 0);
+            pedidos++;
+        }
+        if (usados == pedidos) {
+            break;
+        }
+        
+        BlocoBench *bloco = &blocos[usados % adiante];
+        tarefas_aguardar(pool, &bloco->tarefa, 0);
+        memcpy(saida + tam_saida, bloco->comprimido, bloco->tam_comprimido);
+        tam_saida += bloco->tam_comprimido;
+        usados++;
+    }
+    
+    return tam_saida;
+}
+
+// Compressão em blocos pelo pool de tarefas, com 1 a 8 threads, contra a
+// compressão na própria thread. O resultado tem de ser o mesmo, byte a byte.
+static bool bench_pool_tarefas() {
+    static unsigned char original[16 * 1024 * 1024];
+    static unsigned char referencia[16 * 1024 * 1024 + 1024 * 1024];
+    static unsigned char comprimido[16 * 1024 * 1024 + 1024 * 1024];
+    static BlocoBench blocos[8];
+    size_t tam_original = 0;
+    
+    while (tam_original + 64 < sizeof(original)) {
+        tam_original += sprintf((char *)original + tam_original, 
+                                "linha %zu do tesouro: posição (%zu, %zu)\n", 
+                                tam_original / 40, tam_original % 8, tam_original % 7);
+    }
+    
+    long long inicio = agora_ns();
+    size_t tam_referencia = 0;
+    for (size_t pos = 0; pos < tam_original; pos += TAM_BLOCO_COMPRESSAO) {
+        size_t tam_bloco = (tam_original - pos < TAM_BLOCO_COMPRESSAO) ? tam_original - pos : TAM_BLOCO_COMPRESSAO;
+        tam_referencia += comprimir_bloco(original + pos, tam_bloco, referencia + tam_referencia);
+    }
+    double sequencial = (agora_ns() - inicio) / 1e9;
+    
+    printf("Pool de tarefas: compressão de %zu bytes em blocos de %d, %d à frente (%ld CPUs)\n", 
+           tam_original, TAM_BLOCO_COMPRESSAO, 8, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("  sem pool:  %8.1f MB/s\n", tam_original / 1e6 / sequencial);
+    
+    bool ok = true;
+    for (int threads = 1; ok && threads <= 8; threads *= 2) {
+        PoolTarefas pool;
+        if (!tarefas_iniciar(&pool, threads)) {
+            return false;
+        }
+        
+        inicio = agora_ns();
+        size_t tam_comprimido = comprimir_com_pool(&pool, blocos, 8, original, tam_original, comprimido);
+        double segundos = (agora_ns() - inicio) / 1e9;
+        ok = tam_comprimido == tam_referencia && memcmp(comprimido, referencia, tam_referencia) == 0;
+        
+        printf("  %d thread(s): %6.1f MB/s (%.2fx), %lu roubadas, %lu feitas por quem esperava\n", 
+               threads, tam_original / 1e6 / segundos, sequencial / segundos, pool.roubadas, pool.ajudas);
+        tarefas_finalizar(&pool);
+    }
+    
+    printf("Resultado do pool %s.\n\n", ok ? "igual ao da compressão sequencial" : "DIFERENTE");
+    return ok;
+}
+
+// Estado do jogo na representação antiga: grids de bool do tamanho fixo
+// do grid e busca linear pelos tesouros
+#define GRID_ANTIGO GRID_PADRAO
+#define TESOUROS_ANTIGOS TESOUROS_PADRAO
+
+typedef struct {
+    Posicao pos;
+    bool encontrado;
+} TesouroAntigo;
+
+typedef struct {
+    Posicao jogador;
+    TesouroAntigo tesouros[TESOUROS_ANTIGOS];
+    bool grid_visitado[GRID_ANTIGO][GRID_ANTIGO];
+    bool grid_tesouro[GRID_ANTIGO][GRID_ANTIGO];
+} EstadoJogoAntigo;
+
+// Célula como no desenho do grid do servidor, pela busca linear
+static char celula_antiga(const EstadoJogoAntigo *jogo, int x, int y) {
+    if (x == jogo->jogador.x && y == jogo->jogador.y) {
+        return 'J';
+    }
+    if (jogo->grid_visitado[y][x]) {
+        if (jogo->grid_tesouro[y][x]) {
+            for (int i = 0; i < TESOUROS_ANTIGOS; i++) {
+                if (jogo->tesouros[i].pos.x == x && jogo->tesouros[i].pos.y == y && jogo->tesouros[i].encontrado) {
+                    return 'X';
+                }
+            }
+            return 'T';
+        }
+        return '.';
+    }
+    return jogo->grid_tesouro[y][x] ? 'T' : ' ';
+}
+
+// Célula como no desenho do grid do servidor, pelos planos de bits e pelo
+// mapa de células (o grid padrão é denso)
+static char celula_planos(const EstadoJogo *jogo, int x, int y) {
+    if (x == jogo->jogador.x && y == jogo->jogador.y) {
+        return 'J';
+    }
+    bool com_tesouro = tesouro_na_posicao(jogo->mundo, x, y) != SEM_TESOURO;
+    if (plano_testar(&jogo->visitado, x, y)) {
+        if (plano_testar(&jogo->encontrado, x, y)) {
+            return 'X';
+        }
+        return com_tesouro ? 'T' : '.';
+    }
+    return com_tesouro ? 'T' : ' ';
+}
+
+// Uma passada de desenho (todas as células e a contagem dos encontrados) e
+// uma consulta de tesouro por célula, na representação antiga
+static uint32_t passada_antiga(const EstadoJogoAntigo *jogo) {
+    uint32_t acumulado = 0;
+    for (int i = 0; i < TESOUROS_ANTIGOS; i++) {
+        acumulado += jogo->tesouros[i].encontrado;
+    }
+    for (int y = 0; y < GRID_ANTIGO; y++) {
+        for (int x = 0; x < GRID_ANTIGO; x++) {
+            acumulado = acumulado * 31 + celula_antiga(jogo, x, y);
+            for (int i = 0; i < TESOUROS_ANTIGOS; i++) {
+                if (jogo->tesouros[i].pos.x == x && jogo->tesouros[i].pos.y == y) {
+                    acumulado += i;
+                    break;
+                }
+            }
+        }
+    }
+    return acumulado;
+}
+
+// A mesma passada pelos planos de bits e pelo tesouro de cada célula
+static uint32_t passada_planos(const EstadoJogo *jogo) {
+    uint32_t acumulado = jogo->encontrado.marcadas;
+    for (int y = 0; y < GRID_ANTIGO; y++) {
+        for (int x = 0; x < GRID_ANTIGO; x++) {
+            acumulado = acumulado * 31 + celula_planos(jogo, x, y);
+            int indice = tesouro_na_posicao(jogo->mundo, x, y);
+            if (indice != SEM_TESOURO) {
+                acumulado += indice;
+            }
+        }
+    }
+    return acumulado;
+}
+
+// Consultas de tesouro por célula em um mundo grande, que nas grids de bool
+// ocupariam largura x altura bytes por plano
+static bool bench_mundo_grande(int lado, int num_tesouros) {
+    const long long consultas = 4000000;
+    long long inicio = agora_ns();
+    MundoJogo *mundo = criar_mundo(lado, lado, num_tesouros, 1);
+    double ms_criacao = (agora_ns() - inicio) / 1e6;
+    if (mundo == NULL) {
+        printf("Mundo %dx%d: sem memória.\n", lado, lado);
+        return false;
+    }
+    
+    // Todo tesouro tem de ser achado na sua célula
+    bool ok = true;
+    for (int i = 0; i < num_tesouros && ok; i++) {
+        ok = tesouro_na_posicao(mundo, mundo->tesouros[i].x, mundo->tesouros[i].y) == i;
+    }
+    
+    // Células pseudoaleatórias, quase todas vazias
+    uint32_t estado = 12345, achados = 0;
+    inicio = agora_ns();
+    for (long long i = 0; i < consultas; i++) {
+        estado = estado * 1664525u + 1013904223u;
+        int x = (estado >> 8) % lado;
+        int y = (estado * 2654435761u >> 8) % lado;
+        achados += tesouro_na_posicao(mundo, x, y) != SEM_TESOURO;
+    }
+    double ns_consulta = (double)(agora_ns() - inicio) / consultas;
+    sorvedouro = achados;
+    
+    double mb_indice = (double)num_tesouros * (sizeof(Posicao) + sizeof(EntradaIndice)) / 1e6;
+    printf("Mundo %dx%d com %d tesouros: criado em %.1f ms, %.1f ns por consulta\n", 
+           lado, lado, num_tesouros, ms_criacao, ns_consulta);
+    printf("  índice espacial: %.1f MB (grids de bool: %.1f MB por plano)\n", 
+           mb_indice, (double)lado * lado / 1e6);
+    liberar_mundo(mundo);
+    return ok;
+}
+
+// Compara as consultas do desenho do grid nas duas representações, com
+// metade dos tesouros encontrados. O resultado tem de ser o mesmo, e os
+// planos não podem ser mais lentos que os grids de bool no grid padrão.
+static bool bench_estado_jogo() {
+    const long long repeticoes = 2000000;
+    EstadoJogo jogo;
+    EstadoJogoAntigo antigo;
+    
+    MundoJogo *mundo = criar_mundo(GRID_ANTIGO, GRID_ANTIGO, TESOUROS_ANTIGOS, 1);
+    if (mundo == NULL || !inicializar_jogo(&jogo, mundo)) {
+        printf("Estado do jogo: sem memória.\n");
+        liberar_mundo(mundo);
+        return false;
+    }
+    liberar_mundo(mundo);
+    
+    memset(&antigo, 0, sizeof(antigo));
+    antigo.grid_visitado[0][0] = true;
+    for (int i = 0; i < TESOUROS_ANTIGOS; i++) {
+        antigo.tesouros[i].pos = jogo.mundo->tesouros[i];
+        antigo.grid_tesouro[jogo.mundo->tesouros[i].y][jogo.mundo->tesouros[i].x] = true;
+    }
+    
+    // Percorre as linhas pares e visita os tesouros pares
+    for (int y = 0; y < GRID_ANTIGO; y += 2) {
+        for (int x = 0; x < GRID_ANTIGO; x++) {
+            plano_marcar(&jogo.visitado, x, y, true);
+            antigo.grid_visitado[y][x] = true;
+        }
+    }
+    for (int i = 0; i < TESOUROS_ANTIGOS; i += 2) {
+        Posicao pos = jogo.mundo->tesouros[i];
+        plano_marcar(&jogo.visitado, pos.x, pos.y, true);
+        antigo.grid_visitado[pos.y][pos.x] = true;
+        marcar_tesouro_encontrado(&jogo, i, true);
+        antigo.tesouros[i].encontrado = true;
+    }
+    jogo.jogador = antigo.jogador = jogo.mundo->tesouros[0];
+    
+    bool ok = passada_antiga(&antigo) == passada_planos(&jogo);
+    
+    uint32_t acumulado = 0;
+    long long inicio = agora_ns();
+    for (long long i = 0; i < repeticoes; i++) {
+        antigo.jogador.x = i % GRID_ANTIGO; // Evita que a passada seja içada do laço
+        acumulado ^= passada_antiga(&antigo);
+    }
+    double ns_antiga = (double)(agora_ns() - inicio) / repeticoes;
+    
+    inicio = agora_ns();
+    for (long long i = 0; i < repeticoes; i++) {
+        jogo.jogador.x = i % GRID_ANTIGO;
+        acumulado ^= passada_planos(&jogo);
+    }
+    double ns_planos = (double)(agora_ns() - inicio) / repeticoes;
+    sorvedouro = acumulado;
+    finalizar_jogo(&jogo);
+    
+    printf("Estado do jogo: desenho do grid %dx%d com %d tesouros\n", 
+           GRID_ANTIGO, GRID_ANTIGO, TESOUROS_ANTIGOS);
+    printf("  grids de bool e busca linear: %8.1f ns por desenho\n", ns_antiga);
+    printf("  planos de bits e mapa:        %8.1f ns por desenho (%.2fx)\n", ns_planos, ns_antiga / ns_planos);
+    bool mais_rapido = ns_planos <= ns_antiga;
+    printf("Os planos %s os grids de bool.\n", mais_rapido ? "não são mais lentos que" : "são MAIS LENTOS que");
+    
+    ok = bench_mundo_grande(4096, 100000) && ok;
+    printf("Resultado dos planos %s.\n\n", ok ? "igual ao dos grids de bool" : "DIFERENTE");
+    return ok && mais_rapido;
+}
+
+static int comparar_entradas_antigo(const void *a, const void *b) {
+    uint32_t codigo_a = ((const EntradaIndice *)a)->codigo;
+    uint32_t codigo_b = ((const EntradaIndice *)b)->codigo;
+    return (codigo_a > codigo_b) - (codigo_a < codigo_b);
+}
+
+// Sorteio antigo: rand() com rejeição das células já ocupadas e índice
+// ordenado com qsort. Retorna o número de sorteios feitos, ou -1.
+static long long sorteio_por_rejeicao(int largura, int altura, int num_tesouros) {
+    Posicao *tesouros = malloc((num_tesouros + 1) * sizeof(Posicao));
+    EntradaIndice *indice = malloc((num_tesouros + 1) * sizeof(EntradaIndice));
+    PlanoGrid ocupadas = {0};
+    long long sorteios = 0;
+    
+    for (int i = 0; i < num_tesouros && tesouros != NULL && indice != NULL; i++) {
+        int x, y;
+        do {
+            x = rand() % largura;
+            y = rand() % altura;
+            sorteios++;
+        } while (plano_testar(&ocupadas, x, y));
+        if (!plano_marcar(&ocupadas, x, y, true)) {
+            sorteios = -1;
+            break;
+        }
+        tesouros[i] = (Posicao){x, y};
+        indice[i].codigo = codigo_morton(x, y);
+        indice[i].tesouro = i;
+    }
+    if (tesouros == NULL || indice == NULL) {
+        sorteios = -1;
+    } else if (sorteios >= 0) {
+        qsort(indice, num_tesouros, sizeof(EntradaIndice), comparar_entradas_antigo);
+    }
+    
+    plano_liberar(&ocupadas);
+    free(tesouros);
+    free(indice);
+    return sorteios;
+}
+
+// Sorteio de um mundo pelo algoritmo de Floyd, comparado ao antigo, em um
+// grid esparso e em um quase cheio. A mesma semente tem de repetir o mundo,
+// e o índice tem de achar todos os tesouros.
+static bool bench_sorteio_mundo() {
+    const struct { int lado; int num_tesouros; } casos[] = {
+        {4096, 1000000},  // 6% das células
+        {1024, 1000000},  // 95% das células
+    };
+    const uint64_t semente = 20240601;
+    bool ok = true;
+    
+    printf("Sorteio de mundos (semente %llu):\n", (unsigned long long)semente);
+    srand(semente);
+    for (size_t c = 0; c < sizeof(casos) / sizeof(casos[0]); c++) {
+        int lado = casos[c].lado;
+        int n = casos[c].num_tesouros;
+        
+        long long inicio = agora_ns();
+        long long sorteios = sorteio_por_rejeicao(lado, lado, n);
+        double ms_antigo = (agora_ns() - inicio) / 1e6;
+        
+        inicio = agora_ns();
+        MundoJogo *mundo = criar_mundo(lado, lado, n, semente);
+        double ms_floyd = (agora_ns() - inicio) / 1e6;
+        MundoJogo *repetido = criar_mundo(lado, lado, n, semente);
+        if (sorteios < 0 || mundo == NULL || repetido == NULL) {
+            printf("  %dx%d: sem memória.\n", lado, lado);
+            liberar_mundo(mundo);
+            liberar_mundo(repetido);
+            return false;
+        }
+        
+        bool igual = memcmp(mundo->tesouros, repetido->tesouros, n * sizeof(Posicao)) == 0;
+        for (int i = 0; i < n && igual; i++) {
+            igual = tesouro_na_posicao(mundo, mundo->tesouros[i].x, mundo->tesouros[i].y) == i;
+        }
+        ok = ok && igual;
+        
+        printf("  %dx%d com %d tesouros:\n", lado, lado, n);
+        printf("    rand() e rejeição:  %8.1f ms (%.2f sorteios por tesouro)\n", 
+               ms_antigo, (double)sorteios / n);
+        printf("    xoshiro e Floyd:    %8.1f ms (%.2fx), %s\n", ms_floyd, ms_antigo / ms_floyd, 
+               igual ? "repetido pela semente" : "DIFERENTE");
+        liberar_mundo(mundo);
+        liberar_mundo(repetido);
+    }
+    
+    printf("Resultado do sorteio %s.\n\n", ok ? "repetível e completo" : "DIFERENTE");
+    return ok;
+}
+
+// Monta um quadro como o do servidor: o recorte 32x16 de um grid grande
+// em volta do jogador
+static void montar_quadro_tela(Tela *tela, const EstadoJogo *jogo) {
+    Recorte recorte = recortar_tela(jogo);
+    tela_printf(tela, "SERVIDOR DE CAÇA AO TESOURO\n");
+    tela_printf(tela, "Jogador na posição (%d,%d)\n\n", jogo->jogador.x, jogo->jogador.y);
+    for (int y = recorte.y + recorte.altura - 1; y >= recorte.y; y--) {
+        tela_printf(tela, "%*d |", recorte.largura_rotulo, y);
+        for (int x = recorte.x; x < recorte.x + recorte.largura; x++) {
+            char celula = ' ';
+            if (x == jogo->jogador.x && y == jogo->jogador.y) {
+                celula = 'J';
+            } else if (plano_testar(&jogo->visitado, x, y)) {
+                celula = '.';
+            } else if (tesouro_na_posicao(jogo->mundo, x, y) != SEM_TESOURO) {
+                celula = 'T';
+            }
+            tela_printf(tela, " %c ", celula);
+        }
+        tela_printf(tela, "|\n");
+    }
+}
+
+// Abre um pseudoterminal para a tela, com 50x200 caracteres. O lado mestre,
+// que faz as vezes do emulador de terminal, é lido sem bloquear.
+static bool abrir_terminal(int *mestre, int *terminal) {
+    *terminal = -1;
+    *mestre = posix_openpt(O_RDWR | O_NOCTTY);
+    if (*mestre < 0 || grantpt(*mestre) != 0 || unlockpt(*mestre) != 0 || 
+        fcntl(*mestre, F_SETFL, O_NONBLOCK) != 0) {
+        return false;
+    }
+    *terminal = open(ptsname(*mestre), O_RDWR | O_NOCTTY);
+    struct winsize tamanho = {.ws_row = 50, .ws_col = 200};
+    return *terminal >= 0 && ioctl(*terminal, TIOCSWINSZ, &tamanho) == 0;
+}
+
+static int comparar_tempos(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Desenho da tela com o jogador andando, quadros inteiros contra só as
+// diferenças, em um pseudoterminal: o modo diferencial só é usado em
+// terminais. Conta o custo de apresentar cada quadro e de o terminal ler
+// os bytes; a montagem do quadro é a mesma nos dois modos e fica de fora.
+// Os dois modos se alternam a cada passo e vale a mediana por quadro, para
+// que uma preempção no meio não decida o resultado.
+static bool bench_tela() {
+    const int passos = 2000;
+    int mestre, terminal;
+    bool aberto = abrir_terminal(&mestre, &terminal);
+    MundoJogo *mundo = criar_mundo(4096, 4096, 100000, 1);
+    long long *tempos = malloc(2 * passos * sizeof(long long));
+    EstadoJogo jogo;
+    if (!aberto || mundo == NULL || tempos == NULL || !inicializar_jogo(&jogo, mundo)) {
+        printf("Tela: não foi possível preparar o teste.\n");
+        liberar_mundo(mundo);
+        free(tempos);
+        if (mestre >= 0) {
+            close(mestre);
+        }
+        if (terminal >= 0) {
+            close(terminal);
+        }
+        return false;
+    }
+    liberar_mundo(mundo);
+    
+    printf("Tela: %d quadros do recorte 32x16, com o jogador andando, em um pseudoterminal:\n", passos);
+    Tela telas[2];
+    for (int diferencial = 0; diferencial <= 1; diferencial++) {
+        tela_iniciar(&telas[diferencial], terminal);
+        telas[diferencial].diferencial = diferencial;
+    }
+    
+    char lidos[1 << 16];
+    jogo.jogador = (Posicao){0, 8};
+    for (int i = 0; i < passos; i++) {
+        mover_jogador(&jogo, (i / 200) % 2 ? TIPO_MOVE_ESQ : TIPO_MOVE_DIR);
+        for (int diferencial = 0; diferencial <= 1; diferencial++) {
+            Tela *tela = &telas[diferencial];
+            montar_quadro_tela(tela, &jogo);
+            
+            long long inicio = agora_ns();
+            tela_apresentar(tela);
+            while (read(mestre, lidos, sizeof(lidos)) > 0) {
+                // O terminal consome o quadro
+            }
+            tempos[diferencial * passos + i] = agora_ns() - inicio;
+        }
+    }
+    
+    double us_quadro[2];
+    for (int diferencial = 0; diferencial <= 1; diferencial++) {
+        long long *tempos_modo = tempos + diferencial * passos;
+        qsort(tempos_modo, passos, sizeof(long long), comparar_tempos);
+        us_quadro[diferencial] = tempos_modo[passos / 2] / 1e3;
+        
+        Tela *tela = &telas[diferencial];
+        printf("  %-20s %7.1f bytes e %6.1f us por quadro (%lu inteiros)\n", 
+               diferencial ? "só as diferenças:" : "quadros inteiros:", 
+               (double)tela->bytes_escritos / passos, us_quadro[diferencial], tela->completos);
+        tela_finalizar(tela);
+    }
+    
+    bool mais_rapido = us_quadro[1] <= us_quadro[0];
+    printf("As diferenças %s os quadros inteiros.\n", mais_rapido ? "não custam mais que" : "custam MAIS que");
+    
+    finalizar_jogo(&jogo);
+    free(tempos);
+    close(terminal);
+    close(mestre);
+    printf("\n");
+    return mais_rapido;
+}
+
+int main() {
+    bool ok = bench_verificacao();
+    ok = bench_fec() && ok;
+    ok = bench_compressao("objetos/4.txt") && ok;
+    ok = bench_escrita("recebidos/bench_escrita.tmp") && ok;
+    ok = bench_pool_tarefas() && ok;
+    ok = bench_estado_jogo() && ok;
+    ok = bench_sorteio_mundo() && ok;
+    ok = bench_tela() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+#include "treasure_cache.h"
+#include "treasure_compressao.h"
+#include <sys/mman.h>
+
+// Reserva a arena com o tamanho máximo do cache. As páginas só ocupam
+// memória quando são usadas.
+bool cache_iniciar(CacheTesouros *cache, size_t capacidade) {
+    memset(cache, 0, sizeof(*cache));
+    
+    cache->arena = mmap(NULL, capacidade, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cache->arena == MAP_FAILED) {
+        perror("Erro ao reservar o cache de tesouros");
+        cache->arena = NULL;
+        return false;
+    }
+    
+    cache->capacidade = capacidade;
+    return true;
+}
+
+// Toma 'tam' bytes do fim da arena, logo após a última reserva (as reservas
+// seguidas formam um trecho contínuo). Retorna NULL se não couber.
+static unsigned char *reservar(CacheTesouros *cache, size_t tam) {
+    if (tam > cache->capacidade - cache->usado) {
+        return NULL;
+    }
+    
+    unsigned char *inicio = cache->arena + cache->usado;
+    cache->usado += tam;
+    return inicio;
+}
+
+// Alinha o fim da arena para guardar estruturas
+static bool alinhar(CacheTesouros *cache) {
+    size_t resto = cache->usado % sizeof(void *);
+    return resto == 0 || reservar(cache, sizeof(void *) - resto) != NULL;
+}
+
+// Copia o arquivo para a arena, como está ou comprimido bloco a bloco no
+// formato de treasure_compressao.h. Retorna false se não couber.
+static bool copiar_conteudo(CacheTesouros *cache, FILE *arquivo, size_t tamanho, bool comprimir,
+                            size_t *tam_conteudo) {
+    if (!comprimir) {
+        unsigned char *destino = reservar(cache, tamanho);
+        *tam_conteudo = tamanho;
+        return destino != NULL && fread(destino, 1, tamanho, arquivo) == tamanho;
+    }
+    
+    static unsigned char original[TAM_BLOCO_COMPRESSAO];
+    static unsigned char bloco[TAM_MAX_BLOCO_COMPRIMIDO];
+    size_t lidos;
+    *tam_conteudo = 0;
+    
+    while ((lidos = fread(original, 1, sizeof(original), arquivo)) > 0) {
+        int tam_bloco = comprimir_bloco(original, lidos, bloco);
+        unsigned char *destino = reservar(cache, tam_bloco);
+        if (destino == NULL) {
+            return false;
+        }
+        memcpy(destino, bloco, tam_bloco);
+        *tam_conteudo += tam_bloco;
+    }
+    
+    return true;
+}
+
+// Lê um tesouro e o divide em chunks de 'tam_chunk' bytes, calculando as
+// verificações de cada um. Se o tesouro não couber no que resta da arena,
+// nada é guardado e a função retorna false.
+bool cache_carregar(CacheTesouros *cache, int indice, const char *caminho, int tam_chunk, bool comprimir) {
+    TesouroPronto *tesouro = &cache->tesouros[indice];
+    tesouro->carregado = false;
+    
+    if (cache->arena == NULL || tam_chunk <= 0) {
+        return false;
+    }
+    
+    FILE *arquivo = fopen(caminho, "rb");
+    if (!arquivo) {
+        perror("Erro ao abrir tesouro para o cache");
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fileno(arquivo), &st) == -1) {
+        perror("Erro ao obter tamanho do tesouro");
+        fclose(arquivo);
+        return false;
+    }
+    
+    size_t usado_antes = cache->usado;
+    unsigned char *conteudo = cache->arena + cache->usado;
+    size_t tam_conteudo;
+    bool ok = copiar_conteudo(cache, arquivo, st.st_size, comprimir, &tam_conteudo);
+    fclose(arquivo);
+    
+    // Os chunks vêm depois do conteúdo, que não muda mais de lugar
+    size_t num_chunks = (tam_conteudo + tam_chunk - 1) / tam_chunk;
+    ChunkPronto *chunks = NULL;
+    if (ok && alinhar(cache)) {
+        chunks = (ChunkPronto *)reservar(cache, num_chunks * sizeof(ChunkPronto));
+    }
+    
+    if (chunks == NULL) {
+        cache->usado = usado_antes;
+        return false;
+    }
+    
+    for (size_t i = 0; i < num_chunks; i++) {
+        size_t inicio = i * tam_chunk;
+        chunks[i].dados = conteudo + inicio;
+        chunks[i].tam_dados = (tam_conteudo - inicio < (size_t)tam_chunk) ? tam_conteudo - inicio : tam_chunk;
+        calcular_verificacao_dados(&chunks[i].verificacao, chunks[i].dados, chunks[i].tam_dados);
+    }
+    
+    tesouro->carregado = true;
+    tesouro->comprimido = comprimir;
+    tesouro->tam_chunk = tam_chunk;
+    tesouro->tamanho_arquivo = st.st_size;
+    tesouro->tamanho_conteudo = tam_conteudo;
+    tesouro->num_chunks = num_chunks;
+    tesouro->chunks = chunks;
+    return true;
+}
+
+// Tesouro pré-empacotado para o formato da transferência, ou NULL se ele
+// não estiver no cache ou tiver sido montado para outro formato
+const TesouroPronto *cache_obter(const CacheTesouros *cache, int indice, int tam_chunk, bool comprimido) {
+    const TesouroPronto *tesouro = &cache->tesouros[indice];
+    
+    if (!tesouro->carregado || tesouro->tam_chunk != tam_chunk || tesouro->comprimido != comprimido) {
+        return NULL;
+    }
+    return tesouro;
+}
+
+// Devolve a arena ao sistema
+void cache_liberar(CacheTesouros *cache) {
+    if (cache->arena != NULL) {
+        munmap(cache->arena, cache->capacidade);
+        cache->arena = NULL;
+    }
+    
+    for (int i = 0; i < NUM_ARQUIVOS_TESOUROS; i++) {
+        cache->tesouros[i].carregado = false;
+    }
+}
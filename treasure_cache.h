@@ -0,0 +1,45 @@
+#ifndef TREASURE_CACHE_H
+#define TREASURE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "treasure_protocol.h"
+
+// Cache dos tesouros pré-empacotados, montado na inicialização do servidor.
+// Cada tesouro é lido (e comprimido, se for o caso) uma vez e dividido nos
+// chunks de uma transferência, com as verificações dos dados já calculadas.
+// Tudo fica em uma única arena, limitada pelo tamanho pedido com -m: no
+// envio só o cabeçalho do quadro (sequência e verificação) é montado.
+
+// Chunk pronto para o envio
+typedef struct {
+    unsigned char *dados;             // Na arena
+    int tam_dados;
+    VerificacaoDados verificacao;
+} ChunkPronto;
+
+// Tesouro pré-empacotado para um formato de transferência: tamanho do chunk
+// e conteúdo comprimido ou não
+typedef struct {
+    bool carregado;
+    bool comprimido;
+    int tam_chunk;
+    size_t tamanho_arquivo;           // Tamanho original, anunciado no TIPO_TAMANHO
+    size_t tamanho_conteudo;          // Bytes enviados (comprimidos, se for o caso)
+    size_t num_chunks;
+    ChunkPronto *chunks;              // Na arena
+} TesouroPronto;
+
+typedef struct {
+    unsigned char *arena;
+    size_t capacidade;
+    size_t usado;
+    TesouroPronto tesouros[NUM_ARQUIVOS_TESOUROS];
+} CacheTesouros;
+
+bool cache_iniciar(CacheTesouros *cache, size_t capacidade);
+bool cache_carregar(CacheTesouros *cache, int indice, const char *caminho, int tam_chunk, bool comprimir);
+const TesouroPronto *cache_obter(const CacheTesouros *cache, int indice, int tam_chunk, bool comprimido);
+void cache_liberar(CacheTesouros *cache);
+
+#endif // TREASURE_CACHE_H
@@ -1,4 +1,11 @@
 #include "treasure_protocol.h"
+#include "treasure_reactor.h"
+#include "treasure_fec.h"
+#include "treasure_compressao.h"
+#include "treasure_escrita.h"
+#include "treasure_eventos.h"
+#include "treasure_mundo.h"
+#include "treasure_tela.h"
 #include <pthread.h>
 #include <signal.h>
 #include <sys/time.h>
@@ -7,48 +14,252 @@
 // Configuração de rede
 #define INTERFACE_NAME "veth1"  // Nome da interface para uso com o virtual Ethernet
 #define DIRETORIO_RECEBIDOS "recebidos"  // Diretório onde serão salvos os arquivos recebidos
+#define ARQUIVO_MENSAGENS "treasure_client.log"  // Mensagens enquanto a tela estiver aberta
+#define TAM_ENTRADA 1024  // Comandos digitados ainda não processados
+#define TIMEOUT_TRANSFERENCIA_MS ((MAX_RETRIES + 1) * TIMEOUT_MS) // Silêncio que encerra uma transferência
 
-// MAC addresses (devem corresponder aos do servidor)
+// MAC addresses (o do servidor deve corresponder ao dele; o do cliente
+// identifica o jogador no servidor e pode ser trocado com -M)
 static unsigned char mac_cliente[6] = {0xAA, 0xef, 0x89, 0x44, 0x14, 0xd2};
 static unsigned char mac_servidor[6] = {0x62, 0x42, 0x03, 0x53, 0xa4, 0x24};
 
 // Variáveis globais
 static int sockfd;
-static struct sockaddr_ll endereco_servidor;
-static EstadoJogo jogo;
-static unsigned char ultimo_seq_recebido = 0;
-static unsigned char proximo_seq_envio = 0;
+static Conexao conexao_servidor; // Endereços e formato negociado com o servidor
+static EstadoJogo jogo;           // Só a thread principal: muda pelos eventos da recepção
+static int largura_grid = 0;     // Dimensões do grid informadas pelo servidor (só a
+static int altura_grid = 0;      // thread de recebimento; 0 até a primeira resposta)
+
+// Tesouro recebido, na ordem em que chegaram (só a thread principal)
+typedef struct {
+    Posicao pos;
+    char nome[TAM_MAX_NOME];
+} TesouroRecebido;
+
+static TesouroRecebido *tesouros_recebidos = NULL;
+static int num_recebidos = 0;
+static int capacidade_recebidos = 0;
+static uint16_t ultimo_seq_recebido = 0;
+static uint16_t proximo_seq_envio = 0;
 static bool em_execucao = true;
-static pthread_mutex_t mutex_jogo = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t mutex_recebimento = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t cond_recebimento = PTHREAD_COND_INITIALIZER;
 static bool aguardando_arquivo = false;
 static char nome_arquivo_recebido[TAM_MAX_NOME];
 static int tipo_arquivo_recebido = TIPO_ARQ_DESCONHECIDO;
 static FILE *arquivo_recebendo = NULL; // Ponteiro para o arquivo que está sendo recebido
+static EscritorArquivo escritor;       // Grava o arquivo recebido em lotes, fora desta thread
+
+// Buffer de recepção da janela deslizante, indexado pela sequência do chunk
+// módulo JANELA_MAX (único para as sequências dentro de uma janela)
+typedef struct {
+    unsigned char dados[TAM_MAX_DADOS_EXT];
+    int tam_dados;
+    bool ocupado;
+} SlotRecepcao;
+
+static SlotRecepcao janela_recepcao[JANELA_MAX];
+static uint16_t seq_esperado = 0;      // Próximo chunk a ser escrito no arquivo
+static bool nack_enviado = false;      // Já pedimos a retransmissão de seq_nack
+static uint16_t seq_nack = 0;
+static int chunks_sem_ack = 0;         // Chunks em ordem ainda não confirmados (ACK seletivo)
+static bool sack_pendente = false;     // Enviar um ACK seletivo no fim do lote
+static bool lacuna_pendente = false;   // Pedir o chunk esperado no fim do lote (sem ACK seletivo)
+static uint64_t chunks_escritos = 0;   // Índice de seq_esperado na transferência
+
+// Correção de erros adiante: parâmetros anunciados no TIPO_TAMANHO e blocos
+// em recepção, indexados pelo número do bloco
+static int fec_bloco = 0;              // K (0: o servidor não envia paridades)
+static int fec_paridades = 0;          // M
+static BlocoFEC blocos_fec[BLOCOS_FEC_ABERTOS];
+static unsigned long paridades_recebidas = 0;
+static unsigned long chunks_recuperados = 0;
+
+// Arquivo enviado comprimido (OPCAO_ARQ_COMPRIMIDO): os chunks são remontados
+// em blocos e descomprimidos antes da escrita
+static bool arquivo_comprimido = false;
+static Descompressor descompressor;
+static unsigned long long bytes_comprimidos = 0; // Recebidos nos arquivos comprimidos
+static unsigned long long bytes_descomprimidos = 0;
 
-// Novas variáveis para controle de movimentos
-static bool movimento_em_andamento = false;
-static bool ultimo_movimento_ok = false;
+// Retomada (CAPACIDADE_RETOMADA): o progresso de cada arquivo fica em um
+// diário em recebidos/.<nome>.retomada ("<tamanho> <bytes gravados>"). Se a
+// transferência falhar, o arquivo parcial é mantido e, quando o tesouro for
+// enviado de novo, o ACK do nome pede ao servidor que continue dali.
+#define INTERVALO_DIARIO (1024 * 1024) // Bytes gravados entre atualizações do diário
+static size_t tamanho_arquivo_recebido = 0;
+static uint64_t inicio_retomada = 0;   // Byte em que o arquivo atual recomeçou
+static uint64_t progresso_salvo = 0;   // Último valor gravado no diário
+static unsigned long retomadas = 0;
+static unsigned long long bytes_retomados = 0;
+
+// Movimentos enviados e ainda sem resposta, em um anel na ordem das
+// sequências. O servidor os aplica nessa ordem: a resposta a um movimento
+// confirma também os anteriores a ele.
+#define MOVIMENTOS_EM_VOO_PADRAO MAX_MOVIMENTOS_EM_VOO
+typedef struct {
+    unsigned char direcao;
+    uint16_t seq;
+    struct timespec primeiro_envio;
+    struct timespec enviado_em;            // Último envio
+    int tentativas;                        // Retransmissões (regra de Karn: sem medida do RTT)
+} MovimentoEmVoo;
+
+static MovimentoEmVoo movimentos_em_voo[MAX_MOVIMENTOS_EM_VOO];
+static int primeiro_em_voo = 0;
+static int num_em_voo = 0;
+static int max_em_voo = MOVIMENTOS_EM_VOO_PADRAO; // -j
+static bool movimento_respondido = false;  // O servidor já conhece a nossa sequência
 static pthread_mutex_t mutex_movimento = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t cond_movimento = PTHREAD_COND_INITIALIZER;
-static unsigned char ultimo_movimento_enviado = 0; // Armazena o tipo do último movimento enviado
-static bool atualizacao_pendente = true; // Indica que o grid precisa ser redesenhado
+static bool usar_anel = false; // Usa PACKET_MMAP (TPACKET_V3) no socket
+static bool usar_filtro = false; // Filtra no kernel os quadros que não são para nós
+static bool atualizacao_pendente = true; // Indica que o grid precisa ser redesenhado (só a thread principal)
+static bool negociar = true; // Propõe o formato estendido ao servidor
+static bool usar_crc32c = false; // Pede verificação CRC32C na negociação
+static bool usar_sack = true;    // Propõe ACKs seletivos na negociação
+static bool usar_compressao = true; // Aceita arquivos comprimidos na negociação (-z desativa)
+static double perda_simulada = 0.0;     // Fração de quadros recebidos descartados (-p)
+static double corrupcao_simulada = 0.0; // Fração de quadros recebidos corrompidos (-e)
+static bool negociacao_pendente = false; // Aguardando a resposta do servidor à negociação
+static int tentativas_negociacao = 0;
+static int max_dados_local; // Maior payload suportado pelo MTU da interface
+
+// Laços de eventos: rede (thread de recebimento) e tela/teclado (thread principal)
+static Reator reator_rede;
+static Reator reator_tela;
+static FonteEvento *notificador_tela;    // Acorda a thread principal para redesenhar
+static FonteEvento *timer_tela;          // Desenha o quadro adiado pelo limite de quadros por segundo
+static Tela tela;                        // Quadros desenhados por diferença (só a thread principal)
+static AnelEventos eventos;              // Eventos do jogo da recepção para a tela
+static int progresso_publicado = 0;      // Último vigésimo do arquivo publicado (recepção)
+static uint64_t bytes_na_tela = 0;       // Progresso mostrado na tela (só a thread principal)
+static uint64_t total_na_tela = 0;
+static FonteEvento *fonte_entrada;       // Leitura de comandos do teclado
+static FonteEvento *timer_transferencia; // Abandona transferências que pararam de chegar
+static FonteEvento *timer_negociacao;    // Retransmite a proposta de formato estendido
+static FonteEvento *timer_ack;           // Prazo do ACK seletivo atrasado
+static FonteEvento *timer_movimentos;    // Retransmite os movimentos sem resposta
+static char entrada_pendente[TAM_ENTRADA];
+
+// Respostas (ACK/NACK) geradas durante um lote de recepção, enviadas juntas
+#define TAM_MAX_RESPOSTA TAM_SACK
+static QuadroSaida respostas[MAX_PACOTES_POR_EVENTO];
+static unsigned char dados_respostas[MAX_PACOTES_POR_EVENTO][TAM_MAX_RESPOSTA];
+static int num_respostas = 0;
+static int tam_entrada = 0;
 
 // Funções do cliente
 void imprimir_grid();
 void *thread_recebimento(void *arg);
 bool enviar_movimento(int direcao);
 bool iniciar_recebimento_arquivo(const char *nome_arquivo);
+bool receber_chunk(uint16_t seq, unsigned char *dados, int tam_dados);
+void processar_pacote(unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados);
+void ao_receber_pacotes(void *contexto);
+void confirmar_movimentos(uint16_t seq, bool tesouro);
+void conhecer_grid(const unsigned char *dados);
+void ao_expirar_movimentos(void *contexto);
+void pedir_retransmissao();
+bool ha_lacuna();
+bool acumular_chunk_fec(uint64_t indice, unsigned char *dados, int tam_dados);
+void receber_paridade(unsigned char *dados, int tam_dados);
+void agendar_sack(bool imediato);
+void enviar_sack();
+void ao_expirar_ack(void *contexto);
+void responder(unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados);
+void enviar_respostas();
+void ao_expirar_transferencia(void *contexto);
+void iniciar_negociacao();
+unsigned char capacidades_locais();
+void ao_expirar_negociacao(void *contexto);
+void ao_notificar_tela(void *contexto);
+void ao_ler_entrada(void *contexto);
+void processar_comandos_pendentes();
+void executar_comando(char comando);
+void publicar_atualizacao();
 void finalizar_recebimento_arquivo(bool sucesso);
+void salvar_progresso();
+uint64_t ler_progresso(size_t tamanho);
+void apagar_progresso();
 void inicializar_cliente();
 void finalizar_cliente();
 void imprimir_menu();
 void tratar_sinal(int signum);
+void imprimir_uso(const char *programa);
 
 int main(int argc, char **argv) {
+    // Processar opções de linha de comando
+    int opcao;
+    while ((opcao = getopt(argc, argv, "rfkcsazp:e:M:j:vh")) != -1) {
+        switch (opcao) {
+            case 'r':
+                usar_anel = true;
+                break;
+            case 'f':
+                usar_filtro = true;
+                break;
+            case 'k':
+                negociar = false;
+                break;
+            case 'c':
+                usar_crc32c = true;
+                break;
+            case 's':
+                definir_modo_lote(false);
+                break;
+            case 'a':
+                usar_sack = false;
+                break;
+            case 'z':
+                usar_compressao = false;
+                break;
+            case 'p':
+            case 'e': {
+                double fracao = atof(optarg) / 100.0;
+                if (fracao < 0 || fracao > 1) {
+                    fprintf(stderr, "Porcentagem inválida: use entre 0 e 100.\n");
+                    return 1;
+                }
+                if (opcao == 'p') {
+                    perda_simulada = fracao;
+                } else {
+                    corrupcao_simulada = fracao;
+                }
+                break;
+            }
+            case 'M': {
+                struct ether_addr *mac = ether_aton(optarg);
+                if (mac == NULL) {
+                    fprintf(stderr, "MAC inválido: use o formato aa:bb:cc:dd:ee:ff.\n");
+                    return 1;
+                }
+                memcpy(mac_cliente, mac->ether_addr_octet, 6);
+                break;
+            }
+            case 'j':
+                max_em_voo = atoi(optarg);
+                if (max_em_voo < 1 || max_em_voo > MAX_MOVIMENTOS_EM_VOO) {
+                    fprintf(stderr, "Número de movimentos inválido: use de 1 a %d.\n", MAX_MOVIMENTOS_EM_VOO);
+                    return 1;
+                }
+                break;
+            case 'v':
+                definir_depuracao(true);
+                break;
+            default:
+                imprimir_uso(argv[0]);
+                return (opcao == 'h') ? 0 : 1;
+        }
+    }
+    
     printf("Iniciando cliente de caça ao tesouro...\n");
     
+    if (perda_simulada > 0 || corrupcao_simulada > 0) {
+        simular_falhas(perda_simulada, corrupcao_simulada);
+        printf("Simulando %.1f%% de perda e %.1f%% de corrupção na recepção.\n", 
+               perda_simulada * 100, corrupcao_simulada * 100);
+    }
+    
     // Configurar tratamento de sinais para encerramento limpo
     signal(SIGINT, tratar_sinal);
     signal(SIGTERM, tratar_sinal);
@@ -110,8 +321,17 @@ int main(int argc, char **argv) {
         printf("AVISO: Pode haver problemas ao salvar arquivos em %s\n", DIRETORIO_RECEBIDOS);
     }
     
-    // Inicializar o jogo (grid vazio)
-    inicializar_jogo(&jogo);
+    // Inicializar o jogo (grid vazio). O cliente não conhece os tesouros:
+    // o seu mundo só tem as dimensões do grid, que o servidor informa na
+    // resposta ao primeiro movimento. Até lá, vale o grid padrão.
+    MundoJogo *mundo = criar_mundo(GRID_PADRAO, GRID_PADRAO, 0, 0);
+    bool jogo_criado = mundo != NULL && inicializar_jogo(&jogo, mundo);
+    liberar_mundo(mundo);
+    if (!jogo_criado) {
+        fprintf(stderr, "Sem memória para o jogo.\n");
+        finalizar_cliente();
+        return 1;
+    }
     
     // Criar thread para receber pacotes
     pthread_t thread_id;
@@ -121,70 +341,10 @@ int main(int argc, char **argv) {
         return 1;
     }
     
-    // Loop principal
-    char comando;
-    bool entrada_valida;
-    
-    while (em_execucao) {
-        // Verificar se precisamos atualizar o grid
-        pthread_mutex_lock(&mutex_jogo);
-        if (atualizacao_pendente) {
-            imprimir_grid();
-            imprimir_menu();
-            atualizacao_pendente = false;
-        }
-        pthread_mutex_unlock(&mutex_jogo);
-        
-        // Obter comando do usuário se não estivermos aguardando um arquivo
-        pthread_mutex_lock(&mutex_recebimento);
-        bool pode_obter_comando = !aguardando_arquivo;
-        pthread_mutex_unlock(&mutex_recebimento);
-        
-        // Verificar se há um movimento em andamento
-        pthread_mutex_lock(&mutex_movimento);
-        pode_obter_comando = pode_obter_comando && !movimento_em_andamento;
-        pthread_mutex_unlock(&mutex_movimento);
-        
-        if (pode_obter_comando) {
-            printf("Digite o comando: ");
-            fflush(stdout);
-            comando = getchar();
-            
-            // Limpar o buffer de entrada
-            while (getchar() != '\n');
-            
-            // Converter para minúsculo
-            comando = tolower(comando);
-            
-            entrada_valida = false;
-            switch (comando) {
-                case 'w': // Cima
-                    entrada_valida = enviar_movimento(TIPO_MOVE_CIMA);
-                    break;
-                case 's': // Baixo
-                    entrada_valida = enviar_movimento(TIPO_MOVE_BAIXO);
-                    break;
-                case 'a': // Esquerda
-                    entrada_valida = enviar_movimento(TIPO_MOVE_ESQ);
-                    break;
-                case 'd': // Direita
-                    entrada_valida = enviar_movimento(TIPO_MOVE_DIR);
-                    break;
-                default:
-                    printf("Comando inválido!\n");
-                    atualizacao_pendente = true; // Forçar atualização para mostrar comando inválido
-                    break;
-            }
-            
-            if (!entrada_valida && em_execucao && comando != '\n') {
-                printf("Tente novamente.\n");
-                atualizacao_pendente = true; // Forçar atualização para mostrar mensagem
-            }
-        }
-        
-        // Aguardar um pouco antes de verificar novamente
-        usleep(100000); // 100ms
-    }
+    // Loop principal: comandos do teclado e avisos da thread de recebimento
+    fonte_entrada = reator_adicionar_fd(&reator_tela, STDIN_FILENO, ao_ler_entrada, NULL);
+    ao_notificar_tela(NULL);
+    reator_rodar(&reator_tela);
     
     // Aguardar a thread terminar
     pthread_join(thread_id, NULL);
@@ -195,155 +355,261 @@ int main(int argc, char **argv) {
     return 0;
 }
 
+// Imprime as opções de linha de comando
+void imprimir_uso(const char *programa) {
+    printf("Uso: %s [opções]\n", programa);
+    printf("  -r    Usa anéis mapeados (PACKET_MMAP) no socket\n");
+    printf("  -f    Filtra no kernel (BPF) os quadros que não são do protocolo\n");
+    printf("  -k    Não negocia o formato estendido (usa apenas o formato clássico)\n");
+    printf("  -c    Pede verificação CRC32C nos quadros estendidos\n");
+    printf("  -s    Um quadro por chamada de sistema (sem sendmmsg/recvmmsg)\n");
+    printf("  -a    Confirma cada chunk com um ACK (sem ACKs seletivos)\n");
+    printf("  -z    Não aceita arquivos comprimidos\n");
+    printf("  -p P  Descarta P%% dos quadros recebidos (simulação de perda)\n");
+    printf("  -e P  Corrompe P%% dos quadros recebidos (simulação de erro)\n");
+    printf("  -M MAC  Usa outro MAC de origem, para vários jogadores na mesma interface\n");
+    printf("  -j N  Movimentos enviados sem esperar a resposta (1 a %d, padrão %d)\n", 
+           MAX_MOVIMENTOS_EM_VOO, MOVIMENTOS_EM_VOO_PADRAO);
+    printf("  -v    Mostra cada quadro recebido, cada movimento e cada retransmissão\n");
+    printf("  -h    Mostra esta ajuda\n");
+}
+
 // Inicializa o cliente
 void inicializar_cliente() {
     // Criar o socket raw
     sockfd = cria_raw_socket(INTERFACE_NAME);
     
-    // Configurar o endereço do servidor
-    memset(&endereco_servidor, 0, sizeof(endereco_servidor));
-    endereco_servidor.sll_family = AF_PACKET;
-    endereco_servidor.sll_ifindex = if_nametoindex(INTERFACE_NAME);
-    endereco_servidor.sll_halen = ETH_ALEN;
-    memcpy(endereco_servidor.sll_addr, mac_servidor, 6);
+    // Anexar o filtro BPF, se solicitado
+    if (usar_filtro) {
+        if (anexar_filtro_bpf(sockfd, mac_cliente)) {
+            printf("Filtro BPF ativado.\n");
+        } else {
+            printf("Não foi possível ativar o filtro BPF. Filtrando em espaço de usuário.\n");
+        }
+    }
+    
+    // Ativar o modo anel, se solicitado
+    if (usar_anel) {
+        if (ativar_anel_pacotes(sockfd)) {
+            printf("Modo anel (PACKET_MMAP) ativado.\n");
+        } else {
+            printf("Não foi possível ativar o modo anel. Usando sendto/recvfrom.\n");
+        }
+    }
+    
+    // Configurar a conexão com o servidor (formato clássico até a negociação)
+    inicializar_conexao(&conexao_servidor, sockfd, INTERFACE_NAME, mac_servidor, mac_cliente);
+    max_dados_local = max_dados_interface(INTERFACE_NAME);
+    
+    // Os arquivos recebidos são gravados por uma thread própria
+    if (!escritor_iniciar(&escritor)) {
+        exit(-1);
+    }
+    
+    // Configurar os laços de eventos
+    configurar_nao_bloqueante(sockfd);
+    if (!reator_iniciar(&reator_rede) || !reator_iniciar(&reator_tela)) {
+        exit(-1);
+    }
+    reator_adicionar_fd(&reator_rede, sockfd, ao_receber_pacotes, NULL);
+    timer_transferencia = reator_criar_timer(&reator_rede, ao_expirar_transferencia, NULL);
+    timer_negociacao = reator_criar_timer(&reator_rede, ao_expirar_negociacao, NULL);
+    timer_ack = reator_criar_timer(&reator_rede, ao_expirar_ack, NULL);
+    timer_movimentos = reator_criar_timer(&reator_rede, ao_expirar_movimentos, NULL);
+    notificador_tela = reator_criar_notificador(&reator_tela, ao_notificar_tela, NULL);
+    timer_tela = reator_criar_timer(&reator_tela, ao_notificar_tela, NULL);
+    if (timer_transferencia == NULL || timer_negociacao == NULL || timer_ack == NULL || 
+        timer_movimentos == NULL || notificador_tela == NULL || timer_tela == NULL) {
+        exit(-1);
+    }
+    tela_iniciar(&tela, STDOUT_FILENO);
+    tela_desviar_mensagens(&tela, ARQUIVO_MENSAGENS);
+    anel_eventos_iniciar(&eventos, notificador_tela);
+    
+    // Propor o formato estendido antes de aceitar comandos
+    if (negociar) {
+        iniciar_negociacao();
+    }
     
     printf("Cliente inicializado. Usando interface %s.\n", INTERFACE_NAME);
 }
 
 // Finaliza o cliente
 void finalizar_cliente() {
-    // Fechar qualquer arquivo aberto
+    // O resumo final vai para o terminal, não para o arquivo de mensagens
+    tela_restaurar_mensagens(&tela);
+    
+    // Fechar qualquer arquivo aberto, guardando o progresso para a retomada
     if (arquivo_recebendo != NULL) {
+        escritor_concluir(&escritor);
+        salvar_progresso();
         fclose(arquivo_recebendo);
         arquivo_recebendo = NULL;
         printf("Arquivo aberto fechado durante finalização.\n");
     }
     
+    imprimir_estatisticas_es();
+    imprimir_estatisticas_rto("servidor", &conexao_servidor.rto);
+    if (paridades_recebidas > 0) {
+        printf("FEC: %lu quadros de paridade recebidos, %lu chunks reconstruídos.\n", 
+               paridades_recebidas, chunks_recuperados);
+    }
+    if (bytes_comprimidos > 0) {
+        printf("Compressão: %llu bytes recebidos viraram %llu no disco.\n", 
+               bytes_comprimidos, bytes_descomprimidos);
+    }
+    if (retomadas > 0) {
+        printf("Retomadas: %lu arquivos continuados, %llu bytes que não precisaram ser recebidos de novo.\n", 
+               retomadas, bytes_retomados);
+    }
+    if (escritor.chamadas > 0) {
+        printf("Disco: %llu bytes em %lu chamadas a pwritev (%.0f KiB por chamada), até %d lotes reservados, "
+               "%lu esperas por lote livre.\n", escritor.bytes, escritor.chamadas, 
+               escritor.bytes / 1024.0 / escritor.chamadas, escritor.pico_lotes, escritor.esperas);
+    }
+    escritor_finalizar(&escritor);
+    
+    reator_finalizar(&reator_rede);
+    reator_finalizar(&reator_tela);
+    
     if (sockfd > 0) {
+        liberar_anel_pacotes(sockfd);
         close(sockfd);
     }
-    pthread_mutex_destroy(&mutex_jogo);
+    if (anel_eventos_descartados(&eventos) > 0) {
+        printf("Tela: %lu eventos descartados com o anel cheio.\n", anel_eventos_descartados(&eventos));
+    }
+    printf("Tela: %lu quadros (%lu inteiros), %llu KiB escritos (%llu KiB com todos inteiros).\n", 
+           tela.quadros, tela.completos, tela.bytes_escritos >> 10, tela.bytes_inteiros >> 10);
+    tela_finalizar(&tela);
+    finalizar_jogo(&jogo);
+    free(tesouros_recebidos);
     pthread_mutex_destroy(&mutex_recebimento);
     pthread_cond_destroy(&cond_recebimento);
     pthread_mutex_destroy(&mutex_movimento);
-    pthread_cond_destroy(&cond_movimento);
     printf("Cliente finalizado.\n");
 }
 
-// Imprime o grid do jogo
+// Monta o grid do jogo no quadro da tela
 void imprimir_grid() {
-    printf("\033[2J\033[H"); // Limpa a tela e posiciona cursor no início
-    
-    printf("CLIENTE - CAÇA AO TESOURO\n");
-    printf("=========================\n\n");
+    tela_printf(&tela, "CLIENTE - CAÇA AO TESOURO\n");
+    tela_printf(&tela, "=========================\n\n");
     
     // Imprime a posição do jogador
-    printf("Sua posição: (%d,%d)\n\n", jogo.jogador.x, jogo.jogador.y);
+    tela_printf(&tela, "Sua posição: (%d,%d)\n\n", jogo.jogador.x, jogo.jogador.y);
     
-    // Conta tesouros encontrados
-    int tesouros_encontrados = 0;
-    for (int i = 0; i < NUM_TESOUROS; i++) {
-        if (jogo.tesouros[i].encontrado) {
-            tesouros_encontrados++;
-        }
+    if (total_na_tela > 0) {
+        tela_printf(&tela, "Recebendo tesouro: %llu de %llu bytes (%.0f%%)\n\n", (unsigned long long)bytes_na_tela, 
+                    (unsigned long long)total_na_tela, 100.0 * bytes_na_tela / total_na_tela);
     }
-    printf("Tesouros encontrados: %d de %d\n\n", tesouros_encontrados, NUM_TESOUROS);
+    
+    // Conta tesouros encontrados
+    int tesouros_encontrados = jogo.encontrado.marcadas;
+    tela_printf(&tela, "Tesouros encontrados: %d\n\n", tesouros_encontrados);
+    
+    // Em grids grandes, só o recorte em volta do jogador
+    Recorte recorte = recortar_tela(&jogo);
+    int x_fim = recorte.x + recorte.largura;
     
     // Imprime o grid
-    printf("Grid do jogo:\n");
+    tela_printf(&tela, "Grid do jogo");
+    if (recorte.largura < jogo.mundo->largura || recorte.altura < jogo.mundo->altura) {
+        tela_printf(&tela, " %dx%d (colunas %d a %d, linhas %d a %d)", jogo.mundo->largura, jogo.mundo->altura, 
+                    recorte.x, x_fim - 1, recorte.y, recorte.y + recorte.altura - 1);
+    }
+    tela_printf(&tela, ":\n");
     
-    // Imprime números das colunas
-    printf("  ");
-    for (int x = 0; x < GRID_SIZE; x++) {
-        printf(" %d ", x);
+    // Imprime números das colunas (só o último dígito, para caber)
+    tela_printf(&tela, "%*s", recorte.largura_rotulo + 1, "");
+    for (int x = recorte.x; x < x_fim; x++) {
+        tela_printf(&tela, " %d ", x % 10);
     }
-    printf("\n");
+    tela_printf(&tela, "\n");
     
     // Imprime linha separadora
-    printf("  ");
-    for (int x = 0; x < GRID_SIZE; x++) {
-        printf("---");
+    tela_printf(&tela, "%*s", recorte.largura_rotulo + 1, "");
+    for (int x = recorte.x; x < x_fim; x++) {
+        tela_printf(&tela, "---");
     }
-    printf("\n");
+    tela_printf(&tela, "\n");
     
     // Imprime o grid linha por linha (de cima para baixo)
-    for (int y = GRID_SIZE - 1; y >= 0; y--) {
-        printf("%d |", y);
+    for (int y = recorte.y + recorte.altura - 1; y >= recorte.y; y--) {
+        tela_printf(&tela, "%*d |", recorte.largura_rotulo, y);
         
-        for (int x = 0; x < GRID_SIZE; x++) {
+        for (int x = recorte.x; x < x_fim; x++) {
             char celula = ' ';
             
             // Células especiais
             if (x == jogo.jogador.x && y == jogo.jogador.y) {
                 celula = 'J'; // Jogador
-            } else if (jogo.grid_visitado[y][x]) {
-                bool tesouro_encontrado = false;
-                
-                // Verificar se nesta posição há um tesouro encontrado
-                for (int i = 0; i < NUM_TESOUROS; i++) {
-                    if (jogo.tesouros[i].pos.x == x && jogo.tesouros[i].pos.y == y && jogo.tesouros[i].encontrado) {
-                        celula = 'X'; // Tesouro encontrado
-                        tesouro_encontrado = true;
-                        break;
-                    }
-                }
-                
-                if (!tesouro_encontrado) {
+            } else if (plano_testar(&jogo.visitado, x, y)) {
+                if (plano_testar(&jogo.encontrado, x, y)) {
+                    celula = 'X'; // Tesouro encontrado
+                } else {
                     celula = '.'; // Célula visitada sem tesouro
                 }
             } 
-            printf(" %c ", celula);
+            tela_printf(&tela, " %c ", celula);
         }
-        printf("|\n");
+        tela_printf(&tela, "|\n");
     }
     
     // Imprime linha separadora
-    printf("  ");
-    for (int x = 0; x < GRID_SIZE; x++) {
-        printf("---");
+    tela_printf(&tela, "%*s", recorte.largura_rotulo + 1, "");
+    for (int x = recorte.x; x < x_fim; x++) {
+        tela_printf(&tela, "---");
     }
-    printf("\n\n");
+    tela_printf(&tela, "\n\n");
     
     // Imprime legenda
-    printf("Legenda: J = Jogador, X = Tesouro encontrado, . = Visitado\n");
+    tela_printf(&tela, "Legenda: J = Jogador, X = Tesouro encontrado, . = Visitado\n");
     
     // Imprime lista de tesouros encontrados
-    printf("Tesouros encontrados:\n");
+    tela_printf(&tela, "Tesouros encontrados:\n");
     
     if (tesouros_encontrados > 0) {
         // Tabela formatada e colorida dos tesouros encontrados
-        printf("+------+----------------------+-------------+\n");
-        printf("| \033[1mNum\033[0m  | \033[1mArquivo              \033[0m | \033[1mPosição     \033[0m |\n");
-        printf("+------+----------------------+-------------+\n");
-        
-        for (int i = 0; i < NUM_TESOUROS; i++) {
-            if (jogo.tesouros[i].encontrado) {
-                printf("| \033[1;32m%-4d\033[0m | \033[1;33m%-20s\033[0m | (%2d,%2d)     |\n", 
-                       i + 1, 
-                       jogo.tesouros[i].nome,
-                       jogo.tesouros[i].pos.x,
-                       jogo.tesouros[i].pos.y);
-            }
+        tela_printf(&tela, "+------+----------------------+-------------+\n");
+        tela_printf(&tela, "| \033[1mNum\033[0m  | \033[1mArquivo              \033[0m | \033[1mPosição     \033[0m |\n");
+        tela_printf(&tela, "+------+----------------------+-------------+\n");
+        
+        // Com muitos, só os mais recentes
+        int primeiro = num_recebidos > MAX_TESOUROS_LISTADOS ? num_recebidos - MAX_TESOUROS_LISTADOS : 0;
+        for (int i = primeiro; i < num_recebidos; i++) {
+            tela_printf(&tela, "| \033[1;32m%-4d\033[0m | \033[1;33m%-20s\033[0m | (%2d,%2d)     |\n", 
+                        i + 1, 
+                        tesouros_recebidos[i].nome,
+                        tesouros_recebidos[i].pos.x,
+                        tesouros_recebidos[i].pos.y);
         }
         
-        printf("+------+----------------------+-------------+\n");
+        tela_printf(&tela, "+------+----------------------+-------------+\n");
     } else {
-        printf("\033[3mNenhum tesouro encontrado ainda.\033[0m\n");
+        tela_printf(&tela, "\033[3mNenhum tesouro encontrado ainda.\033[0m\n");
     }
     
-    printf("\n");
+    tela_printf(&tela, "\n");
 }
 
-// Imprime o menu de comandos
+// Monta o menu de comandos no quadro da tela
 void imprimir_menu() {
-    printf("Comandos:\n");
-    printf("  W - Mover para cima\n");
-    printf("  S - Mover para baixo\n");
-    printf("  A - Mover para esquerda\n");
-    printf("  D - Mover para direita\n");
+    tela_printf(&tela, "Comandos:\n");
+    tela_printf(&tela, "  W - Mover para cima\n");
+    tela_printf(&tela, "  S - Mover para baixo\n");
+    tela_printf(&tela, "  A - Mover para esquerda\n");
+    tela_printf(&tela, "  D - Mover para direita\n");
+}
+
+// Movimentos que podem ficar em trânsito. Até a primeira resposta, um só:
+// o servidor toma a sequência do primeiro movimento que receber, e os
+// seguintes não podem chegar antes dele. Chamada com mutex_movimento.
+static int janela_movimentos() {
+    return movimento_respondido ? max_em_voo : 1;
 }
 
-// Envia um comando de movimento para o servidor
+// Envia um comando de movimento para o servidor, sem esperar a resposta. O
+// movimento só é aplicado na tela quando o servidor o confirmar.
 bool enviar_movimento(int direcao) {
     // Validar direção
     if (direcao != TIPO_MOVE_DIR && direcao != TIPO_MOVE_ESQ && 
@@ -351,250 +617,1129 @@ bool enviar_movimento(int direcao) {
         return false;
     }
     
-    // Verificar se já existe um movimento em andamento
     pthread_mutex_lock(&mutex_movimento);
-    if (movimento_em_andamento) {
-        printf("Ainda processando o movimento anterior. Aguarde...\n");
+    if (num_em_voo >= janela_movimentos()) {
+        printf("Muitos movimentos aguardando resposta. Aguarde...\n");
         pthread_mutex_unlock(&mutex_movimento);
         return false;
     }
     
-    // Marcar que estamos iniciando um movimento
-    movimento_em_andamento = true;
-    ultimo_movimento_ok = false;
-    ultimo_movimento_enviado = direcao; // Armazenar o tipo do movimento que está sendo enviado
-    pthread_mutex_unlock(&mutex_movimento);
+    // A resposta pode chegar antes do fim desta função: o movimento entra no
+    // anel antes de ser enviado, com a trava ainda segura
+    MovimentoEmVoo *movimento = &movimentos_em_voo[(primeiro_em_voo + num_em_voo) % MAX_MOVIMENTOS_EM_VOO];
+    movimento->direcao = direcao;
+    movimento->seq = proximo_seq_envio;
+    movimento->tentativas = 0;
+    marcar_instante(&movimento->primeiro_envio);
+    movimento->enviado_em = movimento->primeiro_envio;
     
-    // Enviar o comando
-    if (!enviar_pacote(sockfd, &endereco_servidor, mac_servidor, mac_cliente, 
-                      direcao, proximo_seq_envio, NULL, 0)) {
+    if (!enviar_quadro(&conexao_servidor, direcao, movimento->seq, NULL, 0)) {
         printf("Erro ao enviar comando de movimento.\n");
-        
-        // Liberar o bloqueio de movimento
-        pthread_mutex_lock(&mutex_movimento);
-        movimento_em_andamento = false;
         pthread_mutex_unlock(&mutex_movimento);
-        
         return false;
     }
     
-    printf("Movimento enviado. Aguardando resposta do servidor...\n");
-    
-    // Aguardar resposta do servidor (será processada pela thread_recebimento)
-    struct timespec timeout;
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    timeout.tv_sec = now.tv_sec + (TIMEOUT_MS / 1000);
-    timeout.tv_nsec = (now.tv_usec + (TIMEOUT_MS % 1000) * 1000) * 1000;
+    proximo_seq_envio = avancar_seq(proximo_seq_envio, 1, conexao_servidor.espaco_seq);
+    if (num_em_voo++ == 0) {
+        reator_armar_timer(timer_movimentos, rto_atual_us(&conexao_servidor.rto));
+    }
+    DEPURAR("Movimento enviado (seq=%d, %d aguardando resposta).\n", movimento->seq, num_em_voo);
+    pthread_mutex_unlock(&mutex_movimento);
     
-    // Normalizar os valores de nanosegundos
-    if (timeout.tv_nsec >= 1000000000) {
-        timeout.tv_sec++;
-        timeout.tv_nsec -= 1000000000;
+    return true;
+}
+
+// Microssegundos até o prazo de retransmissão mais próximo entre os
+// movimentos em trânsito. Chamada com mutex_movimento.
+static long long prazo_movimentos_us() {
+    long long rto_us = rto_atual_us(&conexao_servidor.rto);
+    long long prazo = rto_us;
+    for (int i = 0; i < num_em_voo; i++) {
+        MovimentoEmVoo *movimento = &movimentos_em_voo[(primeiro_em_voo + i) % MAX_MOVIMENTOS_EM_VOO];
+        long long restante = rto_us - tempo_decorrido_us(&movimento->enviado_em);
+        if (restante < prazo) {
+            prazo = restante;
+        }
     }
+    return (prazo > 0) ? prazo : 1;
+}
+
+// Tratador do timer dos movimentos (thread de recebimento): retransmite, com
+// a mesma sequência, os movimentos cujo RTO venceu
+void ao_expirar_movimentos(void *contexto) {
+    // Durante o envio de um tesouro o servidor guarda os movimentos sem
+    // responder: as retransmissões esperam o fim do arquivo
+    pthread_mutex_lock(&mutex_recebimento);
+    bool recebendo = aguardando_arquivo;
+    pthread_mutex_unlock(&mutex_recebimento);
     
     pthread_mutex_lock(&mutex_movimento);
-    int result = 0;
-    
-    // Enquanto o movimento estiver em andamento e não tivermos atingido o timeout
-    while (movimento_em_andamento && result != ETIMEDOUT && em_execucao) {
-        result = pthread_cond_timedwait(&cond_movimento, &mutex_movimento, &timeout);
+    if (num_em_voo == 0) {
+        pthread_mutex_unlock(&mutex_movimento);
+        return;
+    }
+    if (recebendo) {
+        for (int i = 0; i < num_em_voo; i++) {
+            marcar_instante(&movimentos_em_voo[(primeiro_em_voo + i) % MAX_MOVIMENTOS_EM_VOO].enviado_em);
+        }
+        reator_armar_timer(timer_movimentos, prazo_movimentos_us());
+        pthread_mutex_unlock(&mutex_movimento);
+        return;
     }
     
-    bool sucesso = ultimo_movimento_ok;
-    movimento_em_andamento = false;
-    pthread_mutex_unlock(&mutex_movimento);
+    long long rto_us = rto_atual_us(&conexao_servidor.rto);
+    MovimentoEmVoo *primeiro = &movimentos_em_voo[primeiro_em_voo];
+    if (tempo_decorrido_us(&primeiro->enviado_em) >= rto_us && 
+        deve_desistir(primeiro->tentativas + 1, &primeiro->primeiro_envio)) {
+        // Os movimentos são abandonados. Os próximos saltam para longe das
+        // sequências usadas: o servidor descarta o que guardou deles e
+        // recomeça pelo primeiro movimento que receber.
+        printf("Timeout aguardando resposta do servidor. %d movimento(s) abandonado(s).\n", num_em_voo);
+        proximo_seq_envio = avancar_seq(primeiro->seq, 2 * MAX_MOVIMENTOS_EM_VOO, conexao_servidor.espaco_seq);
+        num_em_voo = 0;
+        movimento_respondido = false;
+        pthread_mutex_unlock(&mutex_movimento);
+        
+        // Liberar os comandos que aguardavam espaço na janela
+        publicar_atualizacao();
+        return;
+    }
     
-    if (result == ETIMEDOUT) {
-        printf("Timeout aguardando resposta do servidor.\n");
-        return false;
+    // Backoff exponencial: uma vez por expiração, não por movimento retransmitido
+    bool expirou = false;
+    for (int i = 0; i < num_em_voo; i++) {
+        MovimentoEmVoo *movimento = &movimentos_em_voo[(primeiro_em_voo + i) % MAX_MOVIMENTOS_EM_VOO];
+        if (tempo_decorrido_us(&movimento->enviado_em) < rto_us) {
+            continue;
+        }
+        if (!expirou) {
+            rto_registrar_expiracao(&conexao_servidor.rto);
+            expirou = true;
+        }
+        
+        movimento->tentativas++;
+        DEPURAR("Sem resposta do servidor. Retransmitindo movimento seq=%d (tentativa %d, RTO %.3f ms)...\n", 
+                movimento->seq, movimento->tentativas + 1, rto_atual_us(&conexao_servidor.rto) / 1000.0);
+        marcar_instante(&movimento->enviado_em);
+        enviar_quadro(&conexao_servidor, movimento->direcao, movimento->seq, NULL, 0);
     }
     
-    return sucesso;
+    reator_armar_timer(timer_movimentos, prazo_movimentos_us());
+    pthread_mutex_unlock(&mutex_movimento);
 }
 
 // Thread para receber pacotes do servidor
 void *thread_recebimento(void *arg) {
-    unsigned char buffer[TAM_MAX_PACOTE];
-    unsigned char tipo, seq;
-    unsigned char *dados;
-    int tam_dados;
-    
     printf("Thread de recebimento iniciada.\n");
     
-    while (em_execucao) {
-        // Tenta receber um pacote
-        if (receber_pacote(sockfd, buffer, &tipo, &seq, &dados, &tam_dados)) {
+    // Pacotes e o prazo da transferência são tratados pelos callbacks do reator
+    reator_rodar(&reator_rede);
+    
+    printf("Thread de recebimento finalizada.\n");
+    return NULL;
+}
+
+// Tratador de leitura do socket: processa os pacotes disponíveis em lotes
+void ao_receber_pacotes(void *contexto) {
+    static BuffersLote buffers;
+    Pacote pacotes[MAX_PACOTES_POR_EVENTO];
+    int processados = 0;
+    
+    // Limita o total para não monopolizar o laço; o epoll avisa de novo se sobrar
+    bool pode_haver_mais = true;
+    while (pode_haver_mais && processados < MAX_PACOTES_POR_EVENTO) {
+        EstatisticasES antes, depois;
+        obter_estatisticas_es(&antes);
+        
+        int n = receber_pacotes_lote(sockfd, &buffers, pacotes, MAX_PACOTES_POR_EVENTO);
+        if (n < 0) {
+            break;
+        }
+        
+        // Um quadro corrompido não tem cabeçalho confiável: pede o chunk esperado
+        obter_estatisticas_es(&depois);
+        if (depois.quadros_corrompidos != antes.quadros_corrompidos) {
+            pthread_mutex_lock(&mutex_recebimento);
+            pedir_retransmissao();
+            pthread_mutex_unlock(&mutex_recebimento);
+        }
+        
+        for (int i = 0; i < n; i++) {
+            // Sem o filtro BPF o socket vê também os quadros de outros jogadores
+            if (memcmp(pacotes[i].mac_destino, mac_cliente, 6) != 0) {
+                continue;
+            }
+            
             // Pacote válido recebido
-            printf("Pacote recebido: tipo=%d, seq=%d, tam_dados=%d\n", tipo, seq, tam_dados);
+            DEPURAR("Pacote recebido: tipo=%d, seq=%d, tam_dados=%d\n", 
+                    pacotes[i].tipo, pacotes[i].seq, pacotes[i].tam_dados);
+            processar_pacote(pacotes[i].tipo, pacotes[i].seq, pacotes[i].dados, pacotes[i].tam_dados);
+        }
+        processados += (n > 0) ? n : 1;
+        
+        // Lote incompleto: o socket foi esvaziado (evita uma leitura a mais)
+        pode_haver_mais = (n == MAX_PACOTES_POR_EVENTO) || anel_tem_pendentes(sockfd);
+        
+        // Os ACKs de todo o lote saem em uma única chamada. Uma lacuna só é
+        // pedida agora, depois que as paridades do lote tentaram preenchê-la.
+        if (sack_pendente || lacuna_pendente) {
+            pthread_mutex_lock(&mutex_recebimento);
+            if (sack_pendente) {
+                enviar_sack();
+            }
+            if (lacuna_pendente) {
+                lacuna_pendente = false;
+                if (ha_lacuna()) {
+                    pedir_retransmissao();
+                }
+            }
+            pthread_mutex_unlock(&mutex_recebimento);
+        }
+        enviar_respostas();
+    }
+}
+
+// Trata a resposta do servidor ao movimento 'seq', que confirma também os
+// movimentos anteriores a ele: o servidor aplica os movimentos em ordem. Os
+// confirmados saem do anel e são aplicados localmente pela tela, na ordem.
+// Com 'tesouro', o servidor vai enviar um arquivo em seguida.
+void confirmar_movimentos(uint16_t seq, bool tesouro) {
+    pthread_mutex_lock(&mutex_movimento);
+    
+    // Resposta repetida ou a um movimento já confirmado por outra
+    uint32_t posicao = 0;
+    if (num_em_voo > 0) {
+        posicao = distancia_seq(movimentos_em_voo[primeiro_em_voo].seq, seq, conexao_servidor.espaco_seq);
+    }
+    if (num_em_voo == 0 || posicao >= (uint32_t)num_em_voo) {
+        pthread_mutex_unlock(&mutex_movimento);
+        return;
+    }
+    
+    // Regra de Karn: a resposta de um movimento retransmitido não é medida
+    MovimentoEmVoo *movimento = &movimentos_em_voo[(primeiro_em_voo + posicao) % MAX_MOVIMENTOS_EM_VOO];
+    if (movimento->tentativas == 0) {
+        rto_registrar_amostra(&conexao_servidor.rto, tempo_decorrido_us(&movimento->enviado_em));
+    }
+    movimento_respondido = true;
+    
+    // Bloqueia novos comandos antes de liberar a thread principal
+    if (tesouro) {
+        pthread_mutex_lock(&mutex_recebimento);
+        aguardando_arquivo = true;
+        reator_armar_timer(timer_transferencia, TIMEOUT_TRANSFERENCIA_MS * 1000LL);
+        pthread_mutex_unlock(&mutex_recebimento);
+    }
+    
+    // A tela aplica os movimentos localmente, na ordem. Cada evento sai
+    // depois de liberar a janela: quem o consome já vê o movimento concluído.
+    for (uint32_t i = 0; i <= posicao; i++) {
+        EventoJogo evento = {.tipo = EVENTO_MOVIMENTO, .direcao = movimentos_em_voo[primeiro_em_voo].direcao};
+        primeiro_em_voo = (primeiro_em_voo + 1) % MAX_MOVIMENTOS_EM_VOO;
+        num_em_voo--;
+        anel_eventos_publicar(&eventos, &evento);
+    }
+    reator_armar_timer(timer_movimentos, (num_em_voo > 0) ? prazo_movimentos_us() : 0);
+    pthread_mutex_unlock(&mutex_movimento);
+}
+
+// Lê as dimensões do grid que vêm nas respostas aos movimentos. Quando elas
+// mudam (e na primeira resposta), a tela recebe um mundo vazio com elas,
+// antes dos movimentos confirmados pela mesma resposta.
+void conhecer_grid(const unsigned char *dados) {
+    uint32_t largura, altura;
+    memcpy(&largura, dados, 4);
+    memcpy(&altura, dados + 4, 4);
+    largura = ntohl(largura);
+    altura = ntohl(altura);
+    if (largura < 1 || largura > MAX_LADO_GRID || altura < 1 || altura > MAX_LADO_GRID || 
+        ((int)largura == largura_grid && (int)altura == altura_grid)) {
+        return;
+    }
+    
+    // Com o anel cheio, a próxima resposta tenta de novo
+    EventoJogo evento = {.tipo = EVENTO_GRID, .mundo = criar_mundo(largura, altura, 0, 0)};
+    if (evento.mundo == NULL) {
+        return;
+    }
+    if (!anel_eventos_publicar(&eventos, &evento)) {
+        liberar_mundo(evento.mundo);
+        return;
+    }
+    largura_grid = largura;
+    altura_grid = altura;
+}
+
+// Envia um NACK para o próximo chunk esperado, uma vez por lacuna, para que o
+// servidor o retransmita sem esperar o RTO. Chamada com mutex_recebimento.
+void pedir_retransmissao() {
+    if (!aguardando_arquivo || arquivo_recebendo == NULL) {
+        return;
+    }
+    
+    if (nack_enviado && seq_nack == seq_esperado) {
+        return;
+    }
+    
+    DEPURAR("Chunk seq=%d perdido ou corrompido. Enviando NACK.\n", seq_esperado);
+    nack_enviado = true;
+    seq_nack = seq_esperado;
+    responder(TIPO_NACK, seq_esperado, NULL, 0);
+}
+
+// Indica se o chunk esperado se perdeu e precisa ser pedido: algum chunk à
+// frente dele já chegou. Com FEC, só conta um chunk de um bloco seguinte, pois
+// as paridades do bloco, enviadas antes dele, podem ainda reconstruir o
+// esperado. Chamada com mutex_recebimento.
+bool ha_lacuna() {
+    uint32_t espaco = conexao_servidor.espaco_seq;
+    int janela = janela_maxima(&conexao_servidor);
+    int inicio = (fec_bloco > 0) ? fec_bloco - (int)(chunks_escritos % fec_bloco) : 1;
+    
+    for (int i = inicio; i < janela; i++) {
+        if (janela_recepcao[avancar_seq(seq_esperado, i, espaco) % JANELA_MAX].ocupado) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Conta um chunk para o ACK seletivo. Em ordem, o ACK sai a cada
+// ACK_A_CADA_QUADROS chunks (vários por janela, para que a perda de um deles
+// não custe um RTO) ou após ATRASO_ACK_US. Chunks fora de ordem ou repetidos
+// são confirmados no fim do lote. Chamada com mutex_recebimento.
+void agendar_sack(bool imediato) {
+    if (imediato) {
+        sack_pendente = true;
+    } else if (++chunks_sem_ack >= ACK_A_CADA_QUADROS) {
+        enviar_sack();
+    } else if (chunks_sem_ack == 1) {
+        reator_armar_timer(timer_ack, ATRASO_ACK_US);
+    }
+}
+
+// Enfileira um ACK seletivo: o último chunk recebido em ordem e o mapa dos
+// que chegaram depois dele. Chamada com mutex_recebimento.
+void enviar_sack() {
+    unsigned char mapa[TAM_SACK] = {0};
+    uint32_t espaco = conexao_servidor.espaco_seq;
+    uint16_t ultimo_em_ordem = avancar_seq(seq_esperado, espaco - 1, espaco);
+    int janela = janela_maxima(&conexao_servidor);
+    int ultimo_bit = 0;
+    
+    // O bit i corresponde a ultimo_em_ordem + 1 + i, isto é, seq_esperado + i
+    for (int i = 1; i < janela; i++) {
+        if (janela_recepcao[avancar_seq(seq_esperado, i, espaco) % JANELA_MAX].ocupado) {
+            mapa[i / 8] |= 1 << (i % 8);
+            ultimo_bit = i;
+        }
+    }
+    
+    // O mapa vai só até o byte do último chunk marcado
+    responder(TIPO_ACK, ultimo_em_ordem, mapa, ultimo_bit / 8 + 1);
+    chunks_sem_ack = 0;
+    sack_pendente = false;
+    reator_armar_timer(timer_ack, 0);
+}
+
+// Tratador do timer do ACK seletivo: confirma os chunks que esperavam
+void ao_expirar_ack(void *contexto) {
+    pthread_mutex_lock(&mutex_recebimento);
+    if (arquivo_recebendo != NULL && chunks_sem_ack > 0) {
+        enviar_sack();
+    }
+    pthread_mutex_unlock(&mutex_recebimento);
+    
+    enviar_respostas();
+}
+
+// Enfileira um ACK/NACK para ser enviado no fim do lote de recepção
+void responder(unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados) {
+    if (num_respostas == MAX_PACOTES_POR_EVENTO) {
+        enviar_respostas();
+    }
+    
+    QuadroSaida *resposta = &respostas[num_respostas];
+    resposta->tipo = tipo;
+    resposta->seq = seq;
+    resposta->tam_dados = (tam_dados < TAM_MAX_RESPOSTA) ? tam_dados : TAM_MAX_RESPOSTA;
+    resposta->dados = NULL;
+    resposta->verificacao = NULL;
+    if (dados != NULL && resposta->tam_dados > 0) {
+        memcpy(dados_respostas[num_respostas], dados, resposta->tam_dados);
+        resposta->dados = dados_respostas[num_respostas];
+    }
+    num_respostas++;
+}
+
+// Envia as respostas enfileiradas
+void enviar_respostas() {
+    if (num_respostas > 0) {
+        enviar_pacotes_lote(&conexao_servidor, respostas, num_respostas);
+        num_respostas = 0;
+    }
+}
+
+// Processa um pacote válido recebido do servidor
+void processar_pacote(unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados) {
+    // Qualquer pacote da transferência adia o prazo para abandoná-la
+    if (tipo == TIPO_TAMANHO || tipo == TIPO_DADOS || tipo == TIPO_PARIDADE || tipo == TIPO_FIM_ARQUIVO ||
+        tipo == TIPO_TEXTO || tipo == TIPO_VIDEO || tipo == TIPO_IMAGEM) {
+        reator_armar_timer(timer_transferencia, TIMEOUT_TRANSFERENCIA_MS * 1000LL);
+    }
+    
+    // Processar o pacote com base no tipo
+    switch (tipo) {
+        case TIPO_ACK:
+        case TIPO_OK_ACK:
+            // Resposta a um dos movimentos em trânsito
+            if (tam_dados >= TAM_DIMENSOES_GRID) {
+                conhecer_grid(dados);
+            }
+            confirmar_movimentos(seq, tipo == TIPO_OK_ACK);
+            break;
+        
+        case TIPO_TEXTO:
+        case TIPO_VIDEO:
+        case TIPO_IMAGEM:
+            // Recebeu início de arquivo com tipo conhecido
+            pthread_mutex_lock(&mutex_recebimento);
             
-            // Processar o pacote com base no tipo
-            switch (tipo) {
-                case TIPO_ACK:
-                    // Verificar se é uma resposta a um comando de movimento
-                    pthread_mutex_lock(&mutex_movimento);
-                    if (movimento_em_andamento && seq == proximo_seq_envio) {
-                        // Simular o movimento localmente
-                        pthread_mutex_lock(&mutex_jogo);
-                        
-                        // Aplicar o último movimento enviado
-                        if (mover_jogador(&jogo, ultimo_movimento_enviado)) {
-                            printf("Movimento aplicado localmente\n");
-                            atualizacao_pendente = true; // Marcar que o grid precisa ser atualizado
-                        } else {
-                            printf("Erro ao aplicar movimento localmente.\n");
-                            atualizacao_pendente = true; // Marcar que o grid precisa ser atualizado
-                        }
-                        
-                        pthread_mutex_unlock(&mutex_jogo);
-                        
-                        // Atualizar o controle de sequência
-                        proximo_seq_envio = (proximo_seq_envio + 1) % 32;
-                        
-                        // Sinalizar que o movimento foi concluído com sucesso
-                        ultimo_movimento_ok = true;
-                        movimento_em_andamento = false;
-                        pthread_cond_signal(&cond_movimento);
-                    }
-                    pthread_mutex_unlock(&mutex_movimento);
-                    break;
+            // Armazenar informações do arquivo
+            if (tam_dados > 0 && dados != NULL) {
+                strncpy(nome_arquivo_recebido, (char *)dados, TAM_MAX_NOME);
                 
-                case TIPO_TEXTO:
-                case TIPO_VIDEO:
-                case TIPO_IMAGEM:
-                    // Recebeu início de arquivo com tipo conhecido
-                    pthread_mutex_lock(&mutex_recebimento);
+                // Determinar o tipo de arquivo
+                tipo_arquivo_recebido = obter_tipo_arquivo(nome_arquivo_recebido);
+                
+                // Iniciar recebimento do arquivo
+                if (iniciar_recebimento_arquivo(nome_arquivo_recebido)) {
+                    // Sinalizar que estamos aguardando um arquivo
+                    aguardando_arquivo = true;
                     
-                    // Armazenar informações do arquivo
-                    if (tam_dados > 0 && dados != NULL) {
-                        strncpy(nome_arquivo_recebido, (char *)dados, TAM_MAX_NOME);
-                        
-                        // Determinar o tipo de arquivo
-                        tipo_arquivo_recebido = obter_tipo_arquivo(nome_arquivo_recebido);
-                        
-                        // Iniciar recebimento do arquivo
-                        if (iniciar_recebimento_arquivo(nome_arquivo_recebido)) {
-                            // Sinalizar que estamos aguardando um arquivo
-                            aguardando_arquivo = true;
-                            
-                            // Enviar ACK
-                            enviar_pacote(sockfd, &endereco_servidor, mac_servidor, mac_cliente, 
-                                        TIPO_ACK, seq, NULL, 0);
-                            
-                            // Atualizar último sequencial recebido
-                            ultimo_seq_recebido = seq;
-                            
-                            printf("Iniciando recebimento do arquivo %s...\n", nome_arquivo_recebido);
-                        } else {
-                            printf("Falha ao iniciar recebimento do arquivo %s.\n", nome_arquivo_recebido);
-                            aguardando_arquivo = false;
-                        }
+                    // Enviar ACK, com o byte de onde continuar se o arquivo
+                    // for retomado
+                    if (inicio_retomada > 0) {
+                        unsigned char retomada[TAM_RETOMADA];
+                        escrever_be64(retomada, inicio_retomada);
+                        responder(TIPO_ACK, seq, retomada, TAM_RETOMADA);
+                    } else {
+                        responder(TIPO_ACK, seq, NULL, 0);
                     }
                     
-                    pthread_mutex_unlock(&mutex_recebimento);
-                    break;
+                    // Atualizar último sequencial recebido
+                    ultimo_seq_recebido = seq;
                     
-                case TIPO_DADOS:
-                    // Processa dados do arquivo sendo recebido
-                    pthread_mutex_lock(&mutex_recebimento);
-                    if (aguardando_arquivo && arquivo_recebendo != NULL && tam_dados > 0 && dados != NULL) {
-                        // Escrever no arquivo
-                        size_t escritos = fwrite(dados, 1, tam_dados, arquivo_recebendo);
-                        
-                        if (escritos != (size_t)tam_dados) {
-                            perror("Erro ao escrever no arquivo");
-                            enviar_pacote(sockfd, &endereco_servidor, mac_servidor, mac_cliente, 
-                                        TIPO_NACK, seq, NULL, 0);
-                            finalizar_recebimento_arquivo(false);
-                        } else {
-                            // Enviar ACK
-                            enviar_pacote(sockfd, &endereco_servidor, mac_servidor, mac_cliente, 
-                                        TIPO_ACK, seq, NULL, 0);
-                            
-                            // Atualizar último sequencial recebido
-                            ultimo_seq_recebido = seq;
-                        }
+                    // Os chunks de dados começam na sequência seguinte ao nome
+                    seq_esperado = avancar_seq(seq, 1, conexao_servidor.espaco_seq);
+                    nack_enviado = false;
+                    chunks_sem_ack = 0;
+                    sack_pendente = false;
+                    lacuna_pendente = false;
+                    chunks_escritos = 0;
+                    for (int i = 0; i < JANELA_MAX; i++) {
+                        janela_recepcao[i].ocupado = false;
                     }
-                    pthread_mutex_unlock(&mutex_recebimento);
-                    break;
-                    
-                case TIPO_FIM_ARQUIVO:
-                    // Finaliza o recebimento do arquivo
-                    pthread_mutex_lock(&mutex_recebimento);
-                    if (aguardando_arquivo && arquivo_recebendo != NULL) {
-                        // Enviar ACK
-                        enviar_pacote(sockfd, &endereco_servidor, mac_servidor, mac_cliente, 
-                                    TIPO_ACK, seq, NULL, 0);
-                        
-                        // Atualizar último sequencial recebido
-                        ultimo_seq_recebido = seq;
-                        
-                        // Finalizar recebimento
-                        finalizar_recebimento_arquivo(true);
-                        
-                        printf("Arquivo %s recebido com sucesso!\n", nome_arquivo_recebido);
-                                             
-                        // Adicionar o tesouro à lista de tesouros encontrados
-                        pthread_mutex_lock(&mutex_jogo);
-                        for (int i = 0; i < NUM_TESOUROS; i++) {
-                            if (jogo.tesouros[i].encontrado == false && 
-                                jogo.jogador.x == jogo.tesouros[i].pos.x && 
-                                jogo.jogador.y == jogo.tesouros[i].pos.y) {
-                                
-                                strncpy(jogo.tesouros[i].nome, nome_arquivo_recebido, TAM_MAX_NOME);
-                                jogo.tesouros[i].encontrado = true;
-                                jogo.tesouros[i].pos.x = jogo.jogador.x;
-                                jogo.tesouros[i].pos.y = jogo.jogador.y;
-                                
-                                break;
-                            }
-                        }
-                        
-                        // Marcar que o grid precisa ser atualizado
-                        atualizacao_pendente = true;
-                        pthread_mutex_unlock(&mutex_jogo);
-                        
+                    for (int i = 0; i < BLOCOS_FEC_ABERTOS; i++) {
+                        blocos_fec[i].ativo = false;
                     }
-                    pthread_mutex_unlock(&mutex_recebimento);
-                    break;
+                    descompressor_iniciar(&descompressor);
                     
-                case TIPO_TAMANHO:
-                    // Recebeu informação de tamanho do arquivo
-                    if (tam_dados >= sizeof(size_t) && dados != NULL) {
-                        size_t tamanho;
-                        memcpy(&tamanho, dados, sizeof(size_t));
-                        
-                        printf("Tamanho do arquivo a receber: %zu bytes\n", tamanho);
-                        
-                        // Verificar espaço disponível
-                        if (verifica_espaco_disponivel(DIRETORIO_RECEBIDOS, tamanho)) {
-                            // Enviar ACK
-                            enviar_pacote(sockfd, &endereco_servidor, mac_servidor, mac_cliente, 
-                                        TIPO_ACK, seq, NULL, 0);
-                        } else {
-                            // Enviar NACK com erro de espaço insuficiente
-                            unsigned char erro = ERRO_ESPACO_INSUF;
-                            enviar_pacote(sockfd, &endereco_servidor, mac_servidor, mac_cliente, 
-                                        TIPO_NACK, seq, &erro, 1);
+                    printf("Iniciando recebimento do arquivo %s...\n", nome_arquivo_recebido);
+                } else {
+                    printf("Falha ao iniciar recebimento do arquivo %s.\n", nome_arquivo_recebido);
+                    aguardando_arquivo = false;
+                }
+            }
+            
+            pthread_mutex_unlock(&mutex_recebimento);
+            break;
+        
+        case TIPO_DADOS:
+            // Processa dados do arquivo sendo recebido
+            pthread_mutex_lock(&mutex_recebimento);
+            if (aguardando_arquivo && arquivo_recebendo != NULL && tam_dados > 0 && dados != NULL) {
+                // Chunk já escrito: o servidor não recebeu a confirmação
+                uint32_t adiante = distancia_seq(seq_esperado, seq, conexao_servidor.espaco_seq);
+                bool repetido = adiante >= (uint32_t)janela_maxima(&conexao_servidor);
+                
+                // A soma à paridade pode reconstruir chunks e, se a escrita
+                // deles falhar, encerrar a transferência
+                bool encerrado = fec_bloco > 0 && !repetido && 
+                                 !acumular_chunk_fec(chunks_escritos + adiante, dados, tam_dados);
+                
+                if (encerrado) {
+                    // Nada a fazer: o erro já foi tratado
+                } else if (receber_chunk(seq, dados, tam_dados)) {
+                    // Atualizar último sequencial recebido
+                    ultimo_seq_recebido = seq;
+                    
+                    // Chunk à frente do esperado: há uma lacuna na sequência
+                    bool lacuna = adiante > 0 && !repetido;
+                    
+                    if (conexao_servidor.sack) {
+                        // A lacuna aparece no mapa de bits do ACK seletivo
+                        agendar_sack(lacuna || repetido);
+                    } else {
+                        responder(TIPO_ACK, seq, NULL, 0);
+                        if (lacuna) {
+                            lacuna_pendente = true;
                         }
-                        
-                        // Atualizar último sequencial recebido
-                        ultimo_seq_recebido = seq;
                     }
-                    break;
+                } else {
+                    perror("Erro ao escrever no arquivo");
+                    responder(TIPO_NACK, seq, NULL, 0);
+                    finalizar_recebimento_arquivo(false);
+                }
+            }
+            pthread_mutex_unlock(&mutex_recebimento);
+            break;
+        
+        case TIPO_PARIDADE:
+            // Paridade de um bloco de chunks: não é confirmada
+            pthread_mutex_lock(&mutex_recebimento);
+            if (aguardando_arquivo && arquivo_recebendo != NULL && fec_bloco > 0 && dados != NULL) {
+                receber_paridade(dados, tam_dados);
+            }
+            pthread_mutex_unlock(&mutex_recebimento);
+            break;
+        
+        case TIPO_FIM_ARQUIVO:
+            // Finaliza o recebimento do arquivo
+            pthread_mutex_lock(&mutex_recebimento);
+            if (!aguardando_arquivo && seq == ultimo_seq_recebido) {
+                // ACK do fim de arquivo perdido: o servidor retransmitiu
+                responder(TIPO_ACK, seq, NULL, 0);
+            } else if (aguardando_arquivo && arquivo_recebendo != NULL && seq == seq_esperado && 
+                       arquivo_comprimido && !descompressor_completo(&descompressor)) {
+                // O último bloco comprimido ficou pela metade: o arquivo está truncado
+                printf("Arquivo %s terminou no meio de um bloco comprimido.\n", nome_arquivo_recebido);
+                responder(TIPO_NACK, seq, NULL, 0);
+                finalizar_recebimento_arquivo(false);
+            } else if (aguardando_arquivo && arquivo_recebendo != NULL && seq == seq_esperado && 
+                       !escritor_concluir(&escritor)) {
+                // O fim só é confirmado com o arquivo inteiro gravado
+                printf("Falha ao gravar o final do arquivo %s.\n", nome_arquivo_recebido);
+                responder(TIPO_NACK, seq, NULL, 0);
+                finalizar_recebimento_arquivo(false);
+            } else if (aguardando_arquivo && arquivo_recebendo != NULL && seq == seq_esperado) {
+                // Enviar ACK já: ao finalizar, a thread principal pode mandar um
+                // movimento, que o servidor ignoraria sem ter recebido este ACK
+                responder(TIPO_ACK, seq, NULL, 0);
+                enviar_respostas();
+                
+                // Atualizar último sequencial recebido
+                ultimo_seq_recebido = seq;
+                
+                // Finalizar recebimento
+                finalizar_recebimento_arquivo(true);
+                
+                printf("Arquivo %s recebido com sucesso!\n", nome_arquivo_recebido);
+                
+                // A tela adiciona o tesouro à lista de tesouros encontrados
+                EventoJogo evento = {.tipo = EVENTO_TESOURO, .tesouro = -1, .ok = true};
+                strncpy(evento.nome, nome_arquivo_recebido, TAM_MAX_NOME - 1);
+                anel_eventos_publicar(&eventos, &evento);
+            }
+            pthread_mutex_unlock(&mutex_recebimento);
+            break;
+        
+        case TIPO_TAMANHO:
+            // Recebeu informação de tamanho do arquivo
+            if (tam_dados >= sizeof(size_t) && dados != NULL) {
+                size_t tamanho;
+                memcpy(&tamanho, dados, sizeof(size_t));
+                
+                printf("Tamanho do arquivo a receber: %zu bytes\n", tamanho);
+                tamanho_arquivo_recebido = tamanho;
+                progresso_publicado = 0;
+                
+                // Opções do arquivo: paridades (FEC) e conteúdo comprimido
+                unsigned char opcoes = 0;
+                if (tam_dados >= sizeof(size_t) + TAM_EXTENSAO_TAMANHO) {
+                    opcoes = dados[sizeof(size_t)];
+                }
+                
+                fec_bloco = 0;
+                const unsigned char *fec = dados + sizeof(size_t) + 1;
+                if ((opcoes & OPCAO_ARQ_FEC) && fec[0] >= 1 && fec[0] <= MAX_BLOCO_FEC && 
+                    fec[1] >= 1 && fec[1] <= MAX_PARIDADE_FEC) {
+                    fec_bloco = fec[0];
+                    fec_paridades = fec[1];
+                }
+                arquivo_comprimido = (opcoes & OPCAO_ARQ_COMPRIMIDO) != 0;
                 
-                default:
-                    // Ignora outros tipos de pacotes
-                    break;
+                // O OK_ACK do movimento pode ter se perdido, mas o servidor
+                // só envia um tesouro depois de aplicá-lo: o tamanho, que diz
+                // qual foi o movimento, também o confirma
+                if ((opcoes & OPCAO_ARQ_MOVIMENTO) && 
+                    tam_dados >= sizeof(size_t) + TAM_EXTENSAO_TAMANHO + TAM_MOVIMENTO_TAMANHO) {
+                    const unsigned char *movimento = fec + 2;
+                    confirmar_movimentos((movimento[0] << 8) | movimento[1], true);
+                }
+                
+                // Verificar espaço disponível
+                if (verifica_espaco_disponivel(DIRETORIO_RECEBIDOS, tamanho)) {
+                    // Enviar ACK
+                    responder(TIPO_ACK, seq, NULL, 0);
+                } else {
+                    // Enviar NACK com erro de espaço insuficiente
+                    unsigned char erro = ERRO_ESPACO_INSUF;
+                    responder(TIPO_NACK, seq, &erro, 1);
+                }
+                
+                // Atualizar último sequencial recebido
+                ultimo_seq_recebido = seq;
+            }
+            break;
+        
+        case TIPO_NEGOCIACAO:
+            // Resposta do servidor: passar a usar o formato estendido
+            pthread_mutex_lock(&mutex_recebimento);
+            if (negociacao_pendente) {
+                if (aplicar_negociacao(&conexao_servidor, dados, tam_dados, max_dados_local, 
+                                       capacidades_locais())) {
+                    printf("Formato estendido negociado: até %d bytes por quadro, verificação %s, ACKs %s, %s, %s.\n", 
+                           conexao_servidor.max_dados, 
+                           conexao_servidor.crc32c ? "CRC32C" : "soma de 8 bits", 
+                           conexao_servidor.sack ? "seletivos" : "por quadro", 
+                           conexao_servidor.compressao ? "com compressão" : "sem compressão", 
+                           conexao_servidor.retomada ? "com retomada" : "sem retomada");
+                }
+                negociacao_pendente = false;
+                reator_armar_timer(timer_negociacao, 0);
+            }
+            pthread_mutex_unlock(&mutex_recebimento);
+            
+            // Liberar os comandos que aguardavam a negociação
+            publicar_atualizacao();
+            break;
+        
+        default:
+            // Ignora outros tipos de pacotes
+            break;
+    }
+}
+
+// Tratador do timer da transferência: o servidor parou de enviar
+void ao_expirar_transferencia(void *contexto) {
+    pthread_mutex_lock(&mutex_recebimento);
+    if (aguardando_arquivo) {
+        printf("Nenhum pacote do servidor em %d ms. Transferência abandonada.\n", 
+               TIMEOUT_TRANSFERENCIA_MS);
+        finalizar_recebimento_arquivo(false);
+    }
+    pthread_mutex_unlock(&mutex_recebimento);
+    
+    publicar_atualizacao();
+}
+
+// Capacidades propostas ao servidor na negociação
+unsigned char capacidades_locais() {
+    return (usar_crc32c ? CAPACIDADE_CRC32C : 0) | (usar_sack ? CAPACIDADE_SACK : 0) | 
+           (usar_compressao ? CAPACIDADE_COMPRESSAO : 0) | CAPACIDADE_RETOMADA;
+}
+
+// Envia a proposta de formato estendido e arma o timer de retransmissão
+void iniciar_negociacao() {
+    unsigned char proposta[TAM_NEGOCIACAO];
+    int tam_proposta = montar_negociacao(proposta, max_dados_local, capacidades_locais());
+    
+    pthread_mutex_lock(&mutex_recebimento);
+    negociacao_pendente = true;
+    pthread_mutex_unlock(&mutex_recebimento);
+    
+    enviar_quadro(&conexao_servidor, TIPO_NEGOCIACAO, 0, proposta, tam_proposta);
+    reator_armar_timer(timer_negociacao, TIMEOUT_MS * 1000LL);
+}
+
+// Tratador do timer da negociação: retransmite ou desiste e segue no formato
+// clássico (servidor antigo ou iniciado com -k)
+void ao_expirar_negociacao(void *contexto) {
+    pthread_mutex_lock(&mutex_recebimento);
+    if (!negociacao_pendente) {
+        pthread_mutex_unlock(&mutex_recebimento);
+        return;
+    }
+    
+    if (++tentativas_negociacao < MAX_RETRIES) {
+        pthread_mutex_unlock(&mutex_recebimento);
+        iniciar_negociacao();
+        return;
+    }
+    
+    negociacao_pendente = false;
+    pthread_mutex_unlock(&mutex_recebimento);
+    printf("Servidor não respondeu à negociação. Usando o formato clássico.\n");
+    
+    publicar_atualizacao();
+}
+
+// Pede à thread principal que redesenhe a tela (thread de recebimento)
+void publicar_atualizacao() {
+    EventoJogo evento = {.tipo = EVENTO_ATUALIZAR};
+    anel_eventos_publicar(&eventos, &evento);
+}
+
+// Publica o progresso da recepção para a tela a cada 5% do arquivo gravado.
+// Chamada com mutex_recebimento.
+static void publicar_progresso() {
+    if (tamanho_arquivo_recebido == 0) {
+        return;
+    }
+    
+    uint64_t gravados = escritor_gravados(&escritor);
+    int vigesimo = (int)(gravados * 20 / tamanho_arquivo_recebido);
+    if (vigesimo <= progresso_publicado) {
+        return;
+    }
+    progresso_publicado = vigesimo;
+    
+    EventoJogo evento = {.tipo = EVENTO_PROGRESSO, .bytes = gravados, .total = tamanho_arquivo_recebido};
+    anel_eventos_publicar(&eventos, &evento);
+}
+
+// Acrescenta o tesouro recebido à lista e o marca no grid (thread principal)
+static void guardar_tesouro_recebido(Posicao pos, const char *nome) {
+    if (num_recebidos == capacidade_recebidos) {
+        int capacidade = capacidade_recebidos ? capacidade_recebidos * 2 : TESOUROS_PADRAO;
+        TesouroRecebido *tesouros = realloc(tesouros_recebidos, capacidade * sizeof(TesouroRecebido));
+        if (tesouros == NULL) {
+            return;
+        }
+        tesouros_recebidos = tesouros;
+        capacidade_recebidos = capacidade;
+    }
+    
+    TesouroRecebido *tesouro = &tesouros_recebidos[num_recebidos++];
+    tesouro->pos = pos;
+    strncpy(tesouro->nome, nome, TAM_MAX_NOME - 1);
+    tesouro->nome[TAM_MAX_NOME - 1] = '\0';
+    plano_marcar(&jogo.encontrado, pos.x, pos.y, true);
+}
+
+// Aplica um evento da thread de recebimento ao jogo mostrado na tela
+static void aplicar_evento(const EventoJogo *evento) {
+    switch (evento->tipo) {
+        case EVENTO_MOVIMENTO:
+            if (mover_jogador(&jogo, evento->direcao)) {
+                DEPURAR("Movimento aplicado localmente\n");
+            } else {
+                printf("Erro ao aplicar movimento localmente.\n");
             }
+            break;
+        
+        case EVENTO_TESOURO:
+            // O cliente não conhece os tesouros: o recebido está na posição do jogador
+            if (!plano_testar(&jogo.encontrado, jogo.jogador.x, jogo.jogador.y)) {
+                guardar_tesouro_recebido(jogo.jogador, evento->nome);
+            }
+            break;
+        
+        case EVENTO_GRID: {
+            // O servidor só informa outro grid numa sessão nova, com o
+            // jogador na origem: o jogo recomeça com o mundo dele
+            EstadoJogo novo;
+            if (inicializar_jogo(&novo, evento->mundo)) {
+                finalizar_jogo(&jogo);
+                jogo = novo;
+                printf("Grid do servidor: %dx%d\n", jogo.mundo->largura, jogo.mundo->altura);
+            }
+            liberar_mundo(evento->mundo);
+            break;
         }
         
-        // Pequena pausa para não sobrecarregar o processador
-        usleep(10000); // 10ms
+        case EVENTO_PROGRESSO:
+            bytes_na_tela = evento->ok ? 0 : evento->bytes;
+            total_na_tela = evento->ok ? 0 : evento->total;
+            break;
+        
+        default:
+            break;
     }
     
-    printf("Thread de recebimento finalizada.\n");
-    return NULL;
+    // Marcar que o grid precisa ser atualizado
+    atualizacao_pendente = true;
+}
+
+// Indica se a thread principal pode executar um novo comando
+static bool pode_obter_comando() {
+    // Não obter comandos enquanto aguardamos um arquivo ou a negociação
+    pthread_mutex_lock(&mutex_recebimento);
+    bool pode = !aguardando_arquivo && !negociacao_pendente;
+    pthread_mutex_unlock(&mutex_recebimento);
+    
+    // Nem com a janela de movimentos cheia
+    pthread_mutex_lock(&mutex_movimento);
+    pode = pode && num_em_voo < janela_movimentos();
+    pthread_mutex_unlock(&mutex_movimento);
+    
+    return pode;
+}
+
+// Aplica os eventos da thread de recebimento e redesenha o grid se algo
+// mudou, no máximo um quadro a cada INTERVALO_TELA_US: antes disso, o
+// quadro fica para o timer da tela. O desenho não trava nada que a
+// recepção use.
+static void atualizar_tela() {
+    EventoJogo evento;
+    while (anel_eventos_consumir(&eventos, &evento)) {
+        aplicar_evento(&evento);
+    }
+    
+    if (!atualizacao_pendente) {
+        return;
+    }
+    long long espera = tela_espera_us(&tela);
+    if (espera > 0) {
+        reator_armar_timer(timer_tela, espera);
+        return;
+    }
+    imprimir_grid();
+    imprimir_menu();
+    if (pode_obter_comando()) {
+        tela_printf(&tela, "Digite o comando: ");
+    }
+    tela_apresentar(&tela);
+    atualizacao_pendente = false;
+}
+
+// Tratador do notificador e do timer da tela (thread principal)
+void ao_notificar_tela(void *contexto) {
+    atualizar_tela();
+    
+    // Uma transferência pode ter terminado: executar os comandos que esperavam
+    processar_comandos_pendentes();
+}
+
+// Tratador de leitura do teclado: acumula o que foi digitado
+void ao_ler_entrada(void *contexto) {
+    char descarte[TAM_ENTRADA];
+    char *destino = entrada_pendente + tam_entrada;
+    size_t espaco = sizeof(entrada_pendente) - tam_entrada;
+    
+    // Buffer cheio: descarta a entrada para não travar o laço de eventos
+    if (espaco == 0) {
+        destino = descarte;
+        espaco = sizeof(descarte);
+    }
+    
+    ssize_t lidos = read(STDIN_FILENO, destino, espaco);
+    if (lidos <= 0) {
+        // Fim da entrada: não há mais comandos a ler
+        reator_remover_fonte(&reator_tela, fonte_entrada);
+        return;
+    }
+    
+    if (destino == descarte) {
+        printf("Muitos comandos pendentes. Entrada descartada.\n");
+        return;
+    }
+    
+    tam_entrada += lidos;
+    processar_comandos_pendentes();
+}
+
+// Executa os comandos completos (terminados em \n) enquanto for possível
+void processar_comandos_pendentes() {
+    while (pode_obter_comando()) {
+        char *fim_linha = memchr(entrada_pendente, '\n', tam_entrada);
+        if (fim_linha == NULL) {
+            break;
+        }
+        
+        // O comando é o primeiro caractere da linha
+        char comando = entrada_pendente[0];
+        int tam_linha = fim_linha - entrada_pendente + 1;
+        memmove(entrada_pendente, fim_linha + 1, tam_entrada - tam_linha);
+        tam_entrada -= tam_linha;
+        
+        executar_comando(comando);
+        atualizar_tela();
+    }
+}
+
+// Executa um comando digitado pelo usuário
+void executar_comando(char comando) {
+    // Converter para minúsculo
+    comando = tolower(comando);
+    
+    bool entrada_valida = false;
+    switch (comando) {
+        case 'w': // Cima
+            entrada_valida = enviar_movimento(TIPO_MOVE_CIMA);
+            break;
+        case 's': // Baixo
+            entrada_valida = enviar_movimento(TIPO_MOVE_BAIXO);
+            break;
+        case 'a': // Esquerda
+            entrada_valida = enviar_movimento(TIPO_MOVE_ESQ);
+            break;
+        case 'd': // Direita
+            entrada_valida = enviar_movimento(TIPO_MOVE_DIR);
+            break;
+        default:
+            printf("Comando inválido!\n");
+            atualizacao_pendente = true; // Forçar atualização para mostrar comando inválido
+            break;
+    }
+    
+    if (!entrada_valida && em_execucao && comando != '\n') {
+        printf("Tente novamente.\n");
+        atualizacao_pendente = true; // Forçar atualização para mostrar mensagem
+    }
+}
+
+// Destino dos blocos descomprimidos: o lote atual do escritor
+static bool gravar_descomprimido(const unsigned char *dados, int tam, void *contexto) {
+    return escritor_escrever(contexto, dados, tam);
+}
+
+// Armazena um chunk na janela de recepção e escreve no arquivo os chunks que
+// ficaram em ordem. Retorna false apenas em caso de erro de escrita.
+bool receber_chunk(uint16_t seq, unsigned char *dados, int tam_dados) {
+    // Chunks fora da janela já foram escritos: o ACK anterior se perdeu
+    uint32_t espaco = conexao_servidor.espaco_seq;
+    if (distancia_seq(seq_esperado, seq, espaco) >= (uint32_t)janela_maxima(&conexao_servidor)) {
+        return true;
+    }
+    
+    SlotRecepcao *slot = &janela_recepcao[seq % JANELA_MAX];
+    if (!slot->ocupado) {
+        memcpy(slot->dados, dados, tam_dados);
+        slot->tam_dados = tam_dados;
+        slot->ocupado = true;
+    }
+    
+    // Escrever os chunks consecutivos a partir do esperado
+    while (janela_recepcao[seq_esperado % JANELA_MAX].ocupado) {
+        slot = &janela_recepcao[seq_esperado % JANELA_MAX];
+        
+        // Os dados só são copiados para o lote atual: o disco fica com a
+        // thread de escrita
+        if (arquivo_comprimido) {
+            if (!descompressor_alimentar(&descompressor, slot->dados, slot->tam_dados, 
+                                         gravar_descomprimido, &escritor)) {
+                return false;
+            }
+            bytes_comprimidos += slot->tam_dados;
+        } else if (!escritor_escrever(&escritor, slot->dados, slot->tam_dados)) {
+            return false;
+        }
+        
+        if (escritor_gravados(&escritor) - progresso_salvo >= INTERVALO_DIARIO) {
+            salvar_progresso();
+        }
+        
+        slot->ocupado = false;
+        seq_esperado = avancar_seq(seq_esperado, 1, espaco);
+        chunks_escritos++;
+        nack_enviado = false;
+    }
+    
+    publicar_progresso();
+    return true;
+}
+
+// Bloco de FEC que começa no chunk 'inicio', criado se ainda não existir.
+// Retorna NULL se a entrada já foi tomada por um bloco mais novo.
+static BlocoFEC *obter_bloco_fec(uint64_t inicio) {
+    BlocoFEC *bloco = &blocos_fec[(inicio / fec_bloco) % BLOCOS_FEC_ABERTOS];
+    
+    if (bloco->ativo && bloco->inicio == inicio) {
+        return bloco;
+    }
+    if (bloco->ativo && bloco->inicio > inicio) {
+        return NULL;
+    }
+    
+    bloco->ativo = true;
+    bloco->inicio = inicio;
+    bloco->num_chunks = 0;
+    bloco->recebidos = 0;
+    bloco->paridades = 0;
+    bloco->tam_simbolo = 0;
+    return bloco;
+}
+
+// Reconstrói os chunks perdidos de um bloco, se as paridades bastarem, e os
+// entrega à janela de recepção como se tivessem chegado. Retorna false se a
+// escrita falhou e a transferência foi encerrada. Chamada com mutex_recebimento.
+static bool recuperar_bloco_fec(BlocoFEC *bloco) {
+    ChunkRecuperado recuperados[MAX_PARIDADE_FEC];
+    int num_recuperados = fec_recuperar(bloco, fec_paridades, recuperados);
+    
+    for (int i = 0; i < num_recuperados; i++) {
+        if (recuperados[i].indice < chunks_escritos) {
+            continue;
+        }
+        
+        uint16_t seq = avancar_seq(seq_esperado, recuperados[i].indice - chunks_escritos, 
+                                   conexao_servidor.espaco_seq);
+        DEPURAR("Chunk seq=%d reconstruído pela paridade.\n", seq);
+        chunks_recuperados++;
+        
+        if (!receber_chunk(seq, recuperados[i].dados, recuperados[i].tam_dados)) {
+            perror("Erro ao escrever no arquivo");
+            finalizar_recebimento_arquivo(false);
+            return false;
+        }
+        
+        if (conexao_servidor.sack) {
+            agendar_sack(true);
+        } else {
+            responder(TIPO_ACK, seq, NULL, 0);
+        }
+    }
+    
+    return true;
+}
+
+// Soma um chunk novo ao seu bloco de FEC. Retorna false se a transferência
+// foi encerrada. Chamada com mutex_recebimento.
+bool acumular_chunk_fec(uint64_t indice, unsigned char *dados, int tam_dados) {
+    BlocoFEC *bloco = obter_bloco_fec(indice - indice % fec_bloco);
+    if (bloco == NULL) {
+        return true;
+    }
+    
+    fec_acumular(bloco, fec_paridades, indice % fec_bloco, dados, tam_dados);
+    
+    // Uma retransmissão pode completar o que faltava para a paridade
+    return recuperar_bloco_fec(bloco);
+}
+
+// Trata um quadro TIPO_PARIDADE: localiza o bloco pela sequência do seu
+// primeiro chunk, que pode já ter sido escrito, e tenta a reconstrução.
+// Chamada com mutex_recebimento.
+void receber_paridade(unsigned char *dados, int tam_dados) {
+    if (tam_dados <= TAM_CABECALHO_FEC) {
+        return;
+    }
+    
+    uint16_t seq_inicio = (dados[0] << 8) | dados[1];
+    int num_chunks = dados[2];
+    int linha = dados[4];
+    if (dados[3] != fec_paridades || linha >= fec_paridades || num_chunks < 1 || num_chunks > fec_bloco) {
+        return;
+    }
+    paridades_recebidas++;
+    
+    // Índice do primeiro chunk: à frente do esperado, ou atrás se parte do
+    // bloco já foi escrita
+    uint32_t espaco = conexao_servidor.espaco_seq;
+    uint32_t adiante = distancia_seq(seq_esperado, seq_inicio, espaco);
+    uint64_t inicio;
+    if (adiante < (uint32_t)janela_maxima(&conexao_servidor)) {
+        inicio = chunks_escritos + adiante;
+    } else if (espaco - adiante <= chunks_escritos) {
+        inicio = chunks_escritos - (espaco - adiante);
+    } else {
+        return;
+    }
+    
+    // Bloco já escrito por inteiro: a paridade chegou tarde
+    if (inicio + num_chunks <= chunks_escritos || inicio % fec_bloco != 0) {
+        return;
+    }
+    
+    BlocoFEC *bloco = obter_bloco_fec(inicio);
+    if (bloco == NULL) {
+        return;
+    }
+    
+    fec_guardar_paridade(bloco, fec_paridades, linha, num_chunks, 
+                         dados + TAM_CABECALHO_FEC, tam_dados - TAM_CABECALHO_FEC);
+    recuperar_bloco_fec(bloco);
+}
+
+// Caminho do diário de retomada do arquivo em recebimento
+static void caminho_diario(char *caminho, size_t tam) {
+    snprintf(caminho, tam, "%s/.%s.retomada", DIRETORIO_RECEBIDOS, nome_arquivo_recebido);
+}
+
+// Grava no diário quantos bytes do arquivo já estão no disco (os dos lotes
+// ainda na fila não contam). O diário é escrito em um arquivo temporário e
+// renomeado: nunca fica pela metade.
+void salvar_progresso() {
+    uint64_t gravados = escritor_gravados(&escritor);
+    if (!conexao_servidor.retomada || arquivo_recebendo == NULL || gravados == 0) {
+        return;
+    }
+    
+    char caminho[512];
+    char temporario[520];
+    caminho_diario(caminho, sizeof(caminho));
+    snprintf(temporario, sizeof(temporario), "%s.tmp", caminho);
+    
+    FILE *diario = fopen(temporario, "w");
+    if (!diario) {
+        perror("Erro ao criar diário de retomada");
+        return;
+    }
+    fprintf(diario, "%zu %llu\n", tamanho_arquivo_recebido, (unsigned long long)gravados);
+    
+    if (fclose(diario) != 0 || rename(temporario, caminho) != 0) {
+        perror("Erro ao gravar diário de retomada");
+        remove(temporario);
+        return;
+    }
+    progresso_salvo = gravados;
+}
+
+// Bytes gravados segundo o diário do arquivo em recebimento, ou 0 se não
+// houver diário ou ele for de um arquivo com outro tamanho
+uint64_t ler_progresso(size_t tamanho) {
+    char caminho[512];
+    caminho_diario(caminho, sizeof(caminho));
+    
+    FILE *diario = fopen(caminho, "r");
+    if (!diario) {
+        return 0;
+    }
+    
+    size_t tamanho_diario;
+    unsigned long long gravados;
+    bool valido = fscanf(diario, "%zu %llu", &tamanho_diario, &gravados) == 2 && 
+                  tamanho_diario == tamanho && gravados < tamanho;
+    fclose(diario);
+    return valido ? gravados : 0;
+}
+
+void apagar_progresso() {
+    char caminho[512];
+    caminho_diario(caminho, sizeof(caminho));
+    remove(caminho);
+}
+
+// Abre o arquivo parcial de uma transferência anterior para continuar a
+// partir do byte registrado no diário (o escritor grava em posições
+// explícitas). Com compressão, o servidor só retoma no início de um bloco.
+// Retorna o byte de onde continuar (0: recomeçar).
+static uint64_t abrir_arquivo_parcial(const char *caminho) {
+    if (!conexao_servidor.retomada) {
+        return 0;
+    }
+    
+    uint64_t inicio = ler_progresso(tamanho_arquivo_recebido);
+    if (arquivo_comprimido) {
+        inicio -= inicio % TAM_BLOCO_COMPRESSAO;
+    }
+    
+    struct stat st;
+    if (inicio == 0 || stat(caminho, &st) == -1 || (uint64_t)st.st_size < inicio) {
+        return 0;
+    }
+    
+    arquivo_recebendo = fopen(caminho, "r+b");
+    if (!arquivo_recebendo) {
+        perror("Erro ao reabrir arquivo parcial");
+        return 0;
+    }
+    
+    printf("Retomando %s a partir do byte %llu de %zu.\n", 
+           nome_arquivo_recebido, (unsigned long long)inicio, tamanho_arquivo_recebido);
+    return inicio;
 }
 
 // Iniciar o recebimento de um arquivo
@@ -608,6 +1753,16 @@ bool iniciar_recebimento_arquivo(const char *nome_arquivo) {
         arquivo_recebendo = NULL;
     }
     
+    // Arquivo parcial de uma transferência que falhou: continuar de onde parou
+    inicio_retomada = abrir_arquivo_parcial(caminho);
+    progresso_salvo = inicio_retomada;
+    if (arquivo_recebendo != NULL) {
+        retomadas++;
+        bytes_retomados += inicio_retomada;
+        escritor_abrir(&escritor, fileno(arquivo_recebendo), inicio_retomada, tamanho_arquivo_recebido);
+        return true;
+    }
+    
     printf("Tentando criar arquivo para escrita: %s\n", caminho);
     
     // Verificar se o diretório existe
@@ -645,40 +1800,70 @@ bool iniciar_recebimento_arquivo(const char *nome_arquivo) {
         printf("Arquivo aberto com sucesso para escrita.\n");
     }
     
+    escritor_abrir(&escritor, fileno(arquivo_recebendo), 0, tamanho_arquivo_recebido);
     return true;
 }
 
 // Finalizar o recebimento de um arquivo
 void finalizar_recebimento_arquivo(bool sucesso) {
+    // Gravar os lotes que ainda estão na fila
+    if (arquivo_recebendo != NULL && !escritor_concluir(&escritor)) {
+        sucesso = false;
+    }
+    
+    // Com a retomada, o arquivo parcial fica para a próxima tentativa
+    bool manter = !sucesso && conexao_servidor.retomada && escritor_gravados(&escritor) > 0;
+    if (manter) {
+        salvar_progresso();
+    }
+    
     if (arquivo_recebendo != NULL) {
+        // Um arquivo retomado pode ter sobras da tentativa anterior no fim
+        if (sucesso && inicio_retomada > 0 && 
+            ftruncate(fileno(arquivo_recebendo), escritor_gravados(&escritor)) == -1) {
+            perror("Erro ao ajustar o tamanho do arquivo retomado");
+        }
         fclose(arquivo_recebendo);
         arquivo_recebendo = NULL;
     }
     
+    if (sucesso && arquivo_comprimido) {
+        bytes_descomprimidos += descompressor.bytes_escritos;
+    }
+    
     aguardando_arquivo = false;
+    chunks_sem_ack = 0;
+    sack_pendente = false;
+    
+    // Encerrar os prazos da transferência e liberar os comandos que esperavam:
+    // o fim do progresso acorda a tela, que volta a executar comandos
+    reator_armar_timer(timer_transferencia, 0);
+    reator_armar_timer(timer_ack, 0);
+    EventoJogo evento = {.tipo = EVENTO_PROGRESSO, .ok = true};
+    anel_eventos_publicar(&eventos, &evento);
     
-    if (!sucesso) {
+    if (sucesso) {
+        apagar_progresso();
+    } else if (manter) {
+        printf("Arquivo parcial mantido: %llu de %zu bytes gravados.\n", 
+               (unsigned long long)progresso_salvo, tamanho_arquivo_recebido);
+    } else {
         // Em caso de falha, tentar remover o arquivo incompleto
         char caminho[512]; 
         snprintf(caminho, sizeof(caminho), "%s/%s", DIRETORIO_RECEBIDOS, nome_arquivo_recebido);
         remove(caminho);
+        apagar_progresso();
     }
 }
 
-// Tratamento de sinais para encerramento limpo
+// Tratamento de sinais para encerramento limpo. Só marca o encerramento: o
+// progresso da retomada é salvo e o arquivo é fechado em finalizar_cliente,
+// depois que os laços de eventos pararam.
 void tratar_sinal(int signum) {
-    printf("\nSinal %d recebido. Encerrando cliente...\n", signum);
-    
-    // Fechar qualquer arquivo aberto
-    if (arquivo_recebendo != NULL) {
-        fclose(arquivo_recebendo);
-        arquivo_recebendo = NULL;
-        printf("Arquivo aberto fechado durante tratamento de sinal.\n");
-    }
-    
     // Marcar o programa para encerrar
     em_execucao = false;
     
-    // Sinalizar para qualquer espera condicional (como no enviar_movimento)
-    pthread_cond_signal(&cond_movimento);
+    // Interromper os laços de eventos
+    reator_parar(&reator_rede);
+    reator_parar(&reator_tela);
 }
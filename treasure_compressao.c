@@ -0,0 +1,300 @@
+#include "treasure_compressao.h"
+#include <string.h>
+
+// Parâmetros do formato de bloco do LZ4
+#define MIN_REPETICAO 4        // Menor repetição codificada
+#define LITERAIS_FINAIS 5      // O bloco termina sempre com literais
+#define MAX_DESLOCAMENTO 65535
+#define BITS_HASH 12           // Tabela de 4096 posições para as sequências de 4 bytes
+
+static uint32_t ler32(const unsigned char *p) {
+    uint32_t valor;
+    memcpy(&valor, p, sizeof(valor));
+    return valor;
+}
+
+static int hash_sequencia(const unsigned char *p) {
+    return (ler32(p) * 2654435761u) >> (32 - BITS_HASH);
+}
+
+// Escreve um comprimento em bytes de 255 após o nibble do token. Retorna a
+// nova posição ou -1 se não couber.
+static int escrever_comprimento(unsigned char *saida, int pos, int max_saida, int restante) {
+    while (restante >= 255) {
+        if (pos >= max_saida) {
+            return -1;
+        }
+        saida[pos++] = 255;
+        restante -= 255;
+    }
+    if (pos >= max_saida) {
+        return -1;
+    }
+    saida[pos++] = restante;
+    return pos;
+}
+
+// Emite uma sequência: literais de 'literais' com 'tam_literais' bytes e,
+// se tam_repeticao > 0, uma repetição a 'deslocamento' bytes para trás
+static int emitir_sequencia(unsigned char *saida, int pos, int max_saida,
+                            const unsigned char *literais, int tam_literais,
+                            int deslocamento, int tam_repeticao) {
+    if (pos >= max_saida) {
+        return -1;
+    }
+    
+    int token = pos++;
+    int extra_repeticao = (tam_repeticao > 0) ? tam_repeticao - MIN_REPETICAO : 0;
+    saida[token] = ((tam_literais < 15 ? tam_literais : 15) << 4) |
+                   (extra_repeticao < 15 ? extra_repeticao : 15);
+    
+    if (tam_literais >= 15) {
+        pos = escrever_comprimento(saida, pos, max_saida, tam_literais - 15);
+        if (pos < 0) {
+            return -1;
+        }
+    }
+    
+    if (pos + tam_literais > max_saida) {
+        return -1;
+    }
+    memcpy(saida + pos, literais, tam_literais);
+    pos += tam_literais;
+    
+    if (tam_repeticao == 0) {
+        return pos;
+    }
+    
+    if (pos + 2 > max_saida) {
+        return -1;
+    }
+    saida[pos++] = deslocamento & 0xFF;
+    saida[pos++] = deslocamento >> 8;
+    
+    if (extra_repeticao >= 15) {
+        pos = escrever_comprimento(saida, pos, max_saida, extra_repeticao - 15);
+    }
+    return pos;
+}
+
+// Comprime um bloco (até TAM_BLOCO_COMPRESSAO bytes) com busca gulosa por
+// repetições de 4 bytes. Retorna o tamanho comprimido, ou -1 se não couber
+// em max_saida.
+int lz_comprimir(const unsigned char *entrada, int tam_entrada, unsigned char *saida, int max_saida) {
+    int tabela[1 << BITS_HASH];
+    int pos = 0;
+    int ancora = 0;               // Início dos literais ainda não emitidos
+    int limite = tam_entrada - LITERAIS_FINAIS;
+    
+    for (int i = 0; i < (1 << BITS_HASH); i++) {
+        tabela[i] = -1;
+    }
+    
+    int i = 0;
+    while (i + MIN_REPETICAO <= limite) {
+        int h = hash_sequencia(entrada + i);
+        int candidato = tabela[h];
+        tabela[h] = i;
+        
+        if (candidato < 0 || i - candidato > MAX_DESLOCAMENTO ||
+            ler32(entrada + candidato) != ler32(entrada + i)) {
+            // Sem repetição: avança mais rápido em trechos incompressíveis
+            i += 1 + ((i - ancora) >> 6);
+            continue;
+        }
+        
+        // Estende a repetição para trás, sobre os literais pendentes, e para a frente
+        while (i > ancora && candidato > 0 && entrada[i - 1] == entrada[candidato - 1]) {
+            i--;
+            candidato--;
+        }
+        int tam_repeticao = MIN_REPETICAO;
+        while (i + tam_repeticao < limite && entrada[i + tam_repeticao] == entrada[candidato + tam_repeticao]) {
+            tam_repeticao++;
+        }
+        
+        pos = emitir_sequencia(saida, pos, max_saida, entrada + ancora, i - ancora,
+                               i - candidato, tam_repeticao);
+        if (pos < 0) {
+            return -1;
+        }
+        
+        i += tam_repeticao;
+        ancora = i;
+    }
+    
+    // Últimos literais, sem repetição
+    return emitir_sequencia(saida, pos, max_saida, entrada + ancora, tam_entrada - ancora, 0, 0);
+}
+
+// Lê um comprimento estendido (bytes de 255). Retorna -1 se a entrada acabar.
+static int ler_comprimento(const unsigned char *entrada, int tam_entrada, int *pos, int base) {
+    int valor = base;
+    unsigned char byte;
+    do {
+        if (*pos >= tam_entrada) {
+            return -1;
+        }
+        byte = entrada[(*pos)++];
+        valor += byte;
+    } while (byte == 255);
+    return valor;
+}
+
+// Descomprime um bloco, verificando todos os limites: a entrada vem da rede.
+// Retorna o tamanho descomprimido ou -1 se o bloco for inválido.
+int lz_descomprimir(const unsigned char *entrada, int tam_entrada, unsigned char *saida, int max_saida) {
+    int pos = 0;
+    int escrito = 0;
+    
+    while (pos < tam_entrada) {
+        unsigned char token = entrada[pos++];
+        
+        int tam_literais = token >> 4;
+        if (tam_literais == 15) {
+            tam_literais = ler_comprimento(entrada, tam_entrada, &pos, 15);
+            if (tam_literais < 0) {
+                return -1;
+            }
+        }
+        if (tam_literais > tam_entrada - pos || tam_literais > max_saida - escrito) {
+            return -1;
+        }
+        memcpy(saida + escrito, entrada + pos, tam_literais);
+        pos += tam_literais;
+        escrito += tam_literais;
+        
+        // A última sequência só tem literais
+        if (pos == tam_entrada) {
+            break;
+        }
+        
+        if (pos + 2 > tam_entrada) {
+            return -1;
+        }
+        int deslocamento = entrada[pos] | (entrada[pos + 1] << 8);
+        pos += 2;
+        
+        int tam_repeticao = token & 0x0F;
+        if (tam_repeticao == 15) {
+            tam_repeticao = ler_comprimento(entrada, tam_entrada, &pos, 15);
+            if (tam_repeticao < 0) {
+                return -1;
+            }
+        }
+        tam_repeticao += MIN_REPETICAO;
+        
+        if (deslocamento == 0 || deslocamento > escrito || tam_repeticao > max_saida - escrito) {
+            return -1;
+        }
+        
+        // Com sobreposição (deslocamento menor que a repetição) a cópia é
+        // byte a byte: o trecho copiado se repete
+        const unsigned char *origem = saida + escrito - deslocamento;
+        if (deslocamento >= tam_repeticao) {
+            memcpy(saida + escrito, origem, tam_repeticao);
+        } else {
+            for (int i = 0; i < tam_repeticao; i++) {
+                saida[escrito + i] = origem[i];
+            }
+        }
+        escrito += tam_repeticao;
+    }
+    
+    return escrito;
+}
+
+// Monta um bloco do arquivo comprimido (cabeçalho + conteúdo) em 'saida',
+// que precisa de TAM_MAX_BLOCO_COMPRIMIDO bytes. Retorna o tamanho total.
+int comprimir_bloco(const unsigned char *entrada, int tam_entrada, unsigned char *saida) {
+    // Só vale a pena se reduzir: senão o bloco vai como está
+    int tam = lz_comprimir(entrada, tam_entrada, saida + TAM_CABECALHO_BLOCO, tam_entrada - 1);
+    uint32_t cabecalho;
+    
+    if (tam > 0) {
+        cabecalho = BLOCO_COMPRIMIDO | tam;
+    } else {
+        tam = tam_entrada;
+        memcpy(saida + TAM_CABECALHO_BLOCO, entrada, tam_entrada);
+        cabecalho = tam;
+    }
+    
+    saida[0] = cabecalho >> 24;
+    saida[1] = (cabecalho >> 16) & 0xFF;
+    saida[2] = (cabecalho >> 8) & 0xFF;
+    saida[3] = cabecalho & 0xFF;
+    return TAM_CABECALHO_BLOCO + tam;
+}
+
+void descompressor_iniciar(Descompressor *descompressor) {
+    descompressor->preenchido = 0;
+    descompressor->bytes_escritos = 0;
+}
+
+// Tamanho total do bloco em remontagem, conhecido depois do cabeçalho (0 antes)
+static int tamanho_bloco(const Descompressor *descompressor) {
+    if (descompressor->preenchido < TAM_CABECALHO_BLOCO) {
+        return 0;
+    }
+    
+    const unsigned char *c = descompressor->bloco;
+    uint32_t cabecalho = ((uint32_t)c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+    return TAM_CABECALHO_BLOCO + (cabecalho & ~BLOCO_COMPRIMIDO);
+}
+
+// Acrescenta dados do arquivo comprimido, na ordem, e entrega a 'gravar'
+// cada bloco que ficar completo. Retorna false se um bloco for inválido ou a
+// escrita falhar.
+bool descompressor_alimentar(Descompressor *descompressor, const unsigned char *dados, int tam_dados,
+                             GravarSaida gravar, void *contexto) {
+    while (tam_dados > 0) {
+        // Primeiro o cabeçalho, depois o conteúdo do bloco
+        int alvo = tamanho_bloco(descompressor);
+        if (alvo == 0) {
+            alvo = TAM_CABECALHO_BLOCO;
+        } else if (alvo > TAM_MAX_BLOCO_COMPRIMIDO) {
+            return false;
+        }
+        
+        int copiar = alvo - descompressor->preenchido;
+        if (copiar > tam_dados) {
+            copiar = tam_dados;
+        }
+        memcpy(descompressor->bloco + descompressor->preenchido, dados, copiar);
+        descompressor->preenchido += copiar;
+        dados += copiar;
+        tam_dados -= copiar;
+        
+        int total = tamanho_bloco(descompressor);
+        if (total == 0 || descompressor->preenchido < total) {
+            continue;
+        }
+        
+        // Bloco completo: descomprimir (ou copiar) e gravar
+        const unsigned char *conteudo = descompressor->bloco + TAM_CABECALHO_BLOCO;
+        int tam_conteudo = total - TAM_CABECALHO_BLOCO;
+        const unsigned char *saida = conteudo;
+        int tam_saida = tam_conteudo;
+        
+        if (descompressor->bloco[0] & (BLOCO_COMPRIMIDO >> 24)) {
+            tam_saida = lz_descomprimir(conteudo, tam_conteudo, descompressor->saida, TAM_BLOCO_COMPRESSAO);
+            if (tam_saida < 0) {
+                return false;
+            }
+            saida = descompressor->saida;
+        }
+        
+        if (!gravar(saida, tam_saida, contexto)) {
+            return false;
+        }
+        descompressor->bytes_escritos += tam_saida;
+        descompressor->preenchido = 0;
+    }
+    
+    return true;
+}
+
+// Indica se o arquivo terminou no fim de um bloco (nada pela metade)
+bool descompressor_completo(const Descompressor *descompressor) {
+    return descompressor->preenchido == 0;
+}
@@ -0,0 +1,39 @@
+#ifndef TREASURE_COMPRESSAO_H
+#define TREASURE_COMPRESSAO_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Compressão dos arquivos de tesouro em blocos independentes, no formato de
+// bloco do LZ4: sequências [token][literais][deslocamento (16 bits)][extra].
+// O arquivo comprimido é uma sequência de blocos, cada um precedido de um
+// cabeçalho de 32 bits (big-endian) com o tamanho do conteúdo; o bit mais
+// alto indica que o bloco está comprimido (senão vai como está, quando a
+// compressão não o reduz).
+#define TAM_BLOCO_COMPRESSAO (64 * 1024)   // Bytes do arquivo por bloco
+#define TAM_CABECALHO_BLOCO 4
+#define TAM_MAX_BLOCO_COMPRIMIDO (TAM_CABECALHO_BLOCO + TAM_BLOCO_COMPRESSAO)
+#define BLOCO_COMPRIMIDO 0x80000000u
+
+// Remontagem dos blocos no cliente: os chunks chegam em ordem, mas um bloco
+// ocupa vários deles
+typedef struct {
+    unsigned char bloco[TAM_MAX_BLOCO_COMPRIMIDO];
+    int preenchido;                   // Bytes do bloco atual já recebidos
+    unsigned char saida[TAM_BLOCO_COMPRESSAO];
+    unsigned long long bytes_escritos; // Bytes descomprimidos gravados no arquivo
+} Descompressor;
+
+// Destino dos blocos descomprimidos, com o contexto dado ao descompressor
+typedef bool (*GravarSaida)(const unsigned char *dados, int tam, void *contexto);
+
+int lz_comprimir(const unsigned char *entrada, int tam_entrada, unsigned char *saida, int max_saida);
+int lz_descomprimir(const unsigned char *entrada, int tam_entrada, unsigned char *saida, int max_saida);
+int comprimir_bloco(const unsigned char *entrada, int tam_entrada, unsigned char *saida);
+void descompressor_iniciar(Descompressor *descompressor);
+bool descompressor_alimentar(Descompressor *descompressor, const unsigned char *dados, int tam_dados,
+                             GravarSaida gravar, void *contexto);
+bool descompressor_completo(const Descompressor *descompressor);
+
+#endif // TREASURE_COMPRESSAO_H
@@ -0,0 +1,321 @@
+#include "treasure_escrita.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+// Reserva um lote novo, com as páginas já mapeadas: uma só chamada em vez
+// de uma falta de página a cada 4 KiB copiados pela recepção. Retorna NULL
+// sem memória.
+static LoteEscrita *reservar_lote(EscritorArquivo *escritor) {
+    LoteEscrita *lote = malloc(sizeof(LoteEscrita));
+    void *dados = MAP_FAILED;
+    if (lote != NULL) {
+        dados = mmap(NULL, TAM_LOTE_ESCRITA, PROT_READ | PROT_WRITE, 
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    }
+    if (dados == MAP_FAILED) {
+        free(lote);
+        return NULL;
+    }
+    lote->dados = dados;
+    lote->proximo = NULL;
+    
+    escritor->num_lotes++;
+    if (escritor->num_lotes > escritor->pico_lotes) {
+        escritor->pico_lotes = escritor->num_lotes;
+    }
+    return lote;
+}
+
+static void liberar_lote(EscritorArquivo *escritor, LoteEscrita *lote) {
+    escritor->num_lotes--;
+    munmap(lote->dados, TAM_LOTE_ESCRITA);
+    free(lote);
+}
+
+// Prepara o lote atual para receber dados a partir de 'posicao'. Ele vai só
+// até a próxima fronteira de TAM_LOTE_ESCRITA, para que os lotes seguintes
+// fiquem alinhados no arquivo.
+static void preparar_lote(EscritorArquivo *escritor, uint64_t posicao) {
+    LoteEscrita *lote = escritor->atual;
+    lote->tam = 0;
+    lote->posicao = posicao;
+    lote->capacidade = TAM_LOTE_ESCRITA - posicao % TAM_LOTE_ESCRITA;
+}
+
+// Grava 'num' lotes encadeados a partir de 'primeiro' (consecutivos também
+// no arquivo) com pwritev, repetindo enquanto a escrita for parcial
+static bool gravar_lotes(EscritorArquivo *escritor, int fd, LoteEscrita *primeiro, int num) {
+    struct iovec iov[LOTES_POR_CHAMADA];
+    LoteEscrita *lote = primeiro;
+    for (int i = 0; i < num; i++) {
+        iov[i].iov_base = lote->dados;
+        iov[i].iov_len = lote->tam;
+        lote = lote->proximo;
+    }
+    
+    uint64_t posicao = primeiro->posicao;
+    struct iovec *atual = iov;
+    int restantes = num;
+    
+    while (restantes > 0) {
+        ssize_t escritos = pwritev(fd, atual, restantes, posicao);
+        if (escritos < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erro ao gravar lote do arquivo");
+            return false;
+        }
+        escritor->chamadas++;
+        escritor->bytes += escritos;
+        posicao += escritos;
+        
+        // Pular os vetores já gravados e ajustar o que ficou pela metade
+        while (restantes > 0 && (size_t)escritos >= atual->iov_len) {
+            escritos -= atual->iov_len;
+            atual++;
+            restantes--;
+        }
+        if (restantes > 0) {
+            atual->iov_base = (unsigned char *)atual->iov_base + escritos;
+            atual->iov_len -= escritos;
+        }
+    }
+    
+    return true;
+}
+
+// Thread de escrita: grava os lotes da fila, até LOTES_POR_CHAMADA por vez,
+// e os devolve à lista de livres. Os que passam de NUM_LOTES_ESCRITA foram
+// reservados porque o disco atrasou e são liberados.
+static void *thread_escrita(void *arg) {
+    EscritorArquivo *escritor = arg;
+    
+    pthread_mutex_lock(&escritor->mutex);
+    while (true) {
+        while (escritor->fila == NULL && !escritor->encerrar) {
+            pthread_cond_wait(&escritor->cond_trabalho, &escritor->mutex);
+        }
+        if (escritor->fila == NULL) {
+            break;
+        }
+        
+        // Tirar da fila os lotes desta chamada: a recepção só acrescenta ao fim
+        LoteEscrita *primeiro = escritor->fila;
+        LoteEscrita *ultimo = primeiro;
+        int num = 1;
+        while (num < LOTES_POR_CHAMADA && ultimo->proximo != NULL) {
+            ultimo = ultimo->proximo;
+            num++;
+        }
+        escritor->fila = ultimo->proximo;
+        if (escritor->fila == NULL) {
+            escritor->fim_fila = NULL;
+        }
+        int fd = escritor->fd;
+        pthread_mutex_unlock(&escritor->mutex);
+        
+        bool ok = !__atomic_load_n(&escritor->erro, __ATOMIC_RELAXED) &&
+                  gravar_lotes(escritor, fd, primeiro, num);
+        uint64_t fim = ultimo->posicao + ultimo->tam;
+        
+        pthread_mutex_lock(&escritor->mutex);
+        if (ok) {
+            __atomic_store_n(&escritor->gravados, fim, __ATOMIC_RELEASE);
+        } else {
+            __atomic_store_n(&escritor->erro, true, __ATOMIC_RELAXED);
+        }
+        for (int i = 0; i < num; i++) {
+            LoteEscrita *lote = primeiro;
+            primeiro = primeiro->proximo;
+            if (escritor->num_lotes > NUM_LOTES_ESCRITA) {
+                liberar_lote(escritor, lote);
+            } else {
+                lote->proximo = escritor->livres;
+                escritor->livres = lote;
+            }
+        }
+        escritor->pendentes -= num;
+        pthread_cond_broadcast(&escritor->cond_livre);
+    }
+    pthread_mutex_unlock(&escritor->mutex);
+    
+    return NULL;
+}
+
+// Reserva os lotes e inicia a thread de escrita
+bool escritor_iniciar(EscritorArquivo *escritor) {
+    memset(escritor, 0, sizeof(*escritor));
+    escritor->fd = -1;
+    
+    for (int i = 0; i < NUM_LOTES_ESCRITA; i++) {
+        LoteEscrita *lote = reservar_lote(escritor);
+        if (lote == NULL) {
+            fprintf(stderr, "Sem memória para os lotes de escrita.\n");
+            escritor_finalizar(escritor);
+            return false;
+        }
+        lote->proximo = escritor->livres;
+        escritor->livres = lote;
+    }
+    escritor->atual = escritor->livres;
+    escritor->livres = escritor->atual->proximo;
+    
+    pthread_mutex_init(&escritor->mutex, NULL);
+    pthread_cond_init(&escritor->cond_trabalho, NULL);
+    pthread_cond_init(&escritor->cond_livre, NULL);
+    
+    if (pthread_create(&escritor->thread, NULL, thread_escrita, escritor) != 0) {
+        perror("Erro ao criar thread de escrita");
+        escritor_finalizar(escritor);
+        return false;
+    }
+    
+    // A gravação não deve tomar o processador da recepção: ela roda quando
+    // a recepção espera pela rede. Sem essa prioridade, só divide o tempo.
+    struct sched_param parametros = {0};
+    pthread_setschedparam(escritor->thread, SCHED_IDLE, &parametros);
+    return true;
+}
+
+// Passa a gravar em 'fd' a partir do byte 'inicio'. O espaço até 'tamanho'
+// é reservado com fallocate sem mudar o tamanho do arquivo: os blocos ficam
+// contíguos no disco e a falta de espaço aparece aqui, não no meio da
+// transferência. Chamada sem lotes pendentes.
+void escritor_abrir(EscritorArquivo *escritor, int fd, uint64_t inicio, uint64_t tamanho) {
+    if (tamanho > inicio && fallocate(fd, FALLOC_FL_KEEP_SIZE, inicio, tamanho - inicio) == -1 &&
+        errno != EOPNOTSUPP) {
+        perror("Aviso: não foi possível reservar espaço para o arquivo");
+    }
+    
+    pthread_mutex_lock(&escritor->mutex);
+    escritor->fd = fd;
+    escritor->erro = false;
+    __atomic_store_n(&escritor->gravados, inicio, __ATOMIC_RELEASE);
+    preparar_lote(escritor, inicio);
+    pthread_mutex_unlock(&escritor->mutex);
+}
+
+// Entrega o lote atual à thread de escrita. Chamada com o mutex.
+static void enfileirar_lote(EscritorArquivo *escritor) {
+    LoteEscrita *lote = escritor->atual;
+    lote->proximo = NULL;
+    if (escritor->fim_fila != NULL) {
+        escritor->fim_fila->proximo = lote;
+    } else {
+        escritor->fila = lote;
+    }
+    escritor->fim_fila = lote;
+    escritor->pendentes++;
+    pthread_cond_signal(&escritor->cond_trabalho);
+}
+
+// Entrega o lote atual e pega outro para continuar dali: um livre, um novo
+// enquanto não houver MAX_LOTES_ESCRITA, ou o primeiro que for gravado.
+// Chamada com o mutex.
+static void trocar_lote(EscritorArquivo *escritor) {
+    uint64_t proxima = escritor->atual->posicao + escritor->atual->tam;
+    enfileirar_lote(escritor);
+    
+    if (escritor->livres == NULL && escritor->num_lotes < MAX_LOTES_ESCRITA) {
+        escritor->livres = reservar_lote(escritor);
+    }
+    if (escritor->livres == NULL) {
+        escritor->esperas++;
+        while (escritor->livres == NULL) {
+            pthread_cond_wait(&escritor->cond_livre, &escritor->mutex);
+        }
+    }
+    escritor->atual = escritor->livres;
+    escritor->livres = escritor->atual->proximo;
+    preparar_lote(escritor, proxima);
+}
+
+// Acrescenta dados ao fim do arquivo. Retorna false se uma escrita anterior
+// falhou: o erro só aparece na chamada seguinte.
+bool escritor_escrever(EscritorArquivo *escritor, const unsigned char *dados, size_t tam) {
+    if (__atomic_load_n(&escritor->erro, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    
+    while (tam > 0) {
+        // O lote cheio só é trocado quando chegam mais dados: assim o último
+        // lote de uma rajada não espera por um livre
+        if (escritor->atual->tam == escritor->atual->capacidade) {
+            pthread_mutex_lock(&escritor->mutex);
+            trocar_lote(escritor);
+            pthread_mutex_unlock(&escritor->mutex);
+        }
+        
+        // Só a recepção mexe no lote atual: o mutex fica para a troca de lote
+        LoteEscrita *lote = escritor->atual;
+        size_t copiar = lote->capacidade - lote->tam;
+        if (copiar > tam) {
+            copiar = tam;
+        }
+        memcpy(lote->dados + lote->tam, dados, copiar);
+        lote->tam += copiar;
+        dados += copiar;
+        tam -= copiar;
+    }
+    
+    return true;
+}
+
+// Grava o que faltar, inclusive o lote incompleto, e espera a fila esvaziar.
+// Retorna false se alguma escrita falhou.
+bool escritor_concluir(EscritorArquivo *escritor) {
+    pthread_mutex_lock(&escritor->mutex);
+    bool entregue = escritor->atual->tam > 0;
+    if (entregue) {
+        enfileirar_lote(escritor);
+    }
+    while (escritor->pendentes > 0) {
+        pthread_cond_wait(&escritor->cond_livre, &escritor->mutex);
+    }
+    
+    // Com a fila vazia, todos os lotes que restaram estão livres
+    if (entregue) {
+        escritor->atual = escritor->livres;
+        escritor->livres = escritor->atual->proximo;
+        preparar_lote(escritor, 0);
+    }
+    bool ok = !escritor->erro;
+    escritor->fd = -1;
+    pthread_mutex_unlock(&escritor->mutex);
+    
+    return ok;
+}
+
+// Bytes do arquivo já gravados, contínuos desde o início. Não usa o mutex.
+uint64_t escritor_gravados(EscritorArquivo *escritor) {
+    return __atomic_load_n(&escritor->gravados, __ATOMIC_ACQUIRE);
+}
+
+// Para a thread de escrita (depois de gravar a fila) e libera os lotes
+void escritor_finalizar(EscritorArquivo *escritor) {
+    if (escritor->thread) {
+        pthread_mutex_lock(&escritor->mutex);
+        escritor->encerrar = true;
+        pthread_cond_signal(&escritor->cond_trabalho);
+        pthread_mutex_unlock(&escritor->mutex);
+        pthread_join(escritor->thread, NULL);
+        escritor->thread = 0;
+    }
+    
+    if (escritor->atual != NULL) {
+        liberar_lote(escritor, escritor->atual);
+        escritor->atual = NULL;
+    }
+    while (escritor->livres != NULL) {
+        LoteEscrita *lote = escritor->livres;
+        escritor->livres = lote->proximo;
+        liberar_lote(escritor, lote);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef TREASURE_ESCRITA_H
+#define TREASURE_ESCRITA_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Escrita do arquivo recebido fora da thread de recepção. Os chunks são
+// copiados para lotes grandes, alinhados às fronteiras de TAM_LOTE_ESCRITA
+// no arquivo; uma thread própria, de prioridade ociosa, grava os lotes
+// cheios com pwritev, juntando os consecutivos em uma chamada. A entrega de
+// um lote não espera pelo disco: sem lote livre, a recepção reserva outro,
+// e só espera quando já há MAX_LOTES_ESCRITA lotes na fila.
+#define TAM_LOTE_ESCRITA (256 * 1024)
+#define NUM_LOTES_ESCRITA 8           // Reservados de início e mantidos para reuso
+#define MAX_LOTES_ESCRITA 256         // 64 MiB à espera do disco, no máximo
+#define LOTES_POR_CHAMADA 8           // Por chamada a pwritev: a thread ociosa não prende o processador no kernel
+
+typedef struct LoteEscrita {
+    unsigned char *dados;             // TAM_LOTE_ESCRITA bytes, mapeados com mmap
+    size_t tam;                       // Bytes preenchidos
+    size_t capacidade;                // Até a próxima fronteira de lote no arquivo
+    uint64_t posicao;                 // Byte do arquivo em que o lote começa
+    struct LoteEscrita *proximo;      // Seguinte na fila ou na lista de livres
+} LoteEscrita;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_trabalho;     // Há lotes cheios (ou a thread deve parar)
+    pthread_cond_t cond_livre;        // Um lote foi gravado
+    LoteEscrita *fila;                // Lotes cheios, do mais antigo ao mais novo
+    LoteEscrita *fim_fila;
+    LoteEscrita *livres;              // Lotes já gravados, prontos para reuso
+    LoteEscrita *atual;               // Lote em preenchimento, só a recepção mexe
+    int pendentes;                    // Lotes cheios ainda não gravados (na fila ou sendo gravados)
+    int num_lotes;                    // Lotes reservados ao todo
+    int fd;                           // -1: nenhum arquivo aberto
+    uint64_t gravados;                // Bytes do arquivo já entregues ao kernel
+    bool erro;
+    bool encerrar;
+    
+    // Estatísticas
+    unsigned long chamadas;           // Chamadas a pwritev
+    unsigned long long bytes;
+    unsigned long esperas;            // Vezes em que a recepção esperou um lote livre
+    int pico_lotes;                   // Maior número de lotes reservados ao mesmo tempo
+} EscritorArquivo;
+
+bool escritor_iniciar(EscritorArquivo *escritor);
+void escritor_abrir(EscritorArquivo *escritor, int fd, uint64_t inicio, uint64_t tamanho);
+bool escritor_escrever(EscritorArquivo *escritor, const unsigned char *dados, size_t tam);
+bool escritor_concluir(EscritorArquivo *escritor);
+uint64_t escritor_gravados(EscritorArquivo *escritor);
+void escritor_finalizar(EscritorArquivo *escritor);
+
+#endif // TREASURE_ESCRITA_H
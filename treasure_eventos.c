@@ -0,0 +1,48 @@
+#include "treasure_eventos.h"
+#include <string.h>
+
+// Prepara um anel vazio que acorda 'notificador' ao receber eventos
+void anel_eventos_iniciar(AnelEventos *anel, FonteEvento *notificador) {
+    memset(anel, 0, sizeof(*anel));
+    anel->notificador = notificador;
+}
+
+// Publica um evento (só o produtor). Nunca espera: com o anel cheio o evento
+// é descartado e contado, e a função retorna false.
+bool anel_eventos_publicar(AnelEventos *anel, const EventoJogo *evento) {
+    size_t escrita = anel->escrita;
+    size_t leitura = __atomic_load_n(&anel->leitura, __ATOMIC_ACQUIRE);
+    if (escrita - leitura == CAPACIDADE_ANEL_EVENTOS) {
+        __atomic_add_fetch(&anel->descartados, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    
+    anel->eventos[escrita % CAPACIDADE_ANEL_EVENTOS] = *evento;
+    __atomic_store_n(&anel->escrita, escrita + 1, __ATOMIC_SEQ_CST);
+    
+    // Só o primeiro evento depois de o anel esvaziar acorda o consumidor: ele
+    // consome até ver o anel vazio, e um dos dois lados sempre vê o índice
+    // do outro já atualizado
+    if (__atomic_load_n(&anel->leitura, __ATOMIC_SEQ_CST) == escrita) {
+        reator_notificar(anel->notificador);
+    }
+    return true;
+}
+
+// Retira o evento mais antigo (só o consumidor). Retorna false se o anel
+// estiver vazio.
+bool anel_eventos_consumir(AnelEventos *anel, EventoJogo *evento) {
+    size_t leitura = anel->leitura;
+    if (leitura == __atomic_load_n(&anel->escrita, __ATOMIC_SEQ_CST)) {
+        return false;
+    }
+    
+    *evento = anel->eventos[leitura % CAPACIDADE_ANEL_EVENTOS];
+    __atomic_store_n(&anel->leitura, leitura + 1, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+// Eventos perdidos por falta de espaço até agora
+unsigned long anel_eventos_descartados(AnelEventos *anel) {
+    return __atomic_load_n(&anel->descartados, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,55 @@
+#ifndef TREASURE_EVENTOS_H
+#define TREASURE_EVENTOS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "treasure_protocol.h"
+#include "treasure_mundo.h"
+#include "treasure_reactor.h"
+
+// Eventos do jogo publicados pela thread de recepção para a thread da tela,
+// em um anel sem travas com um produtor e um consumidor. A tela mantém a sua
+// própria cópia do que mostra e só a altera pelos eventos: a rede nunca
+// espera pelo desenho. O consumidor é acordado pelo eventfd de um
+// notificador do reator, apenas quando o anel deixa de estar vazio.
+#define CAPACIDADE_ANEL_EVENTOS 1024   // Potência de 2
+
+typedef enum {
+    EVENTO_JOGADOR_NOVO,      // Sessão criada, com o mundo dos seus tesouros (servidor)
+    EVENTO_JOGADOR_SAIU,      // Sessão encerrada (servidor)
+    EVENTO_MOVIMENTO,         // Movimento aplicado: posição (servidor) ou direção (cliente)
+    EVENTO_TESOURO,           // Tesouro encontrado ('ok') ou devolvido ao jogo
+    EVENTO_PROGRESSO,         // Bytes do tesouro já transferidos
+    EVENTO_ATUALIZAR,         // Só redesenhar (mensagens, fim da negociação)
+    EVENTO_GRID               // Dimensões do grid informadas pelo servidor (cliente)
+} TipoEvento;
+
+typedef struct {
+    uint8_t tipo;
+    bool ok;
+    unsigned char mac[6];     // Jogador (no cliente, não é usado)
+    Posicao pos;
+    int direcao;
+    int tesouro;              // Índice do tesouro (-1: o da posição do jogador)
+    uint64_t bytes;
+    uint64_t total;
+    char nome[TAM_MAX_NOME];  // Arquivo do tesouro recebido (cliente)
+    MundoJogo *mundo;         // Só em EVENTO_JOGADOR_NOVO e EVENTO_GRID: uma referência para a tela
+} EventoJogo;
+
+// Os índices ficam em linhas de cache separadas: cada lado só escreve o seu
+typedef struct {
+    EventoJogo eventos[CAPACIDADE_ANEL_EVENTOS];
+    size_t escrita __attribute__((aligned(64))); // Só o produtor escreve
+    FonteEvento *notificador;
+    unsigned long descartados;                   // Publicações com o anel cheio
+    size_t leitura __attribute__((aligned(64))); // Só o consumidor escreve
+} AnelEventos;
+
+void anel_eventos_iniciar(AnelEventos *anel, FonteEvento *notificador);
+bool anel_eventos_publicar(AnelEventos *anel, const EventoJogo *evento);
+bool anel_eventos_consumir(AnelEventos *anel, EventoJogo *evento);
+unsigned long anel_eventos_descartados(AnelEventos *anel);
+
+#endif // TREASURE_EVENTOS_H
@@ -0,0 +1,280 @@
+#include "treasure_fec.h"
+#include <pthread.h>
+#include <string.h>
+
+// Aritmética em GF(2^8) com o polinômio x^8 + x^4 + x^3 + x^2 + 1 (0x11D):
+// soma é XOR e o produto usa tabelas de logaritmos com gerador 2
+static unsigned char gf_exp[512];
+static unsigned char gf_log[256];
+static pthread_once_t tabelas_uma_vez = PTHREAD_ONCE_INIT;
+
+// Monta as tabelas de logaritmos
+static void montar_tabelas() {
+    int valor = 1;
+    for (int i = 0; i < 255; i++) {
+        gf_exp[i] = valor;
+        gf_log[valor] = i;
+        valor <<= 1;
+        if (valor & 0x100) {
+            valor ^= 0x11D;
+        }
+    }
+    
+    // Expoentes repetidos: a soma de dois logaritmos dispensa o módulo 255
+    for (int i = 255; i < 512; i++) {
+        gf_exp[i] = gf_exp[i - 255];
+    }
+}
+
+// Monta as tabelas na primeira chamada, mesmo com várias threads codificando
+static void preparar_tabelas() {
+    pthread_once(&tabelas_uma_vez, montar_tabelas);
+}
+
+static unsigned char gf_mul(unsigned char a, unsigned char b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static unsigned char gf_inv(unsigned char a) {
+    return gf_exp[255 - gf_log[a]];
+}
+
+// Coeficiente do chunk 'posicao' na linha de paridade 'linha'. Uma única
+// paridade é o XOR simples; com mais de uma, a matriz de Cauchy
+// 1 / (x_linha + y_posicao), cujas submatrizes quadradas são todas
+// inversíveis: quaisquer M paridades recuperam quaisquer M chunks.
+static unsigned char coeficiente(int num_paridades, int linha, int posicao) {
+    if (num_paridades == 1) {
+        return 1;
+    }
+    return gf_inv(linha ^ (MAX_PARIDADE_FEC + posicao));
+}
+
+// destino += coef * origem, byte a byte
+static void somar_multiplo(unsigned char *destino, const unsigned char *origem, int tam,
+                           unsigned char coef) {
+    if (coef == 0) {
+        return;
+    }
+    
+    if (coef == 1) {
+        for (int i = 0; i < tam; i++) {
+            destino[i] ^= origem[i];
+        }
+        return;
+    }
+    
+    // Tabela do produto por 'coef', amortizada sobre o chunk inteiro
+    unsigned char produto[256];
+    produto[0] = 0;
+    for (int v = 1; v < 256; v++) {
+        produto[v] = gf_exp[gf_log[coef] + gf_log[v]];
+    }
+    
+    for (int i = 0; i < tam; i++) {
+        destino[i] ^= produto[origem[i]];
+    }
+}
+
+// Soma ao símbolo 'destino' o chunk (tamanho e dados) multiplicado por 'coef'
+static void somar_chunk(unsigned char *destino, const unsigned char *dados, int tam_dados,
+                        unsigned char coef) {
+    unsigned char tamanho[2] = { (tam_dados >> 8) & 0xFF, tam_dados & 0xFF };
+    somar_multiplo(destino, tamanho, 2, coef);
+    somar_multiplo(destino + 2, dados, tam_dados, coef);
+}
+
+// Calcula o símbolo de paridade da 'linha' para um bloco de chunks.
+// Retorna o tamanho do símbolo (2 + maior chunk do bloco).
+int fec_codificar(unsigned char *paridade, int linha, int num_paridades,
+                  unsigned char *const *dados, const int *tamanhos, int num_chunks) {
+    preparar_tabelas();
+    
+    int maior = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        if (tamanhos[i] > maior) {
+            maior = tamanhos[i];
+        }
+    }
+    
+    int tam_simbolo = TAM_SIMBOLO_FEC(maior);
+    memset(paridade, 0, tam_simbolo);
+    
+    for (int i = 0; i < num_chunks; i++) {
+        somar_chunk(paridade, dados[i], tamanhos[i], coeficiente(num_paridades, linha, i));
+    }
+    
+    return tam_simbolo;
+}
+
+// Aumenta o símbolo do bloco: a parte nova dos acumulados começa zerada,
+// como o preenchimento dos chunks menores
+static void ampliar_simbolo(BlocoFEC *bloco, int num_paridades, int tam_simbolo) {
+    if (tam_simbolo <= bloco->tam_simbolo) {
+        return;
+    }
+    
+    for (int linha = 0; linha < num_paridades; linha++) {
+        memset(bloco->acumulado[linha] + bloco->tam_simbolo, 0, tam_simbolo - bloco->tam_simbolo);
+    }
+    bloco->tam_simbolo = tam_simbolo;
+}
+
+// Soma um chunk recebido aos acumulados do bloco (uma vez por chunk)
+void fec_acumular(BlocoFEC *bloco, int num_paridades, int posicao,
+                  const unsigned char *dados, int tam_dados) {
+    if (bloco->recebidos & (1ULL << posicao)) {
+        return;
+    }
+    
+    preparar_tabelas();
+    bloco->recebidos |= 1ULL << posicao;
+    ampliar_simbolo(bloco, num_paridades, TAM_SIMBOLO_FEC(tam_dados));
+    
+    for (int linha = 0; linha < num_paridades; linha++) {
+        somar_chunk(bloco->acumulado[linha], dados, tam_dados,
+                    coeficiente(num_paridades, linha, posicao));
+    }
+}
+
+// Guarda o símbolo de paridade de uma linha, recebido no quadro TIPO_PARIDADE.
+// Todas as paridades do bloco têm o tamanho do seu maior chunk.
+void fec_guardar_paridade(BlocoFEC *bloco, int num_paridades, int linha, int num_chunks,
+                          const unsigned char *simbolo, int tam_simbolo) {
+    if (bloco->paridades & (1 << linha)) {
+        return;
+    }
+    
+    ampliar_simbolo(bloco, num_paridades, tam_simbolo);
+    bloco->paridades |= 1 << linha;
+    bloco->num_chunks = num_chunks;
+    memcpy(bloco->paridade[linha], simbolo, tam_simbolo);
+}
+
+// Inverte a matriz e x e em GF(2^8) por Gauss-Jordan. As submatrizes de
+// Cauchy são sempre inversíveis, mas a verificação protege contra
+// paridades corrompidas de outra configuração.
+static bool inverter_matriz(unsigned char matriz[][MAX_PARIDADE_FEC],
+                            unsigned char inversa[][MAX_PARIDADE_FEC], int e) {
+    for (int i = 0; i < e; i++) {
+        for (int j = 0; j < e; j++) {
+            inversa[i][j] = (i == j);
+        }
+    }
+    
+    for (int coluna = 0; coluna < e; coluna++) {
+        int pivo = coluna;
+        while (pivo < e && matriz[pivo][coluna] == 0) {
+            pivo++;
+        }
+        if (pivo == e) {
+            return false;
+        }
+        
+        for (int j = 0; j < e; j++) {
+            unsigned char temp = matriz[coluna][j];
+            matriz[coluna][j] = matriz[pivo][j];
+            matriz[pivo][j] = temp;
+            temp = inversa[coluna][j];
+            inversa[coluna][j] = inversa[pivo][j];
+            inversa[pivo][j] = temp;
+        }
+        
+        unsigned char fator = gf_inv(matriz[coluna][coluna]);
+        for (int j = 0; j < e; j++) {
+            matriz[coluna][j] = gf_mul(matriz[coluna][j], fator);
+            inversa[coluna][j] = gf_mul(inversa[coluna][j], fator);
+        }
+        
+        for (int i = 0; i < e; i++) {
+            if (i == coluna || matriz[i][coluna] == 0) {
+                continue;
+            }
+            unsigned char multiplo = matriz[i][coluna];
+            for (int j = 0; j < e; j++) {
+                matriz[i][j] ^= gf_mul(multiplo, matriz[coluna][j]);
+                inversa[i][j] ^= gf_mul(multiplo, inversa[coluna][j]);
+            }
+        }
+    }
+    
+    return true;
+}
+
+// Reconstrói os chunks que faltam no bloco quando há paridades suficientes
+// (tantas quanto os chunks perdidos). Retorna quantos foram recuperados; os
+// dados ficam nos buffers do bloco até a próxima chamada sobre ele.
+int fec_recuperar(BlocoFEC *bloco, int num_paridades, ChunkRecuperado *recuperados) {
+    if (bloco->num_chunks == 0) {
+        return 0;
+    }
+    
+    int faltando[MAX_PARIDADE_FEC];
+    int linhas[MAX_PARIDADE_FEC];
+    int num_faltando = 0;
+    int num_linhas = 0;
+    
+    for (int i = 0; i < bloco->num_chunks; i++) {
+        if (!(bloco->recebidos & (1ULL << i))) {
+            if (num_faltando == num_paridades) {
+                return 0; // Perdas demais para este bloco
+            }
+            faltando[num_faltando++] = i;
+        }
+    }
+    
+    for (int linha = 0; linha < num_paridades && num_linhas < num_faltando; linha++) {
+        if (bloco->paridades & (1 << linha)) {
+            linhas[num_linhas++] = linha;
+        }
+    }
+    
+    if (num_faltando == 0 || num_linhas < num_faltando) {
+        return 0;
+    }
+    
+    preparar_tabelas();
+    
+    // Sistema: paridade - acumulado = soma dos chunks perdidos com seus
+    // coeficientes; o resíduo substitui a paridade
+    unsigned char matriz[MAX_PARIDADE_FEC][MAX_PARIDADE_FEC];
+    unsigned char inversa[MAX_PARIDADE_FEC][MAX_PARIDADE_FEC];
+    
+    for (int r = 0; r < num_linhas; r++) {
+        somar_multiplo(bloco->paridade[linhas[r]], bloco->acumulado[linhas[r]], bloco->tam_simbolo, 1);
+        for (int k = 0; k < num_faltando; k++) {
+            matriz[r][k] = coeficiente(num_paridades, linhas[r], faltando[k]);
+        }
+    }
+    
+    if (!inverter_matriz(matriz, inversa, num_faltando)) {
+        return 0;
+    }
+    
+    // Os acumulados não são mais necessários: recebem os chunks recuperados
+    int num_recuperados = 0;
+    for (int k = 0; k < num_faltando; k++) {
+        unsigned char *simbolo = bloco->acumulado[k];
+        memset(simbolo, 0, bloco->tam_simbolo);
+        for (int r = 0; r < num_linhas; r++) {
+            somar_multiplo(simbolo, bloco->paridade[linhas[r]], bloco->tam_simbolo, inversa[k][r]);
+        }
+        
+        bloco->recebidos |= 1ULL << faltando[k];
+        
+        int tam_dados = (simbolo[0] << 8) | simbolo[1];
+        if (tam_dados == 0 || TAM_SIMBOLO_FEC(tam_dados) > bloco->tam_simbolo) {
+            continue; // Paridade inconsistente: o ARQ cuida deste chunk
+        }
+        
+        recuperados[num_recuperados].indice = bloco->inicio + faltando[k];
+        recuperados[num_recuperados].dados = simbolo + 2;
+        recuperados[num_recuperados].tam_dados = tam_dados;
+        num_recuperados++;
+    }
+    
+    return num_recuperados;
+}
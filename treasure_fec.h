@@ -0,0 +1,53 @@
+#ifndef TREASURE_FEC_H
+#define TREASURE_FEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "treasure_protocol.h"
+
+// Correção de erros adiante (FEC) sobre os chunks de dados: a cada bloco de
+// até K chunks o servidor envia M quadros de paridade. Com M = 1 a paridade é
+// o XOR dos chunks; com M > 1 é um código Reed-Solomon sistemático (matriz de
+// Cauchy sobre GF(2^8)), que recupera até M chunks perdidos por bloco.
+//
+// Cada chunk entra no código como um símbolo [tamanho (16 bits)][dados],
+// completado com zeros até o maior chunk do bloco. O quadro de paridade
+// (TIPO_PARIDADE) leva um cabeçalho e o símbolo de paridade:
+// [seq do primeiro chunk (16 bits)][chunks no bloco][M][linha][símbolo]
+#define MAX_BLOCO_FEC 64       // Maior K (chunks por bloco)
+#define MAX_PARIDADE_FEC 4     // Maior M (quadros de paridade por bloco)
+#define TAM_CABECALHO_FEC 5    // Cabeçalho do quadro de paridade
+#define TAM_SIMBOLO_FEC(tam) (2 + (tam)) // Símbolo de um chunk com 'tam' bytes
+#define TAM_MAX_SIMBOLO_FEC TAM_SIMBOLO_FEC(TAM_MAX_DADOS_EXT)
+#define REDUCAO_CHUNK_FEC (TAM_CABECALHO_FEC + 2) // Bytes a menos em cada chunk com FEC
+#define BLOCOS_FEC_ABERTOS 32  // Blocos acompanhados ao mesmo tempo pelo receptor
+
+// Estado de um bloco no receptor: o acumulado de cada linha é a soma dos
+// chunks já recebidos, de modo que os dados não precisam ser guardados
+typedef struct {
+    bool ativo;
+    uint64_t inicio;                  // Índice do primeiro chunk na transferência
+    int num_chunks;                   // Conhecido ao chegar a primeira paridade (0 antes)
+    uint64_t recebidos;               // Bit i: chunk inicio+i chegou
+    unsigned char paridades;          // Bit j: paridade da linha j chegou
+    int tam_simbolo;
+    unsigned char acumulado[MAX_PARIDADE_FEC][TAM_MAX_SIMBOLO_FEC];
+    unsigned char paridade[MAX_PARIDADE_FEC][TAM_MAX_SIMBOLO_FEC];
+} BlocoFEC;
+
+// Chunk reconstruído a partir das paridades
+typedef struct {
+    uint64_t indice;                  // Índice do chunk na transferência
+    unsigned char *dados;             // Aponta para dentro do BlocoFEC
+    int tam_dados;
+} ChunkRecuperado;
+
+int fec_codificar(unsigned char *paridade, int linha, int num_paridades,
+                  unsigned char *const *dados, const int *tamanhos, int num_chunks);
+void fec_acumular(BlocoFEC *bloco, int num_paridades, int posicao,
+                  const unsigned char *dados, int tam_dados);
+void fec_guardar_paridade(BlocoFEC *bloco, int num_paridades, int linha, int num_chunks,
+                          const unsigned char *simbolo, int tam_simbolo);
+int fec_recuperar(BlocoFEC *bloco, int num_paridades, ChunkRecuperado *recuperados);
+
+#endif // TREASURE_FEC_H
@@ -0,0 +1,537 @@
+#include "treasure_mundo.h"
+
+#define BLOCO_VAZIO UINT32_MAX        // Os blocos usam no máximo 26 bits
+#define CAPACIDADE_MINIMA_PLANO 16
+#define BYTES_MAPA_POR_TESOURO 64     // Sorteio com um bit por célula até esse custo
+#define BITS_DIGITO_RADIX 12          // Dígito de cada passada na ordenação do índice
+
+// Intercala os 16 bits de 'v' com zeros (bit i vai para o bit 2i)
+static uint32_t espalhar_bits(uint32_t v) {
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// Código Morton da célula: os bits de x e y intercalados. Células próximas
+// têm códigos próximos, e os 6 bits mais baixos são a célula no bloco 8x8.
+uint32_t codigo_morton(int x, int y) {
+    return espalhar_bits(x) | (espalhar_bits(y) << 1);
+}
+
+// Posição inicial do bloco na tabela (finalizador do MurmurHash3)
+static uint32_t espalhar_bloco(uint32_t bloco) {
+    bloco ^= bloco >> 16;
+    bloco *= 0x85EBCA6B;
+    bloco ^= bloco >> 13;
+    bloco *= 0xC2B2AE35;
+    bloco ^= bloco >> 16;
+    return bloco;
+}
+
+// Entrada do bloco na tabela, ou a entrada livre onde ele ficaria
+static BlocoPlano *buscar_bloco(const PlanoGrid *plano, uint32_t bloco) {
+    uint32_t mascara = plano->capacidade - 1;
+    uint32_t i = espalhar_bloco(bloco) & mascara;
+    while (plano->blocos[i].bloco != bloco && plano->blocos[i].bloco != BLOCO_VAZIO) {
+        i = (i + 1) & mascara;
+    }
+    return &plano->blocos[i];
+}
+
+// Dobra a tabela e reinsere os blocos
+static bool crescer_plano(PlanoGrid *plano) {
+    uint32_t capacidade = plano->capacidade ? plano->capacidade * 2 : CAPACIDADE_MINIMA_PLANO;
+    BlocoPlano *blocos = malloc(capacidade * sizeof(BlocoPlano));
+    if (blocos == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < capacidade; i++) {
+        blocos[i].bloco = BLOCO_VAZIO;
+    }
+    
+    PlanoGrid novo = {.blocos = blocos, .capacidade = capacidade,
+                      .usados = plano->usados, .marcadas = plano->marcadas};
+    for (uint32_t i = 0; i < plano->capacidade; i++) {
+        if (plano->blocos[i].bloco != BLOCO_VAZIO) {
+            *buscar_bloco(&novo, plano->blocos[i].bloco) = plano->blocos[i];
+        }
+    }
+    
+    free(plano->blocos);
+    *plano = novo;
+    return true;
+}
+
+// Indica se o grid cabe nos planos densos e no mapa de células
+static bool grid_denso(int largura, int altura) {
+    return (long long)largura * altura <= AREA_MAXIMA_DENSA;
+}
+
+// Prepara um plano vazio para o grid: denso nos grids pequenos, esparso nos
+// demais. Retorna false se faltar memória.
+bool plano_iniciar(PlanoGrid *plano, int largura, int altura) {
+    memset(plano, 0, sizeof(*plano));
+    if (!grid_denso(largura, altura)) {
+        return true;
+    }
+    plano->palavras = calloc(((size_t)largura * altura + 63) / 64, sizeof(uint64_t));
+    plano->largura = largura;
+    return plano->palavras != NULL;
+}
+
+// Teste de uma célula no plano esparso (plano_testar trata o denso)
+bool plano_testar_esparso(const PlanoGrid *plano, int x, int y) {
+    if (plano->capacidade == 0) {
+        return false;
+    }
+    uint32_t codigo = codigo_morton(x, y);
+    const BlocoPlano *entrada = buscar_bloco(plano, codigo >> 6);
+    return entrada->bloco != BLOCO_VAZIO && ((entrada->bits >> (codigo & 63)) & 1);
+}
+
+// Marca ou desmarca a célula. Retorna false se faltar memória para o bloco.
+bool plano_marcar(PlanoGrid *plano, int x, int y, bool valor) {
+    if (plano->palavras != NULL) {
+        int celula = y * plano->largura + x;
+        uint64_t bit = (uint64_t)1 << (celula % 64);
+        bool antes = (plano->palavras[celula / 64] & bit) != 0;
+        if (valor) {
+            plano->palavras[celula / 64] |= bit;
+        } else {
+            plano->palavras[celula / 64] &= ~bit;
+        }
+        plano->marcadas += (int)valor - (int)antes;
+        return true;
+    }
+    
+    uint32_t codigo = codigo_morton(x, y);
+    uint64_t bit = (uint64_t)1 << (codigo & 63);
+    
+    BlocoPlano *entrada = (plano->capacidade > 0) ? buscar_bloco(plano, codigo >> 6) : NULL;
+    if (entrada == NULL || entrada->bloco == BLOCO_VAZIO) {
+        if (!valor) {
+            return true;
+        }
+        
+        // Carga máxima de 1/2: as buscas continuam curtas
+        if ((plano->usados + 1) * 2 > plano->capacidade && !crescer_plano(plano)) {
+            return false;
+        }
+        entrada = buscar_bloco(plano, codigo >> 6);
+        entrada->bloco = codigo >> 6;
+        entrada->bits = 0;
+        plano->usados++;
+    }
+    
+    bool antes = (entrada->bits & bit) != 0;
+    if (valor) {
+        entrada->bits |= bit;
+    } else {
+        entrada->bits &= ~bit;
+    }
+    plano->marcadas += (int)valor - (int)antes;
+    return true;
+}
+
+void plano_liberar(PlanoGrid *plano) {
+    free(plano->palavras);
+    free(plano->blocos);
+    memset(plano, 0, sizeof(*plano));
+}
+
+// Passo do splitmix64: espalha uma semente qualquer (até 0) por 64 bits
+static uint64_t splitmix64(uint64_t *estado) {
+    uint64_t z = (*estado += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotacionar(uint64_t v, int bits) {
+    return (v << bits) | (v >> (64 - bits));
+}
+
+// Prepara o gerador a partir de uma semente de 64 bits
+void gerador_semear(GeradorAleatorio *gerador, uint64_t semente) {
+    for (int i = 0; i < 4; i++) {
+        gerador->s[i] = splitmix64(&semente);
+    }
+}
+
+// Próximo número de 64 bits (xoshiro256**)
+uint64_t gerador_proximo(GeradorAleatorio *gerador) {
+    uint64_t *s = gerador->s;
+    uint64_t resultado = rotacionar(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotacionar(s[3], 45);
+    return resultado;
+}
+
+// Número uniforme em [0, limite), sem o viés do módulo: multiplica e fica
+// com a parte alta, rejeitando só a pequena faixa que sobraria (Lemire)
+uint64_t gerador_abaixo(GeradorAleatorio *gerador, uint64_t limite) {
+    __uint128_t produto = (__uint128_t)gerador_proximo(gerador) * limite;
+    uint64_t baixo = (uint64_t)produto;
+    if (baixo < limite) {
+        uint64_t minimo = -limite % limite;
+        while (baixo < minimo) {
+            produto = (__uint128_t)gerador_proximo(gerador) * limite;
+            baixo = (uint64_t)produto;
+        }
+    }
+    return (uint64_t)(produto >> 64);
+}
+
+// Semente derivada de outra e de um valor (o MAC de um jogador, por
+// exemplo): a mesma entrada dá sempre a mesma semente
+uint64_t derivar_semente(uint64_t semente, uint64_t valor) {
+    uint64_t estado = semente ^ splitmix64(&valor);
+    return splitmix64(&estado);
+}
+
+// Células já sorteadas: um bit por célula quando o mapa cabe em
+// BYTES_MAPA_POR_TESOURO bytes por tesouro, ou um plano esparso, já com
+// espaço para todos, nos grids enormes
+typedef struct {
+    uint8_t *mapa;
+    PlanoGrid plano;
+    int largura;
+} CelulasSorteadas;
+
+static bool iniciar_sorteadas(CelulasSorteadas *sorteadas, int largura, uint64_t celulas, int num_tesouros) {
+    memset(sorteadas, 0, sizeof(*sorteadas));
+    sorteadas->largura = largura;
+    if (celulas / 8 <= (uint64_t)BYTES_MAPA_POR_TESOURO * (num_tesouros + CAPACIDADE_MINIMA_PLANO)) {
+        sorteadas->mapa = calloc(celulas / 8 + 1, 1);
+        return sorteadas->mapa != NULL;
+    }
+    while (sorteadas->plano.capacidade / 2 < (uint32_t)num_tesouros) {
+        if (!crescer_plano(&sorteadas->plano)) {
+            plano_liberar(&sorteadas->plano);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Marca a célula e retorna se ela já estava marcada
+static bool marcar_sorteada(CelulasSorteadas *sorteadas, uint64_t celula) {
+    if (sorteadas->mapa != NULL) {
+        uint8_t bit = 1 << (celula & 7);
+        bool antes = (sorteadas->mapa[celula >> 3] & bit) != 0;
+        sorteadas->mapa[celula >> 3] |= bit;
+        return antes;
+    }
+    int x = celula % sorteadas->largura;
+    int y = celula / sorteadas->largura;
+    bool antes = plano_testar(&sorteadas->plano, x, y);
+    plano_marcar(&sorteadas->plano, x, y, true); // Reservado: não falha
+    return antes;
+}
+
+static void liberar_sorteadas(CelulasSorteadas *sorteadas) {
+    free(sorteadas->mapa);
+    plano_liberar(&sorteadas->plano);
+}
+
+// Ordena o índice pelo código da célula: radix sort de BITS_DIGITO_RADIX
+// bits por passada, só nos dígitos que os códigos usam (duas passadas até
+// 4096x4096). Linear no número de tesouros, ao
+// contrário do qsort, que dominava o sorteio de mundos grandes.
+static bool ordenar_indice(EntradaIndice *indice, int n, uint32_t maior_codigo) {
+    EntradaIndice *auxiliar = malloc((n + 1) * sizeof(EntradaIndice));
+    if (auxiliar == NULL) {
+        return false;
+    }
+    
+    EntradaIndice *origem = indice;
+    EntradaIndice *destino = auxiliar;
+    uint32_t mascara = (1u << BITS_DIGITO_RADIX) - 1;
+    for (int deslocamento = 0; deslocamento < 32 && (maior_codigo >> deslocamento) != 0; 
+         deslocamento += BITS_DIGITO_RADIX) {
+        int contagem[(1 << BITS_DIGITO_RADIX) + 1] = {0};
+        for (int i = 0; i < n; i++) {
+            contagem[((origem[i].codigo >> deslocamento) & mascara) + 1]++;
+        }
+        for (uint32_t d = 0; d < mascara + 1; d++) {
+            contagem[d + 1] += contagem[d];
+        }
+        for (int i = 0; i < n; i++) {
+            destino[contagem[(origem[i].codigo >> deslocamento) & mascara]++] = origem[i];
+        }
+        
+        EntradaIndice *troca = origem;
+        origem = destino;
+        destino = troca;
+    }
+    
+    if (origem != indice) {
+        memcpy(indice, origem, n * sizeof(EntradaIndice));
+    }
+    free(auxiliar);
+    return true;
+}
+
+// Sorteia as posições dos tesouros, todas diferentes, e monta o mapa de
+// células (grid denso) ou o índice espacial (esparso). A mesma semente
+// sorteia sempre o mesmo mundo. Retorna NULL se faltar memória ou os
+// tesouros não couberem.
+MundoJogo *criar_mundo(int largura, int altura, int num_tesouros, uint64_t semente) {
+    if (largura < 1 || largura > MAX_LADO_GRID || altura < 1 || altura > MAX_LADO_GRID ||
+        num_tesouros < 0 || (long long)num_tesouros > (long long)largura * altura) {
+        fprintf(stderr, "Mundo inválido: %d tesouros em %dx%d.\n", num_tesouros, largura, altura);
+        return NULL;
+    }
+    
+    MundoJogo *mundo = calloc(1, sizeof(MundoJogo));
+    if (mundo == NULL) {
+        return NULL;
+    }
+    mundo->largura = largura;
+    mundo->altura = altura;
+    mundo->num_tesouros = num_tesouros;
+    mundo->semente = semente;
+    mundo->referencias = 1;
+    mundo->tesouros = malloc((num_tesouros + 1) * sizeof(Posicao));
+    bool denso = grid_denso(largura, altura);
+    if (denso) {
+        mundo->tesouro_celula = malloc((size_t)largura * altura * sizeof(int32_t));
+    } else {
+        mundo->indice = malloc((num_tesouros + 1) * sizeof(EntradaIndice));
+    }
+    if (mundo->tesouros == NULL || (denso ? mundo->tesouro_celula == NULL : mundo->indice == NULL)) {
+        liberar_mundo(mundo);
+        return NULL;
+    }
+    
+    // Algoritmo de Floyd: para j de N-k a N-1, sorteia t em [0, j] e fica
+    // com t, ou com j se t já saiu. São k sorteios exatos, sem as
+    // repetições da rejeição, que se multiplicavam com o grid cheio. O
+    // conjunto é uniforme; a ordem (que só decide os arquivos) não é
+    // embaralhada, porque as trocas aleatórias custavam mais que o sorteio.
+    GeradorAleatorio gerador;
+    gerador_semear(&gerador, semente);
+    uint64_t celulas = (uint64_t)largura * altura;
+    CelulasSorteadas sorteadas;
+    if (!iniciar_sorteadas(&sorteadas, largura, celulas, num_tesouros)) {
+        liberar_mundo(mundo);
+        return NULL;
+    }
+    for (int i = 0; i < num_tesouros; i++) {
+        uint64_t j = celulas - num_tesouros + i;
+        uint64_t t = gerador_abaixo(&gerador, j + 1);
+        if (marcar_sorteada(&sorteadas, t)) {
+            t = j; // j ainda não saiu: os sorteios anteriores foram todos menores
+            marcar_sorteada(&sorteadas, t);
+        }
+        mundo->tesouros[i] = (Posicao){t % largura, t / largura};
+    }
+    liberar_sorteadas(&sorteadas);
+    
+    if (denso) {
+        for (uint64_t c = 0; c < celulas; c++) {
+            mundo->tesouro_celula[c] = SEM_TESOURO;
+        }
+        for (int i = 0; i < num_tesouros; i++) {
+            mundo->tesouro_celula[mundo->tesouros[i].y * largura + mundo->tesouros[i].x] = i;
+        }
+        return mundo;
+    }
+    
+    uint32_t maior_codigo = 0;
+    for (int i = 0; i < num_tesouros; i++) {
+        mundo->indice[i].codigo = codigo_morton(mundo->tesouros[i].x, mundo->tesouros[i].y);
+        mundo->indice[i].tesouro = i;
+        if (mundo->indice[i].codigo > maior_codigo) {
+            maior_codigo = mundo->indice[i].codigo;
+        }
+    }
+    if (!ordenar_indice(mundo->indice, num_tesouros, maior_codigo)) {
+        liberar_mundo(mundo);
+        return NULL;
+    }
+    
+    return mundo;
+}
+
+// Mais uma referência ao mundo (qualquer thread)
+MundoJogo *reter_mundo(MundoJogo *mundo) {
+    __atomic_add_fetch(&mundo->referencias, 1, __ATOMIC_RELAXED);
+    return mundo;
+}
+
+// Solta uma referência; a última libera o mundo
+void liberar_mundo(MundoJogo *mundo) {
+    if (mundo == NULL || __atomic_sub_fetch(&mundo->referencias, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    free(mundo->tesouros);
+    free(mundo->tesouro_celula);
+    free(mundo->indice);
+    free(mundo);
+}
+
+// Índice do tesouro na posição, ou SEM_TESOURO, num grid esparso (busca
+// binária no índice; tesouro_na_posicao trata o denso)
+int tesouro_no_indice(const MundoJogo *mundo, int x, int y) {
+    uint32_t codigo = codigo_morton(x, y);
+    int inicio = 0;
+    int fim = mundo->num_tesouros;
+    
+    while (inicio < fim) {
+        int meio = inicio + (fim - inicio) / 2;
+        if (mundo->indice[meio].codigo < codigo) {
+            inicio = meio + 1;
+        } else {
+            fim = meio;
+        }
+    }
+    
+    if (inicio < mundo->num_tesouros && mundo->indice[inicio].codigo == codigo) {
+        return mundo->indice[inicio].tesouro;
+    }
+    return SEM_TESOURO;
+}
+
+// Função para inicializar o estado do jogo, em um mundo já sorteado (o
+// jogo fica com uma referência a ele)
+bool inicializar_jogo(EstadoJogo *jogo, MundoJogo *mundo) {
+    memset(jogo, 0, sizeof(*jogo));
+    jogo->mundo = reter_mundo(mundo);
+    if (!plano_iniciar(&jogo->visitado, mundo->largura, mundo->altura) || 
+        !plano_iniciar(&jogo->encontrado, mundo->largura, mundo->altura)) {
+        finalizar_jogo(jogo);
+        return false;
+    }
+    
+    // Inicializa posição do jogador no canto inferior esquerdo, já visitada
+    jogo->jogador.x = 0;
+    jogo->jogador.y = 0;
+    if (!plano_marcar(&jogo->visitado, 0, 0, true)) {
+        finalizar_jogo(jogo);
+        return false;
+    }
+    return true;
+}
+
+void finalizar_jogo(EstadoJogo *jogo) {
+    plano_liberar(&jogo->visitado);
+    plano_liberar(&jogo->encontrado);
+    liberar_mundo(jogo->mundo);
+    jogo->mundo = NULL;
+}
+
+// Função para mover o jogador
+bool mover_jogador(EstadoJogo *jogo, int direcao) {
+    int novo_x = jogo->jogador.x;
+    int novo_y = jogo->jogador.y;
+    
+    // Calcula a nova posição com base na direção
+    switch (direcao) {
+        case TIPO_MOVE_DIR:   // Direita
+            novo_x++;
+            break;
+        case TIPO_MOVE_ESQ:   // Esquerda
+            novo_x--;
+            break;
+        case TIPO_MOVE_CIMA:  // Cima
+            novo_y++;
+            break;
+        case TIPO_MOVE_BAIXO: // Baixo
+            novo_y--;
+            break;
+        default:
+            return false;
+    }
+    
+    // Verifica se a nova posição está dentro dos limites do grid
+    if (novo_x < 0 || novo_x >= jogo->mundo->largura || novo_y < 0 || novo_y >= jogo->mundo->altura) {
+        return false;
+    }
+    
+    // Atualiza a posição do jogador
+    jogo->jogador.x = novo_x;
+    jogo->jogador.y = novo_y;
+    
+    // Marca a posição como visitada. Sem memória para um bloco novo, a
+    // célula só deixa de aparecer como visitada na tela.
+    plano_marcar(&jogo->visitado, novo_x, novo_y, true);
+    
+    return true;
+}
+
+// Função para verificar se há um tesouro na posição atual do jogador
+int verificar_tesouro(EstadoJogo *jogo) {
+    // Verifica se há um tesouro na posição, já pelo seu índice
+    int indice = tesouro_na_posicao(jogo->mundo, jogo->jogador.x, jogo->jogador.y);
+    if (indice == SEM_TESOURO) {
+        return 0; // Nenhum tesouro encontrado
+    }
+    if (tesouro_encontrado(jogo, indice)) {
+        return 0; // Tesouro já encontrado
+    }
+    
+    marcar_tesouro_encontrado(jogo, indice, true);
+    return indice + 1; // Retorna o índice do tesouro (1-based)
+}
+
+bool tesouro_encontrado(const EstadoJogo *jogo, int indice) {
+    Posicao pos = jogo->mundo->tesouros[indice];
+    return plano_testar(&jogo->encontrado, pos.x, pos.y);
+}
+
+// Marca o tesouro como encontrado (ou devolvido ao jogo)
+void marcar_tesouro_encontrado(EstadoJogo *jogo, int indice, bool encontrado) {
+    Posicao pos = jogo->mundo->tesouros[indice];
+    plano_marcar(&jogo->encontrado, pos.x, pos.y, encontrado);
+}
+
+// Início do recorte de 'tamanho' células em um lado de 'total', centrado
+// em 'centro' sem passar das bordas
+static int inicio_recorte(int centro, int tamanho, int total) {
+    int inicio = centro - tamanho / 2;
+    if (inicio + tamanho > total) {
+        inicio = total - tamanho;
+    }
+    return inicio < 0 ? 0 : inicio;
+}
+
+// Recorte do grid que cabe na tela, em volta do jogador. O grid padrão
+// aparece inteiro.
+Recorte recortar_tela(const EstadoJogo *jogo) {
+    Recorte recorte;
+    recorte.largura = jogo->mundo->largura < LARGURA_TELA_GRID ? jogo->mundo->largura : LARGURA_TELA_GRID;
+    recorte.altura = jogo->mundo->altura < ALTURA_TELA_GRID ? jogo->mundo->altura : ALTURA_TELA_GRID;
+    recorte.x = inicio_recorte(jogo->jogador.x, recorte.largura, jogo->mundo->largura);
+    recorte.y = inicio_recorte(jogo->jogador.y, recorte.altura, jogo->mundo->altura);
+    
+    recorte.largura_rotulo = 1;
+    for (int maior = jogo->mundo->altura - 1; maior >= 10; maior /= 10) {
+        recorte.largura_rotulo++;
+    }
+    return recorte;
+}
+
+// Lê as dimensões do grid no formato LARGURAxALTURA (ou só o lado, para
+// um grid quadrado)
+bool ler_dimensoes_grid(const char *texto, int *largura, int *altura) {
+    // O texto inteiro precisa ser consumido: "8x" e "8abc" são inválidos
+    int consumidos = 0;
+    if (sscanf(texto, "%dx%d%n", largura, altura, &consumidos) != 2 || texto[consumidos] != '\0') {
+        consumidos = 0;
+        if (sscanf(texto, "%d%n", largura, &consumidos) != 1 || texto[consumidos] != '\0') {
+            return false;
+        }
+        *altura = *largura;
+    }
+    return *largura >= 1 && *largura <= MAX_LADO_GRID && *altura >= 1 && *altura <= MAX_LADO_GRID;
+}
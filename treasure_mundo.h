@@ -0,0 +1,128 @@
+#ifndef TREASURE_MUNDO_H
+#define TREASURE_MUNDO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "treasure_protocol.h"
+
+// Mundo do jogo com dimensões e número de tesouros definidos na
+// inicialização. Nos grids de até AREA_MAXIMA_DENSA células, como o padrão
+// (8x8, uma palavra), as células ficam em planos de bits densos e cada
+// célula aponta direto para o seu tesouro. Acima disso, nada é proporcional
+// à área do grid: as células visitadas ficam em um plano de bits esparso,
+// em blocos de 8x8 guardados em uma tabela hash, e os tesouros em um índice
+// espacial, ordenado pelo código Morton da célula.
+#define GRID_PADRAO 8             // Largura e altura padrão do grid
+#define AREA_MAXIMA_DENSA 16384   // Maior grid denso, em células (128x128)
+#define TESOUROS_PADRAO 8         // Número padrão de tesouros
+#define MAX_LADO_GRID 65536       // Coordenadas de 16 bits no código Morton
+#define SEM_TESOURO -1            // Célula sem tesouro em tesouro_na_posicao
+#define LARGURA_TELA_GRID 32      // Colunas do grid mostradas na tela
+#define ALTURA_TELA_GRID 16       // Linhas do grid mostradas na tela
+#define MAX_TESOUROS_LISTADOS 16  // Tesouros listados na tela
+
+// Bloco 8x8 do plano esparso: o bit (codigo_morton & 63) é a célula
+typedef struct {
+    uint32_t bloco;               // codigo_morton >> 6 (BLOCO_VAZIO: entrada livre)
+    uint64_t bits;
+} BlocoPlano;
+
+// Plano de bits do grid. Denso, a célula (x,y) é o bit y * largura + x de
+// 'palavras'. Esparso (zerado, ou num grid grande), só os blocos com alguma
+// célula marcada existem.
+typedef struct {
+    uint64_t *palavras;           // Plano denso (NULL no esparso)
+    int largura;                  // Largura do grid, no plano denso
+    BlocoPlano *blocos;           // Esparso: endereçamento aberto (NULL até a primeira marcação)
+    uint32_t capacidade;          // Potência de 2
+    uint32_t usados;
+    int marcadas;                 // Células marcadas, somadas todas
+} PlanoGrid;
+
+// Gerador pseudoaleatório xoshiro256**. Cada thread usa o seu (no sorteio
+// de um mundo, um na pilha): não há estado global nem travas, e a mesma
+// semente sorteia sempre o mesmo mundo.
+typedef struct {
+    uint64_t s[4];
+} GeradorAleatorio;
+
+// Entrada do índice espacial: a célula do tesouro e o seu índice
+typedef struct {
+    uint32_t codigo;              // Código Morton da célula
+    int32_t tesouro;
+} EntradaIndice;
+
+// Posições dos tesouros de um jogo. Imutável depois de criado e
+// compartilhado por referências (a sessão e a cópia da tela).
+typedef struct {
+    int largura;
+    int altura;
+    int num_tesouros;
+    uint64_t semente;             // Semente do sorteio (repete o mundo)
+    Posicao *tesouros;            // Posição de cada tesouro
+    int32_t *tesouro_celula;      // Grid denso: o tesouro de cada célula, ou SEM_TESOURO
+    EntradaIndice *indice;        // Grid esparso: os tesouros, ordenados pelo código da célula
+    int referencias;
+} MundoJogo;
+
+// Estrutura para representar o estado do jogo
+typedef struct {
+    MundoJogo *mundo;
+    Posicao jogador;              // Posição atual do jogador
+    PlanoGrid visitado;           // Posições visitadas
+    PlanoGrid encontrado;         // Posições com tesouros já encontrados
+} EstadoJogo;
+
+// Parte do grid mostrada na tela, em volta do jogador
+typedef struct {
+    int x;                        // Canto inferior esquerdo
+    int y;
+    int largura;
+    int altura;
+    int largura_rotulo;           // Dígitos do maior número de linha
+} Recorte;
+
+void gerador_semear(GeradorAleatorio *gerador, uint64_t semente);
+uint64_t gerador_proximo(GeradorAleatorio *gerador);
+uint64_t gerador_abaixo(GeradorAleatorio *gerador, uint64_t limite);
+uint64_t derivar_semente(uint64_t semente, uint64_t valor);
+
+uint32_t codigo_morton(int x, int y);
+bool plano_iniciar(PlanoGrid *plano, int largura, int altura);
+bool plano_testar_esparso(const PlanoGrid *plano, int x, int y);
+bool plano_marcar(PlanoGrid *plano, int x, int y, bool valor);
+void plano_liberar(PlanoGrid *plano);
+
+MundoJogo *criar_mundo(int largura, int altura, int num_tesouros, uint64_t semente);
+MundoJogo *reter_mundo(MundoJogo *mundo);
+void liberar_mundo(MundoJogo *mundo);
+int tesouro_no_indice(const MundoJogo *mundo, int x, int y);
+
+// Indica se a célula está marcada no plano. O plano denso é um teste de bit,
+// feito aqui mesmo: o desenho do grid consulta cada célula.
+static inline bool plano_testar(const PlanoGrid *plano, int x, int y) {
+    if (plano->palavras != NULL) {
+        int celula = y * plano->largura + x;
+        return (plano->palavras[celula / 64] >> (celula % 64)) & 1;
+    }
+    return plano_testar_esparso(plano, x, y);
+}
+
+// Índice do tesouro na posição, ou SEM_TESOURO
+static inline int tesouro_na_posicao(const MundoJogo *mundo, int x, int y) {
+    if (mundo->tesouro_celula != NULL) {
+        return mundo->tesouro_celula[y * mundo->largura + x];
+    }
+    return tesouro_no_indice(mundo, x, y);
+}
+
+bool inicializar_jogo(EstadoJogo *jogo, MundoJogo *mundo);
+void finalizar_jogo(EstadoJogo *jogo);
+bool mover_jogador(EstadoJogo *jogo, int direcao);
+int verificar_tesouro(EstadoJogo *jogo);
+bool tesouro_encontrado(const EstadoJogo *jogo, int indice);
+void marcar_tesouro_encontrado(EstadoJogo *jogo, int indice, bool encontrado);
+Recorte recortar_tela(const EstadoJogo *jogo);
+bool ler_dimensoes_grid(const char *texto, int *largura, int *altura);
+
+#endif // TREASURE_MUNDO_H
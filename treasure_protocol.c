@@ -1,4 +1,47 @@
 #include "treasure_protocol.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <linux/filter.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+static bool validar_cabecalho_estendido(unsigned char *payload, ssize_t n, Pacote *pacote);
+static uint32_t verificacao_estendida(const unsigned char *cabecalho, const unsigned char *dados, int tam_dados);
+static bool transmitir_quadro(int sockfd, struct sockaddr_ll *endereco, unsigned char formato, 
+                              unsigned char *mac_destino, unsigned char *mac_origem, 
+                              unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados);
+static int anel_enviar_lote(struct sockaddr_ll *endereco, unsigned char formato, unsigned char *mac_destino, 
+                            unsigned char *mac_origem, const QuadroSaida *quadros, int num_quadros);
+static int anel_receber_lote(Pacote *pacotes, int max_pacotes);
+static bool aceitar_quadro(unsigned char *quadro, ssize_t n, Pacote *pacote);
+static unsigned char formato_conexao(const Conexao *conexao);
+
+// Envio e recepção em lote (sendmmsg/recvmmsg); desativado para comparar com
+// o caminho de um quadro por chamada
+static bool modo_lote = true;
+
+// Mensagens de depuração (DEPURAR): desligadas por padrão
+static bool depuracao = false;
+
+// Contadores de E/S do processo (atualizados por mais de uma thread)
+static EstatisticasES estatisticas_es;
+
+// Soma aos contadores de E/S
+static void contar_es(unsigned long *contador, unsigned long valor) {
+    __atomic_fetch_add(contador, valor, __ATOMIC_RELAXED);
+}
+
+// Falhas injetadas na recepção, para testar a recuperação sem netem
+// (frações de 0 a 1 dos quadros do protocolo). Cada thread sorteia com a
+// sua semente, derivada da base: as threads de recepção do servidor não
+// disputam o estado do sorteio nem perdem os mesmos quadros.
+static double perda_simulada = 0.0;
+static double corrupcao_simulada = 0.0;
+static unsigned int semente_base_falhas;
+static unsigned int threads_falhas = 0;
+static __thread unsigned int semente_falhas = 0;
 
 // Função para imprimir um buffer em hexadecimal (para debug)
 void print_buffer(const char* prefix, unsigned char* buffer, int size) {
@@ -18,6 +61,146 @@ unsigned char calcula_checksum(unsigned char* dados, int tamanho) {
     return (unsigned char)(soma & 0xFF);  // Retorna apenas o byte menos significativo
 }
 
+// ---------------------------------------------------------------------------
+// CRC32C (Castagnoli): instrução crc32 do SSE4.2 quando disponível, senão
+// tabelas "slicing-by-8". Encadeável: crc32c(crc32c(0, a, na), b, nb) é o CRC
+// da concatenação de a e b.
+// ---------------------------------------------------------------------------
+
+#define POLINOMIO_CRC32C 0x82F63B78  // Polinômio refletido
+
+static uint32_t tabela_crc32c[8][256];
+static uint32_t potencias_crc32c[32]; // x^(2^k) módulo o polinômio, para combinar CRCs
+static uint32_t (*crc32c_impl)(uint32_t, const unsigned char *, size_t);
+static pthread_once_t crc32c_uma_vez = PTHREAD_ONCE_INIT;
+
+#if defined(__x86_64__)
+// Processa 8 bytes por instrução; o restante byte a byte
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *dados, size_t tamanho) {
+    uint64_t c = ~crc;
+    
+    while (tamanho >= 8) {
+        uint64_t palavra;
+        memcpy(&palavra, dados, 8);
+        c = _mm_crc32_u64(c, palavra);
+        dados += 8;
+        tamanho -= 8;
+    }
+    
+    uint32_t c32 = (uint32_t)c;
+    while (tamanho--) {
+        c32 = _mm_crc32_u8(c32, *dados++);
+    }
+    
+    return ~c32;
+}
+#endif
+
+// Produto de dois polinômios módulo o do CRC32C (representação refletida)
+static uint32_t multiplicar_mod_crc32c(uint32_t a, uint32_t b) {
+    uint32_t produto = 0;
+    
+    for (uint32_t m = 1u << 31; m != 0; m >>= 1) {
+        if (a & m) {
+            produto ^= b;
+        }
+        b = (b & 1) ? (b >> 1) ^ POLINOMIO_CRC32C : b >> 1;
+    }
+    
+    return produto;
+}
+
+// Gera as tabelas e escolhe a implementação para esta CPU
+static void crc32c_iniciar() {
+    for (int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? POLINOMIO_CRC32C : 0);
+        }
+        tabela_crc32c[0][i] = crc;
+    }
+    
+    for (int i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t anterior = tabela_crc32c[k - 1][i];
+            tabela_crc32c[k][i] = (anterior >> 8) ^ tabela_crc32c[0][anterior & 0xFF];
+        }
+    }
+    
+    // x^1, x^2, x^4, ... (representação refletida: x^0 é o bit 31)
+    uint32_t potencia = 1u << 30;
+    for (int k = 0; k < 32; k++) {
+        potencias_crc32c[k] = potencia;
+        potencia = multiplicar_mod_crc32c(potencia, potencia);
+    }
+    
+    crc32c_impl = crc32c_software;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = crc32c_sse42;
+    }
+#endif
+}
+
+// CRC32C por tabelas, 8 bytes por iteração
+uint32_t crc32c_software(uint32_t crc, const unsigned char *dados, size_t tamanho) {
+    pthread_once(&crc32c_uma_vez, crc32c_iniciar);
+    crc = ~crc;
+    
+    while (tamanho >= 8) {
+        crc ^= dados[0] | (dados[1] << 8) | (dados[2] << 16) | ((uint32_t)dados[3] << 24);
+        crc = tabela_crc32c[7][crc & 0xFF] ^ tabela_crc32c[6][(crc >> 8) & 0xFF] ^
+              tabela_crc32c[5][(crc >> 16) & 0xFF] ^ tabela_crc32c[4][crc >> 24] ^
+              tabela_crc32c[3][dados[4]] ^ tabela_crc32c[2][dados[5]] ^
+              tabela_crc32c[1][dados[6]] ^ tabela_crc32c[0][dados[7]];
+        dados += 8;
+        tamanho -= 8;
+    }
+    
+    while (tamanho--) {
+        crc = tabela_crc32c[0][(crc ^ *dados++) & 0xFF] ^ (crc >> 8);
+    }
+    
+    return ~crc;
+}
+
+// CRC32C com a implementação mais rápida disponível
+uint32_t crc32c(uint32_t crc, const unsigned char *dados, size_t tamanho) {
+    pthread_once(&crc32c_uma_vez, crc32c_iniciar);
+    return crc32c_impl(crc, dados, tamanho);
+}
+
+// CRC32C da concatenação de a e b a partir dos CRCs de cada parte e do
+// tamanho de b: crc32c_combinar(crc32c(0, a, na), crc32c(0, b, nb), nb) é
+// crc32c(0, a||b, na + nb). Custa O(log nb), sem reler os dados de b.
+uint32_t crc32c_combinar(uint32_t crc_a, uint32_t crc_b, size_t tam_b) {
+    pthread_once(&crc32c_uma_vez, crc32c_iniciar);
+    
+    // crc_a deslocado por tam_b bytes: multiplicado por x^(8 * tam_b)
+    uint32_t deslocamento = 1u << 31;
+    for (int k = 3; tam_b != 0; tam_b >>= 1, k++) {
+        if (tam_b & 1) {
+            deslocamento = multiplicar_mod_crc32c(potencias_crc32c[k & 31], deslocamento);
+        }
+    }
+    
+    return multiplicar_mod_crc32c(deslocamento, crc_a) ^ crc_b;
+}
+
+// Verificações dos dados de um quadro calculadas uma vez, para quadros
+// enviados várias vezes (ver montar_cabecalho)
+void calcular_verificacao_dados(VerificacaoDados *verificacao, const unsigned char *dados, int tam_dados) {
+    verificacao->soma = calcula_checksum((unsigned char *)dados, tam_dados);
+    verificacao->crc = crc32c(0, dados, tam_dados);
+}
+
+// Indica se o CRC32C usa a instrução do processador
+bool crc32c_acelerado() {
+    pthread_once(&crc32c_uma_vez, crc32c_iniciar);
+    return crc32c_impl != crc32c_software;
+}
+
 // Função para criar um socket raw
 int cria_raw_socket(char* interface) {
     // Cria arquivo para o socket sem qualquer protocolo
@@ -26,13 +209,13 @@ int cria_raw_socket(char* interface) {
         fprintf(stderr, "Erro ao criar socket: Verifique se você é root!\n");
         exit(-1);
     }
- 
+    
     int ifindex = if_nametoindex(interface);
     if (ifindex == 0) {
         fprintf(stderr, "Interface %s não encontrada.\n", interface);
         exit(-1);
     }
- 
+    
     struct sockaddr_ll endereco = {0};
     endereco.sll_family = AF_PACKET;
     endereco.sll_protocol = htons(ETH_P_ALL);
@@ -43,7 +226,7 @@ int cria_raw_socket(char* interface) {
         fprintf(stderr, "Erro ao fazer bind no socket\n");
         exit(-1);
     }
- 
+    
     struct packet_mreq mr = {0};
     mr.mr_ifindex = ifindex;
     mr.mr_type = PACKET_MR_PROMISC;
@@ -53,23 +236,39 @@ int cria_raw_socket(char* interface) {
             "Verifique se a interface de rede foi especificada corretamente.\n");
         exit(-1);
     }
- 
+    
+    // Buffers maiores que o padrão, para janelas profundas. SO_*BUFFORCE
+    // ignora os limites de net.core (somos root); sem ele, fica o que couber.
+    int tam_buffer = TAM_BUFFER_SOCKET;
+    if (setsockopt(soquete, SOL_SOCKET, SO_RCVBUFFORCE, &tam_buffer, sizeof(tam_buffer)) == -1) {
+        setsockopt(soquete, SOL_SOCKET, SO_RCVBUF, &tam_buffer, sizeof(tam_buffer));
+    }
+    if (setsockopt(soquete, SOL_SOCKET, SO_SNDBUFFORCE, &tam_buffer, sizeof(tam_buffer)) == -1) {
+        setsockopt(soquete, SOL_SOCKET, SO_SNDBUF, &tam_buffer, sizeof(tam_buffer));
+    }
+    
     return soquete;
 }
 
-// Função para enviar um pacote
-bool enviar_pacote(int sockfd, struct sockaddr_ll *endereco, unsigned char *mac_destino, 
-                  unsigned char *mac_origem, unsigned char tipo, unsigned char seq, 
-                  unsigned char *dados, int tam_dados) {
+// Monta o cabeçalho Ethernet e o do protocolo no formato pedido: 0 para o
+// clássico, ou FLAG_ESTENDIDO combinado com as flags do cabeçalho estendido.
+// A verificação é calculada sobre 'dados' onde eles estiverem, sem copiá-los
+// para o quadro, ou combinada com a dos dados em 'pre' (se não for NULL).
+// Retorna o tamanho do cabeçalho.
+static int montar_cabecalho(unsigned char *quadro, unsigned char formato, unsigned char *mac_destino, 
+                            unsigned char *mac_origem, unsigned char tipo, uint16_t seq, 
+                            const unsigned char *dados, int tam_dados, const VerificacaoDados *pre) {
+    bool estendido = (formato & FLAG_ESTENDIDO) != 0;
     
-    if (tam_dados > TAM_MAX_DADOS) {
+    if (tam_dados < 0 || tam_dados > (estendido ? TAM_MAX_DADOS_EXT : TAM_MAX_DADOS)) {
         fprintf(stderr, "Erro: Tamanho de dados excede o máximo permitido.\n");
-        return false;
+        return -1;
+    }
+    if (dados == NULL) {
+        tam_dados = 0;
     }
     
-    // Buffer para o pacote completo
-    unsigned char pacote[TAM_MAX_PACOTE];
-    struct ether_header *eth = (struct ether_header *)pacote;
+    struct ether_header *eth = (struct ether_header *)quadro;
     
     // Configurar o cabeçalho Ethernet
     memcpy(eth->ether_dhost, mac_destino, 6);
@@ -77,240 +276,1196 @@ bool enviar_pacote(int sockfd, struct sockaddr_ll *endereco, unsigned char *mac_
     eth->ether_type = htons(ETH_CUSTOM_TYPE);
     
     // Ponteiro para a parte de dados do pacote (após o cabeçalho Ethernet)
-    unsigned char *payload = pacote + sizeof(struct ether_header);
+    unsigned char *payload = quadro + sizeof(struct ether_header);
     
-    // Configurar o cabeçalho do protocolo
-    payload[0] = MARCADOR;            // Marcador de início
-    payload[1] = tam_dados & 0x7F;    // Tamanho (7 bits)
-    payload[2] = seq & 0x1F;          // Sequência (5 bits)
-    payload[3] = tipo & 0x0F;         // Tipo (4 bits)
+    if (!estendido) {
+        // Configurar o cabeçalho do protocolo
+        payload[0] = MARCADOR;            // Marcador de início
+        payload[1] = tam_dados & 0x7F;    // Tamanho (7 bits)
+        payload[2] = seq & 0x1F;          // Sequência (5 bits)
+        payload[3] = tipo & 0x0F;         // Tipo (4 bits)
+        
+        // Checksum de tamanho, seq, tipo e dados, somados por partes
+        payload[4] = calcula_checksum(payload + 1, 3) + 
+                     (pre != NULL ? pre->soma : calcula_checksum((unsigned char *)dados, tam_dados));
+        
+        return sizeof(struct ether_header) + 5;
+    }
     
-    // Cria um buffer temporário para calcular o checksum
-    unsigned char temp_buffer[TAM_MAX_PACOTE];
-    memcpy(temp_buffer, payload + 1, 3);           // Copia tamanho, seq e tipo
+    uint16_t tam_rede = htons(tam_dados);
+    uint16_t seq_rede = htons(seq);
     
-    // Se houver dados, copia para o buffer temporário
-    if (tam_dados > 0 && dados != NULL) {
-        memcpy(temp_buffer + 3, dados, tam_dados);
+    payload[0] = MARCADOR;                     // Marcador de início
+    payload[1] = FLAG_ESTENDIDO | VERSAO_EXT;  // Formato e versão
+    payload[2] = tipo;                         // Tipo (8 bits)
+    payload[3] = formato & ~FLAG_ESTENDIDO;    // Flags (algoritmo de verificação)
+    memcpy(payload + 4, &tam_rede, 2);         // Tamanho (16 bits)
+    memcpy(payload + 6, &seq_rede, 2);         // Sequência (16 bits)
+    
+    uint32_t verificacao;
+    if (pre == NULL || tam_dados == 0) {
+        verificacao = verificacao_estendida(payload, dados, tam_dados);
+    } else if (formato & FLAG_CRC32C) {
+        verificacao = crc32c_combinar(crc32c(0, payload + 1, 7), pre->crc, tam_dados);
+    } else {
+        verificacao = (calcula_checksum(payload + 1, 7) + pre->soma) & 0xFF;
     }
+    verificacao = htonl(verificacao);
+    memcpy(payload + 8, &verificacao, 4);      // Verificação (32 bits)
     
-    // Calcula e armazena o checksum
-    unsigned char checksum = calcula_checksum(temp_buffer, 3 + tam_dados);
-    payload[4] = checksum;
+    return sizeof(struct ether_header) + TAM_CABECALHO_EXT;
+}
+
+// Monta o quadro completo no formato pedido e retorna seu tamanho
+static int montar_quadro_formato(unsigned char *quadro, unsigned char formato, unsigned char *mac_destino, 
+                                 unsigned char *mac_origem, unsigned char tipo, uint16_t seq, 
+                                 unsigned char *dados, int tam_dados, const VerificacaoDados *pre) {
+    int tam_cabecalho = montar_cabecalho(quadro, formato, mac_destino, mac_origem, 
+                                         tipo, seq, dados, tam_dados, pre);
+    if (tam_cabecalho < 0) {
+        return -1;
+    }
     
     // Copia os dados para o pacote
     if (tam_dados > 0 && dados != NULL) {
-        memcpy(payload + 5, dados, tam_dados);
+        memcpy(quadro + tam_cabecalho, dados, tam_dados);
+    } else {
+        tam_dados = 0;
     }
     
-    // Tamanho total do pacote
-    size_t tam_total = sizeof(struct ether_header) + 5 + tam_dados;
+    return tam_cabecalho + tam_dados;
+}
+
+// Monta um quadro completo (Ethernet + protocolo) em 'quadro' e retorna seu tamanho
+int montar_quadro(unsigned char *quadro, unsigned char *mac_destino, unsigned char *mac_origem, 
+                  unsigned char tipo, unsigned char seq, unsigned char *dados, int tam_dados) {
+    return montar_quadro_formato(quadro, 0, mac_destino, mac_origem, tipo, seq, dados, tam_dados, NULL);
+}
+
+// Anexa ao socket um filtro BPF clássico que só deixa passar quadros do nosso
+// protocolo (EtherType, marcador no offset 14) endereçados ao MAC local.
+// Os demais quadros da interface são descartados no kernel, sem cópia.
+bool anexar_filtro_bpf(int sockfd, const unsigned char *mac_local) {
+    uint32_t mac_alto = ((uint32_t)mac_local[0] << 24) | ((uint32_t)mac_local[1] << 16) |
+                        ((uint32_t)mac_local[2] << 8) | mac_local[3];
+    uint32_t mac_baixo = ((uint32_t)mac_local[4] << 8) | mac_local[5];
     
-    // Envia o pacote
-    ssize_t enviados = sendto(sockfd, pacote, tam_total, 0, 
-                             (struct sockaddr*)endereco, sizeof(struct sockaddr_ll));
+    struct sock_filter codigo[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),                   // EtherType
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_CUSTOM_TYPE, 0, 7),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 14),                   // Marcador
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, MARCADOR, 0, 5),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),                    // MAC destino (4 primeiros bytes)
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, mac_alto, 0, 3),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4),                    // MAC destino (2 últimos bytes)
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, mac_baixo, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),                    // Aceita o quadro inteiro
+        BPF_STMT(BPF_RET | BPF_K, 0),                             // Descarta
+    };
     
-    if (enviados < 0) {
-        perror("sendto");
+    struct sock_fprog programa = {
+        .len = sizeof(codigo) / sizeof(codigo[0]),
+        .filter = codigo,
+    };
+    
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &programa, sizeof(programa)) == -1) {
+        perror("setsockopt SO_ATTACH_FILTER");
         return false;
     }
     
-    return (enviados == (ssize_t)tam_total);
+    // Descarta o que chegou antes do filtro estar ativo
+    unsigned char lixo[TAM_MAX_QUADRO];
+    while (!anel_ativo(sockfd) && recv(sockfd, lixo, sizeof(lixo), MSG_DONTWAIT) > 0);
+    
+    return true;
 }
 
-// Função para receber um pacote
-bool receber_pacote(int sockfd, unsigned char *buffer, unsigned char *tipo, 
-                   unsigned char *seq, unsigned char **dados, int *tam_dados) {
+// Coloca o socket em um grupo de fanout: cada quadro recebido na interface
+// vai para um só socket do grupo, escolhido por um programa BPF a partir do
+// MAC de origem. Os quadros de um mesmo par caem sempre no mesmo socket, e
+// os quadros enviados por um socket do grupo não voltam para os outros.
+bool entrar_grupo_fanout(int sockfd, uint16_t grupo) {
+    int modo = grupo | (PACKET_FANOUT_CBPF << 16);
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_FANOUT, &modo, sizeof(modo)) == -1) {
+        perror("setsockopt PACKET_FANOUT");
+        return false;
+    }
     
-    struct sockaddr_ll addr;
-    socklen_t addr_len = sizeof(addr);
+    // O programa vê o quadro a partir do cabeçalho de rede: o MAC é lido
+    // pelo deslocamento da camada de enlace. O kernel tira o resto da divisão
+    // do resultado pelo número de sockets.
+    struct sock_filter codigo[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_LL_OFF + 6),       // MAC origem (4 primeiros bytes)
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_LL_OFF + 10),      // MAC origem (2 últimos bytes)
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
     
-    // Recebe um pacote
-    ssize_t n = recvfrom(sockfd, buffer, TAM_MAX_PACOTE, 0, 
-                         (struct sockaddr*)&addr, &addr_len);
+    struct sock_fprog programa = {
+        .len = sizeof(codigo) / sizeof(codigo[0]),
+        .filter = codigo,
+    };
     
-    if (n < 0) {
-        perror("recvfrom");
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_FANOUT_DATA, &programa, sizeof(programa)) == -1) {
+        perror("setsockopt PACKET_FANOUT_DATA");
         return false;
     }
     
+    return true;
+}
+
+// Função para enviar um pacote no formato clássico
+bool enviar_pacote(int sockfd, struct sockaddr_ll *endereco, unsigned char *mac_destino, 
+                  unsigned char *mac_origem, unsigned char tipo, unsigned char seq, 
+                  unsigned char *dados, int tam_dados) {
+    return transmitir_quadro(sockfd, endereco, 0, mac_destino, mac_origem, 
+                             tipo, seq, dados, tam_dados);
+}
+
+// Valida um quadro recebido (formato clássico ou estendido) e extrai os campos
+// do cabeçalho do protocolo
+bool validar_quadro(unsigned char *quadro, ssize_t n, Pacote *pacote) {
+    
     // Verifica se o pacote tem tamanho mínimo para ser um pacote válido
     if ((size_t)n < sizeof(struct ether_header) + 5) {
         return false;
     }
     
-    struct ether_header *eth = (struct ether_header *)buffer;
+    struct ether_header *eth = (struct ether_header *)quadro;
     
     // Verifica se é do nosso protocolo
     if (ntohs(eth->ether_type) != ETH_CUSTOM_TYPE) {
         return false;
     }
     
-    unsigned char *payload = buffer + sizeof(struct ether_header);
+    unsigned char *payload = quadro + sizeof(struct ether_header);
     
     // Verifica o marcador
     if (payload[0] != MARCADOR) {
         return false;
     }
     
+    memcpy(pacote->mac_origem, eth->ether_shost, 6);
+    memcpy(pacote->mac_destino, eth->ether_dhost, 6);
+    
+    // No formato clássico o bit mais alto do byte de tamanho é sempre zero
+    if (payload[1] & FLAG_ESTENDIDO) {
+        return validar_cabecalho_estendido(payload, n - sizeof(struct ether_header), pacote);
+    }
+    
     // Extrai informações do cabeçalho
-    *tam_dados = payload[1] & 0x7F;
-    *seq = payload[2] & 0x1F;
-    *tipo = payload[3] & 0x0F;
+    pacote->estendido = false;
+    pacote->tam_dados = payload[1] & 0x7F;
+    pacote->seq = payload[2] & 0x1F;
+    pacote->tipo = payload[3] & 0x0F;
     unsigned char checksum_recebido = payload[4];
     
-    // Verifica o checksum
-    unsigned char temp_buffer[TAM_MAX_PACOTE];
-    memcpy(temp_buffer, payload + 1, 3);            // Copia os 3 bytes de cabeçalho
-    
-    // Se houver dados, copia para o buffer temporário
-    if (*tam_dados > 0) {
-        memcpy(temp_buffer + 3, payload + 5, *tam_dados);
+    // Descarta quadros truncados
+    if ((size_t)n < sizeof(struct ether_header) + 5 + pacote->tam_dados) {
+        return false;
     }
     
-    unsigned char checksum_calculado = calcula_checksum(temp_buffer, 3 + *tam_dados);
+    // Verifica o checksum (calculado por partes, direto no quadro)
+    unsigned char checksum_calculado = calcula_checksum(payload + 1, 3) + 
+                                       calcula_checksum(payload + 5, pacote->tam_dados);
     
     if (checksum_recebido != checksum_calculado) {
         return false;
     }
     
     // Define o ponteiro para os dados
-    *dados = payload + 5;
+    pacote->dados = payload + 5;
     
     return true;
 }
 
-// Função para verificar o espaço disponível em um diretório
-bool verifica_espaco_disponivel(const char* diretorio, size_t tamanho_necessario) {
-    struct statvfs stat;
+// Valida o cabeçalho estendido que começa em 'payload' (após o Ethernet)
+static bool validar_cabecalho_estendido(unsigned char *payload, ssize_t n, Pacote *pacote) {
+    if (n < TAM_CABECALHO_EXT) {
+        return false;
+    }
     
-    if (statvfs(diretorio, &stat) != 0) {
-        perror("statvfs");
+    // Versões mais novas podem mudar o layout: não arriscamos interpretá-las
+    if ((payload[1] & ~FLAG_ESTENDIDO) != VERSAO_EXT) {
         return false;
     }
     
-    // Calcula o espaço livre em bytes
-    size_t espaco_livre = stat.f_bsize * stat.f_bavail;
+    uint16_t tam_dados, seq;
+    uint32_t verificacao;
+    memcpy(&tam_dados, payload + 4, 2);
+    memcpy(&seq, payload + 6, 2);
+    memcpy(&verificacao, payload + 8, 4);
     
-    // Adiciona uma margem de segurança (10%)
-    size_t tamanho_com_margem = tamanho_necessario * 1.1;
+    pacote->estendido = true;
+    pacote->tipo = payload[2];
+    pacote->tam_dados = ntohs(tam_dados);
+    pacote->seq = ntohs(seq);
+    pacote->dados = payload + TAM_CABECALHO_EXT;
     
-    return (espaco_livre >= tamanho_com_margem);
+    if (n < TAM_CABECALHO_EXT + pacote->tam_dados) {
+        return false;
+    }
+    
+    return ntohl(verificacao) == verificacao_estendida(payload, pacote->dados, pacote->tam_dados);
 }
 
-// Função para obter o tipo de um arquivo com base em sua extensão
-int obter_tipo_arquivo(const char *nome_arquivo) {
-    const char *extensao = strrchr(nome_arquivo, '.');
+// Indica se o quadro é do protocolo (EtherType e marcador), válido ou não
+static bool quadro_do_protocolo(const unsigned char *quadro, ssize_t n) {
+    const struct ether_header *eth = (const struct ether_header *)quadro;
+    return (size_t)n > sizeof(struct ether_header) && 
+           ntohs(eth->ether_type) == ETH_CUSTOM_TYPE && 
+           quadro[sizeof(struct ether_header)] == MARCADOR;
+}
+
+// Valida um quadro recebido aplicando as falhas simuladas e contando os
+// quadros do protocolo que chegaram corrompidos
+static bool aceitar_quadro(unsigned char *quadro, ssize_t n, Pacote *pacote) {
+    bool do_protocolo = quadro_do_protocolo(quadro, n);
     
-    if (extensao == NULL) {
-        return TIPO_ARQ_DESCONHECIDO;
+    if (do_protocolo && (perda_simulada > 0 || corrupcao_simulada > 0)) {
+        if (semente_falhas == 0) {
+            unsigned int thread = __atomic_add_fetch(&threads_falhas, 1, __ATOMIC_RELAXED);
+            semente_falhas = (semente_base_falhas ^ (0x85EBCA6Bu * thread)) | 1;
+        }
+        double sorteio = rand_r(&semente_falhas) / (RAND_MAX + 1.0);
+        
+        if (sorteio < perda_simulada) {
+            contar_es(&estatisticas_es.quadros_descartados, 1);
+            return false;
+        }
+        
+        // Altera um byte coberto pela verificação nos dois formatos
+        if (sorteio < perda_simulada + corrupcao_simulada && 
+            (size_t)n > sizeof(struct ether_header) + 2) {
+            quadro[sizeof(struct ether_header) + 2] ^= 0x1F;
+        }
     }
     
-    if (strcasecmp(extensao, ".txt") == 0) {
-        return TIPO_ARQ_TEXTO;
-    } else if (strcasecmp(extensao, ".mp4") == 0) {
-        return TIPO_ARQ_VIDEO;
-    } else if (strcasecmp(extensao, ".jpg") == 0 || strcasecmp(extensao, ".jpeg") == 0) {
-        return TIPO_ARQ_IMAGEM;
+    if (validar_quadro(quadro, n, pacote)) {
+        return true;
     }
     
-    return TIPO_ARQ_DESCONHECIDO;
+    if (do_protocolo) {
+        contar_es(&estatisticas_es.quadros_corrompidos, 1);
+    }
+    return false;
 }
 
-// Função para inicializar o estado do jogo
-void inicializar_jogo(EstadoJogo *jogo) {
-    // Inicializa posição do jogador no canto inferior esquerdo
-    jogo->jogador.x = 0;
-    jogo->jogador.y = 0;
+// Ativa a perda e a corrupção simuladas de quadros recebidos
+void simular_falhas(double perda, double corrupcao) {
+    perda_simulada = perda;
+    corrupcao_simulada = corrupcao;
+    semente_base_falhas = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+}
+
+// Recebe um quadro de qualquer formato. No modo anel o quadro é lido no
+// próprio bloco do anel: pacote->dados aponta para dentro dele e vale até
+// a próxima chamada.
+bool receber_quadro(int sockfd, unsigned char *buffer, Pacote *pacote) {
     
-    // Limpa os grids
-    memset(jogo->grid_visitado, 0, sizeof(jogo->grid_visitado));
-    memset(jogo->grid_tesouro, 0, sizeof(jogo->grid_tesouro));
+    if (anel_ativo(sockfd)) {
+        unsigned char *quadro;
+        int n;
+        
+        if (!anel_receber(&quadro, &n)) {
+            return false;
+        }
+        
+        contar_es(&estatisticas_es.quadros_recebidos, 1);
+        return aceitar_quadro(quadro, n, pacote);
+    }
+    
+    struct sockaddr_ll addr;
+    socklen_t addr_len = sizeof(addr);
     
-    // Marca a posição inicial como visitada
-    jogo->grid_visitado[0][0] = true;
+    // Recebe um pacote
+    ssize_t n = recvfrom(sockfd, buffer, TAM_MAX_QUADRO, 0, 
+                         (struct sockaddr*)&addr, &addr_len);
+    contar_es(&estatisticas_es.chamadas_recepcao, 1);
     
-    // Inicializa os tesouros
-    for (int i = 0; i < NUM_TESOUROS; i++) {
-        jogo->tesouros[i].encontrado = false;
-        sprintf(jogo->tesouros[i].nome, "%d", i + 1); // será completado depois
+    if (n < 0) {
+        // Socket não bloqueante sem pacotes disponíveis não é erro
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("recvfrom");
+        }
+        return false;
     }
     
-    // Gera posições aleatórias para os tesouros
-    srand(time(NULL));
-    for (int i = 0; i < NUM_TESOUROS; i++) {
-        bool posicao_valida = false;
-        while (!posicao_valida) {
-            int x = rand() % GRID_SIZE;
-            int y = rand() % GRID_SIZE;
+    contar_es(&estatisticas_es.quadros_recebidos, 1);
+    return aceitar_quadro(buffer, n, pacote);
+}
+
+// Função para receber um pacote (API clássica, mantida para compatibilidade).
+// O buffer deve ter TAM_MAX_QUADRO bytes.
+bool receber_pacote(int sockfd, unsigned char *buffer, unsigned char *tipo, 
+                   unsigned char *seq, unsigned char **dados, int *tam_dados) {
+    Pacote pacote;
+    
+    if (!receber_quadro(sockfd, buffer, &pacote)) {
+        return false;
+    }
+    
+    *tipo = pacote.tipo;
+    *seq = pacote.seq;
+    *dados = pacote.dados;
+    *tam_dados = pacote.tam_dados;
+    
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Formato estendido e negociação
+// ---------------------------------------------------------------------------
+
+// Verificação do formato estendido sobre os bytes 1 a 7 do cabeçalho mais os
+// dados: CRC32C se FLAG_CRC32C estiver nas flags, senão a soma de 8 bits.
+// Calculada em duas partes para não copiar o payload.
+static uint32_t verificacao_estendida(const unsigned char *cabecalho, const unsigned char *dados, int tam_dados) {
+    if (tam_dados == 0 || dados == NULL) {
+        tam_dados = 0;
+    }
+    
+    if (cabecalho[3] & FLAG_CRC32C) {
+        return crc32c(crc32c(0, cabecalho + 1, 7), dados, tam_dados);
+    }
+    
+    unsigned int soma = calcula_checksum((unsigned char *)cabecalho + 1, 7) + 
+                        calcula_checksum((unsigned char *)dados, tam_dados);
+    return soma & 0xFF;
+}
+
+// Monta um quadro no formato estendido e retorna seu tamanho
+int montar_quadro_estendido(unsigned char *quadro, unsigned char *mac_destino, unsigned char *mac_origem, 
+                            unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados, 
+                            unsigned char flags) {
+    return montar_quadro_formato(quadro, FLAG_ESTENDIDO | flags, mac_destino, mac_origem, 
+                                 tipo, seq, dados, tam_dados, NULL);
+}
+
+// Monta e transmite um quadro pelo anel ou por sendmsg
+static bool transmitir_quadro(int sockfd, struct sockaddr_ll *endereco, unsigned char formato, 
+                              unsigned char *mac_destino, unsigned char *mac_origem, 
+                              unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados) {
+    
+    // No modo anel o quadro é montado diretamente no anel de transmissão
+    if (anel_ativo(sockfd)) {
+        return anel_enviar(endereco, formato, mac_destino, mac_origem, tipo, seq, dados, tam_dados);
+    }
+    
+    // Só o cabeçalho é montado: os dados vão do lugar onde estão, como
+    // segunda parte da mensagem (sendmsg com iovec)
+    unsigned char cabecalho[sizeof(struct ether_header) + TAM_CABECALHO_EXT];
+    int tam_cabecalho = montar_cabecalho(cabecalho, formato, mac_destino, mac_origem, 
+                                         tipo, seq, dados, tam_dados, NULL);
+    if (tam_cabecalho < 0) {
+        return false;
+    }
+    
+    struct iovec partes[2];
+    partes[0].iov_base = cabecalho;
+    partes[0].iov_len = tam_cabecalho;
+    partes[1].iov_base = dados;
+    partes[1].iov_len = (dados != NULL) ? tam_dados : 0;
+    
+    struct msghdr mensagem;
+    memset(&mensagem, 0, sizeof(mensagem));
+    mensagem.msg_name = endereco;
+    mensagem.msg_namelen = sizeof(struct sockaddr_ll);
+    mensagem.msg_iov = partes;
+    mensagem.msg_iovlen = 2;
+    
+    // Envia o pacote
+    ssize_t tam_total = tam_cabecalho + partes[1].iov_len;
+    ssize_t enviados = sendmsg(sockfd, &mensagem, 0);
+    contar_es(&estatisticas_es.chamadas_envio, 1);
+    
+    if (enviados < 0) {
+        perror("sendmsg");
+        return false;
+    }
+    
+    contar_es(&estatisticas_es.quadros_enviados, 1);
+    return (enviados == tam_total);
+}
+
+// Prepara uma conexão no formato clássico com o outro lado
+void inicializar_conexao(Conexao *conexao, int sockfd, const char *interface, 
+                         const unsigned char *mac_destino, const unsigned char *mac_origem) {
+    memset(conexao, 0, sizeof(*conexao));
+    conexao->sockfd = sockfd;
+    
+    conexao->endereco.sll_family = AF_PACKET;
+    conexao->endereco.sll_ifindex = if_nametoindex(interface);
+    conexao->endereco.sll_halen = ETH_ALEN;
+    memcpy(conexao->endereco.sll_addr, mac_destino, 6);
+    
+    memcpy(conexao->mac_destino, mac_destino, 6);
+    memcpy(conexao->mac_origem, mac_origem, 6);
+    
+    conexao->estendido = false;
+    conexao->crc32c = false;
+    conexao->sack = false;
+    conexao->compressao = false;
+    conexao->retomada = false;
+    conexao->espaco_seq = NUM_SEQ;
+    conexao->max_dados = TAM_MAX_DADOS;
+    rto_iniciar(&conexao->rto);
+}
+
+// Envia um quadro pela conexão, no formato negociado
+bool enviar_quadro(Conexao *conexao, unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados) {
+    return transmitir_quadro(conexao->sockfd, &conexao->endereco, formato_conexao(conexao), 
+                             conexao->mac_destino, conexao->mac_origem, 
+                             tipo, seq, dados, tam_dados);
+}
+
+// Formato de envio negociado na conexão
+static unsigned char formato_conexao(const Conexao *conexao) {
+    if (!conexao->estendido) {
+        return 0;
+    }
+    return FLAG_ESTENDIDO | (conexao->crc32c ? FLAG_CRC32C : 0);
+}
+
+// Envia vários quadros pela conexão com uma única chamada de sistema
+// (sendmmsg, ou um só aviso ao kernel no modo anel). Cada mensagem é um iovec
+// com o cabeçalho montado na pilha e os dados no lugar onde estão, sem cópia.
+// Retorna o número de quadros enviados.
+int enviar_pacotes_lote(Conexao *conexao, const QuadroSaida *quadros, int num_quadros) {
+    unsigned char formato = formato_conexao(conexao);
+    
+    if (!modo_lote) {
+        int enviados = 0;
+        for (int i = 0; i < num_quadros; i++) {
+            if (enviar_quadro(conexao, quadros[i].tipo, quadros[i].seq, 
+                              quadros[i].dados, quadros[i].tam_dados)) {
+                enviados++;
+            }
+        }
+        return enviados;
+    }
+    
+    if (anel_ativo(conexao->sockfd)) {
+        return anel_enviar_lote(&conexao->endereco, formato, conexao->mac_destino, 
+                                conexao->mac_origem, quadros, num_quadros);
+    }
+    
+    unsigned char cabecalhos[MAX_PACOTES_POR_EVENTO][sizeof(struct ether_header) + TAM_CABECALHO_EXT];
+    struct iovec partes[MAX_PACOTES_POR_EVENTO][2];
+    struct mmsghdr mensagens[MAX_PACOTES_POR_EVENTO];
+    int enviados = 0;
+    
+    while (enviados < num_quadros) {
+        int lote = 0;
+        
+        // Monta até MAX_PACOTES_POR_EVENTO mensagens por chamada
+        while (lote < MAX_PACOTES_POR_EVENTO && enviados + lote < num_quadros) {
+            const QuadroSaida *q = &quadros[enviados + lote];
+            int tam_cabecalho = montar_cabecalho(cabecalhos[lote], formato, conexao->mac_destino, 
+                                                 conexao->mac_origem, q->tipo, q->seq, 
+                                                 q->dados, q->tam_dados, q->verificacao);
+            if (tam_cabecalho < 0) {
+                return enviados;
+            }
+            
+            partes[lote][0].iov_base = cabecalhos[lote];
+            partes[lote][0].iov_len = tam_cabecalho;
+            partes[lote][1].iov_base = q->dados;
+            partes[lote][1].iov_len = (q->dados != NULL) ? q->tam_dados : 0;
             
-            // Verifica se a posição já tem um tesouro
-            if (!jogo->grid_tesouro[y][x]) {
-                jogo->tesouros[i].pos.x = x;
-                jogo->tesouros[i].pos.y = y;
-                jogo->grid_tesouro[y][x] = true;
-                posicao_valida = true;
+            memset(&mensagens[lote], 0, sizeof(mensagens[lote]));
+            mensagens[lote].msg_hdr.msg_name = &conexao->endereco;
+            mensagens[lote].msg_hdr.msg_namelen = sizeof(conexao->endereco);
+            mensagens[lote].msg_hdr.msg_iov = partes[lote];
+            mensagens[lote].msg_hdr.msg_iovlen = 2;
+            lote++;
+        }
+        
+        int r = sendmmsg(conexao->sockfd, mensagens, lote, 0);
+        contar_es(&estatisticas_es.chamadas_envio, 1);
+        
+        if (r < 0) {
+            perror("sendmmsg");
+            return enviados;
+        }
+        
+        contar_es(&estatisticas_es.quadros_enviados, r);
+        enviados += r;
+        
+        // Envio parcial (fila do socket cheia): o restante fica para o chamador
+        if (r < lote) {
+            break;
+        }
+    }
+    
+    return enviados;
+}
+
+// Recebe de uma vez todos os quadros disponíveis (até max_pacotes) com um
+// único recvmmsg e valida cada um. Os dados dos pacotes apontam para dentro
+// de 'buffers' (ou do anel) e valem até a próxima chamada.
+// Retorna o número de pacotes válidos, ou -1 se nada havia para ler.
+int receber_pacotes_lote(int sockfd, BuffersLote *buffers, Pacote *pacotes, int max_pacotes) {
+    if (max_pacotes > MAX_PACOTES_POR_EVENTO) {
+        max_pacotes = MAX_PACOTES_POR_EVENTO;
+    }
+    
+    if (!modo_lote) {
+        // Um quadro por chamada, como em receber_quadro
+        if (!receber_quadro(sockfd, buffers->quadros[0], &pacotes[0])) {
+            return anel_tem_pendentes(sockfd) ? 0 : -1;
+        }
+        return 1;
+    }
+    
+    if (anel_ativo(sockfd)) {
+        return anel_receber_lote(pacotes, max_pacotes);
+    }
+    
+    struct iovec partes[MAX_PACOTES_POR_EVENTO];
+    struct mmsghdr mensagens[MAX_PACOTES_POR_EVENTO];
+    
+    memset(mensagens, 0, sizeof(mensagens[0]) * max_pacotes);
+    for (int i = 0; i < max_pacotes; i++) {
+        partes[i].iov_base = buffers->quadros[i];
+        partes[i].iov_len = TAM_MAX_QUADRO;
+        mensagens[i].msg_hdr.msg_iov = &partes[i];
+        mensagens[i].msg_hdr.msg_iovlen = 1;
+    }
+    
+    int n = recvmmsg(sockfd, mensagens, max_pacotes, MSG_DONTWAIT, NULL);
+    contar_es(&estatisticas_es.chamadas_recepcao, 1);
+    
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("recvmmsg");
+        }
+        return -1;
+    }
+    
+    contar_es(&estatisticas_es.quadros_recebidos, n);
+    
+    int validos = 0;
+    for (int i = 0; i < n; i++) {
+        if (aceitar_quadro(buffers->quadros[i], mensagens[i].msg_len, &pacotes[validos])) {
+            validos++;
+        }
+    }
+    
+    return validos;
+}
+
+// Ativa ou desativa o envio e a recepção em lote
+void definir_modo_lote(bool ativo) {
+    modo_lote = ativo;
+}
+
+// Liga ou desliga as mensagens de depuração
+void definir_depuracao(bool ativa) {
+    depuracao = ativa;
+}
+
+bool depuracao_ativa() {
+    return depuracao;
+}
+
+// Copia os contadores de E/S do processo
+void obter_estatisticas_es(EstatisticasES *estatisticas) {
+    estatisticas->quadros_enviados = __atomic_load_n(&estatisticas_es.quadros_enviados, __ATOMIC_RELAXED);
+    estatisticas->chamadas_envio = __atomic_load_n(&estatisticas_es.chamadas_envio, __ATOMIC_RELAXED);
+    estatisticas->quadros_recebidos = __atomic_load_n(&estatisticas_es.quadros_recebidos, __ATOMIC_RELAXED);
+    estatisticas->chamadas_recepcao = __atomic_load_n(&estatisticas_es.chamadas_recepcao, __ATOMIC_RELAXED);
+    estatisticas->quadros_corrompidos = __atomic_load_n(&estatisticas_es.quadros_corrompidos, __ATOMIC_RELAXED);
+    estatisticas->quadros_descartados = __atomic_load_n(&estatisticas_es.quadros_descartados, __ATOMIC_RELAXED);
+}
+
+// Imprime os contadores de E/S e o tempo de CPU do processo por quadro
+void imprimir_estatisticas_es() {
+    EstatisticasES est;
+    obter_estatisticas_es(&est);
+    
+    struct rusage uso;
+    getrusage(RUSAGE_SELF, &uso);
+    double cpu_us = uso.ru_utime.tv_sec * 1e6 + uso.ru_utime.tv_usec + 
+                    uso.ru_stime.tv_sec * 1e6 + uso.ru_stime.tv_usec;
+    unsigned long quadros = est.quadros_enviados + est.quadros_recebidos;
+    
+    printf("E/S (%s): %lu quadros enviados em %lu chamadas, %lu recebidos em %lu chamadas.\n", 
+           modo_lote ? "em lote" : "um quadro por chamada", 
+           est.quadros_enviados, est.chamadas_envio, est.quadros_recebidos, est.chamadas_recepcao);
+    if (est.quadros_corrompidos > 0 || est.quadros_descartados > 0) {
+        printf("Falhas na recepção: %lu quadros corrompidos, %lu perdas simuladas.\n", 
+               est.quadros_corrompidos, est.quadros_descartados);
+    }
+    if (quadros > 0) {
+        printf("CPU: %.0f us no total, %.2f us por quadro.\n", cpu_us, cpu_us / quadros);
+    }
+}
+
+// Maior payload do formato estendido que cabe no MTU da interface
+int max_dados_interface(const char *interface) {
+    struct ifreq ifr = {0};
+    strncpy(ifr.ifr_name, interface, IFNAMSIZ - 1);
+    
+    int mtu = 1500;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd >= 0) {
+        if (ioctl(fd, SIOCGIFMTU, &ifr) == 0) {
+            mtu = ifr.ifr_mtu;
+        }
+        close(fd);
+    }
+    
+    int max_dados = mtu - TAM_CABECALHO_EXT;
+    if (max_dados > TAM_MAX_DADOS_EXT) {
+        max_dados = TAM_MAX_DADOS_EXT;
+    }
+    if (max_dados < TAM_MAX_DADOS) {
+        max_dados = TAM_MAX_DADOS;
+    }
+    
+    return max_dados;
+}
+
+// Preenche o payload de TIPO_NEGOCIACAO e retorna seu tamanho
+int montar_negociacao(unsigned char *dados, int max_dados, unsigned char capacidades) {
+    uint16_t max_rede = htons(max_dados);
+    
+    dados[0] = VERSAO_EXT;
+    memcpy(dados + 1, &max_rede, 2);
+    dados[3] = capacidades;
+    
+    return TAM_NEGOCIACAO;
+}
+
+// Aplica à conexão o resultado de uma negociação: usa o formato estendido se o
+// outro lado o conhece (com sequências de 16 bits), o menor payload máximo
+// entre os dois e CRC32C se qualquer um dos lados o pediu
+bool aplicar_negociacao(Conexao *conexao, const unsigned char *dados, int tam_dados, 
+                        int max_dados_local, unsigned char capacidades_local) {
+    if (tam_dados < TAM_NEGOCIACAO || dados[0] < VERSAO_EXT) {
+        return false;
+    }
+    
+    uint16_t max_rede;
+    memcpy(&max_rede, dados + 1, 2);
+    int max_remoto = ntohs(max_rede);
+    
+    conexao->max_dados = (max_remoto < max_dados_local) ? max_remoto : max_dados_local;
+    if (conexao->max_dados < TAM_MAX_DADOS) {
+        conexao->max_dados = TAM_MAX_DADOS;
+    }
+    conexao->estendido = true;
+    conexao->espaco_seq = NUM_SEQ_EXT;
+    conexao->crc32c = ((dados[3] | capacidades_local) & CAPACIDADE_CRC32C) != 0;
+    conexao->sack = (dados[3] & capacidades_local & CAPACIDADE_SACK) != 0;
+    conexao->compressao = (dados[3] & capacidades_local & CAPACIDADE_COMPRESSAO) != 0;
+    conexao->retomada = (dados[3] & capacidades_local & CAPACIDADE_RETOMADA) != 0;
+    
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Modo anel (PACKET_MMAP com TPACKET_V3)
+//
+// Os anéis de recepção e transmissão ficam em uma única região mapeada:
+// primeiro os blocos RX, depois os quadros TX. Na recepção o kernel entrega
+// blocos inteiros com vários quadros; na transmissão cada quadro é montado
+// no próprio anel e o kernel é avisado com um sendto sem dados.
+// ---------------------------------------------------------------------------
+
+// Estado do anel de um socket (um por processo)
+typedef struct {
+    int sockfd;                       // Socket dono do anel (-1 se inativo)
+    unsigned char *mapa;              // Região mapeada (RX seguido de TX)
+    size_t tam_mapa;
+    struct tpacket_req3 req_rx;
+    struct tpacket_req3 req_tx;
+    unsigned char *base_tx;           // Início do anel de transmissão
+    unsigned int bloco_rx;            // Bloco RX sendo consumido
+    struct tpacket3_hdr *quadro_rx;   // Próximo quadro dentro do bloco
+    unsigned int restantes_rx;        // Quadros ainda não lidos no bloco
+    bool liberar_bloco;               // Bloco lido por completo, devolver ao kernel
+    bool nao_bloqueante;              // Não espera por blocos em anel_receber
+    unsigned int quadro_tx;           // Próximo quadro livre do anel TX
+    pthread_mutex_t mutex_tx;         // Cliente envia de duas threads
+} AnelPacotes;
+
+static AnelPacotes anel = { .sockfd = -1, .mutex_tx = PTHREAD_MUTEX_INITIALIZER };
+
+// Indica se o socket está usando o modo anel
+bool anel_ativo(int sockfd) {
+    return anel.sockfd >= 0 && anel.sockfd == sockfd;
+}
+
+// Configura os anéis RX/TX no socket. Em caso de falha o socket continua
+// funcionando com sendto/recvfrom.
+bool ativar_anel_pacotes(int sockfd) {
+    if (anel.sockfd >= 0) {
+        fprintf(stderr, "Modo anel já ativo em outro socket.\n");
+        return false;
+    }
+    
+    int versao = TPACKET_V3;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_VERSION, &versao, sizeof(versao)) == -1) {
+        perror("setsockopt PACKET_VERSION");
+        return false;
+    }
+    
+    memset(&anel.req_rx, 0, sizeof(anel.req_rx));
+    anel.req_rx.tp_block_size = TAM_BLOCO_ANEL;
+    anel.req_rx.tp_block_nr = NUM_BLOCOS_RX;
+    anel.req_rx.tp_frame_size = TAM_QUADRO_ANEL;
+    anel.req_rx.tp_frame_nr = (TAM_BLOCO_ANEL / TAM_QUADRO_ANEL) * NUM_BLOCOS_RX;
+    anel.req_rx.tp_retire_blk_tov = TIMEOUT_BLOCO_MS;
+    
+    // O anel TX do TPACKET_V3 é organizado em quadros e não aceita os campos de bloco
+    memset(&anel.req_tx, 0, sizeof(anel.req_tx));
+    anel.req_tx.tp_block_size = TAM_BLOCO_ANEL;
+    anel.req_tx.tp_block_nr = NUM_BLOCOS_TX;
+    anel.req_tx.tp_frame_size = TAM_QUADRO_ANEL;
+    anel.req_tx.tp_frame_nr = (TAM_BLOCO_ANEL / TAM_QUADRO_ANEL) * NUM_BLOCOS_TX;
+    
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &anel.req_rx, sizeof(anel.req_rx)) == -1) {
+        perror("setsockopt PACKET_RX_RING");
+        return false;
+    }
+    
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_TX_RING, &anel.req_tx, sizeof(anel.req_tx)) == -1) {
+        perror("setsockopt PACKET_TX_RING");
+        return false;
+    }
+    
+    size_t tam_rx = (size_t)anel.req_rx.tp_block_size * anel.req_rx.tp_block_nr;
+    size_t tam_tx = (size_t)anel.req_tx.tp_block_size * anel.req_tx.tp_block_nr;
+    
+    anel.mapa = mmap(NULL, tam_rx + tam_tx, PROT_READ | PROT_WRITE, 
+                     MAP_SHARED | MAP_LOCKED, sockfd, 0);
+    if (anel.mapa == MAP_FAILED) {
+        // MAP_LOCKED pode falhar por limite de memória travada; tenta sem ele
+        anel.mapa = mmap(NULL, tam_rx + tam_tx, PROT_READ | PROT_WRITE, 
+                         MAP_SHARED, sockfd, 0);
+    }
+    if (anel.mapa == MAP_FAILED) {
+        perror("mmap do anel de pacotes");
+        return false;
+    }
+    
+    anel.tam_mapa = tam_rx + tam_tx;
+    anel.base_tx = anel.mapa + tam_rx;
+    anel.bloco_rx = 0;
+    anel.quadro_rx = NULL;
+    anel.restantes_rx = 0;
+    anel.liberar_bloco = false;
+    anel.quadro_tx = 0;
+    anel.sockfd = sockfd;
+    
+    return true;
+}
+
+// Desfaz o mapeamento dos anéis (o socket continua aberto)
+void liberar_anel_pacotes(int sockfd) {
+    if (!anel_ativo(sockfd)) {
+        return;
+    }
+    
+    munmap(anel.mapa, anel.tam_mapa);
+    anel.mapa = NULL;
+    anel.sockfd = -1;
+}
+
+// Indica se há quadros já entregues pelo kernel e ainda não lidos
+bool anel_tem_pendentes(int sockfd) {
+    if (!anel_ativo(sockfd)) {
+        return false;
+    }
+    
+    if (anel.restantes_rx > 0) {
+        return true;
+    }
+    
+    unsigned int bloco = anel.bloco_rx;
+    if (anel.liberar_bloco) {
+        bloco = (bloco + 1) % anel.req_rx.tp_block_nr;
+    }
+    
+    struct tpacket_block_desc *desc = (struct tpacket_block_desc *)
+        (anel.mapa + (size_t)bloco * anel.req_rx.tp_block_size);
+    
+    return (desc->hdr.bh1.block_status & TP_STATUS_USER) != 0;
+}
+
+// Obtém o próximo quadro do anel RX, esperando se nenhum bloco estiver pronto
+bool anel_receber(unsigned char **quadro, int *tam) {
+    // O último quadro do bloco anterior já foi usado pelo chamador: devolve o bloco
+    if (anel.liberar_bloco) {
+        struct tpacket_block_desc *desc = (struct tpacket_block_desc *)
+            (anel.mapa + (size_t)anel.bloco_rx * anel.req_rx.tp_block_size);
+        __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        anel.bloco_rx = (anel.bloco_rx + 1) % anel.req_rx.tp_block_nr;
+        anel.liberar_bloco = false;
+    }
+    
+    if (anel.restantes_rx == 0) {
+        struct tpacket_block_desc *desc = (struct tpacket_block_desc *)
+            (anel.mapa + (size_t)anel.bloco_rx * anel.req_rx.tp_block_size);
+        
+        while (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            if (anel.nao_bloqueante) {
+                return false;
+            }
+            struct pollfd pfd = { .fd = anel.sockfd, .events = POLLIN | POLLERR };
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                perror("poll");
+                return false;
             }
         }
+        
+        anel.restantes_rx = desc->hdr.bh1.num_pkts;
+        anel.quadro_rx = (struct tpacket3_hdr *)((unsigned char *)desc + desc->hdr.bh1.offset_to_first_pkt);
+        
+        // Bloco vazio (retirado por timeout sem pacotes)
+        if (anel.restantes_rx == 0) {
+            anel.liberar_bloco = true;
+            return false;
+        }
     }
+    
+    struct tpacket3_hdr *hdr = anel.quadro_rx;
+    *quadro = (unsigned char *)hdr + hdr->tp_mac;
+    *tam = hdr->tp_snaplen;
+    
+    anel.restantes_rx--;
+    if (anel.restantes_rx > 0) {
+        anel.quadro_rx = (struct tpacket3_hdr *)((unsigned char *)hdr + hdr->tp_next_offset);
+    } else {
+        anel.liberar_bloco = true;
+    }
+    
+    return true;
 }
 
-// Função para mover o jogador
-bool mover_jogador(EstadoJogo *jogo, int direcao) {
-    int novo_x = jogo->jogador.x;
-    int novo_y = jogo->jogador.y;
+// Monta os quadros diretamente nos próximos slots do anel TX e pede a
+// transmissão de todos com um único aviso ao kernel. Retorna quantos foram
+// entregues ao kernel, sempre os primeiros da lista: para no primeiro slot
+// que não fica livre a tempo e no primeiro quadro que não pode ser montado.
+static int anel_enviar_lote(struct sockaddr_ll *endereco, unsigned char formato, unsigned char *mac_destino, 
+                            unsigned char *mac_origem, const QuadroSaida *quadros, int num_quadros) {
+    int marcados = 0;
     
-    // Calcula a nova posição com base na direção
-    switch (direcao) {
-        case TIPO_MOVE_DIR:   // Direita
-            novo_x++;
+    pthread_mutex_lock(&anel.mutex_tx);
+    
+    for (int i = 0; i < num_quadros; i++) {
+        struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)
+            (anel.base_tx + (size_t)anel.quadro_tx * anel.req_tx.tp_frame_size);
+        
+        // Aguarda o kernel liberar o slot caso o anel esteja cheio, por um
+        // tempo limitado: a trava impede as outras threads de enviar
+        struct timespec inicio;
+        marcar_instante(&inicio);
+        bool livre = true;
+        while (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            if (hdr->tp_status & TP_STATUS_WRONG_FORMAT) {
+                hdr->tp_status = TP_STATUS_AVAILABLE;
+                break;
+            }
+            if (tempo_decorrido_ms(&inicio) >= ESPERA_MAX_TX_MS) {
+                livre = false;
+                break;
+            }
+            // Os quadros já marcados precisam ser enviados para liberar espaço
+            sendto(anel.sockfd, NULL, 0, MSG_DONTWAIT, (struct sockaddr*)endereco, sizeof(struct sockaddr_ll));
+            struct pollfd pfd = { .fd = anel.sockfd, .events = POLLOUT };
+            poll(&pfd, 1, 1);
+        }
+        if (!livre) {
+            fprintf(stderr, "Anel de transmissão cheio por %d ms.\n", ESPERA_MAX_TX_MS);
             break;
-        case TIPO_MOVE_ESQ:   // Esquerda
-            novo_x--;
+        }
+        
+        unsigned char *quadro = (unsigned char *)hdr + TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+        int tam_total = montar_quadro_formato(quadro, formato, mac_destino, mac_origem, quadros[i].tipo, 
+                                              quadros[i].seq, quadros[i].dados, quadros[i].tam_dados, 
+                                              quadros[i].verificacao);
+        if (tam_total < 0) {
             break;
-        case TIPO_MOVE_CIMA:  // Cima
-            novo_y++;
+        }
+        
+        hdr->tp_len = tam_total;
+        hdr->tp_snaplen = tam_total;
+        hdr->tp_next_offset = 0;
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        anel.quadro_tx = (anel.quadro_tx + 1) % anel.req_tx.tp_frame_nr;
+        marcados++;
+    }
+    
+    // Sem dados: o kernel transmite todos os quadros marcados no anel
+    ssize_t r = sendto(anel.sockfd, NULL, 0, 0, (struct sockaddr*)endereco, sizeof(struct sockaddr_ll));
+    pthread_mutex_unlock(&anel.mutex_tx);
+    contar_es(&estatisticas_es.chamadas_envio, 1);
+    
+    // Os quadros marcados continuam no anel e saem no próximo aviso, então
+    // uma falha aqui não os desfaz
+    if (r < 0) {
+        perror("sendto (anel)");
+    }
+    
+    contar_es(&estatisticas_es.quadros_enviados, marcados);
+    return marcados;
+}
+
+// Monta o quadro diretamente no próximo slot do anel TX e pede a transmissão
+bool anel_enviar(struct sockaddr_ll *endereco, unsigned char formato, unsigned char *mac_destino, 
+                 unsigned char *mac_origem, unsigned char tipo, uint16_t seq, 
+                 unsigned char *dados, int tam_dados) {
+    QuadroSaida quadro = { .tipo = tipo, .seq = seq, .dados = dados, .tam_dados = tam_dados };
+    return anel_enviar_lote(endereco, formato, mac_destino, mac_origem, &quadro, 1) == 1;
+}
+
+// Lê do anel RX os quadros já entregues pelo kernel. Para no fim de um bloco:
+// os quadros lidos só continuam válidos enquanto o bloco não é devolvido.
+static int anel_receber_lote(Pacote *pacotes, int max_pacotes) {
+    int validos = 0;
+    int lidos = 0;
+    
+    while (lidos < max_pacotes) {
+        unsigned char *quadro;
+        int n;
+        
+        if (!anel_receber(&quadro, &n)) {
+            // Bloco vazio retirado por timeout: tenta o próximo se já estiver pronto
+            if (lidos == 0 && anel_tem_pendentes(anel.sockfd)) {
+                continue;
+            }
             break;
-        case TIPO_MOVE_BAIXO: // Baixo
-            novo_y--;
+        }
+        
+        lidos++;
+        if (aceitar_quadro(quadro, n, &pacotes[validos])) {
+            validos++;
+        }
+        
+        if (anel.liberar_bloco) {
             break;
-        default:
-            return false;
+        }
     }
     
-    // Verifica se a nova posição está dentro dos limites do grid
-    if (novo_x < 0 || novo_x >= GRID_SIZE || novo_y < 0 || novo_y >= GRID_SIZE) {
-        return false;
+    contar_es(&estatisticas_es.quadros_recebidos, lidos);
+    return (lidos > 0) ? validos : -1;
+}
+
+// Aguarda até timeout_ms milissegundos por um pacote no socket
+bool aguardar_pacote(int sockfd, int timeout_ms) {
+    struct pollfd pfd = {0};
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    
+    if (timeout_ms < 0) {
+        timeout_ms = 0;
+    }
+    
+    // Quadros já entregues no anel não geram um novo evento no socket
+    if (anel_tem_pendentes(sockfd)) {
+        return true;
     }
     
-    // Atualiza a posição do jogador
-    jogo->jogador.x = novo_x;
-    jogo->jogador.y = novo_y;
+    int pronto = poll(&pfd, 1, timeout_ms);
+    if (pronto < 0 && errno != EINTR) {
+        perror("poll");
+    }
+    
+    return (pronto > 0 && (pfd.revents & POLLIN));
+}
+
+// Coloca o socket em modo não bloqueante, para uso com o reator
+bool configurar_nao_bloqueante(int sockfd) {
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl O_NONBLOCK");
+        return false;
+    }
     
-    // Marca a posição como visitada
-    jogo->grid_visitado[novo_y][novo_x] = true;
+    if (anel_ativo(sockfd)) {
+        anel.nao_bloqueante = true;
+    }
     
     return true;
 }
 
-// Função para verificar se há um tesouro na posição atual do jogador
-int verificar_tesouro(EstadoJogo *jogo) {
-    int x = jogo->jogador.x;
-    int y = jogo->jogador.y;
-    
-    // Verifica se há um tesouro na posição
-    if (jogo->grid_tesouro[y][x]) {
-        // Procura qual tesouro está nesta posição
-        for (int i = 0; i < NUM_TESOUROS; i++) {
-            if (jogo->tesouros[i].pos.x == x && jogo->tesouros[i].pos.y == y) {
-                if (!jogo->tesouros[i].encontrado) {
-                    jogo->tesouros[i].encontrado = true;
-                    return i + 1; // Retorna o índice do tesouro (1-based)
-                }
-                return 0; // Tesouro já encontrado
-            }
+// Aritmética de números de sequência (RFC 1982) em um espaço de 'espaco'
+// valores: NUM_SEQ no formato clássico, NUM_SEQ_EXT no estendido
+
+// Sequência 'passos' posições depois de 'seq'
+uint16_t avancar_seq(uint16_t seq, uint32_t passos, uint32_t espaco) {
+    return (uint16_t)((seq + passos) % espaco);
+}
+
+// Distância da sequência 'de' até a sequência 'ate', sempre para a frente
+uint32_t distancia_seq(uint16_t de, uint16_t ate, uint32_t espaco) {
+    return ((uint32_t)ate + espaco - de) % espaco;
+}
+
+// Indica se 'a' vem antes de 'b': a distância de 'a' até 'b' cabe em meio
+// espaço. Sequências a meio espaço de distância não são comparáveis.
+bool seq_anterior(uint16_t a, uint16_t b, uint32_t espaco) {
+    uint32_t distancia = distancia_seq(a, b, espaco);
+    return distancia != 0 && distancia < espaco / 2;
+}
+
+// Maior janela da repetição seletiva na conexão: metade do espaço de
+// sequência, para que um quadro antigo nunca se confunda com um novo
+int janela_maxima(const Conexao *conexao) {
+    int metade = conexao->espaco_seq / 2;
+    return (metade < JANELA_MAX) ? metade : JANELA_MAX;
+}
+
+// Marca o instante atual no relógio monotônico. Os prazos e as medidas de
+// RTT usam só esse relógio: um ajuste do relógio do sistema (NTP, date) não
+// gera amostras negativas nem dispara ou adia todos os prazos de uma vez.
+void marcar_instante(struct timespec *instante) {
+    clock_gettime(CLOCK_MONOTONIC, instante);
+}
+
+// Milissegundos decorridos desde 'inicio'
+long tempo_decorrido_ms(const struct timespec *inicio) {
+    struct timespec atual;
+    marcar_instante(&atual);
+    return (atual.tv_sec - inicio->tv_sec) * 1000 + 
+           (atual.tv_nsec - inicio->tv_nsec) / 1000000;
+}
+
+// Microssegundos decorridos desde 'inicio'
+long long tempo_decorrido_us(const struct timespec *inicio) {
+    struct timespec atual;
+    marcar_instante(&atual);
+    return (atual.tv_sec - inicio->tv_sec) * 1000000LL + 
+           (atual.tv_nsec - inicio->tv_nsec) / 1000;
+}
+
+// Prepara o estimador: sem medidas, o prazo é o TIMEOUT_MS fixo
+void rto_iniciar(EstimadorRTO *rto) {
+    memset(rto, 0, sizeof(*rto));
+    rto->rto_us = TIMEOUT_MS * 1000LL;
+}
+
+// Limita o prazo ao intervalo [RTO_MIN_US, RTO_MAX_US]
+static long long limitar_rto(long long rto_us) {
+    if (rto_us < RTO_MIN_US) {
+        return RTO_MIN_US;
+    }
+    if (rto_us > RTO_MAX_US) {
+        return RTO_MAX_US;
+    }
+    return rto_us;
+}
+
+// Incorpora uma medida de RTT. Pela regra de Karn, o chamador só mede pacotes
+// que não foram retransmitidos: o ACK de um retransmitido é ambíguo.
+void rto_registrar_amostra(EstimadorRTO *rto, long long rtt_us) {
+    if (rtt_us <= 0) {
+        rtt_us = 1;
+    }
+    
+    if (rto->amostras == 0) {
+        rto->srtt_us = rtt_us;
+        rto->rttvar_us = rtt_us / 2;
+    } else {
+        long long erro = rto->srtt_us - rtt_us;
+        if (erro < 0) {
+            erro = -erro;
         }
+        // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|;  SRTT = 7/8 SRTT + 1/8 R
+        rto->rttvar_us = (3 * rto->rttvar_us + erro) / 4;
+        rto->srtt_us = (7 * rto->srtt_us + rtt_us) / 8;
+    }
+    
+    rto->amostras++;
+    rto->backoff = 0;
+    rto->rto_us = limitar_rto(rto->srtt_us + 4 * rto->rttvar_us);
+}
+
+// O prazo venceu: dobra o RTO até a próxima medida válida
+void rto_registrar_expiracao(EstimadorRTO *rto) {
+    rto->expiracoes++;
+    rto->backoff++;
+    rto->rto_us = limitar_rto(rto->rto_us * 2);
+}
+
+// Prazo de retransmissão atual em microssegundos
+long long rto_atual_us(const EstimadorRTO *rto) {
+    return rto->rto_us;
+}
+
+// Indica se um pacote sem resposta deve ser abandonado: esgotou as tentativas
+// e está sem confirmação há pelo menos PACIENCIA_MS. Com um RTO de
+// microssegundos, as tentativas sozinhas acabariam em poucos milissegundos.
+bool deve_desistir(int tentativas, const struct timespec *primeiro_envio) {
+    return tentativas >= MAX_RETRIES && tempo_decorrido_ms(primeiro_envio) >= PACIENCIA_MS;
+}
+
+// Imprime o estado do estimador de RTO de um par
+void imprimir_estatisticas_rto(const char *par, const EstimadorRTO *rto) {
+    printf("RTO (%s): %.3f ms, SRTT %.3f ms, RTTVAR %.3f ms, %lu medidas, %lu expirações.\n", 
+           par, rto->rto_us / 1000.0, rto->srtt_us / 1000.0, rto->rttvar_us / 1000.0, 
+           rto->amostras, rto->expiracoes);
+}
+
+// Função para verificar o espaço disponível em um diretório
+bool verifica_espaco_disponivel(const char* diretorio, size_t tamanho_necessario) {
+    struct statvfs stat;
+    
+    if (statvfs(diretorio, &stat) != 0) {
+        perror("statvfs");
+        return false;
+    }
+    
+    // Calcula o espaço livre em bytes
+    size_t espaco_livre = stat.f_bsize * stat.f_bavail;
+    
+    // Adiciona uma margem de segurança (10%)
+    size_t tamanho_com_margem = tamanho_necessario * 1.1;
+    
+    return (espaco_livre >= tamanho_com_margem);
+}
+
+// Função para obter o tipo de um arquivo com base em sua extensão
+int obter_tipo_arquivo(const char *nome_arquivo) {
+    const char *extensao = strrchr(nome_arquivo, '.');
+    
+    if (extensao == NULL) {
+        return TIPO_ARQ_DESCONHECIDO;
     }
     
-    return 0; // Nenhum tesouro encontrado
+    if (strcasecmp(extensao, ".txt") == 0) {
+        return TIPO_ARQ_TEXTO;
+    } else if (strcasecmp(extensao, ".mp4") == 0) {
+        return TIPO_ARQ_VIDEO;
+    } else if (strcasecmp(extensao, ".jpg") == 0 || strcasecmp(extensao, ".jpeg") == 0) {
+        return TIPO_ARQ_IMAGEM;
+    }
+    
+    return TIPO_ARQ_DESCONHECIDO;
+}
+
+// Indica se vale a pena comprimir um tipo de arquivo: imagens e vídeos já
+// vêm comprimidos e só gastariam CPU
+bool tipo_comprimivel(int tipo_arquivo) {
+    return tipo_arquivo != TIPO_ARQ_VIDEO && tipo_arquivo != TIPO_ARQ_IMAGEM;
+}
+
+// Inteiro de 64 bits na ordem da rede (big-endian)
+void escrever_be64(unsigned char *destino, uint64_t valor) {
+    for (int i = 7; i >= 0; i--) {
+        destino[i] = valor & 0xFF;
+        valor >>= 8;
+    }
+}
+
+uint64_t ler_be64(const unsigned char *origem) {
+    uint64_t valor = 0;
+    for (int i = 0; i < 8; i++) {
+        valor = (valor << 8) | origem[i];
+    }
+    return valor;
 } 
\ No newline at end of file
@@ -7,7 +7,7 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/ether.h>
-#include <netpacket/packet.h>
+#include <linux/if_packet.h>
 #include <net/if.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -17,26 +17,82 @@
 #include <time.h>
 #include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/time.h>
 
 // Constantes do protocolo
 #define MARCADOR 0x7E          // Marcador de início do pacote (01111110)
 #define TAM_MAX_DADOS 127      // Tamanho máximo de dados em um pacote
 #define TAM_MAX_PACOTE 1500    // Tamanho máximo de um pacote Ethernet
+#define MTU_JUMBO 9000         // Maior MTU suportado (jumbo frames)
+#define TAM_MAX_QUADRO (14 + MTU_JUMBO) // Maior quadro recebido (Ethernet + MTU)
 #define ETH_CUSTOM_TYPE 0x88B5 // Tipo Ethernet personalizado para nosso protocolo
 #define TAM_MAX_NOME 63        // Tamanho máximo para o nome do arquivo
 
-// Estrutura do grid de jogo
-#define GRID_SIZE 8           // Grid 8x8
-#define NUM_TESOUROS 8        // Número de tesouros no jogo
+// Formato estendido do cabeçalho (após negociação):
+//   [0] marcador  [1] 0x80 | versão  [2] tipo  [3] flags (FLAG_CRC32C)
+//   [4-5] tamanho  [6-7] sequência  [8-11] verificação   (big-endian)
+#define FLAG_ESTENDIDO 0x80    // Bit que distingue o formato estendido do clássico
+#define FLAG_CRC32C 0x01       // Verificação é CRC32C em vez da soma de 8 bits
+#define VERSAO_EXT 1           // Versão do cabeçalho estendido
+#define TAM_CABECALHO_EXT 12   // Tamanho do cabeçalho estendido
+#define TAM_MAX_DADOS_EXT (MTU_JUMBO - TAM_CABECALHO_EXT) // Maior payload estendido
+#define TAM_NEGOCIACAO 4       // Payload de TIPO_NEGOCIACAO: versão, máx. dados (16 bits), capacidades
+#define CAPACIDADE_CRC32C 0x01 // Pede verificação CRC32C nos dois sentidos
+#define CAPACIDADE_SACK 0x02   // Sabe usar ACKs cumulativos com mapa de bits (os dois lados precisam)
+#define CAPACIDADE_COMPRESSAO 0x04 // Sabe descomprimir arquivos (os dois lados precisam)
+#define CAPACIDADE_RETOMADA 0x08   // Retoma arquivos interrompidos (os dois lados precisam)
+
+// Constantes do modo anel (PACKET_MMAP / TPACKET_V3)
+#define TAM_BLOCO_ANEL (1 << 16) // Tamanho de cada bloco dos anéis (64 KiB)
+#define TAM_QUADRO_ANEL (1 << 14) // Espaço reservado para cada quadro (cabe um jumbo frame)
+#define NUM_BLOCOS_RX 32       // Blocos do anel de recepção (2 MiB)
+#define NUM_BLOCOS_TX 16       // Blocos do anel de transmissão (64 quadros)
+#define TIMEOUT_BLOCO_MS 1     // Prazo para o kernel entregar um bloco parcial
+#define ESPERA_MAX_TX_MS 100   // Espera máxima por um slot livre no anel de transmissão
+
+// Arquivos dos tesouros (1 a 8 em objetos/). Com mais tesouros no grid, o
+// tesouro i usa o arquivo i % NUM_ARQUIVOS_TESOUROS.
+#define NUM_ARQUIVOS_TESOUROS 8
+
+// Mensagens de cada quadro e de cada movimento (opção -v). Desligadas, não
+// custam uma escrita no terminal por quadro no caminho de recepção.
+#define DEPURAR(...) do { if (depuracao_ativa()) printf(__VA_ARGS__); } while (0)
 
 // Constantes para timeout e retransmissão
-#define TIMEOUT_MS 500        // Timeout em milissegundos
+#define TIMEOUT_MS 500        // Timeout em milissegundos (RTO antes da primeira medida)
 #define MAX_RETRIES 5         // Número máximo de retentativas
 
+// Prazo adaptativo de retransmissão (RTO), estimado pelo RTT medido
+#define RTO_MIN_US 10000              // Menor RTO: cobre a entrega de blocos do anel em ambos os lados
+#define RTO_MAX_US 2000000LL          // Maior RTO, já com o backoff
+#define PACIENCIA_MS (MAX_RETRIES * TIMEOUT_MS) // Tempo mínimo sem resposta antes de desistir
+
+// Constantes da janela deslizante (repetição seletiva)
+#define NUM_SEQ 32            // Espaço de sequência do formato clássico (5 bits)
+#define NUM_SEQ_EXT 65536     // Espaço de sequência do formato estendido (16 bits)
+#define JANELA_MAX 1024       // Maior janela aceita (potência de 2, divide NUM_SEQ_EXT)
+#define JANELA_PADRAO 8       // Número padrão de pacotes em trânsito
+#define MAX_MOVIMENTOS_EM_VOO 8 // Movimentos enviados sem resposta (menos que meio NUM_SEQ, divide NUM_SEQ)
+#define TAM_BUFFER_SOCKET (8 << 20) // Buffers do socket: comportam uma janela cheia
+
+// ACK seletivo dos chunks de dados: TIPO_ACK com seq = último chunk recebido
+// em ordem e payload = mapa de bits, em que o bit i (bit i%8 do byte i/8)
+// indica que o chunk seq+1+i também chegou. O mapa vai só até o último bit
+// marcado.
+#define TAM_SACK ((JANELA_MAX + 7) / 8) // Maior mapa de bits, em bytes
+#define ACK_A_CADA_QUADROS 4  // Chunks em ordem que pedem um ACK imediato
+#define ATRASO_ACK_US 500     // Prazo máximo para confirmar um chunk em ordem
+
+// Número máximo de pacotes lidos a cada evento de leitura do socket
+#define MAX_PACOTES_POR_EVENTO 64
+
 // Tipos de mensagens
 #define TIPO_ACK 0            // Confirmação
 #define TIPO_NACK 1           // Negação
 #define TIPO_OK_ACK 2         // OK + confirmação
+#define TIPO_NEGOCIACAO 3     // Negociação do formato estendido (sempre no formato clássico)
 #define TIPO_TAMANHO 4        // Informa tamanho do arquivo
 #define TIPO_DADOS 5          // Dados do arquivo
 #define TIPO_TEXTO 6          // Arquivo de texto + ack + nome
@@ -47,12 +103,31 @@
 #define TIPO_MOVE_CIMA 11     // Movimento para cima
 #define TIPO_MOVE_BAIXO 12    // Movimento para baixo
 #define TIPO_MOVE_ESQ 13      // Movimento para esquerda
+#define TIPO_PARIDADE 14      // Paridade (FEC) de um bloco de chunks de dados
 #define TIPO_ERRO 15          // Erro
 
 // Códigos de erro
 #define ERRO_SEM_PERMISSAO 0  // Sem permissão de acesso
 #define ERRO_ESPACO_INSUF 1   // Espaço insuficiente
 
+// Extensão opcional do payload de TIPO_TAMANHO, depois do tamanho (size_t):
+// [opções][K][M], com K e M da correção de erros (treasure_fec.h), seguidos,
+// com OPCAO_ARQ_MOVIMENTO, da sequência (16 bits, big-endian) do movimento
+// que encontrou o tesouro
+#define TAM_EXTENSAO_TAMANHO 3
+#define TAM_MOVIMENTO_TAMANHO 2
+#define OPCAO_ARQ_FEC 0x01        // Blocos de chunks seguidos de quadros de paridade
+#define OPCAO_ARQ_COMPRIMIDO 0x02 // Conteúdo no formato de treasure_compressao.h
+#define OPCAO_ARQ_MOVIMENTO 0x04  // Sequência do movimento depois de K e M
+
+// Payload opcional do ACK do nome do arquivo, com a retomada negociada: o
+// byte (64 bits, big-endian) a partir do qual o cliente já tem o arquivo
+#define TAM_RETOMADA 8
+
+// Payload das respostas a movimentos (ACK e OK_ACK): largura e altura do grid
+// do servidor (32 bits cada, big-endian), com que o cliente monta o seu mundo
+#define TAM_DIMENSOES_GRID 8
+
 // Estados do protocolo para uso no cliente e servidor
 typedef enum {
     ESPERANDO_COMANDO,        // Esperando comando do usuário
@@ -67,35 +142,143 @@ typedef struct {
     int y;
 } Posicao;
 
-// Estrutura para representar um tesouro
+// Pacote recebido e validado (formato clássico ou estendido)
+typedef struct {
+    unsigned char tipo;
+    uint16_t seq;
+    unsigned char *dados;     // Aponta para dentro do buffer (ou do anel)
+    int tam_dados;
+    bool estendido;           // Chegou com o cabeçalho estendido
+    unsigned char mac_origem[6];
+    unsigned char mac_destino[6];
+} Pacote;
+
+// Estimador do RTO (Jacobson/Karels, RFC 6298) de um par
+typedef struct {
+    long long srtt_us;        // RTT suavizado (0 enquanto não há medidas)
+    long long rttvar_us;      // Variação do RTT
+    long long rto_us;         // Prazo atual, já com o backoff
+    int backoff;              // Expirações seguidas desde a última medida
+    unsigned long amostras;   // Medidas aceitas
+    unsigned long expiracoes; // Vezes em que o prazo venceu
+} EstimadorRTO;
+
+// Conexão com o outro lado: endereços e parâmetros negociados
 typedef struct {
-    Posicao pos;              // Posição do tesouro no grid
-    char nome[TAM_MAX_NOME];  // Nome do arquivo do tesouro
-    bool encontrado;          // Indica se o tesouro foi encontrado
-} Tesouro;
+    int sockfd;
+    struct sockaddr_ll endereco;
+    unsigned char mac_destino[6];
+    unsigned char mac_origem[6];
+    bool estendido;           // Envia com o cabeçalho estendido
+    bool crc32c;              // Verifica os quadros estendidos com CRC32C
+    bool sack;                // Chunks confirmados com ACKs seletivos
+    bool compressao;          // Arquivos comprimíveis vão comprimidos
+    bool retomada;            // Arquivos interrompidos continuam de onde pararam
+    uint32_t espaco_seq;      // Números de sequência distintos: NUM_SEQ ou NUM_SEQ_EXT
+    int max_dados;            // Maior payload por quadro aceito pelo outro lado
+    EstimadorRTO rto;         // Prazo de retransmissão para este par
+} Conexao;
 
-// Estrutura para representar o estado do jogo
+// Verificações dos dados de um quadro calculadas de antemão: no envio só a
+// parte do cabeçalho (tipo, sequência) é calculada e combinada com elas
 typedef struct {
-    Posicao jogador;          // Posição atual do jogador
-    Tesouro tesouros[NUM_TESOUROS]; // Lista de tesouros
-    bool grid_visitado[GRID_SIZE][GRID_SIZE]; // Grid de posições visitadas
-    bool grid_tesouro[GRID_SIZE][GRID_SIZE];  // Grid de posições com tesouros
-} EstadoJogo;
+    unsigned char soma;       // Soma de 8 bits dos dados
+    uint32_t crc;             // crc32c(0, dados)
+} VerificacaoDados;
+
+// Quadro a ser enviado em lote; os dados são lidos no lugar no momento do envio
+typedef struct {
+    unsigned char tipo;
+    uint16_t seq;
+    unsigned char *dados;
+    int tam_dados;
+    const VerificacaoDados *verificacao; // Verificações dos dados (NULL: calculadas no envio)
+} QuadroSaida;
+
+// Buffers para a recepção em lote: um quadro completo por mensagem
+typedef struct {
+    unsigned char quadros[MAX_PACOTES_POR_EVENTO][TAM_MAX_QUADRO];
+} BuffersLote;
+
+// Contadores de E/S, para comparar o caminho em lote com o de um quadro por vez
+typedef struct {
+    unsigned long quadros_enviados;
+    unsigned long chamadas_envio;      // sendto/sendmmsg (ou avisos ao anel)
+    unsigned long quadros_recebidos;
+    unsigned long chamadas_recepcao;   // recvfrom/recvmmsg (zero no modo anel)
+    unsigned long quadros_corrompidos; // Do protocolo, mas com verificação inválida
+    unsigned long quadros_descartados; // Perdas simuladas (simular_falhas)
+} EstatisticasES;
 
 // Funções de utilidade para o protocolo
 void print_buffer(const char* prefix, unsigned char* buffer, int size);
 unsigned char calcula_checksum(unsigned char* dados, int tamanho);
+uint32_t crc32c(uint32_t crc, const unsigned char *dados, size_t tamanho);
+uint32_t crc32c_software(uint32_t crc, const unsigned char *dados, size_t tamanho);
+bool crc32c_acelerado();
+uint32_t crc32c_combinar(uint32_t crc_a, uint32_t crc_b, size_t tam_b);
+void calcular_verificacao_dados(VerificacaoDados *verificacao, const unsigned char *dados, int tam_dados);
 int cria_raw_socket(char* interface);
+bool anexar_filtro_bpf(int sockfd, const unsigned char *mac_local);
+bool entrar_grupo_fanout(int sockfd, uint16_t grupo);
+int montar_quadro(unsigned char *quadro, unsigned char *mac_destino, unsigned char *mac_origem, 
+                  unsigned char tipo, unsigned char seq, unsigned char *dados, int tam_dados);
+int montar_quadro_estendido(unsigned char *quadro, unsigned char *mac_destino, unsigned char *mac_origem, 
+                            unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados, 
+                            unsigned char flags);
+bool validar_quadro(unsigned char *quadro, ssize_t n, Pacote *pacote);
+bool receber_quadro(int sockfd, unsigned char *buffer, Pacote *pacote);
+void inicializar_conexao(Conexao *conexao, int sockfd, const char *interface, 
+                         const unsigned char *mac_destino, const unsigned char *mac_origem);
+bool enviar_quadro(Conexao *conexao, unsigned char tipo, uint16_t seq, unsigned char *dados, int tam_dados);
+int enviar_pacotes_lote(Conexao *conexao, const QuadroSaida *quadros, int num_quadros);
+int receber_pacotes_lote(int sockfd, BuffersLote *buffers, Pacote *pacotes, int max_pacotes);
+void definir_modo_lote(bool ativo);
+void definir_depuracao(bool ativa);
+bool depuracao_ativa();
+void obter_estatisticas_es(EstatisticasES *estatisticas);
+void imprimir_estatisticas_es();
+void simular_falhas(double perda, double corrupcao);
+int max_dados_interface(const char *interface);
+int montar_negociacao(unsigned char *dados, int max_dados, unsigned char capacidades);
+bool aplicar_negociacao(Conexao *conexao, const unsigned char *dados, int tam_dados, 
+                        int max_dados_local, unsigned char capacidades_local);
 bool enviar_pacote(int sockfd, struct sockaddr_ll *endereco, unsigned char *mac_destino, 
                   unsigned char *mac_origem, unsigned char tipo, unsigned char seq, 
                   unsigned char *dados, int tam_dados);
 bool receber_pacote(int sockfd, unsigned char *buffer, unsigned char *tipo, 
                   unsigned char *seq, unsigned char **dados, int *tam_dados);
+bool aguardar_pacote(int sockfd, int timeout_ms);
+bool configurar_nao_bloqueante(int sockfd);
+
+// Modo anel (PACKET_MMAP): opcional, sendto/recvfrom continuam como alternativa
+bool ativar_anel_pacotes(int sockfd);
+void liberar_anel_pacotes(int sockfd);
+bool anel_ativo(int sockfd);
+bool anel_tem_pendentes(int sockfd);
+bool anel_receber(unsigned char **quadro, int *tam);
+bool anel_enviar(struct sockaddr_ll *endereco, unsigned char formato, unsigned char *mac_destino, 
+                 unsigned char *mac_origem, unsigned char tipo, uint16_t seq, 
+                 unsigned char *dados, int tam_dados);
+
+uint16_t avancar_seq(uint16_t seq, uint32_t passos, uint32_t espaco);
+uint32_t distancia_seq(uint16_t de, uint16_t ate, uint32_t espaco);
+bool seq_anterior(uint16_t a, uint16_t b, uint32_t espaco);
+int janela_maxima(const Conexao *conexao);
+void marcar_instante(struct timespec *instante);
+long tempo_decorrido_ms(const struct timespec *inicio);
+long long tempo_decorrido_us(const struct timespec *inicio);
+void rto_iniciar(EstimadorRTO *rto);
+void rto_registrar_amostra(EstimadorRTO *rto, long long rtt_us);
+void rto_registrar_expiracao(EstimadorRTO *rto);
+long long rto_atual_us(const EstimadorRTO *rto);
+bool deve_desistir(int tentativas, const struct timespec *primeiro_envio);
+void imprimir_estatisticas_rto(const char *par, const EstimadorRTO *rto);
 bool verifica_espaco_disponivel(const char* diretorio, size_t tamanho_necessario);
 int obter_tipo_arquivo(const char *nome_arquivo);
-void inicializar_jogo(EstadoJogo *jogo);
-bool mover_jogador(EstadoJogo *jogo, int direcao);
-int verificar_tesouro(EstadoJogo *jogo);
+bool tipo_comprimivel(int tipo_arquivo);
+void escrever_be64(unsigned char *destino, uint64_t valor);
+uint64_t ler_be64(const unsigned char *origem);
 
 // Valores para tipo de arquivo
 #define TIPO_ARQ_TEXTO 1
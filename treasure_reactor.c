@@ -0,0 +1,226 @@
+#include "treasure_reactor.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+// Inicializa o reator e o eventfd interno usado para interromper o laço
+bool reator_iniciar(Reator *reator) {
+    memset(reator, 0, sizeof(*reator));
+    
+    reator->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (reator->epfd == -1) {
+        perror("epoll_create1");
+        return false;
+    }
+    
+    reator->fd_parada = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reator->fd_parada == -1) {
+        perror("eventfd");
+        close(reator->epfd);
+        return false;
+    }
+    
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // Evento sem fonte: pedido de parada
+    epoll_ctl(reator->epfd, EPOLL_CTL_ADD, reator->fd_parada, &ev);
+    
+    reator->em_execucao = true;
+    return true;
+}
+
+// Libera todos os descritores criados pelo reator
+void reator_finalizar(Reator *reator) {
+    for (int i = 0; i < reator->num_fontes; i++) {
+        if (reator->fontes[i].ativa) {
+            reator_remover_fonte(reator, &reator->fontes[i]);
+        }
+    }
+    
+    if (reator->fd_parada > 0) {
+        close(reator->fd_parada);
+    }
+    if (reator->epfd > 0) {
+        close(reator->epfd);
+    }
+}
+
+// Reserva uma entrada livre na tabela de fontes e registra o fd no epoll
+static FonteEvento *registrar_fonte(Reator *reator, int fd, TipoFonte tipo,
+                                    TratadorEvento tratador, void *contexto) {
+    FonteEvento *fonte = NULL;
+    
+    for (int i = 0; i < reator->num_fontes; i++) {
+        if (!reator->fontes[i].ativa) {
+            fonte = &reator->fontes[i];
+            break;
+        }
+    }
+    
+    if (fonte == NULL) {
+        if (reator->num_fontes >= MAX_FONTES_REATOR) {
+            fprintf(stderr, "Erro: Número máximo de fontes do reator atingido.\n");
+            return NULL;
+        }
+        fonte = &reator->fontes[reator->num_fontes++];
+    }
+    
+    fonte->fd = fd;
+    fonte->tipo = tipo;
+    fonte->tratador = tratador;
+    fonte->contexto = contexto;
+    
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = fonte;
+    
+    if (epoll_ctl(reator->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        perror("epoll_ctl");
+        return NULL;
+    }
+    
+    fonte->ativa = true;
+    return fonte;
+}
+
+// Registra um descritor já existente (socket, stdin)
+FonteEvento *reator_adicionar_fd(Reator *reator, int fd, TratadorEvento tratador, void *contexto) {
+    return registrar_fonte(reator, fd, FONTE_FD, tratador, contexto);
+}
+
+// Remove uma fonte do reator. Timers e notificadores são fechados.
+void reator_remover_fonte(Reator *reator, FonteEvento *fonte) {
+    if (fonte == NULL || !fonte->ativa) {
+        return;
+    }
+    
+    epoll_ctl(reator->epfd, EPOLL_CTL_DEL, fonte->fd, NULL);
+    
+    if (fonte->tipo != FONTE_FD) {
+        close(fonte->fd);
+    }
+    
+    fonte->ativa = false;
+}
+
+// Cria um timer (timerfd) desarmado
+FonteEvento *reator_criar_timer(Reator *reator, TratadorEvento tratador, void *contexto) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        perror("timerfd_create");
+        return NULL;
+    }
+    
+    FonteEvento *fonte = registrar_fonte(reator, fd, FONTE_TIMER, tratador, contexto);
+    if (fonte == NULL) {
+        close(fd);
+    }
+    
+    return fonte;
+}
+
+// Arma o timer para disparar uma vez daqui a timeout_us microssegundos (0 desarma)
+void reator_armar_timer(FonteEvento *timer, long long timeout_us) {
+    struct itimerspec prazo = {0};
+    
+    if (timeout_us > 0) {
+        prazo.it_value.tv_sec = timeout_us / 1000000;
+        prazo.it_value.tv_nsec = (timeout_us % 1000000) * 1000;
+    }
+    
+    if (timerfd_settime(timer->fd, 0, &prazo, NULL) == -1) {
+        perror("timerfd_settime");
+    }
+}
+
+// Cria um notificador (eventfd) para acordar o reator a partir de outra thread
+FonteEvento *reator_criar_notificador(Reator *reator, TratadorEvento tratador, void *contexto) {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1) {
+        perror("eventfd");
+        return NULL;
+    }
+    
+    FonteEvento *fonte = registrar_fonte(reator, fd, FONTE_NOTIFICADOR, tratador, contexto);
+    if (fonte == NULL) {
+        close(fd);
+    }
+    
+    return fonte;
+}
+
+// Acorda o reator dono do notificador (pode ser chamado de qualquer thread)
+void reator_notificar(FonteEvento *notificador) {
+    uint64_t um = 1;
+    if (write(notificador->fd, &um, sizeof(um)) == -1 && errno != EAGAIN) {
+        perror("write eventfd");
+    }
+}
+
+// Espera por eventos por até timeout_ms (-1 = sem limite) e chama os tratadores.
+// Retorna o número de eventos tratados ou -1 em caso de erro.
+int reator_executar(Reator *reator, int timeout_ms) {
+    struct epoll_event eventos[MAX_EVENTOS_REATOR];
+    
+    int n = epoll_wait(reator->epfd, eventos, MAX_EVENTOS_REATOR, timeout_ms);
+    if (n == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("epoll_wait");
+        return -1;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        FonteEvento *fonte = eventos[i].data.ptr;
+        
+        // Pedido de parada
+        if (fonte == NULL) {
+            uint64_t contador;
+            if (read(reator->fd_parada, &contador, sizeof(contador)) == -1 && errno != EAGAIN) {
+                perror("read eventfd");
+            }
+            continue;
+        }
+        
+        // A fonte pode ter sido removida por um tratador anterior nesta rodada
+        if (!fonte->ativa) {
+            continue;
+        }
+        
+        // Timers e notificadores precisam ter o contador consumido
+        if (fonte->tipo != FONTE_FD) {
+            uint64_t contador;
+            if (read(fonte->fd, &contador, sizeof(contador)) == -1) {
+                continue; // Timer rearmado ou já consumido
+            }
+        }
+        
+        fonte->tratador(fonte->contexto);
+    }
+    
+    return n;
+}
+
+// Executa o laço de eventos até reator_parar ser chamado
+void reator_rodar(Reator *reator) {
+    while (reator->em_execucao) {
+        if (reator_executar(reator, -1) < 0) {
+            break;
+        }
+    }
+}
+
+// Interrompe reator_rodar. Seguro para uso em tratadores de sinal.
+void reator_parar(Reator *reator) {
+    uint64_t um = 1;
+    reator->em_execucao = false;
+    if (reator->fd_parada > 0 && write(reator->fd_parada, &um, sizeof(um)) == -1) {
+        // Nada a fazer: o laço verificará em_execucao no próximo evento
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef TREASURE_REACTOR_H
+#define TREASURE_REACTOR_H
+
+#include <stdbool.h>
+
+// Número máximo de fontes de eventos registradas em um reator
+#define MAX_FONTES_REATOR 16
+
+// Número máximo de eventos tratados por chamada a epoll_wait
+#define MAX_EVENTOS_REATOR 16
+
+// Função chamada quando uma fonte de eventos fica pronta
+typedef void (*TratadorEvento)(void *contexto);
+
+// Tipos de fonte de eventos
+typedef enum {
+    FONTE_FD,                 // Descritor qualquer (socket, stdin)
+    FONTE_TIMER,              // timerfd para prazos de retransmissão
+    FONTE_NOTIFICADOR         // eventfd para avisos entre threads
+} TipoFonte;
+
+// Fonte de eventos registrada no reator
+typedef struct {
+    int fd;
+    TipoFonte tipo;
+    TratadorEvento tratador;
+    void *contexto;
+    bool ativa;
+} FonteEvento;
+
+// Reator: laço de eventos sobre epoll
+typedef struct {
+    int epfd;
+    FonteEvento fontes[MAX_FONTES_REATOR];
+    int num_fontes;
+    int fd_parada;            // eventfd usado por reator_parar
+    volatile bool em_execucao;
+} Reator;
+
+bool reator_iniciar(Reator *reator);
+void reator_finalizar(Reator *reator);
+FonteEvento *reator_adicionar_fd(Reator *reator, int fd, TratadorEvento tratador, void *contexto);
+void reator_remover_fonte(Reator *reator, FonteEvento *fonte);
+FonteEvento *reator_criar_timer(Reator *reator, TratadorEvento tratador, void *contexto);
+void reator_armar_timer(FonteEvento *timer, long long timeout_us);
+FonteEvento *reator_criar_notificador(Reator *reator, TratadorEvento tratador, void *contexto);
+void reator_notificar(FonteEvento *notificador);
+int reator_executar(Reator *reator, int timeout_ms);
+void reator_rodar(Reator *reator);
+void reator_parar(Reator *reator);
+
+#endif // TREASURE_REACTOR_H
@@ -1,38 +1,419 @@
 #include "treasure_protocol.h"
+#include "treasure_reactor.h"
+#include "treasure_fec.h"
+#include "treasure_compressao.h"
+#include "treasure_cache.h"
+#include "treasure_tarefas.h"
+#include "treasure_eventos.h"
+#include "treasure_mundo.h"
+#include "treasure_tela.h"
 #include <pthread.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 
 // Configuração de rede
 #define INTERFACE_NAME "veth0"  // Nome da interface para uso com o virtual Ethernet
 #define DIRETORIO_TESOUROS "objetos"  // Diretório onde estão os tesouros
+#define ARQUIVO_MENSAGENS "treasure_server.log"  // Mensagens enquanto a tela estiver aberta
 
-// MAC addresses (podem ser alterados conforme necessário)
-static unsigned char mac_cliente[6] = {0xAA, 0xef, 0x89, 0x44, 0x14, 0xd2};
+// Sessões dos jogadores
+#define MAX_TRABALHADORES 16           // Threads de recepção (-t)
+#define NUM_BALDES_SESSOES 256         // Baldes da tabela de sessões de cada thread
+#define MAX_SESSOES 1024               // Jogadores ao mesmo tempo, somadas todas as threads
+#define TEMPO_SESSAO_PADRAO 300        // Segundos sem quadros do jogador até a sessão expirar
+#define INTERVALO_EXPIRACAO_US 1000000 // Período da busca por sessões inativas
+
+// MAC do servidor (pode ser alterado conforme necessário). Cada cliente é
+// identificado pelo MAC de origem dos seus quadros.
 static unsigned char mac_servidor[6] = {0x62, 0x42, 0x03, 0x53, 0xa4, 0x24};
 
 // Variáveis globais
-static int sockfd;
-static struct sockaddr_ll endereco_cliente;
-static EstadoJogo jogo;
-static unsigned char ultimo_seq_recebido = 0;
-static unsigned char proximo_seq_envio = 0;
 static bool em_execucao = true;
-static pthread_mutex_t mutex_jogo = PTHREAD_MUTEX_INITIALIZER;
-static bool atualizacao_pendente = true; // Nova variável para controlar atualizações
+static bool usar_anel = false; // Usa PACKET_MMAP (TPACKET_V3) no socket
+static bool usar_filtro = false; // Filtra no kernel os quadros que não são para nós
+static bool atualizacao_pendente = true; // A tela mudou desde o último desenho (só a thread principal)
+static int tamanho_janela = JANELA_PADRAO; // Número de chunks de dados em trânsito
+static bool negociar = true; // Aceita negociar o formato estendido
+static bool usar_crc32c = false; // Pede verificação CRC32C na negociação
+static bool usar_compressao = true; // Aceita comprimir arquivos na negociação (-z desativa)
+static double perda_simulada = 0.0;     // Fração de quadros recebidos descartados (-p)
+static double corrupcao_simulada = 0.0; // Fração de quadros recebidos corrompidos (-e)
+static int max_dados_local; // Maior payload suportado pelo MTU da interface
+static size_t limite_cache = 0;    // Memória do cache de tesouros pré-empacotados (-m, 0 desativa)
+static CacheTesouros cache_tesouros;
+static unsigned long envios_cache = 0; // Tesouros enviados do cache, sem abrir o arquivo
+static unsigned long retomadas = 0;            // Transferências retomadas a pedido do cliente
+static unsigned long long bytes_retomados = 0; // Bytes que o cliente já tinha e não foram reenviados
+static int fec_bloco = 0;      // Chunks por bloco de FEC (-b; 0 desativa)
+static int fec_paridades = 1;  // Quadros de paridade por bloco (-q; 1 = XOR)
+static unsigned long quadros_paridade = 0; // Quadros de paridade enviados
+static unsigned long chunks_lidos = 0;     // Chunks de dados enviados pela primeira vez
+static unsigned long long bytes_originais = 0;   // Bytes de arquivos que passaram pela compressão
+static unsigned long long bytes_comprimidos = 0; // O que eles ocuparam depois dela
+static int num_trabalhadores = 1;  // Threads de recepção, cada uma com parte dos jogadores (-t)
+static int tempo_sessao = TEMPO_SESSAO_PADRAO; // Segundos de inatividade até a sessão expirar (-x)
+static char nomes_tesouros[NUM_ARQUIVOS_TESOUROS][TAM_MAX_NOME]; // Arquivos dos tesouros, os mesmos em todas as sessões
+static int largura_grid = GRID_PADRAO;     // Dimensões do grid de cada sessão (-g)
+static int altura_grid = GRID_PADRAO;
+static int num_tesouros = TESOUROS_PADRAO; // Tesouros sorteados em cada sessão (-n)
+static uint64_t semente_mundos;            // Base das sementes dos jogadores (-S ou do relógio)
+static int sessoes_ativas = 0;           // Somadas todas as threads (atômico)
+static unsigned long sessoes_criadas = 0;
+static unsigned long sessoes_expiradas = 0;
+static int threads_tarefas = 0;    // Threads do pool de compressão e paridades (-w, 0 desativa)
+static PoolTarefas pool_tarefas;
+static unsigned long blocos_adiante = 0; // Blocos comprimidos pelo pool à frente do envio
+static unsigned long esperas_blocos = 0; // Vezes em que o envio precisou esperar um bloco do pool
+
+static Reator reator_tela;      // Laço de eventos da thread principal
+static FonteEvento *notificador_tela;    // Acorda a thread principal para redesenhar
+static FonteEvento *timer_tela;          // Desenha o quadro adiado pelo limite de quadros por segundo
+static Tela tela;                        // Quadros desenhados por diferença (só a thread principal)
+
+// Pacote da transferência aguardando confirmação (controle ou chunk de dados).
+// Os dados ficam no buffer do slot ou, para chunks de arquivos mapeados, no
+// próprio mapeamento do arquivo.
+typedef struct {
+    unsigned char *dados;
+    unsigned char buffer[TAM_MAX_DADOS_EXT];
+    int tam_dados;
+    const VerificacaoDados *verificacao; // Pré-calculada no cache (NULL: calculada no envio)
+    unsigned char tipo;
+    uint16_t seq;
+    bool confirmado;
+    int tentativas;
+    int acks_posteriores;             // ACKs de chunks enviados depois deste
+    unsigned long ordem_envio;        // Ordem do último envio entre todos os slots
+    struct timespec enviado_em;
+    struct timespec primeiro_envio;   // Início do prazo total antes de desistir
+} SlotJanela;
+
+// ACKs de chunks mais novos que indicam a perda de um chunk (como os três
+// ACKs duplicados do TCP)
+#define LIMIAR_RETRANSMISSAO_RAPIDA 3
+
+// Retransmissões por motivo, para as estatísticas
+static unsigned long retransmissoes_nack = 0;
+static unsigned long retransmissoes_rapidas = 0;
+static unsigned long retransmissoes_timeout = 0;
+static unsigned long envios_slots = 0;  // Numera os envios para comparar sua ordem
+
+// Etapas do envio de um tesouro
+typedef enum {
+    TRANSFERENCIA_INATIVA,
+    TRANSFERENCIA_TAMANHO,    // Aguardando ACK do tamanho
+    TRANSFERENCIA_NOME,       // Aguardando ACK do nome
+    TRANSFERENCIA_DADOS,      // Janela de dados em andamento
+    TRANSFERENCIA_FIM         // Aguardando ACK do fim de arquivo
+} EtapaTransferencia;
+
+// Bloco do arquivo mapeado comprimido por uma thread do pool, à frente do
+// envio. A transferência guarda BLOCOS_ADIANTE deles em anel e os divide em
+// chunks na ordem em que foram pedidos.
+#define BLOCOS_ADIANTE 8
+
+typedef struct {
+    Tarefa tarefa;
+    const unsigned char *original;    // No mapeamento do arquivo
+    int tam_original;
+    unsigned char comprimido[TAM_MAX_BLOCO_COMPRIMIDO];
+    int tam_comprimido;
+} BlocoAdiante;
+
+// Estado da transferência em andamento
+typedef struct {
+    EtapaTransferencia etapa;
+    int indice_tesouro;
+    char nome[TAM_MAX_NOME];          // Arquivo do tesouro enviado
+    FILE *arquivo;
+    unsigned char *mapa;              // Arquivo mapeado em memória (NULL: lido com fread)
+    size_t tam_mapa;
+    size_t pos_mapa;                  // Próximo byte do mapeamento a enviar
+    const TesouroPronto *pronto;      // Tesouro pré-empacotado no cache (NULL: lido do arquivo)
+    size_t tamanho_arquivo;
+    unsigned char tipo_mensagem;
+    SlotJanela controle;              // Pacote de controle em trânsito
+    SlotJanela *janela;               // Chunks de dados em trânsito (tamanho_janela slots)
+    size_t base;                      // Índice do chunk mais antigo não confirmado
+    size_t proximo;                   // Índice do próximo chunk a ser lido do arquivo
+    uint16_t seq_inicial;             // Sequência do primeiro chunk
+    int fec_bloco;                    // Chunks por bloco de FEC neste arquivo (0 sem FEC)
+    bool comprimido;                  // Conteúdo enviado no formato comprimido
+    unsigned char bloco_comprimido[TAM_MAX_BLOCO_COMPRIMIDO]; // Comprimido na própria thread (sem o pool)
+    const unsigned char *bloco;       // Bloco sendo dividido em chunks
+    int tam_bloco_comprimido;
+    int pos_bloco_comprimido;         // Próximo byte do bloco a enviar
+    BlocoAdiante *adiante;            // Anel de blocos do pool (NULL até o primeiro)
+    size_t blocos_pedidos;            // Blocos enviados ao pool
+    size_t blocos_usados;             // Blocos já recebidos de volta, na ordem
+    unsigned long long bytes_originais;
+    unsigned long long bytes_comprimidos;
+    bool fim_arquivo;
+    int progresso_publicado;          // Último vigésimo do arquivo mostrado na tela
+} Transferencia;
+
+typedef struct Trabalhador Trabalhador;
+
+// Movimento recebido à frente do esperado, ou durante o envio de um
+// tesouro, aguardando a sua vez de ser aplicado
+typedef struct {
+    uint16_t seq;
+    unsigned char tipo;               // TIPO_MOVE_*
+    bool presente;
+} MovimentoPendente;
+
+// Resposta enviada a um movimento, repetida se ele for retransmitido
+typedef struct {
+    uint16_t seq;
+    unsigned char tipo;               // ACK ou OK_ACK
+    bool valida;
+} RespostaMovimento;
+
+// Sessão de um jogador, identificada pelo MAC de origem dos seus quadros. Só
+// a thread de recepção que recebe esses quadros mexe nela; a tela tem a sua
+// própria cópia do jogo, mantida pelos eventos que a sessão publica.
+typedef struct Sessao {
+    unsigned char mac[6];
+    char nome_mac[18];                // MAC no formato de texto, para as mensagens
+    Conexao conexao;                  // Endereços e formato negociado com o cliente
+    EstadoJogo jogo;
+    // O cliente envia até MAX_MOVIMENTOS_EM_VOO movimentos sem esperar as
+    // respostas. Eles são aplicados na ordem das sequências; as duas tabelas
+    // são indexadas pela sequência módulo MAX_MOVIMENTOS_EM_VOO.
+    uint16_t seq_movimento;           // Próximo movimento a aplicar
+    bool movimentos_sincronizados;    // seq_movimento já veio do cliente
+    MovimentoPendente pendentes[MAX_MOVIMENTOS_EM_VOO];
+    RespostaMovimento respostas[MAX_MOVIMENTOS_EM_VOO];
+    uint16_t proximo_seq_envio;
+    bool deslizar_pendente;           // ACKs de dados recebidos: deslizar a janela após o lote
+    Transferencia *transferencia;     // Alocada no primeiro tesouro (NULL até lá)
+    long long prazo_us;               // Próximo prazo de retransmissão, em agora_us (-1: nenhum)
+    long long ultimo_contato_us;      // Último quadro recebido do jogador
+    Trabalhador *trabalhador;
+    struct Sessao *proxima;           // Próxima sessão do mesmo balde
+} Sessao;
+
+// Thread de recepção. Os sockets das threads formam um grupo de fanout: o
+// kernel entrega os quadros de cada jogador sempre ao mesmo socket, e a
+// thread guarda as sessões desses jogadores.
+struct Trabalhador {
+    int indice;
+    int sockfd;
+    pthread_t thread;
+    Reator reator;
+    FonteEvento *timer_retransmissao; // Prazo mais próximo entre as sessões
+    long long timer_armado_us;        // Prazo para o qual o timer está armado (-1: desarmado)
+    FonteEvento *timer_expiracao;     // Busca periódica por sessões inativas
+    Sessao *baldes[NUM_BALDES_SESSOES];
+    Sessao *deslizar[MAX_PACOTES_POR_EVENTO]; // Sessões com deslizar_pendente no lote
+    int num_deslizar;
+    BuffersLote buffers;
+    unsigned char buffer_original[TAM_BLOCO_COMPRESSAO]; // Bloco do arquivo a comprimir
+    unsigned char paridades[MAX_PARIDADE_FEC][TAM_CABECALHO_FEC + TAM_MAX_SIMBOLO_FEC];
+    AnelEventos eventos;              // Para a tela: esta thread é a única que publica
+};
+
+static Trabalhador *trabalhadores[MAX_TRABALHADORES];
+
+// Jogador como a tela o vê. A thread principal monta essas cópias só com os
+// eventos das threads de recepção e nunca lê as sessões.
+typedef struct VisaoJogador {
+    unsigned char mac[6];
+    char nome_mac[18];
+    EstadoJogo jogo;
+    int enviando;                     // Tesouro sendo enviado (-1: nenhum)
+    uint64_t bytes_enviados;
+    uint64_t tamanho_envio;
+    struct VisaoJogador *proxima;
+} VisaoJogador;
+
+static VisaoJogador *visoes[NUM_BALDES_SESSOES];
+static int num_visoes = 0;
+static VisaoJogador *visao_destaque = NULL; // Mostrada na tela: a do último movimento
 
 // Funções do servidor
 void imprimir_grid();
 void *thread_recebimento(void *arg);
-bool processar_movimento(unsigned char tipo, unsigned char seq);
-bool enviar_arquivo_tesouro(int indice_tesouro);
+bool processar_movimento(Sessao *sessao, unsigned char tipo, uint16_t seq);
+static void aplicar_movimentos_pendentes(Sessao *sessao);
+bool enviar_arquivo_tesouro(Sessao *sessao, int indice_tesouro, uint16_t seq_movimento);
+bool enviar_controle(Sessao *sessao, unsigned char tipo, unsigned char *dados, int tam_dados);
+static void verificar_fim_dados(Sessao *sessao);
+static int janela_efetiva(Sessao *sessao);
+void tratar_resposta_transferencia(Sessao *sessao, unsigned char tipo, uint16_t seq,
+                                   unsigned char *dados, int tam_dados);
+void reprogramar_timer_transferencia(Sessao *sessao);
+void ao_expirar_timer(void *contexto);
+void concluir_transferencia(Sessao *sessao, bool sucesso);
+void liberar_arquivo_transferencia(Sessao *sessao);
+void ao_receber_pacotes(void *contexto);
+void ao_verificar_sessoes(void *contexto);
+void processar_pacote(Sessao *sessao, Pacote *pacote);
+void responder_negociacao(Sessao *sessao, unsigned char *dados, int tam_dados);
+void ao_notificar_tela(void *contexto);
+void consumir_eventos();
+void marcar_atualizacao();
 void inicializar_servidor();
 void finalizar_servidor();
 void carregar_tipos_tesouros();
+void preparar_cache_tesouros();
 void tratar_sinal(int signum);
+void imprimir_uso(const char *programa);
 
 int main(int argc, char **argv) {
+    // Processar opções de linha de comando
+    int opcao;
+    bool semente_definida = false;
+    while ((opcao = getopt(argc, argv, "j:rfkcszp:e:b:q:m:t:x:w:g:n:S:vh")) != -1) {
+        switch (opcao) {
+            case 'j':
+                tamanho_janela = atoi(optarg);
+                if (tamanho_janela < 1 || tamanho_janela > JANELA_MAX) {
+                    fprintf(stderr, "Tamanho de janela inválido: use entre 1 e %d.\n", JANELA_MAX);
+                    return 1;
+                }
+                break;
+            case 'r':
+                usar_anel = true;
+                break;
+            case 'f':
+                usar_filtro = true;
+                break;
+            case 'k':
+                negociar = false;
+                break;
+            case 'c':
+                usar_crc32c = true;
+                break;
+            case 's':
+                definir_modo_lote(false);
+                break;
+            case 'z':
+                usar_compressao = false;
+                break;
+            case 'p':
+            case 'e': {
+                double fracao = atof(optarg) / 100.0;
+                if (fracao < 0 || fracao > 1) {
+                    fprintf(stderr, "Porcentagem inválida: use entre 0 e 100.\n");
+                    return 1;
+                }
+                if (opcao == 'p') {
+                    perda_simulada = fracao;
+                } else {
+                    corrupcao_simulada = fracao;
+                }
+                break;
+            }
+            case 'b':
+                fec_bloco = atoi(optarg);
+                if (fec_bloco < 1 || fec_bloco > MAX_BLOCO_FEC) {
+                    fprintf(stderr, "Bloco de FEC inválido: use entre 1 e %d chunks.\n", MAX_BLOCO_FEC);
+                    return 1;
+                }
+                break;
+            case 'q':
+                fec_paridades = atoi(optarg);
+                if (fec_paridades < 1 || fec_paridades > MAX_PARIDADE_FEC) {
+                    fprintf(stderr, "Paridades por bloco inválidas: use entre 1 e %d.\n", MAX_PARIDADE_FEC);
+                    return 1;
+                }
+                break;
+            case 'm': {
+                int megabytes = atoi(optarg);
+                if (megabytes < 1) {
+                    fprintf(stderr, "Tamanho de cache inválido: use pelo menos 1 MiB.\n");
+                    return 1;
+                }
+                limite_cache = (size_t)megabytes << 20;
+                break;
+            }
+            case 't':
+                num_trabalhadores = atoi(optarg);
+                if (num_trabalhadores < 1 || num_trabalhadores > MAX_TRABALHADORES) {
+                    fprintf(stderr, "Número de threads inválido: use entre 1 e %d.\n", MAX_TRABALHADORES);
+                    return 1;
+                }
+                break;
+            case 'x':
+                tempo_sessao = atoi(optarg);
+                if (tempo_sessao < 1) {
+                    fprintf(stderr, "Tempo de sessão inválido: use pelo menos 1 segundo.\n");
+                    return 1;
+                }
+                break;
+            case 'w':
+                threads_tarefas = atoi(optarg);
+                if (threads_tarefas < 0 || threads_tarefas > MAX_THREADS_TAREFAS) {
+                    fprintf(stderr, "Threads do pool inválidas: use entre 0 e %d.\n", MAX_THREADS_TAREFAS);
+                    return 1;
+                }
+                break;
+            case 'g':
+                if (!ler_dimensoes_grid(optarg, &largura_grid, &altura_grid)) {
+                    fprintf(stderr, "Grid inválido: use LARGURAxALTURA, de 1 a %d em cada lado.\n", MAX_LADO_GRID);
+                    return 1;
+                }
+                break;
+            case 'n':
+                num_tesouros = atoi(optarg);
+                if (num_tesouros < 1) {
+                    fprintf(stderr, "Número de tesouros inválido: use pelo menos 1.\n");
+                    return 1;
+                }
+                break;
+            case 'S': {
+                char *fim;
+                semente_mundos = strtoull(optarg, &fim, 0);
+                if (*optarg == '\0' || *fim != '\0') {
+                    fprintf(stderr, "Semente inválida: use um número de até 64 bits.\n");
+                    return 1;
+                }
+                semente_definida = true;
+                break;
+            }
+            case 'v':
+                definir_depuracao(true);
+                break;
+            default:
+                imprimir_uso(argv[0]);
+                return (opcao == 'h') ? 0 : 1;
+        }
+    }
+    
+    if ((long long)num_tesouros > (long long)largura_grid * altura_grid) {
+        fprintf(stderr, "%d tesouros não cabem em um grid %dx%d.\n", num_tesouros, largura_grid, altura_grid);
+        return 1;
+    }
+    
     printf("Iniciando servidor de caça ao tesouro...\n");
+    printf("Grid %dx%d com %d tesouros por jogador.\n", largura_grid, altura_grid, num_tesouros);
+    
+    // Sem -S, a semente vem do relógio e do PID, e é mostrada para que a
+    // execução possa ser repetida com os mesmos mundos
+    if (!semente_definida) {
+        struct timespec agora;
+        clock_gettime(CLOCK_REALTIME, &agora);
+        semente_mundos = derivar_semente((uint64_t)agora.tv_sec * 1000000000ULL + agora.tv_nsec, getpid());
+    }
+    printf("Semente dos mundos: %llu (repita com -S %llu).\n", 
+           (unsigned long long)semente_mundos, (unsigned long long)semente_mundos);
+    printf("Janela de envio: %d pacotes em trânsito.\n", tamanho_janela);
+    if (tamanho_janela > NUM_SEQ / 2) {
+        printf("No formato clássico (sequência de 5 bits) a janela fica limitada a %d.\n", NUM_SEQ / 2);
+    }
+    if (fec_bloco > 0) {
+        printf("FEC: %d quadro(s) de paridade (%s) a cada %d chunks, redundância de %.1f%%.\n", 
+               fec_paridades, fec_paridades == 1 ? "XOR" : "Reed-Solomon", fec_bloco, 
+               100.0 * fec_paridades / fec_bloco);
+    }
+    
+    if (perda_simulada > 0 || corrupcao_simulada > 0) {
+        simular_falhas(perda_simulada, corrupcao_simulada);
+        printf("Simulando %.1f%% de perda e %.1f%% de corrupção na recepção.\n", 
+               perda_simulada * 100, corrupcao_simulada * 100);
+    }
     
     // Configurar tratamento de sinais para encerramento limpo
     signal(SIGINT, tratar_sinal);
@@ -48,50 +429,33 @@ int main(int argc, char **argv) {
         printf("Diretório %s criado.\n", DIRETORIO_TESOUROS);
     }
     
-    // Inicializar o jogo primeiro
-    inicializar_jogo(&jogo);
-    
-    // Depois completar os nomes dos tesouros com as extensões corretas
-    // Isso garantirá que os nomes com extensão não sejam sobrescritos
+    // Nomes dos arquivos dos tesouros, com as extensões corretas. Cada sessão
+    // sorteia as posições dos seus tesouros ao ser criada.
     carregar_tipos_tesouros();
     
-    // Exibir a posição dos tesouros
-    printf("\nPosições dos tesouros:\n");
-    for (int i = 0; i < NUM_TESOUROS; i++) {
-        printf("Tesouro %d: (%d,%d) - Arquivo: %s\n", 
-               i + 1, jogo.tesouros[i].pos.x, jogo.tesouros[i].pos.y,
-               jogo.tesouros[i].nome);
+    if (limite_cache > 0) {
+        preparar_cache_tesouros();
     }
     
-    // Exibir o grid inicial
-    printf("\nGrid inicial:\n");
+    // Exibir a tela inicial, ainda sem jogadores
     imprimir_grid();
-    atualizacao_pendente = false; // Grid inicial já foi impresso
-    
-    // Criar thread para receber pacotes
-    pthread_t thread_id;
-    if (pthread_create(&thread_id, NULL, thread_recebimento, NULL) != 0) {
-        perror("Falha ao criar thread de recebimento");
-        finalizar_servidor();
-        return 1;
-    }
+    atualizacao_pendente = false; // Tela inicial já foi impressa
     
-    // Loop principal - modificado para atualizar apenas quando necessário
-    while (em_execucao) {
-        // Verifica se há necessidade de atualizar a tela
-        pthread_mutex_lock(&mutex_jogo);
-        if (atualizacao_pendente) {
-            imprimir_grid();
-            atualizacao_pendente = false;
+    // Criar as threads que recebem os pacotes
+    for (int i = 0; i < num_trabalhadores; i++) {
+        if (pthread_create(&trabalhadores[i]->thread, NULL, thread_recebimento, trabalhadores[i]) != 0) {
+            perror("Falha ao criar thread de recebimento");
+            exit(-1);
         }
-        pthread_mutex_unlock(&mutex_jogo);
-        
-        // Aguarda um pouco antes de verificar novamente
-        usleep(500000); // 500ms
     }
     
-    // Aguardar a thread terminar
-    pthread_join(thread_id, NULL);
+    // Loop principal: redesenha a tela apenas quando uma thread de recebimento avisa
+    reator_rodar(&reator_tela);
+    
+    // Aguardar as threads terminarem
+    for (int i = 0; i < num_trabalhadores; i++) {
+        pthread_join(trabalhadores[i]->thread, NULL);
+    }
     
     // Finalizar o servidor
     finalizar_servidor();
@@ -99,36 +463,247 @@ int main(int argc, char **argv) {
     return 0;
 }
 
+// Imprime as opções de linha de comando
+void imprimir_uso(const char *programa) {
+    printf("Uso: %s [opções]\n", programa);
+    printf("  -j N  Número de pacotes de dados em trânsito (1 a %d, padrão %d)\n", 
+           JANELA_MAX, JANELA_PADRAO);
+    printf("  -r    Usa anéis mapeados (PACKET_MMAP) no socket\n");
+    printf("  -f    Filtra no kernel (BPF) os quadros que não são do protocolo\n");
+    printf("  -k    Não negocia o formato estendido (usa apenas o formato clássico)\n");
+    printf("  -c    Pede verificação CRC32C nos quadros estendidos\n");
+    printf("  -s    Um quadro por chamada de sistema (sem sendmmsg/recvmmsg)\n");
+    printf("  -z    Não comprime os arquivos de texto\n");
+    printf("  -p P  Descarta P%% dos quadros recebidos (simulação de perda)\n");
+    printf("  -e P  Corrompe P%% dos quadros recebidos (simulação de erro)\n");
+    printf("  -b K  FEC: envia paridade a cada K chunks de dados (1 a %d)\n", MAX_BLOCO_FEC);
+    printf("  -q M  FEC: quadros de paridade por bloco (1 = XOR, até %d = Reed-Solomon)\n", 
+           MAX_PARIDADE_FEC);
+    printf("  -m N  Pré-empacota os tesouros na inicialização, em até N MiB de memória\n");
+    printf("  -t N  Threads de recepção, com os jogadores divididos entre elas (1 a %d)\n",
+           MAX_TRABALHADORES);
+    printf("  -x S  Encerra a sessão de um jogador após S segundos sem quadros (padrão %d)\n",
+           TEMPO_SESSAO_PADRAO);
+    printf("  -w N  Comprime e calcula paridades em um pool de N threads (0 a %d, padrão 0)\n",
+           MAX_THREADS_TAREFAS);
+    printf("  -g LxA  Dimensões do grid (até %d em cada lado, padrão %dx%d)\n",
+           MAX_LADO_GRID, GRID_PADRAO, GRID_PADRAO);
+    printf("  -n N  Tesouros sorteados no grid de cada jogador (padrão %d)\n", TESOUROS_PADRAO);
+    printf("  -S N  Semente dos sorteios: o mesmo jogador recebe sempre o mesmo mundo\n");
+    printf("  -v    Mostra cada quadro recebido, cada movimento e cada retransmissão\n");
+    printf("  -h    Mostra esta ajuda\n");
+}
+
+// Soma a um contador compartilhado pelas threads de recepção
+static void contar(unsigned long *contador, unsigned long valor) {
+    __atomic_fetch_add(contador, valor, __ATOMIC_RELAXED);
+}
+
+static void contar_bytes(unsigned long long *contador, unsigned long long valor) {
+    __atomic_fetch_add(contador, valor, __ATOMIC_RELAXED);
+}
+
+// Instante atual em microssegundos, para comparar os prazos das sessões
+static long long agora_us() {
+    struct timespec atual;
+    marcar_instante(&atual);
+    return atual.tv_sec * 1000000LL + atual.tv_nsec / 1000;
+}
+
+// Cria o socket de uma thread de recepção, com seu laço de eventos. Com mais
+// de uma thread, os sockets entram no mesmo grupo de fanout.
+static Trabalhador *iniciar_trabalhador(int indice, uint16_t grupo_fanout) {
+    Trabalhador *trabalhador = calloc(1, sizeof(Trabalhador));
+    if (trabalhador == NULL) {
+        fprintf(stderr, "Sem memória para a thread de recepção.\n");
+        exit(-1);
+    }
+    trabalhador->indice = indice;
+    trabalhador->timer_armado_us = -1;
+    anel_eventos_iniciar(&trabalhador->eventos, notificador_tela);
+    
+    // Criar o socket raw
+    trabalhador->sockfd = cria_raw_socket(INTERFACE_NAME);
+    
+    if (num_trabalhadores > 1 && !entrar_grupo_fanout(trabalhador->sockfd, grupo_fanout)) {
+        fprintf(stderr, "Não foi possível dividir os jogadores entre as threads. Use -t 1.\n");
+        exit(-1);
+    }
+    
+    // Anexar o filtro BPF, se solicitado (a mensagem sai uma vez só)
+    if (usar_filtro) {
+        bool ativado = anexar_filtro_bpf(trabalhador->sockfd, mac_servidor);
+        if (indice == 0 && ativado) {
+            printf("Filtro BPF ativado.\n");
+        } else if (indice == 0) {
+            printf("Não foi possível ativar o filtro BPF. Filtrando em espaço de usuário.\n");
+        }
+    }
+    
+    // Ativar o modo anel, se solicitado. Ele atende um só socket por
+    // processo: com várias threads, fica com a primeira.
+    if (usar_anel && indice == 0) {
+        if (ativar_anel_pacotes(trabalhador->sockfd)) {
+            printf("Modo anel (PACKET_MMAP) ativado%s.\n",
+                   num_trabalhadores > 1 ? " na primeira thread de recepção" : "");
+        } else {
+            printf("Não foi possível ativar o modo anel. Usando sendto/recvfrom.\n");
+        }
+    }
+    
+    // Configurar o laço de eventos: socket, prazos de retransmissão e
+    // expiração das sessões
+    configurar_nao_bloqueante(trabalhador->sockfd);
+    if (!reator_iniciar(&trabalhador->reator)) {
+        exit(-1);
+    }
+    reator_adicionar_fd(&trabalhador->reator, trabalhador->sockfd, ao_receber_pacotes, trabalhador);
+    trabalhador->timer_retransmissao = reator_criar_timer(&trabalhador->reator, ao_expirar_timer, trabalhador);
+    trabalhador->timer_expiracao = reator_criar_timer(&trabalhador->reator, ao_verificar_sessoes, trabalhador);
+    if (trabalhador->timer_retransmissao == NULL || trabalhador->timer_expiracao == NULL) {
+        exit(-1);
+    }
+    reator_armar_timer(trabalhador->timer_expiracao, INTERVALO_EXPIRACAO_US);
+    
+    return trabalhador;
+}
+
 // Inicializa o servidor
 void inicializar_servidor() {
-    // Criar o socket raw
-    sockfd = cria_raw_socket(INTERFACE_NAME);
+    max_dados_local = max_dados_interface(INTERFACE_NAME);
+    
+    // O pool é dividido por todas as threads de recepção: cada uma envia
+    // para a fila de mesmo índice, e as threads do pool roubam umas das outras
+    if (threads_tarefas > 0) {
+        if (!tarefas_iniciar(&pool_tarefas, threads_tarefas)) {
+            exit(-1);
+        }
+        printf("Pool de %d thread(s) para compressão e paridades.\n", threads_tarefas);
+    }
+    
+    // Configurar o laço de eventos da tela: os anéis de eventos das threads
+    // de recepção acordam a thread principal pelo mesmo notificador
+    if (!reator_iniciar(&reator_tela)) {
+        exit(-1);
+    }
+    notificador_tela = reator_criar_notificador(&reator_tela, ao_notificar_tela, NULL);
+    timer_tela = reator_criar_timer(&reator_tela, ao_notificar_tela, NULL);
+    if (notificador_tela == NULL || timer_tela == NULL) {
+        exit(-1);
+    }
+    tela_iniciar(&tela, STDOUT_FILENO);
+    tela_desviar_mensagens(&tela, ARQUIVO_MENSAGENS);
     
-    // Configurar o endereço do cliente
-    memset(&endereco_cliente, 0, sizeof(endereco_cliente));
-    endereco_cliente.sll_family = AF_PACKET;
-    endereco_cliente.sll_ifindex = if_nametoindex(INTERFACE_NAME);
-    endereco_cliente.sll_halen = ETH_ALEN;
-    memcpy(endereco_cliente.sll_addr, mac_cliente, 6);
+    // Uma thread de recepção por socket; o grupo de fanout é identificado
+    // pelo PID, para não se misturar com o de outro processo
+    for (int i = 0; i < num_trabalhadores; i++) {
+        trabalhadores[i] = iniciar_trabalhador(i, getpid() & 0xFFFF);
+    }
     
-    printf("Servidor inicializado. Usando interface %s.\n", INTERFACE_NAME);
+    printf("Servidor inicializado. Usando interface %s com %d thread(s) de recepção.\n",
+           INTERFACE_NAME, num_trabalhadores);
 }
 
+static void encerrar_sessao(Sessao *sessao, bool expirou);
+
 // Finaliza o servidor
 void finalizar_servidor() {
-    if (sockfd > 0) {
-        close(sockfd);
+    // O resumo final vai para o terminal, não para o arquivo de mensagens
+    tela_restaurar_mensagens(&tela);
+    
+    for (int i = 0; i < num_trabalhadores; i++) {
+        Trabalhador *trabalhador = trabalhadores[i];
+        for (int balde = 0; balde < NUM_BALDES_SESSOES; balde++) {
+            while (trabalhador->baldes[balde] != NULL) {
+                encerrar_sessao(trabalhador->baldes[balde], false);
+            }
+        }
+    }
+    
+    imprimir_estatisticas_es();
+    printf("Sessões: %lu criadas, %lu expiradas por inatividade.\n", sessoes_criadas, sessoes_expiradas);
+    printf("Retransmissões: %lu por NACK, %lu rápidas (ACKs posteriores), %lu por timeout.\n", 
+           retransmissoes_nack, retransmissoes_rapidas, retransmissoes_timeout);
+    if (bytes_originais > 0) {
+        printf("Compressão: %llu bytes de arquivos enviados como %llu (%.1f%%).\n", 
+               bytes_originais, bytes_comprimidos, 100.0 * bytes_comprimidos / bytes_originais);
+    }
+    if (cache_tesouros.arena != NULL) {
+        printf("Cache: %lu tesouros enviados do cache, %.1f MiB em uso.\n", 
+               envios_cache, cache_tesouros.usado / 1048576.0);
+    }
+    if (retomadas > 0) {
+        printf("Retomadas: %lu transferências, %llu bytes que não precisaram ser reenviados.\n", 
+               retomadas, bytes_retomados);
+    }
+    if (fec_bloco > 0) {
+        printf("FEC: %lu quadros de paridade para %lu chunks (%.1f%% a mais).\n", 
+               quadros_paridade, chunks_lidos, 
+               chunks_lidos > 0 ? 100.0 * quadros_paridade / chunks_lidos : 0.0);
+    }
+    
+    unsigned long descartados = 0;
+    for (int i = 0; i < num_trabalhadores; i++) {
+        descartados += anel_eventos_descartados(&trabalhadores[i]->eventos);
+    }
+    if (descartados > 0) {
+        printf("Tela: %lu eventos descartados com o anel cheio.\n", descartados);
+    }
+    printf("Tela: %lu quadros (%lu inteiros), %llu KiB escritos (%llu KiB com todos inteiros).\n", 
+           tela.quadros, tela.completos, tela.bytes_escritos >> 10, tela.bytes_inteiros >> 10);
+    
+    // As sessões já foram encerradas: nenhuma tarefa ficou pendente
+    if (threads_tarefas > 0) {
+        printf("Pool: %lu tarefas, %lu roubadas entre threads, %lu feitas por quem esperava.\n", 
+               pool_tarefas.executadas, pool_tarefas.roubadas, pool_tarefas.ajudas);
+        printf("Compressão adiante: %lu blocos, o envio esperou por %lu deles.\n", 
+               blocos_adiante, esperas_blocos);
+        tarefas_finalizar(&pool_tarefas);
+    }
+    
+    // Os eventos que ficaram nos anéis ainda seguram os mundos das sessões
+    consumir_eventos();
+    
+    for (int i = 0; i < num_trabalhadores; i++) {
+        Trabalhador *trabalhador = trabalhadores[i];
+        reator_finalizar(&trabalhador->reator);
+        if (trabalhador->sockfd > 0) {
+            liberar_anel_pacotes(trabalhador->sockfd);
+            close(trabalhador->sockfd);
+        }
+        free(trabalhador);
+    }
+    reator_finalizar(&reator_tela);
+    tela_finalizar(&tela);
+    
+    for (int balde = 0; balde < NUM_BALDES_SESSOES; balde++) {
+        while (visoes[balde] != NULL) {
+            VisaoJogador *visao = visoes[balde];
+            visoes[balde] = visao->proxima;
+            finalizar_jogo(&visao->jogo);
+            free(visao);
+        }
     }
-    pthread_mutex_destroy(&mutex_jogo);
+    
+    cache_liberar(&cache_tesouros);
     printf("Servidor finalizado.\n");
 }
 
+// Arquivo do tesouro: com mais tesouros que arquivos, eles se repetem
+static int arquivo_tesouro(int indice_tesouro) {
+    return indice_tesouro % NUM_ARQUIVOS_TESOUROS;
+}
+
+static const char *nome_tesouro(int indice_tesouro) {
+    return nomes_tesouros[arquivo_tesouro(indice_tesouro)];
+}
+
 // Carrega e completa os nomes dos arquivos de tesouro
 void carregar_tipos_tesouros() {
     const char *extensoes[] = {".txt", ".jpg", ".mp4"};
     
     // Primeiro, procurar pelos arquivos existentes para cada tesouro
-    for (int i = 0; i < NUM_TESOUROS; i++) {
+    for (int i = 0; i < NUM_ARQUIVOS_TESOUROS; i++) {
         // Obter o número do tesouro (1-8)
         int num_tesouro = i + 1;
         bool arquivo_encontrado = false;
@@ -144,7 +719,7 @@ void carregar_tipos_tesouros() {
             // Verificar se o arquivo existe
             if (access(caminho, F_OK) != -1) {
                 // Encontramos um arquivo para este tesouro
-                strncpy(jogo.tesouros[i].nome, nome_arquivo, TAM_MAX_NOME);
+                strncpy(nomes_tesouros[i], nome_arquivo, TAM_MAX_NOME);
                 arquivo_encontrado = true;
                 printf("Arquivo %s associado ao tesouro %d\n", nome_arquivo, num_tesouro);
                 break;
@@ -155,8 +730,8 @@ void carregar_tipos_tesouros() {
             printf("AVISO: Arquivo para o tesouro %d não encontrado!\n", num_tesouro);
             // Mesmo sem encontrar o arquivo, garantimos que o nome tenha uma extensão
             // para evitar erros ao tentar abrir o arquivo
-            snprintf(jogo.tesouros[i].nome, TAM_MAX_NOME, "%d%s", num_tesouro, extensoes[0]); // .txt por padrão
-            printf("Definindo nome padrão: %s para o tesouro %d\n", jogo.tesouros[i].nome, num_tesouro);
+            snprintf(nomes_tesouros[i], TAM_MAX_NOME, "%d%s", num_tesouro, extensoes[0]); // .txt por padrão
+            printf("Definindo nome padrão: %s para o tesouro %d\n", nomes_tesouros[i], num_tesouro);
         }
     }
     
@@ -167,285 +742,894 @@ void carregar_tipos_tesouros() {
     system(comando);
 }
 
-// Imprime o grid do jogo
+// Pré-empacota os tesouros no formato que as transferências devem usar: o
+// maior payload da interface (menos o espaço da FEC) e compressão para os
+// tipos comprimíveis. Um cliente que negociar outro formato recebe o
+// tesouro do arquivo, como sem o cache.
+void preparar_cache_tesouros() {
+    if (!cache_iniciar(&cache_tesouros, limite_cache)) {
+        return;
+    }
+    
+    int tam_chunk = (negociar ? max_dados_local : TAM_MAX_DADOS) - (fec_bloco > 0 ? REDUCAO_CHUNK_FEC : 0);
+    int carregados = 0;
+    
+    for (int i = 0; i < NUM_ARQUIVOS_TESOUROS; i++) {
+        char caminho[256];
+        snprintf(caminho, sizeof(caminho), "%s/%s", DIRETORIO_TESOUROS, nomes_tesouros[i]);
+        bool comprimir = negociar && usar_compressao && tipo_comprimivel(obter_tipo_arquivo(nomes_tesouros[i]));
+        
+        if (cache_carregar(&cache_tesouros, i, caminho, tam_chunk, comprimir)) {
+            carregados++;
+        } else {
+            printf("Tesouro %d fora do cache: será lido do arquivo.\n", i + 1);
+        }
+    }
+    
+    printf("Cache: %d de %d tesouros pré-empacotados em chunks de %d bytes, %.1f de %.1f MiB usados.\n", 
+           carregados, NUM_ARQUIVOS_TESOUROS, tam_chunk, cache_tesouros.usado / 1048576.0, 
+           cache_tesouros.capacidade / 1048576.0);
+}
+
+// Desenha o grid do jogo do jogador que se moveu por último, pela cópia
+// da tela (só a thread principal). O quadro vai para a tela de uma vez, só
+// com o que mudou desde o anterior.
 void imprimir_grid() {
-    printf("\033[2J\033[H"); // Limpa a tela e posiciona cursor no início
+    tela_printf(&tela, "SERVIDOR DE CAÇA AO TESOURO\n");
+    tela_printf(&tela, "===========================\n\n");
     
-    printf("SERVIDOR DE CAÇA AO TESOURO\n");
-    printf("===========================\n\n");
+    tela_printf(&tela, "Jogadores conectados: %d\n\n", num_visoes);
+    if (visao_destaque == NULL) {
+        tela_printf(&tela, "Aguardando jogadores...\n");
+        tela_apresentar(&tela);
+        return;
+    }
+    EstadoJogo *jogo = &visao_destaque->jogo;
     
     // Imprime a posição do jogador
-    printf("Posição do jogador: (%d,%d)\n\n", jogo.jogador.x, jogo.jogador.y);
+    tela_printf(&tela, "Jogador %s na posição (%d,%d)\n\n", visao_destaque->nome_mac, jogo->jogador.x, jogo->jogador.y);
     
-    // Imprime tesouros encontrados
-    int tesouros_encontrados = 0;
-    for (int i = 0; i < NUM_TESOUROS; i++) {
-        if (jogo.tesouros[i].encontrado) {
-            tesouros_encontrados++;
-        }
+    if (visao_destaque->enviando >= 0 && visao_destaque->tamanho_envio > 0) {
+        tela_printf(&tela, "Enviando tesouro %d: %llu de %llu bytes (%.0f%%)\n\n", visao_destaque->enviando + 1, 
+                    (unsigned long long)visao_destaque->bytes_enviados, 
+                    (unsigned long long)visao_destaque->tamanho_envio, 
+                    100.0 * visao_destaque->bytes_enviados / visao_destaque->tamanho_envio);
     }
-    printf("Tesouros encontrados: %d de %d\n\n", tesouros_encontrados, NUM_TESOUROS);
+    
+    // Imprime tesouros encontrados
+    int tesouros_encontrados = jogo->encontrado.marcadas;
+    tela_printf(&tela, "Tesouros encontrados: %d de %d\n\n", tesouros_encontrados, jogo->mundo->num_tesouros);
+    
+    // Em grids grandes, só o recorte em volta do jogador
+    Recorte recorte = recortar_tela(jogo);
+    int x_fim = recorte.x + recorte.largura;
+    int largura_rotulo = recorte.largura_rotulo;
     
     // Imprime o grid
-    printf("Grid do jogo:\n");
+    tela_printf(&tela, "Grid do jogo");
+    if (recorte.largura < jogo->mundo->largura || recorte.altura < jogo->mundo->altura) {
+        tela_printf(&tela, " %dx%d (colunas %d a %d, linhas %d a %d)", jogo->mundo->largura, jogo->mundo->altura, 
+                    recorte.x, x_fim - 1, recorte.y, recorte.y + recorte.altura - 1);
+    }
+    tela_printf(&tela, ":\n");
     
-    // Imprime números das colunas
-    printf("  ");
-    for (int x = 0; x < GRID_SIZE; x++) {
-        printf(" %d ", x);
+    // Imprime números das colunas (só o último dígito, para caber)
+    tela_printf(&tela, "%*s", largura_rotulo + 1, "");
+    for (int x = recorte.x; x < x_fim; x++) {
+        tela_printf(&tela, " %d ", x % 10);
     }
-    printf("\n");
+    tela_printf(&tela, "\n");
     
     // Imprime linha separadora
-    printf("  ");
-    for (int x = 0; x < GRID_SIZE; x++) {
-        printf("---");
+    tela_printf(&tela, "%*s", largura_rotulo + 1, "");
+    for (int x = recorte.x; x < x_fim; x++) {
+        tela_printf(&tela, "---");
     }
-    printf("\n");
+    tela_printf(&tela, "\n");
     
     // Imprime o grid linha por linha (de cima para baixo)
-    for (int y = GRID_SIZE - 1; y >= 0; y--) {
-        printf("%d |", y);
+    for (int y = recorte.y + recorte.altura - 1; y >= recorte.y; y--) {
+        tela_printf(&tela, "%*d |", largura_rotulo, y);
         
-        for (int x = 0; x < GRID_SIZE; x++) {
+        for (int x = recorte.x; x < x_fim; x++) {
             char celula = ' ';
+            bool tem_tesouro = tesouro_na_posicao(jogo->mundo, x, y) != SEM_TESOURO;
             
             // Células especiais
-            if (x == jogo.jogador.x && y == jogo.jogador.y) {
+            if (x == jogo->jogador.x && y == jogo->jogador.y) {
                 celula = 'J'; // Jogador
-            } else if (jogo.grid_visitado[y][x]) {
-                if (jogo.grid_tesouro[y][x]) {
-                    // Verificar se o tesouro já foi encontrado
-                    for (int i = 0; i < NUM_TESOUROS; i++) {
-                        if (jogo.tesouros[i].pos.x == x && jogo.tesouros[i].pos.y == y && jogo.tesouros[i].encontrado) {
-                            celula = 'X'; // Tesouro encontrado
-                            break;
-                        }
-                    }
-                    if (celula == ' ') {
-                        celula = 'T'; // Tesouro não encontrado
-                    }
+            } else if (plano_testar(&jogo->visitado, x, y)) {
+                if (plano_testar(&jogo->encontrado, x, y)) {
+                    celula = 'X'; // Tesouro encontrado
+                } else if (tem_tesouro) {
+                    celula = 'T'; // Tesouro não encontrado
                 } else {
                     celula = '.'; // Célula visitada
                 }
-            } else if (jogo.grid_tesouro[y][x]) {
+            } else if (tem_tesouro) {
                 celula = 'T'; // Tesouro (visível apenas no servidor)
             }
             
-            printf(" %c ", celula);
+            tela_printf(&tela, " %c ", celula);
         }
         
-        printf("|\n");
+        tela_printf(&tela, "|\n");
     }
     
     // Imprime linha separadora
-    printf("  ");
-    for (int x = 0; x < GRID_SIZE; x++) {
-        printf("---");
+    tela_printf(&tela, "%*s", largura_rotulo + 1, "");
+    for (int x = recorte.x; x < x_fim; x++) {
+        tela_printf(&tela, "---");
     }
-    printf("\n\n");
+    tela_printf(&tela, "\n\n");
     
     // Imprime legenda
-    printf("Legenda: J = Jogador, T = Tesouro, X = Tesouro encontrado, . = Visitado\n\n");
+    tela_printf(&tela, "Legenda: J = Jogador, T = Tesouro, X = Tesouro encontrado, . = Visitado\n\n");
     
-    // Imprime detalhes dos tesouros
-    printf("Detalhes dos tesouros:\n");
-    for (int i = 0; i < NUM_TESOUROS; i++) {
-        printf("Tesouro %d: (%d,%d) - %s - %s\n", 
-               i + 1, 
-               jogo.tesouros[i].pos.x, 
-               jogo.tesouros[i].pos.y,
-               jogo.tesouros[i].nome,
-               jogo.tesouros[i].encontrado ? "ENCONTRADO" : "não encontrado");
+    // Imprime detalhes dos tesouros (com muitos, só os primeiros)
+    tela_printf(&tela, "Detalhes dos tesouros:\n");
+    int listados = jogo->mundo->num_tesouros < MAX_TESOUROS_LISTADOS ? jogo->mundo->num_tesouros : MAX_TESOUROS_LISTADOS;
+    for (int i = 0; i < listados; i++) {
+        Posicao pos = jogo->mundo->tesouros[i];
+        tela_printf(&tela, "Tesouro %d: (%d,%d) - %s - %s\n", 
+                    i + 1, 
+                    pos.x,
+                    pos.y,
+                    nome_tesouro(i),
+                    tesouro_encontrado(jogo, i) ? "ENCONTRADO" : "não encontrado");
     }
+    if (listados < jogo->mundo->num_tesouros) {
+        tela_printf(&tela, "... e mais %d tesouros.\n", jogo->mundo->num_tesouros - listados);
+    }
+    
+    tela_apresentar(&tela);
 }
 
-// Thread para receber pacotes do cliente
+// Thread para receber pacotes dos clientes
 void *thread_recebimento(void *arg) {
-    unsigned char buffer[TAM_MAX_PACOTE];
-    unsigned char tipo, seq;
-    unsigned char *dados;
-    int tam_dados;
+    Trabalhador *trabalhador = arg;
+    printf("Thread de recebimento %d iniciada.\n", trabalhador->indice);
     
-    printf("Thread de recebimento iniciada.\n");
+    // Pacotes, prazos de retransmissão e expiração das sessões são tratados
+    // pelos callbacks do reator
+    reator_rodar(&trabalhador->reator);
     
-    while (em_execucao) {
-        // Tenta receber um pacote
-        if (receber_pacote(sockfd, buffer, &tipo, &seq, &dados, &tam_dados)) {
-            // Pacote válido recebido
-            printf("Pacote recebido: tipo=%d, seq=%d, tam_dados=%d\n", tipo, seq, tam_dados);
-            
-            // Processar o pacote com base no tipo
-            switch (tipo) {
-                case TIPO_MOVE_DIR:
-                case TIPO_MOVE_ESQ:
-                case TIPO_MOVE_CIMA:
-                case TIPO_MOVE_BAIXO:
-                    pthread_mutex_lock(&mutex_jogo);
-                    if (processar_movimento(tipo, seq)) {
-                        ultimo_seq_recebido = seq;
-                        // Não precisa marcar atualização_pendente aqui,
-                        // pois já é feito dentro de processar_movimento
-                    }
-                    pthread_mutex_unlock(&mutex_jogo);
-                    break;
-                    
-                case TIPO_ACK:
-                case TIPO_NACK:
-                    // Processamento de ACKs/NACKs para transferência de arquivos
-                    break;
-                
-                default:
-                    printf("Tipo de pacote não reconhecido: %d\n", tipo);
-                    // Marcar para atualizar a tela mostrando o pacote não reconhecido
-                    pthread_mutex_lock(&mutex_jogo);
-                    atualizacao_pendente = true;
-                    pthread_mutex_unlock(&mutex_jogo);
-                    break;
-            }
+    printf("Thread de recebimento %d finalizada.\n", trabalhador->indice);
+    return NULL;
+}
+
+// Balde da tabela de sessões para um MAC (FNV-1a). O fanout escolhe a thread
+// por outra conta, então os jogadores de uma thread se espalham pelos baldes.
+static int balde_sessao(const unsigned char *mac) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ mac[i]) * 16777619u;
+    }
+    return hash % NUM_BALDES_SESSOES;
+}
+
+// Publica um evento da sessão para a tela, pelo anel da sua thread.
+// Retorna false se o anel estava cheio e o evento foi descartado.
+static bool publicar_evento(Sessao *sessao, EventoJogo *evento) {
+    memcpy(evento->mac, sessao->mac, 6);
+    return anel_eventos_publicar(&sessao->trabalhador->eventos, evento);
+}
+
+static Sessao *buscar_sessao(Trabalhador *trabalhador, const unsigned char *mac) {
+    for (Sessao *sessao = trabalhador->baldes[balde_sessao(mac)]; sessao != NULL; sessao = sessao->proxima) {
+        if (memcmp(sessao->mac, mac, 6) == 0) {
+            return sessao;
         }
-        
-        // Pequena pausa para não sobrecarregar o processador
-        usleep(10000); // 10ms
     }
-    
-    printf("Thread de recebimento finalizada.\n");
     return NULL;
 }
 
-// Processa um comando de movimento do cliente
-bool processar_movimento(unsigned char tipo, unsigned char seq) {
-    printf("Processando movimento: tipo=%d\n", tipo);
-    
-    // Enviar ACK para o cliente
-    enviar_pacote(sockfd, &endereco_cliente, mac_cliente, mac_servidor, 
-                 TIPO_ACK, seq, NULL, 0);
+// Cria a sessão de um jogador no seu primeiro contato: um jogo novo, com os
+// tesouros em posições sorteadas, e a conexão no formato clássico até a
+// negociação. Retorna NULL se o limite de jogadores foi atingido.
+static Sessao *criar_sessao(Trabalhador *trabalhador, const unsigned char *mac) {
+    // O limite vale para a soma das threads: a vaga é reservada antes de
+    // gerar o mundo, para que um jogador recusado não custe um mundo inteiro
+    if (__atomic_add_fetch(&sessoes_ativas, 1, __ATOMIC_RELAXED) > MAX_SESSOES) {
+        __atomic_sub_fetch(&sessoes_ativas, 1, __ATOMIC_RELAXED);
+        char nome_mac[18];
+        DEPURAR("Limite de %d jogadores atingido: %s ignorado.\n", MAX_SESSOES, 
+                ether_ntoa_r((const struct ether_addr *)mac, nome_mac));
+        return NULL;
+    }
     
-    // Atualizar posição do jogador
-    if (!mover_jogador(&jogo, tipo)) {
-        printf("Movimento inválido! Fora dos limites do grid.\n");
-        return false;
+    Sessao *sessao = calloc(1, sizeof(Sessao));
+    if (sessao == NULL) {
+        __atomic_sub_fetch(&sessoes_ativas, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Sem memória para a sessão de um jogador.\n");
+        return NULL;
     }
     
-    printf("Jogador moveu para (%d,%d)\n", jogo.jogador.x, jogo.jogador.y);
+    memcpy(sessao->mac, mac, 6);
+    ether_ntoa_r((const struct ether_addr *)mac, sessao->nome_mac);
+    inicializar_conexao(&sessao->conexao, trabalhador->sockfd, INTERFACE_NAME, mac, mac_servidor);
+    // A semente do jogador só depende da base e do MAC: não importa a
+    // ordem em que as threads criam as sessões
+    uint64_t valor_mac = 0;
+    for (int i = 0; i < 6; i++) {
+        valor_mac = (valor_mac << 8) | mac[i];
+    }
+    MundoJogo *mundo = criar_mundo(largura_grid, altura_grid, num_tesouros, 
+                                   derivar_semente(semente_mundos, valor_mac));
+    bool jogo_criado = mundo != NULL && inicializar_jogo(&sessao->jogo, mundo);
+    liberar_mundo(mundo); // O jogo fica com a sua referência
+    if (!jogo_criado) {
+        __atomic_sub_fetch(&sessoes_ativas, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Sem memória para o jogo de %s.\n", sessao->nome_mac);
+        free(sessao);
+        return NULL;
+    }
+    sessao->prazo_us = -1;
+    sessao->trabalhador = trabalhador;
     
-    // Marcar que uma atualização da tela é necessária
-    atualizacao_pendente = true;
+    int balde = balde_sessao(mac);
+    sessao->proxima = trabalhador->baldes[balde];
+    trabalhador->baldes[balde] = sessao;
+    contar(&sessoes_criadas, 1);
     
-    // Verificar se há tesouro na nova posição
-    int indice_tesouro = verificar_tesouro(&jogo);
-    if (indice_tesouro > 0) {
-        printf("Tesouro %d encontrado na posição (%d,%d)!\n", 
-               indice_tesouro, jogo.jogador.x, jogo.jogador.y);
-        printf("Nome do arquivo do tesouro: '%s'\n", jogo.tesouros[indice_tesouro-1].nome);
-        
-        // Enviar o arquivo do tesouro para o cliente
-        if (enviar_arquivo_tesouro(indice_tesouro - 1)) {
-            printf("Arquivo do tesouro enviado com sucesso.\n");
-        } else {
-            printf("Falha ao enviar arquivo do tesouro.\n");
-        }
+    // A tela recebe uma referência ao mundo, que não muda mais, e é ela
+    // quem anuncia a sessão: a thread de recepção não escreve no terminal
+    EventoJogo evento = {.tipo = EVENTO_JOGADOR_NOVO, .mundo = reter_mundo(sessao->jogo.mundo)};
+    if (!publicar_evento(sessao, &evento)) {
+        liberar_mundo(evento.mundo);
     }
-    
-    return true;
+    return sessao;
 }
 
-// Envia um arquivo de tesouro para o cliente
-bool enviar_arquivo_tesouro(int indice_tesouro) {
-    if (indice_tesouro < 0 || indice_tesouro >= NUM_TESOUROS) {
-        printf("Índice de tesouro inválido: %d\n", indice_tesouro);
-        return false;
+// Indica se a sessão tem um tesouro sendo enviado
+static bool transferencia_ativa(const Sessao *sessao) {
+    return sessao->transferencia != NULL && sessao->transferencia->etapa != TRANSFERENCIA_INATIVA;
+}
+
+// Tira a sessão da tabela e libera o que ela usa, interrompendo a
+// transferência em andamento. A tela anuncia as sessões que expiraram.
+static void encerrar_sessao(Sessao *sessao, bool expirou) {
+    Trabalhador *trabalhador = sessao->trabalhador;
+    
+    if (sessao->transferencia != NULL) {
+        liberar_arquivo_transferencia(sessao);
+        free(sessao->transferencia->adiante);
+        free(sessao->transferencia->janela);
+        free(sessao->transferencia);
     }
     
-    Tesouro *tesouro = &jogo.tesouros[indice_tesouro];
-    printf("Enviando tesouro %d: nome='%s', posição=(%d,%d)\n", 
-           indice_tesouro + 1, tesouro->nome, tesouro->pos.x, tesouro->pos.y);
+    if (depuracao_ativa()) {
+        char par[32];
+        snprintf(par, sizeof(par), "cliente %s", sessao->nome_mac);
+        imprimir_estatisticas_rto(par, &sessao->conexao.rto);
+    }
     
-    // Caminho completo do arquivo
-    char caminho[256];
-    snprintf(caminho, sizeof(caminho), "%s/%s", DIRETORIO_TESOUROS, tesouro->nome);
-    printf("Tentando abrir arquivo: '%s'\n", caminho);
+    Sessao **ref = &trabalhador->baldes[balde_sessao(sessao->mac)];
+    while (*ref != sessao) {
+        ref = &(*ref)->proxima;
+    }
+    *ref = sessao->proxima;
+    __atomic_sub_fetch(&sessoes_ativas, 1, __ATOMIC_RELAXED);
     
-    // Abrir o arquivo
-    FILE *arquivo = fopen(caminho, "rb");
+    EventoJogo evento = {.tipo = EVENTO_JOGADOR_SAIU, .ok = expirou};
+    publicar_evento(sessao, &evento);
+    finalizar_jogo(&sessao->jogo);
+    free(sessao);
+}
+
+// Tratador do timer de expiração: encerra as sessões sem quadros há mais de
+// tempo_sessao segundos. Uma sessão enviando um tesouro espera o fim do
+// envio, que tem seu próprio prazo para desistir.
+void ao_verificar_sessoes(void *contexto) {
+    Trabalhador *trabalhador = contexto;
+    long long limite = agora_us() - tempo_sessao * 1000000LL;
     
-    // Se não encontramos o arquivo, tentamos adicionar uma extensão .txt
-    if (!arquivo) {
-        perror("Erro ao abrir arquivo de tesouro");
+    for (int balde = 0; balde < NUM_BALDES_SESSOES; balde++) {
+        Sessao *sessao = trabalhador->baldes[balde];
+        while (sessao != NULL) {
+            Sessao *proxima = sessao->proxima;
+            if (sessao->ultimo_contato_us < limite && !transferencia_ativa(sessao)) {
+                encerrar_sessao(sessao, true);
+                contar(&sessoes_expiradas, 1);
+            }
+            sessao = proxima;
+        }
+    }
+    
+    reator_armar_timer(trabalhador->timer_expiracao, INTERVALO_EXPIRACAO_US);
+}
+
+// Tipos de quadro que abrem uma sessão. Os demais (ACKs e NACKs) só fazem
+// sentido dentro de uma sessão existente.
+static bool inicia_sessao(unsigned char tipo) {
+    return tipo == TIPO_NEGOCIACAO || tipo == TIPO_MOVE_DIR || tipo == TIPO_MOVE_ESQ ||
+           tipo == TIPO_MOVE_CIMA || tipo == TIPO_MOVE_BAIXO;
+}
+
+// Tratador de leitura do socket: processa os pacotes disponíveis em lotes,
+// cada um na sessão do seu MAC de origem
+void ao_receber_pacotes(void *contexto) {
+    Trabalhador *trabalhador = contexto;
+    Pacote pacotes[MAX_PACOTES_POR_EVENTO];
+    int processados = 0;
+    
+    // Limita o total para não monopolizar o laço; o epoll avisa de novo se sobrar
+    bool pode_haver_mais = true;
+    while (pode_haver_mais && processados < MAX_PACOTES_POR_EVENTO) {
+        int n = receber_pacotes_lote(trabalhador->sockfd, &trabalhador->buffers, pacotes, MAX_PACOTES_POR_EVENTO);
+        if (n < 0) {
+            break;
+        }
         
-        // Verificar se o nome já tem extensão
-        const char *ponto = strchr(tesouro->nome, '.');
-        if (ponto == NULL) {
-            // Se não tem extensão, tente adicionar .txt
-            // Limitar o tamanho do nome original para evitar truncamento ao adicionar a extensão
-            char nome_base[TAM_MAX_NOME - 5]; // Reservar espaço para ".txt" e null terminator
-            strncpy(nome_base, tesouro->nome, sizeof(nome_base) - 1);
-            nome_base[sizeof(nome_base) - 1] = '\0'; // Garantir terminação
-            
-            char novo_nome[TAM_MAX_NOME];
-            snprintf(novo_nome, sizeof(novo_nome), "%s.txt", nome_base);
-            
-            // Atualiza o caminho com a extensão
-            snprintf(caminho, sizeof(caminho), "%s/%s", DIRETORIO_TESOUROS, novo_nome);
-            printf("Tentando novamente com extensão .txt: '%s'\n", caminho);
+        long long agora = agora_us();
+        for (int i = 0; i < n; i++) {
+            // Sem o filtro BPF o socket vê todo o tráfego da interface
+            if (memcmp(pacotes[i].mac_destino, mac_servidor, 6) != 0) {
+                continue;
+            }
             
-            arquivo = fopen(caminho, "rb");
+            Sessao *sessao = buscar_sessao(trabalhador, pacotes[i].mac_origem);
+            if (sessao == NULL && inicia_sessao(pacotes[i].tipo)) {
+                sessao = criar_sessao(trabalhador, pacotes[i].mac_origem);
+            }
+            if (sessao == NULL) {
+                continue;
+            }
             
-            // Se encontramos o arquivo com a extensão, atualizamos o nome do tesouro
-            if (arquivo) {
-                strncpy(tesouro->nome, novo_nome, TAM_MAX_NOME);
-                printf("Arquivo encontrado com extensão. Atualizando nome do tesouro para: %s\n", 
-                      tesouro->nome);
+            sessao->ultimo_contato_us = agora;
+            processar_pacote(sessao, &pacotes[i]);
+        }
+        processados += (n > 0) ? n : 1;
+        
+        // Lote incompleto: o socket foi esvaziado (evita uma leitura a mais)
+        pode_haver_mais = (n == MAX_PACOTES_POR_EVENTO) || anel_tem_pendentes(trabalhador->sockfd);
+        
+        // Os ACKs do lote liberam a janela de uma vez: os novos chunks saem juntos
+        for (int i = 0; i < trabalhador->num_deslizar; i++) {
+            Sessao *sessao = trabalhador->deslizar[i];
+            sessao->deslizar_pendente = false;
+            if (sessao->transferencia->etapa == TRANSFERENCIA_DADOS) {
+                verificar_fim_dados(sessao);
             }
         }
+        trabalhador->num_deslizar = 0;
+    }
+}
+
+// Processa um pacote válido recebido do cliente
+void processar_pacote(Sessao *sessao, Pacote *pacote) {
+    unsigned char tipo = pacote->tipo;
+    uint16_t seq = pacote->seq;
+    
+    // Pacote válido recebido
+    DEPURAR("Pacote recebido: tipo=%d, seq=%d, tam_dados=%d\n", tipo, seq, pacote->tam_dados);
+    
+    // Processar o pacote com base no tipo
+    switch (tipo) {
+        case TIPO_MOVE_DIR:
+        case TIPO_MOVE_ESQ:
+        case TIPO_MOVE_CIMA:
+        case TIPO_MOVE_BAIXO:
+            // O movimento chega à tela como evento, dentro de processar_movimento
+            processar_movimento(sessao, tipo, seq);
+            break;
         
-        if (!arquivo) {
-            // Tentar encontrar e listar os arquivos disponíveis no diretório
-            printf("Listando arquivos em %s:\n", DIRETORIO_TESOUROS);
-            char comando[300];
-            snprintf(comando, sizeof(comando), "ls -la %s", DIRETORIO_TESOUROS);
-            system(comando);
+        case TIPO_ACK:
+        case TIPO_NACK:
+            // Processamento de ACKs/NACKs para transferência de arquivos
+            tratar_resposta_transferencia(sessao, tipo, seq, pacote->dados, pacote->tam_dados);
             
-            // Tentar encontrar um arquivo que comece com o mesmo número
-            printf("Procurando por qualquer arquivo que comece com '%d'...\n", indice_tesouro + 1);
-            
-            // Verificar arquivos com diferentes extensões
-            const char *extensoes[] = {".txt", ".jpg", ".mp4"};
-            for (int j = 0; j < 3; j++) {
-                char nome_possivel[TAM_MAX_NOME];
-                snprintf(nome_possivel, sizeof(nome_possivel), "%d%s", indice_tesouro + 1, extensoes[j]);
-                
-                snprintf(caminho, sizeof(caminho), "%s/%s", DIRETORIO_TESOUROS, nome_possivel);
+            // Com o tesouro entregue, os movimentos que chegaram durante o
+            // envio são aplicados sem esperar que o cliente os retransmita
+            aplicar_movimentos_pendentes(sessao);
+            break;
+        
+        case TIPO_NEGOCIACAO:
+            // Com -k o servidor se comporta como um par clássico
+            if (negociar) {
+                responder_negociacao(sessao, pacote->dados, pacote->tam_dados);
+                break;
+            }
+            // fallthrough
+        
+        default:
+            DEPURAR("Tipo de pacote não reconhecido: %d\n", tipo);
+            // Marcar para atualizar a tela mostrando o pacote não reconhecido
+            EventoJogo evento = {.tipo = EVENTO_ATUALIZAR};
+            publicar_evento(sessao, &evento);
+            break;
+    }
+}
+
+// Responde a uma negociação do cliente com os nossos limites e passa a usar o
+// formato estendido. A resposta vai no formato clássico, pois o cliente só
+// troca de formato depois de recebê-la.
+void responder_negociacao(Sessao *sessao, unsigned char *dados, int tam_dados) {
+    unsigned char resposta[TAM_NEGOCIACAO];
+    unsigned char capacidades = (usar_crc32c ? CAPACIDADE_CRC32C : 0) | CAPACIDADE_SACK | 
+                                (usar_compressao ? CAPACIDADE_COMPRESSAO : 0) | CAPACIDADE_RETOMADA;
+    int tam_resposta = montar_negociacao(resposta, max_dados_local, capacidades);
+    
+    sessao->conexao.estendido = false;
+    enviar_quadro(&sessao->conexao, TIPO_NEGOCIACAO, 0, resposta, tam_resposta);
+    
+    // O cliente negocia ao iniciar: os seus movimentos recomeçam a contagem
+    sessao->movimentos_sincronizados = false;
+    
+    if (aplicar_negociacao(&sessao->conexao, dados, tam_dados, max_dados_local, capacidades)) {
+        DEPURAR("Formato estendido negociado com %s: até %d bytes por quadro, verificação %s, ACKs %s, %s, %s.\n", 
+                sessao->nome_mac, sessao->conexao.max_dados, 
+                sessao->conexao.crc32c ? "CRC32C" : "soma de 8 bits", 
+                sessao->conexao.sack ? "seletivos" : "por quadro", 
+                sessao->conexao.compressao ? "com compressão" : "sem compressão", 
+                sessao->conexao.retomada ? "com retomada" : "sem retomada");
+    }
+}
+
+// Cópia da tela para o jogador do MAC, ou NULL se ela não existir
+static VisaoJogador **buscar_visao(const unsigned char *mac) {
+    VisaoJogador **ref = &visoes[balde_sessao(mac)];
+    while (*ref != NULL && memcmp((*ref)->mac, mac, 6) != 0) {
+        ref = &(*ref)->proxima;
+    }
+    return ref;
+}
+
+// Tira a cópia da tela de um jogador da tabela e a libera
+static void remover_visao(VisaoJogador **ref) {
+    VisaoJogador *visao = *ref;
+    *ref = visao->proxima;
+    num_visoes--;
+    if (visao_destaque == visao) {
+        visao_destaque = NULL;
+    }
+    finalizar_jogo(&visao->jogo);
+    free(visao);
+}
+
+// Aplica um evento de uma thread de recepção à cópia da tela
+static void aplicar_evento(const EventoJogo *evento) {
+    VisaoJogador **ref = buscar_visao(evento->mac);
+    VisaoJogador *visao = *ref;
+    
+    if (evento->tipo == EVENTO_JOGADOR_NOVO) {
+        if (visao == NULL) {
+            visao = calloc(1, sizeof(VisaoJogador));
+            if (visao == NULL) {
+                liberar_mundo(evento->mundo);
+                return;
+            }
+            memcpy(visao->mac, evento->mac, 6);
+            ether_ntoa_r((const struct ether_addr *)evento->mac, visao->nome_mac);
+            *ref = visao;
+            num_visoes++;
+        } else {
+            finalizar_jogo(&visao->jogo);
+        }
+        
+        // O mesmo estado inicial do jogo da sessão, no mesmo mundo
+        bool criado = inicializar_jogo(&visao->jogo, evento->mundo);
+        liberar_mundo(evento->mundo);
+        if (!criado) {
+            remover_visao(ref);
+            return;
+        }
+        visao->enviando = -1;
+        
+        const MundoJogo *mundo = visao->jogo.mundo;
+        printf("Nova sessão para o jogador %s, grid %dx%d, semente %llu. Tesouros:", 
+               visao->nome_mac, mundo->largura, mundo->altura, (unsigned long long)mundo->semente);
+        for (int i = 0; i < mundo->num_tesouros && i < MAX_TESOUROS_LISTADOS; i++) {
+            printf(" %d:(%d,%d)", i + 1, mundo->tesouros[i].x, mundo->tesouros[i].y);
+        }
+        printf(mundo->num_tesouros > MAX_TESOUROS_LISTADOS ? " ... (%d ao todo)\n" : "\n", 
+               mundo->num_tesouros);
+        marcar_atualizacao();
+        return;
+    }
+    
+    if (visao == NULL) {
+        return; // Evento de um jogador que a tela não chegou a ver (anel cheio)
+    }
+    
+    switch (evento->tipo) {
+        case EVENTO_JOGADOR_SAIU:
+            if (evento->ok) {
+                printf("Sessão do jogador %s expirou após %d s sem quadros.\n", visao->nome_mac, tempo_sessao);
+            }
+            remover_visao(ref);
+            break;
+        
+        case EVENTO_MOVIMENTO:
+            visao->jogo.jogador = evento->pos;
+            plano_marcar(&visao->jogo.visitado, evento->pos.x, evento->pos.y, true);
+            visao_destaque = visao;
+            break;
+        
+        case EVENTO_TESOURO:
+            marcar_tesouro_encontrado(&visao->jogo, evento->tesouro, evento->ok);
+            if (evento->ok) {
+                printf("Jogador %s encontrou o tesouro %d na posição (%d,%d)!\n", visao->nome_mac, 
+                       evento->tesouro + 1, visao->jogo.jogador.x, visao->jogo.jogador.y);
+            } else {
+                printf("Falha ao enviar o tesouro %d para %s. Ele pode ser buscado de novo.\n", 
+                       evento->tesouro + 1, visao->nome_mac);
+            }
+            break;
+        
+        case EVENTO_PROGRESSO:
+            if (evento->ok && evento->total > 0) {
+                printf("Tesouro %d enviado com sucesso para %s.\n", evento->tesouro + 1, visao->nome_mac);
+            }
+            visao->enviando = evento->ok ? -1 : evento->tesouro;
+            visao->bytes_enviados = evento->bytes;
+            visao->tamanho_envio = evento->total;
+            break;
+        
+        default:
+            break;
+    }
+    marcar_atualizacao();
+}
+
+// Marca que a tela precisa ser redesenhada (só a thread principal)
+void marcar_atualizacao() {
+    atualizacao_pendente = true;
+}
+
+// Aplica os eventos de todas as threads de recepção (thread principal)
+void consumir_eventos() {
+    EventoJogo evento;
+    for (int i = 0; i < num_trabalhadores; i++) {
+        while (anel_eventos_consumir(&trabalhadores[i]->eventos, &evento)) {
+            aplicar_evento(&evento);
+        }
+    }
+}
+
+// Redesenha a tela se algo mudou, no máximo um quadro a cada
+// INTERVALO_TELA_US: antes disso, o quadro fica para o timer da tela
+static void desenhar_tela() {
+    if (!atualizacao_pendente) {
+        return;
+    }
+    
+    long long espera = tela_espera_us(&tela);
+    if (espera > 0) {
+        reator_armar_timer(timer_tela, espera);
+        return;
+    }
+    imprimir_grid();
+    atualizacao_pendente = false;
+}
+
+// Tratador do notificador e do timer da tela (thread principal): consome os
+// eventos de todas as threads de recepção e redesenha uma vez só
+void ao_notificar_tela(void *contexto) {
+    consumir_eventos();
+    desenhar_tela();
+}
+
+// Envia a resposta a um movimento. Ela leva as dimensões do grid: o cliente
+// só conhece o grid por elas.
+static void enviar_resposta_movimento(Sessao *sessao, unsigned char tipo_resposta, uint16_t seq) {
+    unsigned char dimensoes[TAM_DIMENSOES_GRID];
+    uint32_t largura = htonl(sessao->jogo.mundo->largura);
+    uint32_t altura = htonl(sessao->jogo.mundo->altura);
+    memcpy(dimensoes, &largura, 4);
+    memcpy(dimensoes + 4, &altura, 4);
+    enviar_quadro(&sessao->conexao, tipo_resposta, seq, dimensoes, TAM_DIMENSOES_GRID);
+}
+
+// Responde a um movimento e guarda a resposta para o caso de ele ser retransmitido
+static void responder_movimento(Sessao *sessao, unsigned char tipo_resposta, uint16_t seq) {
+    RespostaMovimento *resposta = &sessao->respostas[seq % MAX_MOVIMENTOS_EM_VOO];
+    resposta->seq = seq;
+    resposta->tipo = tipo_resposta;
+    resposta->valida = true;
+    enviar_resposta_movimento(sessao, tipo_resposta, seq);
+}
+
+// Descarta os movimentos que aguardavam os anteriores
+static void descartar_movimentos_pendentes(Sessao *sessao) {
+    for (int i = 0; i < MAX_MOVIMENTOS_EM_VOO; i++) {
+        sessao->pendentes[i].presente = false;
+    }
+}
+
+// Processa um comando de movimento do cliente. O movimento é guardado até
+// que os anteriores a ele tenham sido aplicados e nenhum tesouro esteja
+// sendo enviado; retorna true se ele foi aceito.
+bool processar_movimento(Sessao *sessao, unsigned char tipo, uint16_t seq) {
+    DEPURAR("Processando movimento: tipo=%d, seq=%d\n", tipo, seq);
+    uint32_t espaco = sessao->conexao.espaco_seq;
+    
+    // O primeiro movimento define a sequência esperada
+    if (!sessao->movimentos_sincronizados) {
+        sessao->seq_movimento = seq;
+        sessao->movimentos_sincronizados = true;
+        descartar_movimentos_pendentes(sessao);
+    }
+    
+    uint32_t adiante = distancia_seq(sessao->seq_movimento, seq, espaco);
+    if (adiante >= MAX_MOVIMENTOS_EM_VOO) {
+        // Retransmissão de um movimento já aplicado (a resposta se perdeu ou
+        // atrasou): repete a resposta sem mover o jogador de novo
+        uint32_t atras = distancia_seq(seq, sessao->seq_movimento, espaco);
+        if (atras <= MAX_MOVIMENTOS_EM_VOO) {
+            RespostaMovimento *resposta = &sessao->respostas[seq % MAX_MOVIMENTOS_EM_VOO];
+            if (resposta->valida && resposta->seq == seq) {
+                DEPURAR("Movimento repetido (seq=%d). Reenviando a resposta.\n", seq);
+                enviar_resposta_movimento(sessao, resposta->tipo, seq);
+            }
+            return false;
+        }
+        
+        // Fora das duas janelas: o cliente desistiu dos movimentos anteriores
+        // e recomeçou adiante deles
+        DEPURAR("Movimento fora da janela (seq=%d, esperado %d). Ressincronizando.\n", 
+                seq, sessao->seq_movimento);
+        sessao->seq_movimento = seq;
+        descartar_movimentos_pendentes(sessao);
+    }
+    
+    MovimentoPendente *pendente = &sessao->pendentes[seq % MAX_MOVIMENTOS_EM_VOO];
+    pendente->seq = seq;
+    pendente->tipo = tipo;
+    pendente->presente = true;
+    
+    // Um tesouro ainda está sendo enviado: o movimento espera o fim do envio
+    if (transferencia_ativa(sessao)) {
+        DEPURAR("Movimento guardado: transferência de tesouro em andamento.\n");
+    }
+    
+    aplicar_movimentos_pendentes(sessao);
+    return true;
+}
+
+// Aplica um movimento, na sua vez, e responde ao cliente
+static void aplicar_movimento(Sessao *sessao, unsigned char tipo, uint16_t seq) {
+    // Atualizar posição do jogador
+    if (!mover_jogador(&sessao->jogo, tipo)) {
+        DEPURAR("Movimento inválido! Fora dos limites do grid.\n");
+        
+        // Confirmar mesmo assim: o cliente também não conseguirá aplicá-lo
+        responder_movimento(sessao, TIPO_ACK, seq);
+        return;
+    }
+    
+    DEPURAR("Jogador %s moveu para (%d,%d)\n", sessao->nome_mac, sessao->jogo.jogador.x, sessao->jogo.jogador.y);
+    
+    // Avisar a tela, que mostra o jogador que se moveu por último
+    EventoJogo evento = {.tipo = EVENTO_MOVIMENTO, .pos = sessao->jogo.jogador};
+    publicar_evento(sessao, &evento);
+    
+    // Verificar se há tesouro na nova posição
+    int indice_tesouro = verificar_tesouro(&sessao->jogo);
+    if (indice_tesouro > 0) {
+        EventoJogo tesouro = {.tipo = EVENTO_TESOURO, .tesouro = indice_tesouro - 1, .ok = true};
+        publicar_evento(sessao, &tesouro);
+    }
+    
+    // Confirmar o movimento. OK_ACK avisa o cliente de que um tesouro será
+    // enviado em seguida, para que ele não mande outro comando antes disso.
+    responder_movimento(sessao, indice_tesouro > 0 ? TIPO_OK_ACK : TIPO_ACK, seq);
+    
+    if (indice_tesouro > 0) {
+        // Iniciar o envio do arquivo do tesouro para o cliente; o resultado
+        // é informado por concluir_transferencia
+        if (enviar_arquivo_tesouro(sessao, indice_tesouro - 1, seq)) {
+            DEPURAR("Envio do arquivo do tesouro iniciado.\n");
+        }
+    }
+}
+
+// Aplica, em ordem, os movimentos guardados que já podem ser aplicados. Um
+// tesouro encontrado interrompe a sequência até o fim do seu envio.
+static void aplicar_movimentos_pendentes(Sessao *sessao) {
+    while (sessao->movimentos_sincronizados && !transferencia_ativa(sessao)) {
+        MovimentoPendente *pendente = &sessao->pendentes[sessao->seq_movimento % MAX_MOVIMENTOS_EM_VOO];
+        if (!pendente->presente || pendente->seq != sessao->seq_movimento) {
+            break;
+        }
+        
+        pendente->presente = false;
+        sessao->seq_movimento = avancar_seq(pendente->seq, 1, sessao->conexao.espaco_seq);
+        aplicar_movimento(sessao, pendente->tipo, pendente->seq);
+    }
+}
+
+// Abre o arquivo do tesouro, procurando por outras extensões se o nome não
+// existir. Retorna NULL se nenhum arquivo for encontrado.
+static FILE *abrir_arquivo_tesouro(Sessao *sessao, int indice_tesouro) {
+    char *nome = sessao->transferencia->nome;
+    int num_arquivo = arquivo_tesouro(indice_tesouro) + 1;
+    
+    // Caminho completo do arquivo
+    char caminho[256];
+    snprintf(caminho, sizeof(caminho), "%s/%s", DIRETORIO_TESOUROS, nome);
+    DEPURAR("Tentando abrir arquivo: '%s'\n", caminho);
+    
+    // Abrir o arquivo
+    FILE *arquivo = fopen(caminho, "rb");
+    
+    // Se não encontramos o arquivo, tentamos adicionar uma extensão .txt
+    if (!arquivo) {
+        perror("Erro ao abrir arquivo de tesouro");
+        
+        // Verificar se o nome já tem extensão
+        const char *ponto = strchr(nome, '.');
+        if (ponto == NULL) {
+            // Se não tem extensão, tente adicionar .txt
+            // Limitar o tamanho do nome original para evitar truncamento ao adicionar a extensão
+            char nome_base[TAM_MAX_NOME - 5]; // Reservar espaço para ".txt" e null terminator
+            strncpy(nome_base, nome, sizeof(nome_base) - 1);
+            nome_base[sizeof(nome_base) - 1] = '\0'; // Garantir terminação
+            
+            char novo_nome[TAM_MAX_NOME];
+            snprintf(novo_nome, sizeof(novo_nome), "%s.txt", nome_base);
+            
+            // Atualiza o caminho com a extensão
+            snprintf(caminho, sizeof(caminho), "%s/%s", DIRETORIO_TESOUROS, novo_nome);
+            printf("Tentando novamente com extensão .txt: '%s'\n", caminho);
+            
+            arquivo = fopen(caminho, "rb");
+            
+            // Se encontramos o arquivo com a extensão, atualizamos o nome do tesouro
+            if (arquivo) {
+                strncpy(nome, novo_nome, TAM_MAX_NOME);
+                printf("Arquivo encontrado com extensão. Atualizando nome do tesouro para: %s\n", 
+                      nome);
+            }
+        }
+        
+        if (!arquivo) {
+            // Tentar encontrar e listar os arquivos disponíveis no diretório
+            printf("Listando arquivos em %s:\n", DIRETORIO_TESOUROS);
+            char comando[300];
+            snprintf(comando, sizeof(comando), "ls -la %s", DIRETORIO_TESOUROS);
+            system(comando);
+            
+            // Tentar encontrar um arquivo que comece com o mesmo número
+            printf("Procurando por qualquer arquivo que comece com '%d'...\n", num_arquivo);
+            
+            // Verificar arquivos com diferentes extensões
+            const char *extensoes[] = {".txt", ".jpg", ".mp4"};
+            for (int j = 0; j < 3; j++) {
+                char nome_possivel[TAM_MAX_NOME];
+                snprintf(nome_possivel, sizeof(nome_possivel), "%d%s", num_arquivo, extensoes[j]);
+                
+                snprintf(caminho, sizeof(caminho), "%s/%s", DIRETORIO_TESOUROS, nome_possivel);
                 printf("Verificando: %s\n", caminho);
                 
                 arquivo = fopen(caminho, "rb");
                 if (arquivo) {
                     // Se encontramos o arquivo, atualizamos o nome do tesouro
-                    strncpy(tesouro->nome, nome_possivel, TAM_MAX_NOME);
+                    strncpy(nome, nome_possivel, TAM_MAX_NOME);
                     printf("Arquivo alternativo encontrado. Atualizando nome do tesouro para: %s\n", 
-                          tesouro->nome);
+                          nome);
                     break;
                 }
             }
             
             if (!arquivo) {
-                return false;
+                return NULL;
             }
         }
     }
     
+    return arquivo;
+}
+
+// Obtém o tamanho do arquivo aberto e o mapeia em memória. Retorna false (e
+// fecha o arquivo) se o tamanho não puder ser obtido.
+static bool mapear_arquivo_tesouro(FILE *arquivo, size_t *tamanho_arquivo, unsigned char **mapa) {
     // Obter tamanho do arquivo
     struct stat st;
-    if (stat(caminho, &st) == -1) {
+    if (fstat(fileno(arquivo), &st) == -1) {
         perror("Erro ao obter tamanho do arquivo");
         fclose(arquivo);
         return false;
     }
-    size_t tamanho_arquivo = st.st_size;
+    *tamanho_arquivo = st.st_size;
+    
+    // Mapear o arquivo: os chunks vão para o socket direto do mapeamento, sem
+    // passar por buffers. Sem ele (arquivo vazio, por exemplo), usa fread.
+    *mapa = NULL;
+    if (*tamanho_arquivo > 0) {
+        *mapa = mmap(NULL, *tamanho_arquivo, PROT_READ, MAP_PRIVATE, fileno(arquivo), 0);
+        if (*mapa == MAP_FAILED) {
+            perror("Erro ao mapear arquivo de tesouro");
+            *mapa = NULL;
+        } else {
+            // Leitura sequencial: o kernel lê adiante e descarta o que passou
+            madvise(*mapa, *tamanho_arquivo, MADV_SEQUENTIAL);
+            madvise(*mapa, *tamanho_arquivo, MADV_WILLNEED);
+        }
+    }
+    
+    return true;
+}
+
+// Tesouro pré-empacotado com o tamanho de chunk e a compressão que esta
+// transferência vai usar, ou NULL se ele não estiver no cache
+static const TesouroPronto *obter_tesouro_pronto(Sessao *sessao, int indice_tesouro) {
+    int tipo_arquivo = obter_tipo_arquivo(nome_tesouro(indice_tesouro));
+    int tam_chunk = sessao->conexao.max_dados - (fec_bloco > 0 ? REDUCAO_CHUNK_FEC : 0);
+    bool comprimido = sessao->conexao.compressao && tipo_comprimivel(tipo_arquivo);
+    return cache_obter(&cache_tesouros, arquivo_tesouro(indice_tesouro), tam_chunk, comprimido);
+}
+
+// Transferência da sessão, zerada para um novo tesouro. Ela é alocada no
+// primeiro tesouro do jogador e reaproveitada nos seguintes; a janela tem
+// tamanho_janela slots, que a janela efetiva nunca ultrapassa.
+static Transferencia *preparar_transferencia(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    if (transferencia == NULL) {
+        transferencia = calloc(1, sizeof(Transferencia));
+        SlotJanela *janela = calloc(tamanho_janela, sizeof(SlotJanela));
+        if (transferencia == NULL || janela == NULL) {
+            fprintf(stderr, "Sem memória para a transferência do tesouro.\n");
+            free(transferencia);
+            free(janela);
+            return NULL;
+        }
+        transferencia->janela = janela;
+        sessao->transferencia = transferencia;
+    }
+    
+    SlotJanela *janela = transferencia->janela;
+    BlocoAdiante *adiante = transferencia->adiante;
+    memset(transferencia, 0, sizeof(*transferencia));
+    transferencia->janela = janela;
+    transferencia->adiante = adiante;
+    return transferencia;
+}
+
+// Slot da janela de dados para o chunk de índice 'indice'
+static SlotJanela *slot_dados(Transferencia *transferencia, size_t indice) {
+    return &transferencia->janela[indice % tamanho_janela];
+}
+
+// Inicia o envio de um arquivo de tesouro para o cliente
+bool enviar_arquivo_tesouro(Sessao *sessao, int indice_tesouro, uint16_t seq_movimento) {
+    if (indice_tesouro < 0 || indice_tesouro >= sessao->jogo.mundo->num_tesouros) {
+        printf("Índice de tesouro inválido: %d\n", indice_tesouro);
+        return false;
+    }
+    
+    Transferencia *transferencia = preparar_transferencia(sessao);
+    if (transferencia == NULL) {
+        return false;
+    }
+    
+    // O nome é da transferência: pode ganhar outra extensão ao abrir o arquivo
+    strncpy(transferencia->nome, nome_tesouro(indice_tesouro), TAM_MAX_NOME - 1);
+    Posicao pos = sessao->jogo.mundo->tesouros[indice_tesouro];
+    DEPURAR("Enviando tesouro %d: nome='%s', posição=(%d,%d)\n", 
+            indice_tesouro + 1, transferencia->nome, pos.x, pos.y);
+    
+    // Tesouro pré-empacotado no cache para o formato desta transferência: o
+    // arquivo nem é aberto
+    const TesouroPronto *pronto = obter_tesouro_pronto(sessao, indice_tesouro);
+    FILE *arquivo = NULL;
+    unsigned char *mapa = NULL;
+    size_t tamanho_arquivo;
+    
+    if (pronto != NULL) {
+        DEPURAR("Tesouro pré-empacotado no cache: %zu chunks.\n", pronto->num_chunks);
+        tamanho_arquivo = pronto->tamanho_arquivo;
+        contar(&envios_cache, 1);
+    } else {
+        arquivo = abrir_arquivo_tesouro(sessao, indice_tesouro);
+        if (!arquivo || !mapear_arquivo_tesouro(arquivo, &tamanho_arquivo, &mapa)) {
+            return false;
+        }
+    }
     
     // Determinar o tipo de mensagem com base na extensão
     unsigned char tipo_mensagem;
-    int tipo_arquivo = obter_tipo_arquivo(tesouro->nome);
+    int tipo_arquivo = obter_tipo_arquivo(transferencia->nome);
     
     switch (tipo_arquivo) {
         case TIPO_ARQ_TEXTO:
@@ -462,184 +1646,963 @@ bool enviar_arquivo_tesouro(int indice_tesouro) {
             break;
     }
     
-    // Enviar informação de tamanho
-    unsigned char dados_tamanho[sizeof(size_t)];
+    // Iniciar a transferência: os ACKs chegam pela thread de recebimento
+    // e os prazos de retransmissão são controlados pelo timer do reator
+    transferencia->indice_tesouro = indice_tesouro;
+    transferencia->arquivo = arquivo;
+    transferencia->mapa = mapa;
+    transferencia->tam_mapa = tamanho_arquivo;
+    transferencia->pronto = pronto;
+    transferencia->tamanho_arquivo = tamanho_arquivo;
+    transferencia->tipo_mensagem = tipo_mensagem;
+    
+    // Um bloco maior que a janela nunca se completaria com um chunk perdido
+    transferencia->fec_bloco = (fec_bloco < janela_efetiva(sessao)) ? fec_bloco : janela_efetiva(sessao);
+    if (transferencia->fec_bloco < fec_bloco) {
+        DEPURAR("Bloco de FEC reduzido a %d chunks, o tamanho da janela.\n", transferencia->fec_bloco);
+    }
+    
+    // Imagens e vídeos já vêm comprimidos: só os demais tipos passam pelo LZ
+    transferencia->comprimido = sessao->conexao.compressao && tipo_comprimivel(tipo_arquivo);
+    if (pronto != NULL && pronto->comprimido) {
+        transferencia->bytes_originais = pronto->tamanho_arquivo;
+        transferencia->bytes_comprimidos = pronto->tamanho_conteudo;
+    }
+    
+    // O tamanho leva as opções do arquivo, para o cliente se preparar, e o
+    // movimento que encontrou o tesouro: se o OK_ACK dele se perdeu, o
+    // cliente sabe qual dos movimentos em trânsito foi aplicado por último
+    unsigned char dados_tamanho[sizeof(size_t) + TAM_EXTENSAO_TAMANHO + TAM_MOVIMENTO_TAMANHO];
+    int tam_dados_tamanho = sizeof(size_t);
     memcpy(dados_tamanho, &tamanho_arquivo, sizeof(size_t));
+    dados_tamanho[tam_dados_tamanho++] = (transferencia->fec_bloco > 0 ? OPCAO_ARQ_FEC : 0) | 
+                                         (transferencia->comprimido ? OPCAO_ARQ_COMPRIMIDO : 0) | 
+                                         OPCAO_ARQ_MOVIMENTO;
+    dados_tamanho[tam_dados_tamanho++] = transferencia->fec_bloco;
+    dados_tamanho[tam_dados_tamanho++] = fec_paridades;
+    dados_tamanho[tam_dados_tamanho++] = seq_movimento >> 8;
+    dados_tamanho[tam_dados_tamanho++] = seq_movimento & 0xFF;
     
-    if (!enviar_pacote(sockfd, &endereco_cliente, mac_cliente, mac_servidor, 
-                      TIPO_TAMANHO, proximo_seq_envio, dados_tamanho, sizeof(size_t))) {
-        fclose(arquivo);
+    transferencia->etapa = TRANSFERENCIA_TAMANHO;
+    if (!enviar_controle(sessao, TIPO_TAMANHO, dados_tamanho, tam_dados_tamanho)) {
+        concluir_transferencia(sessao, false);
         return false;
     }
     
-    // Aguardar ACK pelo tamanho
-    unsigned char buffer[TAM_MAX_PACOTE];
-    unsigned char tipo_resp, seq_resp;
-    unsigned char *dados_resp;
-    int tam_dados_resp;
-    bool ack_recebido = false;
+    return true;
+}
+
+// Marca o horário de envio de um slot; o primeiro envio abre o prazo total
+static void marcar_envio(SlotJanela *slot) {
+    marcar_instante(&slot->enviado_em);
+    slot->acks_posteriores = 0;
+    slot->ordem_envio = __atomic_add_fetch(&envios_slots, 1, __ATOMIC_RELAXED);
+    if (slot->tentativas == 0) {
+        slot->primeiro_envio = slot->enviado_em;
+    }
+}
+
+// Transmite (ou retransmite) um slot de controle ou de dados
+static bool transmitir_slot(Sessao *sessao, SlotJanela *slot) {
+    marcar_envio(slot);
     
-    // Loop com timeout para esperar ACK
-    struct timeval inicio, atual;
-    gettimeofday(&inicio, NULL);
+    if (!enviar_quadro(&sessao->conexao, slot->tipo, slot->seq, slot->dados, slot->tam_dados)) {
+        printf("Erro ao enviar pacote da transferência.\n");
+        return false;
+    }
+    
+    return true;
+}
+
+// Acrescenta um slot a um lote de envio e marca o horário de envio
+static void adicionar_ao_lote(QuadroSaida *lote, int *num_lote, SlotJanela *slot) {
+    marcar_envio(slot);
+    
+    QuadroSaida *quadro = &lote[(*num_lote)++];
+    quadro->tipo = slot->tipo;
+    quadro->seq = slot->seq;
+    quadro->dados = slot->dados;
+    quadro->tam_dados = slot->tam_dados;
+    quadro->verificacao = slot->verificacao;
+}
+
+// Transmite os slots de um lote com uma única chamada de sistema
+static void transmitir_lote(Sessao *sessao, QuadroSaida *lote, int num_lote) {
+    if (num_lote > 0 && enviar_pacotes_lote(&sessao->conexao, lote, num_lote) < num_lote) {
+        printf("Erro ao enviar lote da transferência. O timer cuidará da retransmissão.\n");
+    }
+}
+
+// Envia um pacote de controle da transferência (tamanho, nome ou fim) e
+// reprograma o timer de retransmissão
+bool enviar_controle(Sessao *sessao, unsigned char tipo, unsigned char *dados, int tam_dados) {
+    Transferencia *transferencia = sessao->transferencia;
+    SlotJanela *slot = &transferencia->controle;
+    
+    slot->tipo = tipo;
+    slot->seq = sessao->proximo_seq_envio;
+    slot->dados = slot->buffer;
+    slot->verificacao = NULL;
+    slot->tam_dados = tam_dados;
+    if (tam_dados > 0) {
+        memcpy(slot->buffer, dados, tam_dados);
+    }
+    slot->confirmado = false;
+    slot->tentativas = 0;
     
-    while (!ack_recebido) {
-        // Verificar timeout
-        gettimeofday(&atual, NULL);
-        long elapsed = (atual.tv_sec - inicio.tv_sec) * 1000 + 
-                      (atual.tv_usec - inicio.tv_usec) / 1000;
+    if (!transmitir_slot(sessao, slot)) {
+        return false;
+    }
+    
+    reprogramar_timer_transferencia(sessao);
+    return true;
+}
+
+// Janela usada na transferência: a pedida com -j, limitada pelo espaço de
+// sequência do formato negociado (16 chunks no clássico)
+static int janela_efetiva(Sessao *sessao) {
+    int maxima = janela_maxima(&sessao->conexao);
+    return (tamanho_janela < maxima) ? tamanho_janela : maxima;
+}
+
+// Próximos 'max' bytes do arquivo original, no mapeamento ou lidos para
+// 'buffer'. Retorna o tamanho do trecho (0 no fim do arquivo).
+static size_t ler_arquivo(Sessao *sessao, unsigned char **trecho, unsigned char *buffer, size_t max) {
+    Transferencia *transferencia = sessao->transferencia;
+    if (transferencia->mapa == NULL) {
+        *trecho = buffer;
+        return fread(buffer, 1, max, transferencia->arquivo);
+    }
+    
+    size_t restante = transferencia->tam_mapa - transferencia->pos_mapa;
+    size_t tam = (max < restante) ? max : restante;
+    *trecho = transferencia->mapa + transferencia->pos_mapa;
+    transferencia->pos_mapa += tam;
+    return tam;
+}
+
+// Tarefa do pool: comprime um bloco do arquivo
+static void comprimir_bloco_adiante(void *contexto) {
+    BlocoAdiante *bloco = contexto;
+    bloco->tam_comprimido = comprimir_bloco(bloco->original, bloco->tam_original, bloco->comprimido);
+}
+
+// Envia ao pool os próximos blocos do arquivo mapeado, até BLOCOS_ADIANTE
+// contando o que acabou de ser dividido em chunks, cujo lugar no anel é
+// reaproveitado
+static void pedir_blocos_adiante(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    
+    while (transferencia->blocos_pedidos - transferencia->blocos_usados < BLOCOS_ADIANTE) {
+        BlocoAdiante *bloco = &transferencia->adiante[transferencia->blocos_pedidos % BLOCOS_ADIANTE];
+        unsigned char *original;
+        bloco->tam_original = ler_arquivo(sessao, &original, NULL, TAM_BLOCO_COMPRESSAO);
+        if (bloco->tam_original == 0) {
+            break;
+        }
         
-        if (elapsed > TIMEOUT_MS) {
-            printf("Timeout esperando ACK para tamanho do arquivo.\n");
-            fclose(arquivo);
+        bloco->original = original;
+        tarefas_enviar(&pool_tarefas, &bloco->tarefa, comprimir_bloco_adiante, bloco, 
+                       sessao->trabalhador->indice);
+        transferencia->blocos_pedidos++;
+    }
+}
+
+// Espera os blocos ainda no pool, que leem o mapeamento do arquivo
+static void aguardar_blocos_adiante(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    
+    while (transferencia->blocos_usados < transferencia->blocos_pedidos) {
+        BlocoAdiante *bloco = &transferencia->adiante[transferencia->blocos_usados % BLOCOS_ADIANTE];
+        tarefas_aguardar(&pool_tarefas, &bloco->tarefa, sessao->trabalhador->indice);
+        transferencia->blocos_usados++;
+    }
+}
+
+// Indica se a compressão vai pelo pool: só com o arquivo mapeado, que as
+// threads do pool leem direto. O anel de blocos é alocado na primeira vez e
+// fica com a sessão.
+static bool comprimir_no_pool(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    if (threads_tarefas == 0 || transferencia->mapa == NULL) {
+        return false;
+    }
+    
+    if (transferencia->adiante == NULL) {
+        transferencia->adiante = malloc(BLOCOS_ADIANTE * sizeof(BlocoAdiante));
+        if (transferencia->adiante == NULL) {
+            fprintf(stderr, "Sem memória para os blocos do pool: comprimindo na thread de recepção.\n");
             return false;
         }
+    }
+    return true;
+}
+
+// Passa ao próximo bloco do arquivo comprimido. Com o pool, ele e os
+// seguintes já foram pedidos antes e só falta esperar que fique pronto; sem
+// ele, o bloco é lido no buffer da thread e comprimido aqui. Retorna false
+// no fim do arquivo.
+static bool proximo_bloco_comprimido(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    size_t tam_original;
+    
+    if (comprimir_no_pool(sessao)) {
+        pedir_blocos_adiante(sessao);
+        if (transferencia->blocos_usados == transferencia->blocos_pedidos) {
+            return false;
+        }
+        
+        BlocoAdiante *bloco = &transferencia->adiante[transferencia->blocos_usados % BLOCOS_ADIANTE];
+        if (!tarefas_pronta(&bloco->tarefa)) {
+            contar(&esperas_blocos, 1);
+            tarefas_aguardar(&pool_tarefas, &bloco->tarefa, sessao->trabalhador->indice);
+        }
+        transferencia->blocos_usados++;
+        contar(&blocos_adiante, 1);
+        
+        transferencia->bloco = bloco->comprimido;
+        transferencia->tam_bloco_comprimido = bloco->tam_comprimido;
+        tam_original = bloco->tam_original;
+    } else {
+        unsigned char *original;
+        tam_original = ler_arquivo(sessao, &original, sessao->trabalhador->buffer_original, 
+                                   TAM_BLOCO_COMPRESSAO);
+        if (tam_original == 0) {
+            return false;
+        }
+        
+        transferencia->tam_bloco_comprimido = comprimir_bloco(original, tam_original, 
+                                                             transferencia->bloco_comprimido);
+        transferencia->bloco = transferencia->bloco_comprimido;
+    }
+    
+    transferencia->pos_bloco_comprimido = 0;
+    transferencia->bytes_originais += tam_original;
+    transferencia->bytes_comprimidos += transferencia->tam_bloco_comprimido;
+    return true;
+}
+
+// Lê o próximo chunk a enviar para o slot: os bytes do arquivo, apontados no
+// mapeamento, ou, com compressão, os do arquivo comprimido, produzido um bloco
+// por vez e copiado para o buffer do slot. Um chunk pode juntar o fim de um
+// bloco com o início do seguinte.
+static size_t ler_chunk(Sessao *sessao, SlotJanela *slot, size_t max) {
+    Transferencia *transferencia = sessao->transferencia;
+    
+    // Do cache: o chunk já está pronto, com as verificações calculadas
+    if (transferencia->pronto != NULL) {
+        if (transferencia->proximo >= transferencia->pronto->num_chunks) {
+            return 0;
+        }
+        const ChunkPronto *chunk = &transferencia->pronto->chunks[transferencia->proximo];
+        slot->dados = chunk->dados;
+        slot->verificacao = &chunk->verificacao;
+        return chunk->tam_dados;
+    }
+    
+    slot->verificacao = NULL;
+    if (!transferencia->comprimido) {
+        return ler_arquivo(sessao, &slot->dados, slot->buffer, max);
+    }
+    
+    slot->dados = slot->buffer;
+    size_t lidos = 0;
+    
+    while (lidos < max) {
+        if (transferencia->pos_bloco_comprimido == transferencia->tam_bloco_comprimido && 
+            !proximo_bloco_comprimido(sessao)) {
+            break;
+        }
+        
+        size_t disponivel = transferencia->tam_bloco_comprimido - transferencia->pos_bloco_comprimido;
+        size_t copiar = (max - lidos < disponivel) ? max - lidos : disponivel;
+        memcpy(slot->buffer + lidos, transferencia->bloco + transferencia->pos_bloco_comprimido, copiar);
+        transferencia->pos_bloco_comprimido += copiar;
+        lidos += copiar;
+    }
+    
+    return lidos;
+}
+
+// Linha de paridade de um bloco de FEC, codificada por uma thread do pool
+typedef struct {
+    Tarefa tarefa;
+    unsigned char *paridade;
+    int linha;
+    unsigned char *const *dados;
+    const int *tamanhos;
+    int num_chunks;
+    int tam_simbolo;
+} LinhaParidade;
+
+static void codificar_linha_paridade(void *contexto) {
+    LinhaParidade *linha = contexto;
+    linha->tam_simbolo = fec_codificar(linha->paridade + TAM_CABECALHO_FEC, linha->linha, fec_paridades, 
+                                       linha->dados, linha->tamanhos, linha->num_chunks);
+}
+
+// Envia as paridades do bloco de FEC com 'num_chunks' chunks a partir do
+// índice 'inicio'. Os chunks ainda estão na janela: um bloco nunca é maior
+// que ela. O lote é transmitido junto, pois os buffers de paridade são
+// reaproveitados no próximo bloco.
+static void enviar_paridades(Sessao *sessao, size_t inicio, int num_chunks, QuadroSaida *lote, int *num_lote) {
+    Transferencia *transferencia = sessao->transferencia;
+    unsigned char *dados[MAX_BLOCO_FEC];
+    int tamanhos[MAX_BLOCO_FEC];
+    uint16_t seq_inicio = slot_dados(transferencia, inicio)->seq;
+    
+    for (int i = 0; i < num_chunks; i++) {
+        SlotJanela *slot = slot_dados(transferencia, inicio + i);
+        dados[i] = slot->dados;
+        tamanhos[i] = slot->tam_dados;
+    }
+    
+    // Com o pool, as linhas além da primeira são codificadas por ele enquanto
+    // esta thread codifica a primeira; os quadros saem na ordem das linhas
+    LinhaParidade linhas[MAX_PARIDADE_FEC];
+    for (int linha = 0; linha < fec_paridades; linha++) {
+        unsigned char *paridade = sessao->trabalhador->paridades[linha];
+        paridade[0] = seq_inicio >> 8;
+        paridade[1] = seq_inicio & 0xFF;
+        paridade[2] = num_chunks;
+        paridade[3] = fec_paridades;
+        paridade[4] = linha;
+        
+        LinhaParidade *atual = &linhas[linha];
+        atual->paridade = paridade;
+        atual->linha = linha;
+        atual->dados = dados;
+        atual->tamanhos = tamanhos;
+        atual->num_chunks = num_chunks;
+        if (threads_tarefas > 0 && linha > 0) {
+            tarefas_enviar(&pool_tarefas, &atual->tarefa, codificar_linha_paridade, atual, 
+                           sessao->trabalhador->indice);
+        }
+    }
+    
+    for (int linha = 0; linha < fec_paridades; linha++) {
+        LinhaParidade *atual = &linhas[linha];
+        if (threads_tarefas > 0 && linha > 0) {
+            tarefas_aguardar(&pool_tarefas, &atual->tarefa, sessao->trabalhador->indice);
+        } else {
+            codificar_linha_paridade(atual);
+        }
         
-        if (receber_pacote(sockfd, buffer, &tipo_resp, &seq_resp, &dados_resp, &tam_dados_resp)) {
-            if (tipo_resp == TIPO_ACK && seq_resp == proximo_seq_envio) {
-                ack_recebido = true;
-                proximo_seq_envio = (proximo_seq_envio + 1) % 32;
+        QuadroSaida *quadro = &lote[(*num_lote)++];
+        quadro->tipo = TIPO_PARIDADE;
+        quadro->seq = seq_inicio;
+        quadro->dados = atual->paridade;
+        quadro->tam_dados = TAM_CABECALHO_FEC + atual->tam_simbolo;
+        quadro->verificacao = NULL;
+        contar(&quadros_paridade, 1);
+    }
+    
+    transmitir_lote(sessao, lote, *num_lote);
+    *num_lote = 0;
+}
+
+// Publica o progresso do envio para a tela a cada 5% do arquivo lido
+static void publicar_progresso(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    if (transferencia->tamanho_arquivo == 0) {
+        return;
+    }
+    
+    uint64_t lidos;
+    if (transferencia->pronto != NULL) {
+        lidos = (uint64_t)transferencia->tamanho_arquivo * transferencia->proximo / 
+                transferencia->pronto->num_chunks;
+    } else if (transferencia->mapa != NULL) {
+        lidos = transferencia->pos_mapa;
+    } else {
+        off_t posicao = ftello(transferencia->arquivo);
+        lidos = (posicao > 0) ? (uint64_t)posicao : 0;
+    }
+    if (lidos > transferencia->tamanho_arquivo) {
+        lidos = transferencia->tamanho_arquivo;
+    }
+    
+    int vigesimo = (int)(lidos * 20 / transferencia->tamanho_arquivo);
+    if (vigesimo <= transferencia->progresso_publicado) {
+        return;
+    }
+    transferencia->progresso_publicado = vigesimo;
+    
+    EventoJogo evento = {.tipo = EVENTO_PROGRESSO, .tesouro = transferencia->indice_tesouro, 
+                         .bytes = lidos, .total = transferencia->tamanho_arquivo};
+    publicar_evento(sessao, &evento);
+}
+
+// Lê novos chunks do arquivo enquanto houver espaço na janela e os envia
+// juntos em um único lote. Com FEC, cada bloco completo (ou o último, menor)
+// é seguido das suas paridades.
+static void preencher_janela(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    QuadroSaida lote[JANELA_MAX + MAX_PARIDADE_FEC];
+    int num_lote = 0;
+    int janela = janela_efetiva(sessao);
+    
+    // Os chunks encolhem para que a paridade (cabeçalho + símbolo) caiba no quadro
+    int bloco = transferencia->fec_bloco;
+    int tam_chunk = sessao->conexao.max_dados - (bloco > 0 ? REDUCAO_CHUNK_FEC : 0);
+    
+    while (!transferencia->fim_arquivo && 
+           transferencia->proximo - transferencia->base < (size_t)janela) {
+        SlotJanela *slot = slot_dados(transferencia, transferencia->proximo);
+        size_t bytes_lidos = ler_chunk(sessao, slot, tam_chunk);
+        
+        if (bytes_lidos == 0) {
+            transferencia->fim_arquivo = true;
+            
+            int incompleto = (bloco > 0) ? transferencia->proximo % bloco : 0;
+            if (incompleto > 0) {
+                enviar_paridades(sessao, transferencia->proximo - incompleto, incompleto, lote, &num_lote);
             }
+            break;
         }
         
-        usleep(10000); // 10ms
+        slot->tipo = TIPO_DADOS;
+        slot->tam_dados = bytes_lidos;
+        slot->seq = avancar_seq(transferencia->seq_inicial, transferencia->proximo, sessao->conexao.espaco_seq);
+        slot->confirmado = false;
+        slot->tentativas = 0;
+        adicionar_ao_lote(lote, &num_lote, slot);
+        transferencia->proximo++;
+        contar(&chunks_lidos, 1);
+        
+        if (bloco > 0 && transferencia->proximo % bloco == 0) {
+            enviar_paridades(sessao, transferencia->proximo - bloco, bloco, lote, &num_lote);
+        }
     }
     
-    // Enviar nome do arquivo
-    size_t tam_nome = strlen(tesouro->nome) + 1;
-    if (!enviar_pacote(sockfd, &endereco_cliente, mac_cliente, mac_servidor, 
-                      tipo_mensagem, proximo_seq_envio, (unsigned char*)tesouro->nome, tam_nome)) {
-        fclose(arquivo);
+    transmitir_lote(sessao, lote, num_lote);
+    publicar_progresso(sessao);
+}
+
+// Pula os 'inicio' primeiros bytes do arquivo, que o cliente guardou de uma
+// tentativa anterior. Com compressão, o cliente só tem blocos inteiros e
+// 'inicio' cai no começo de um bloco. Retorna false se o pedido for inválido
+// ou o arquivo não puder ser aberto.
+static bool retomar_transferencia(Sessao *sessao, uint64_t inicio) {
+    Transferencia *transferencia = sessao->transferencia;
+    if (inicio == 0) {
+        return true;
+    }
+    if (inicio >= transferencia->tamanho_arquivo || 
+        (transferencia->comprimido && inicio % TAM_BLOCO_COMPRESSAO != 0)) {
+        printf("Pedido de retomada inválido: byte %llu de %zu.\n", 
+               (unsigned long long)inicio, transferencia->tamanho_arquivo);
         return false;
     }
     
-    // Aguardar ACK pelo nome
-    ack_recebido = false;
-    gettimeofday(&inicio, NULL);
-    
-    while (!ack_recebido) {
-        // Verificar timeout
-        gettimeofday(&atual, NULL);
-        long elapsed = (atual.tv_sec - inicio.tv_sec) * 1000 + 
-                      (atual.tv_usec - inicio.tv_usec) / 1000;
+    // Os chunks do cache começam no byte zero: a retomada lê do arquivo
+    if (transferencia->pronto != NULL) {
+        transferencia->pronto = NULL;
+        transferencia->bytes_originais = 0;
+        transferencia->bytes_comprimidos = 0;
         
-        if (elapsed > TIMEOUT_MS) {
-            printf("Timeout esperando ACK para nome do arquivo.\n");
-            fclose(arquivo);
+        size_t tamanho;
+        transferencia->arquivo = abrir_arquivo_tesouro(sessao, transferencia->indice_tesouro);
+        if (!transferencia->arquivo || 
+            !mapear_arquivo_tesouro(transferencia->arquivo, &tamanho, &transferencia->mapa)) {
+            transferencia->arquivo = NULL;
             return false;
         }
-        
-        if (receber_pacote(sockfd, buffer, &tipo_resp, &seq_resp, &dados_resp, &tam_dados_resp)) {
-            if (tipo_resp == TIPO_ACK && seq_resp == proximo_seq_envio) {
-                ack_recebido = true;
-                proximo_seq_envio = (proximo_seq_envio + 1) % 32;
+        transferencia->tam_mapa = tamanho;
+    }
+    
+    if (transferencia->mapa != NULL) {
+        transferencia->pos_mapa = inicio;
+    } else if (fseeko(transferencia->arquivo, inicio, SEEK_SET) != 0) {
+        perror("Erro ao posicionar arquivo para a retomada");
+        return false;
+    }
+    
+    DEPURAR("Retomando a partir do byte %llu de %zu.\n", 
+            (unsigned long long)inicio, transferencia->tamanho_arquivo);
+    contar(&retomadas, 1);
+    contar_bytes(&bytes_retomados, inicio);
+    return true;
+}
+
+// Avança a transferência para a próxima etapa após o ACK de um pacote de controle
+static void avancar_etapa(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    sessao->proximo_seq_envio = avancar_seq(sessao->proximo_seq_envio, 1, sessao->conexao.espaco_seq);
+    
+    switch (transferencia->etapa) {
+        case TRANSFERENCIA_TAMANHO: {
+            // Enviar nome do arquivo
+            size_t tam_nome = strlen(transferencia->nome) + 1;
+            transferencia->etapa = TRANSFERENCIA_NOME;
+            if (!enviar_controle(sessao, transferencia->tipo_mensagem, (unsigned char*)transferencia->nome, tam_nome)) {
+                concluir_transferencia(sessao, false);
             }
+            break;
         }
         
-        usleep(10000); // 10ms
+        case TRANSFERENCIA_NOME:
+            // Enviar dados do arquivo em chunks, com vários pacotes em trânsito
+            transferencia->etapa = TRANSFERENCIA_DADOS;
+            transferencia->seq_inicial = sessao->proximo_seq_envio;
+            verificar_fim_dados(sessao);
+            break;
+        
+        case TRANSFERENCIA_FIM:
+            concluir_transferencia(sessao, true);
+            break;
+        
+        default:
+            break;
+    }
+}
+
+// Desliza a janela, envia novos chunks e, quando tudo foi confirmado,
+// envia a mensagem de fim de arquivo
+static void verificar_fim_dados(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    
+    // Deslizar a janela sobre os chunks já confirmados
+    while (transferencia->base < transferencia->proximo && 
+           slot_dados(transferencia, transferencia->base)->confirmado) {
+        transferencia->base++;
+    }
+    
+    preencher_janela(sessao);
+    
+    if (transferencia->fim_arquivo && transferencia->base == transferencia->proximo) {
+        sessao->proximo_seq_envio = avancar_seq(transferencia->seq_inicial, transferencia->proximo, 
+                                        sessao->conexao.espaco_seq);
+        transferencia->etapa = TRANSFERENCIA_FIM;
+        if (!enviar_controle(sessao, TIPO_FIM_ARQUIVO, NULL, 0)) {
+            concluir_transferencia(sessao, false);
+        }
+        return;
     }
     
-    // Enviar dados do arquivo em chunks
-    unsigned char dados_arquivo[TAM_MAX_DADOS];
-    size_t bytes_lidos;
-    int retries;
+    reprogramar_timer_transferencia(sessao);
+}
+
+// Alimenta o estimador de RTO com o tempo até o ACK de um slot. Pela regra de
+// Karn, slots retransmitidos não são medidos.
+static void medir_rtt(Sessao *sessao, SlotJanela *slot) {
+    if (slot->tentativas == 0) {
+        rto_registrar_amostra(&sessao->conexao.rto, tempo_decorrido_us(&slot->enviado_em));
+    }
+}
+
+// Retransmissão rápida: cada chunk confirmado por um ACK conta contra os
+// chunks mais antigos ainda sem ACK que foram enviados antes dele; no limiar,
+// o chunk é reenviado sem esperar o RTO. Um chunk já retransmitido só volta a
+// contar com ACKs de envios posteriores à retransmissão. Com FEC, só contam
+// ACKs de blocos seguintes: dentro do bloco, a paridade ainda pode reconstruir
+// o chunk. Os chunks a reenviar vão para o lote. 'confirmados' traz, em ordem
+// crescente, os deslocamentos que o ACK acabou de confirmar; a janela é
+// percorrida uma vez, de trás para frente, acumulando a contagem.
+static void retransmitir_anteriores(Sessao *sessao, const size_t *confirmados, int num_confirmados, 
+                                    QuadroSaida *lote, int *num_lote) {
+    Transferencia *transferencia = sessao->transferencia;
+    size_t bloco = (transferencia->fec_bloco > 0) ? (size_t)transferencia->fec_bloco : 1;
+    int posteriores = 0;                  // Confirmados em blocos seguintes
+    unsigned long ordem_posteriores = 0;  // Envio mais recente entre eles
+    int no_bloco = 0;                     // Confirmados no bloco corrente
+    unsigned long ordem_bloco = 0;
+    int proximo = num_confirmados - 1;
+    
+    if (num_confirmados == 0) {
+        return;
+    }
     
-    while ((bytes_lidos = fread(dados_arquivo, 1, TAM_MAX_DADOS, arquivo)) > 0) {
-        retries = 0;
-        ack_recebido = false;
+    for (size_t i = confirmados[num_confirmados - 1] + 1; i-- > 0;) {
+        size_t indice = transferencia->base + i;
+        SlotJanela *anterior = slot_dados(transferencia, indice);
         
-        while (!ack_recebido && retries < MAX_RETRIES) {
-            // Enviar chunk de dados
-            if (!enviar_pacote(sockfd, &endereco_cliente, mac_cliente, mac_servidor, 
-                             TIPO_DADOS, proximo_seq_envio, dados_arquivo, bytes_lidos)) {
-                printf("Erro ao enviar dados do arquivo.\n");
-                retries++;
-                continue;
+        // Ao passar para o bloco anterior, os confirmados do bloco corrente
+        // passam a contar (sem FEC, cada chunk é um bloco)
+        if (indice % bloco == bloco - 1) {
+            posteriores += no_bloco;
+            if (ordem_bloco > ordem_posteriores) {
+                ordem_posteriores = ordem_bloco;
             }
+            no_bloco = 0;
+            ordem_bloco = 0;
+        }
+        
+        if (proximo >= 0 && confirmados[proximo] == i) {
+            no_bloco++;
+            if (anterior->ordem_envio > ordem_bloco) {
+                ordem_bloco = anterior->ordem_envio;
+            }
+            proximo--;
+            continue;
+        }
+        
+        if (anterior->confirmado || posteriores == 0 || anterior->ordem_envio > ordem_posteriores) {
+            continue;
+        }
+        anterior->acks_posteriores += posteriores;
+        if (anterior->acks_posteriores < LIMIAR_RETRANSMISSAO_RAPIDA) {
+            continue;
+        }
+        
+        DEPURAR("Chunk seq=%d sem ACK após %d ACKs posteriores. Retransmitindo...\n", 
+                anterior->seq, LIMIAR_RETRANSMISSAO_RAPIDA);
+        contar(&retransmissoes_rapidas, 1);
+        anterior->tentativas++;
+        adicionar_ao_lote(lote, num_lote, anterior);
+    }
+}
+
+// Confirma o chunk no deslocamento dado a partir da base. Retorna o slot se
+// ele ainda não estava confirmado, ou NULL.
+static SlotJanela *confirmar_chunk(Sessao *sessao, size_t deslocamento) {
+    Transferencia *transferencia = sessao->transferencia;
+    SlotJanela *slot = slot_dados(transferencia, transferencia->base + deslocamento);
+    if (slot->confirmado) {
+        return NULL;
+    }
+    
+    // A janela desliza no fim do lote de pacotes recebidos
+    slot->confirmado = true;
+    if (!sessao->deslizar_pendente) {
+        Trabalhador *trabalhador = sessao->trabalhador;
+        trabalhador->deslizar[trabalhador->num_deslizar++] = sessao;
+        sessao->deslizar_pendente = true;
+    }
+    return slot;
+}
+
+// Trata um ACK seletivo: confirma os chunks até 'seq' e os marcados no mapa
+// de bits. Os buracos que ficaram para trás são reenviados juntos.
+static void tratar_sack(Sessao *sessao, uint16_t seq, const unsigned char *mapa, int tam_mapa) {
+    Transferencia *transferencia = sessao->transferencia;
+    size_t em_transito = transferencia->proximo - transferencia->base;
+    uint16_t seq_base = slot_dados(transferencia, transferencia->base)->seq;
+    uint32_t espaco = sessao->conexao.espaco_seq;
+    QuadroSaida lote[JANELA_MAX];
+    int num_lote = 0;
+    SlotJanela *mais_recente = NULL;
+    size_t confirmados[JANELA_MAX];
+    int num_confirmados = 0;
+    
+    // Parte cumulativa; um ACK antigo cai fora da janela e é ignorado
+    size_t cumulativos = distancia_seq(seq_base, avancar_seq(seq, 1, espaco), espaco);
+    if (cumulativos > em_transito) {
+        cumulativos = 0;
+    }
+    
+    for (size_t i = 0; i < cumulativos; i++) {
+        SlotJanela *slot = confirmar_chunk(sessao, i);
+        if (slot != NULL && (mais_recente == NULL || slot->ordem_envio > mais_recente->ordem_envio)) {
+            mais_recente = slot;
+        }
+        if (slot != NULL) {
+            confirmados[num_confirmados++] = i;
+        }
+    }
+    
+    // Chunks recebidos além do primeiro buraco
+    for (int bit = 0; bit < tam_mapa * 8; bit++) {
+        if (!(mapa[bit / 8] & (1 << (bit % 8)))) {
+            continue;
+        }
+        
+        size_t deslocamento = distancia_seq(seq_base, avancar_seq(seq, 1 + bit, espaco), espaco);
+        if (deslocamento >= em_transito) {
+            continue;
+        }
+        
+        SlotJanela *slot = confirmar_chunk(sessao, deslocamento);
+        if (slot != NULL && (mais_recente == NULL || slot->ordem_envio > mais_recente->ordem_envio)) {
+            mais_recente = slot;
+        }
+        if (slot != NULL) {
+            confirmados[num_confirmados++] = deslocamento;
+        }
+    }
+    
+    // Uma medida por ACK, do chunk que o provocou: os demais esperaram o atraso
+    // de coalescência do receptor
+    retransmitir_anteriores(sessao, confirmados, num_confirmados, lote, &num_lote);
+    if (mais_recente != NULL) {
+        medir_rtt(sessao, mais_recente);
+    }
+    
+    transmitir_lote(sessao, lote, num_lote);
+}
+
+// Trata um ACK ou NACK recebido durante a transferência. Um NACK com dados
+// traz um código de erro; sem dados, pede a retransmissão imediata. Um ACK
+// de dados com payload é um ACK seletivo.
+void tratar_resposta_transferencia(Sessao *sessao, unsigned char tipo, uint16_t seq, 
+                                   unsigned char *dados, int tam_dados) {
+    Transferencia *transferencia = sessao->transferencia;
+    if (!transferencia_ativa(sessao)) {
+        return;
+    }
+    
+    if (transferencia->etapa != TRANSFERENCIA_DADOS) {
+        if (seq != transferencia->controle.seq) {
+            return;
+        }
+        
+        if (tipo == TIPO_ACK) {
+            medir_rtt(sessao, &transferencia->controle);
             
-            // Aguardar ACK
-            gettimeofday(&inicio, NULL);
-            bool timeout = false;
-            
-            while (!ack_recebido && !timeout) {
-                // Verificar timeout
-                gettimeofday(&atual, NULL);
-                long elapsed = (atual.tv_sec - inicio.tv_sec) * 1000 + 
-                               (atual.tv_usec - inicio.tv_usec) / 1000;
-                
-                if (elapsed > TIMEOUT_MS) {
-                    printf("Timeout esperando ACK para dados. Tentativa %d/%d.\n", 
-                          retries + 1, MAX_RETRIES);
-                    timeout = true;
-                    retries++;
-                    continue;
-                }
-                
-                if (receber_pacote(sockfd, buffer, &tipo_resp, &seq_resp, &dados_resp, &tam_dados_resp)) {
-                    if (tipo_resp == TIPO_ACK && seq_resp == proximo_seq_envio) {
-                        ack_recebido = true;
-                        proximo_seq_envio = (proximo_seq_envio + 1) % 32;
-                    } else if (tipo_resp == TIPO_NACK && seq_resp == proximo_seq_envio) {
-                        printf("NACK recebido. Retransmitindo...\n");
-                        timeout = true;
-                        retries++;
-                    }
-                }
-                
-                usleep(10000); // 10ms
+            // O ACK do nome pode pedir que o arquivo continue de onde parou
+            if (transferencia->etapa == TRANSFERENCIA_NOME && sessao->conexao.retomada && 
+                tam_dados >= TAM_RETOMADA && dados != NULL && !retomar_transferencia(sessao, ler_be64(dados))) {
+                concluir_transferencia(sessao, false);
+                return;
             }
+            avancar_etapa(sessao);
+        } else if (tam_dados > 0) {
+            // NACK com código de erro: o cliente recusou o arquivo
+            DEPURAR("NACK recebido para pacote de controle (tipo=%d).\n", transferencia->controle.tipo);
+            concluir_transferencia(sessao, false);
+        } else {
+            // NACK sem erro: o pacote chegou corrompido
+            DEPURAR("NACK recebido para pacote de controle (seq=%d). Retransmitindo...\n", seq);
+            contar(&retransmissoes_nack, 1);
+            if (deve_desistir(++transferencia->controle.tentativas, &transferencia->controle.primeiro_envio)) {
+                printf("Número máximo de tentativas excedido.\n");
+                concluir_transferencia(sessao, false);
+                return;
+            }
+            transmitir_slot(sessao, &transferencia->controle);
+            reprogramar_timer_transferencia(sessao);
         }
+        return;
+    }
+    
+    if (transferencia->base == transferencia->proximo) {
+        return;
+    }
+    
+    if (tipo == TIPO_ACK && tam_dados > 0) {
+        tratar_sack(sessao, seq, dados, tam_dados);
+        return;
+    }
+    
+    // Localizar o chunk correspondente dentro da janela
+    size_t deslocamento = distancia_seq(slot_dados(transferencia, transferencia->base)->seq, seq, 
+                                        sessao->conexao.espaco_seq);
+    if (deslocamento >= transferencia->proximo - transferencia->base) {
+        return;
+    }
+    
+    SlotJanela *slot = slot_dados(transferencia, transferencia->base + deslocamento);
+    
+    if (tipo == TIPO_ACK) {
+        QuadroSaida lote[JANELA_MAX];
+        int num_lote = 0;
         
-        if (retries >= MAX_RETRIES) {
+        if (confirmar_chunk(sessao, deslocamento) != NULL) {
+            retransmitir_anteriores(sessao, &deslocamento, 1, lote, &num_lote);
+            medir_rtt(sessao, slot);
+        }
+        transmitir_lote(sessao, lote, num_lote);
+        return;
+    }
+    
+    if (!slot->confirmado) {
+        DEPURAR("NACK recebido para seq=%d. Retransmitindo...\n", slot->seq);
+        contar(&retransmissoes_nack, 1);
+        if (deve_desistir(++slot->tentativas, &slot->primeiro_envio)) {
             printf("Número máximo de tentativas excedido.\n");
-            fclose(arquivo);
-            return false;
+            concluir_transferencia(sessao, false);
+            return;
         }
+        transmitir_slot(sessao, slot);
     }
     
-    // Enviar mensagem de fim de arquivo
-    if (!enviar_pacote(sockfd, &endereco_cliente, mac_cliente, mac_servidor, 
-                     TIPO_FIM_ARQUIVO, proximo_seq_envio, NULL, 0)) {
-        fclose(arquivo);
+    verificar_fim_dados(sessao);
+}
+
+// Arma o timer da thread para o instante 'prazo' (em agora_us), se ele vier
+// antes do prazo já armado. Um prazo que se afastou não rearma o timer: o
+// disparo adiantado só refaz a conta.
+static void programar_timer(Trabalhador *trabalhador, long long prazo) {
+    if (prazo < 0 || (trabalhador->timer_armado_us >= 0 && trabalhador->timer_armado_us <= prazo)) {
+        return;
+    }
+    
+    long long espera = prazo - agora_us();
+    reator_armar_timer(trabalhador->timer_retransmissao, espera > 0 ? espera : 1);
+    trabalhador->timer_armado_us = prazo;
+}
+
+// Calcula o prazo pendente mais próximo da sessão e arma o timer da thread,
+// que atende todas as sessões dela, se esse prazo for o primeiro a vencer
+void reprogramar_timer_transferencia(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    long long prazo = rto_atual_us(&sessao->conexao.rto);
+    long long espera = -1;
+    
+    if (transferencia->etapa == TRANSFERENCIA_DADOS) {
+        for (size_t i = transferencia->base; i < transferencia->proximo; i++) {
+            SlotJanela *slot = slot_dados(transferencia, i);
+            if (!slot->confirmado) {
+                long long restante = prazo - tempo_decorrido_us(&slot->enviado_em);
+                if (espera < 0 || restante < espera) {
+                    espera = restante;
+                }
+            }
+        }
+    } else if (transferencia->etapa != TRANSFERENCIA_INATIVA) {
+        espera = prazo - tempo_decorrido_us(&transferencia->controle.enviado_em);
+    }
+    
+    // Prazo já vencido: dispara o quanto antes (0 desarmaria o timer)
+    if (espera == 0 || (espera < 0 && transferencia->etapa != TRANSFERENCIA_INATIVA)) {
+        espera = 1;
+    }
+    
+    sessao->prazo_us = (espera > 0) ? agora_us() + espera : -1;
+    programar_timer(sessao->trabalhador, sessao->prazo_us);
+}
+
+// Conta uma nova tentativa para um slot cujo prazo expirou. Retorna false se
+// as tentativas e o prazo total acabaram.
+static bool registrar_tentativa(Sessao *sessao, SlotJanela *slot, const char *descricao) {
+    DEPURAR("Timeout esperando ACK para %s (seq=%d). Tentativa %d, RTO %.3f ms.\n", 
+            descricao, slot->seq, slot->tentativas + 1, rto_atual_us(&sessao->conexao.rto) / 1000.0);
+    
+    if (deve_desistir(++slot->tentativas, &slot->primeiro_envio)) {
+        printf("Número máximo de tentativas excedido.\n");
         return false;
     }
     
-    // Aguardar ACK final
-    ack_recebido = false;
-    gettimeofday(&inicio, NULL);
+    return true;
+}
+
+// Retransmite os pacotes da sessão cujo prazo venceu
+static void expirar_prazos(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    long long prazo = rto_atual_us(&sessao->conexao.rto);
+    bool expirou = false;
     
-    while (!ack_recebido) {
-        // Verificar timeout
-        gettimeofday(&atual, NULL);
-        long elapsed = (atual.tv_sec - inicio.tv_sec) * 1000 + 
-                      (atual.tv_usec - inicio.tv_usec) / 1000;
+    if (transferencia->etapa == TRANSFERENCIA_DADOS) {
+        // Os chunks vencidos são retransmitidos juntos em um lote
+        QuadroSaida lote[JANELA_MAX];
+        int num_lote = 0;
         
-        if (elapsed > TIMEOUT_MS) {
-            printf("Timeout esperando ACK final.\n");
-            fclose(arquivo);
-            return false;
+        for (size_t i = transferencia->base; i < transferencia->proximo; i++) {
+            SlotJanela *slot = slot_dados(transferencia, i);
+            if (!slot->confirmado && tempo_decorrido_us(&slot->enviado_em) >= prazo) {
+                if (!registrar_tentativa(sessao, slot, "dados")) {
+                    concluir_transferencia(sessao, false);
+                    return;
+                }
+                adicionar_ao_lote(lote, &num_lote, slot);
+                contar(&retransmissoes_timeout, 1);
+                expirou = true;
+            }
         }
         
-        if (receber_pacote(sockfd, buffer, &tipo_resp, &seq_resp, &dados_resp, &tam_dados_resp)) {
-            if (tipo_resp == TIPO_ACK && seq_resp == proximo_seq_envio) {
-                ack_recebido = true;
-                proximo_seq_envio = (proximo_seq_envio + 1) % 32;
+        transmitir_lote(sessao, lote, num_lote);
+    } else if (transferencia->etapa != TRANSFERENCIA_INATIVA) {
+        SlotJanela *slot = &transferencia->controle;
+        if (tempo_decorrido_us(&slot->enviado_em) >= prazo) {
+            if (!registrar_tentativa(sessao, slot, "pacote de controle")) {
+                concluir_transferencia(sessao, false);
+                return;
             }
+            transmitir_slot(sessao, slot);
+            contar(&retransmissoes_timeout, 1);
+            expirou = true;
         }
-        
-        usleep(10000); // 10ms
     }
     
-    fclose(arquivo);
+    // Backoff exponencial: uma vez por expiração, não por slot retransmitido
+    if (expirou) {
+        rto_registrar_expiracao(&sessao->conexao.rto);
+    }
     
-    // Marcar que o grid precisa ser atualizado para mostrar o tesouro encontrado
-    atualizacao_pendente = true;
+    reprogramar_timer_transferencia(sessao);
+}
+
+// Tratador do timer de retransmissão: atende as sessões com prazo vencido e
+// rearma o timer para o prazo mais próximo entre as que restam
+void ao_expirar_timer(void *contexto) {
+    Trabalhador *trabalhador = contexto;
+    long long agora = agora_us();
+    trabalhador->timer_armado_us = -1;
     
-    return true;
+    for (int balde = 0; balde < NUM_BALDES_SESSOES; balde++) {
+        for (Sessao *sessao = trabalhador->baldes[balde]; sessao != NULL; sessao = sessao->proxima) {
+            if (sessao->prazo_us >= 0 && sessao->prazo_us <= agora) {
+                expirar_prazos(sessao);
+            }
+        }
+    }
+    
+    for (int balde = 0; balde < NUM_BALDES_SESSOES; balde++) {
+        for (Sessao *sessao = trabalhador->baldes[balde]; sessao != NULL; sessao = sessao->proxima) {
+            programar_timer(trabalhador, sessao->prazo_us);
+        }
+    }
+}
+
+// Encerra a transferência atual e avisa a thread principal
+void concluir_transferencia(Sessao *sessao, bool sucesso) {
+    Transferencia *transferencia = sessao->transferencia;
+    liberar_arquivo_transferencia(sessao);
+    
+    transferencia->etapa = TRANSFERENCIA_INATIVA;
+    sessao->prazo_us = -1;
+    
+    if (sucesso) {
+        if (transferencia->comprimido && transferencia->bytes_originais > 0) {
+            DEPURAR("Comprimido: %llu bytes enviados como %llu (%.1f%%).\n", 
+                    transferencia->bytes_originais, transferencia->bytes_comprimidos, 
+                    100.0 * transferencia->bytes_comprimidos / transferencia->bytes_originais);
+            contar_bytes(&bytes_originais, transferencia->bytes_originais);
+            contar_bytes(&bytes_comprimidos, transferencia->bytes_comprimidos);
+        }
+    } else {
+        // O tesouro volta a valer: ao pisar de novo nele, o cliente recebe o
+        // arquivo outra vez (com a retomada, só a parte que falta)
+        marcar_tesouro_encontrado(&sessao->jogo, transferencia->indice_tesouro, false);
+        
+        EventoJogo evento = {.tipo = EVENTO_TESOURO, .tesouro = transferencia->indice_tesouro, .ok = false};
+        publicar_evento(sessao, &evento);
+    }
+    
+    // A tela deixa de mostrar o progresso do envio. Com sucesso, o evento
+    // leva o arquivo inteiro como transferido.
+    EventoJogo evento = {.tipo = EVENTO_PROGRESSO, .tesouro = transferencia->indice_tesouro, .ok = true};
+    if (sucesso) {
+        evento.bytes = evento.total = transferencia->tamanho_arquivo;
+    }
+    publicar_evento(sessao, &evento);
+}
+
+// Desfaz o mapeamento e fecha o arquivo da transferência. O mapeamento dura
+// até aqui: os chunks em trânsito apontam para ele nas retransmissões, e os
+// blocos ainda no pool o leem.
+void liberar_arquivo_transferencia(Sessao *sessao) {
+    Transferencia *transferencia = sessao->transferencia;
+    if (transferencia->mapa != NULL) {
+        aguardar_blocos_adiante(sessao);
+        munmap(transferencia->mapa, transferencia->tam_mapa);
+        transferencia->mapa = NULL;
+    }
+    
+    if (transferencia->arquivo != NULL) {
+        fclose(transferencia->arquivo);
+        transferencia->arquivo = NULL;
+    }
 }
 
 // Tratamento de sinais para encerramento limpo
 void tratar_sinal(int signum) {
     printf("\nSinal %d recebido. Encerrando servidor...\n", signum);
     em_execucao = false;
+    for (int i = 0; i < num_trabalhadores; i++) {
+        if (trabalhadores[i] != NULL) {
+            reator_parar(&trabalhadores[i]->reator);
+        }
+    }
+    reator_parar(&reator_tela);
 } 
\ No newline at end of file
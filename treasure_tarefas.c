@@ -0,0 +1,252 @@
+#include "treasure_tarefas.h"
+#include <stdio.h>
+#include <string.h>
+
+// Fila da thread do pool que está executando este código (-1 fora do pool)
+static __thread int fila_propria = -1;
+static __thread unsigned int semente_externa = 0; // Sorteio das vítimas fora do pool
+
+// Próximo número do sorteio das vítimas (xorshift de 32 bits)
+static unsigned int sortear(unsigned int *semente) {
+    unsigned int x = *semente;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *semente = x;
+    return x;
+}
+
+// Tira a tarefa mais nova da fila: a dona trabalha no que acabou de enviar,
+// ainda quente no cache
+static Tarefa *tirar_do_fim(PoolTarefas *pool, int indice) {
+    FilaTarefas *fila = &pool->filas[indice];
+    Tarefa *tarefa = NULL;
+    
+    pthread_mutex_lock(&fila->mutex);
+    if (fila->fim != fila->inicio) {
+        fila->fim--;
+        tarefa = fila->itens[fila->fim % CAPACIDADE_FILA_TAREFAS];
+        __atomic_sub_fetch(&pool->enfileiradas, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&fila->mutex);
+    
+    return tarefa;
+}
+
+// Rouba a tarefa mais antiga da fila de outra thread
+static Tarefa *tirar_do_inicio(PoolTarefas *pool, int indice) {
+    FilaTarefas *fila = &pool->filas[indice];
+    Tarefa *tarefa = NULL;
+    
+    pthread_mutex_lock(&fila->mutex);
+    if (fila->fim != fila->inicio) {
+        tarefa = fila->itens[fila->inicio % CAPACIDADE_FILA_TAREFAS];
+        fila->inicio++;
+        __atomic_sub_fetch(&pool->enfileiradas, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&fila->mutex);
+    
+    return tarefa;
+}
+
+// Próxima tarefa para a thread: da própria fila ou, se ela estiver vazia, de
+// uma vítima sorteada, seguindo pelas demais até achar alguma
+static Tarefa *buscar_tarefa(PoolTarefas *pool, int propria, unsigned int *semente) {
+    if (propria >= 0) {
+        Tarefa *tarefa = tirar_do_fim(pool, propria);
+        if (tarefa != NULL) {
+            return tarefa;
+        }
+    }
+    
+    int vitima = sortear(semente) % pool->num_threads;
+    for (int i = 0; i < pool->num_threads; i++) {
+        int indice = (vitima + i) % pool->num_threads;
+        if (indice == propria) {
+            continue;
+        }
+        
+        Tarefa *tarefa = tirar_do_inicio(pool, indice);
+        if (tarefa != NULL) {
+            if (propria >= 0) {
+                __atomic_add_fetch(&pool->roubadas, 1, __ATOMIC_RELAXED);
+            }
+            return tarefa;
+        }
+    }
+    
+    return NULL;
+}
+
+// Executa a tarefa e acorda quem estiver esperando por alguma. Depois de
+// marcada como concluída, a tarefa pode ser reaproveitada por quem a enviou
+// e não é mais tocada.
+static void executar(PoolTarefas *pool, Tarefa *tarefa) {
+    tarefa->funcao(tarefa->contexto);
+    __atomic_add_fetch(&pool->executadas, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&tarefa->concluida, true, __ATOMIC_SEQ_CST);
+    
+    if (__atomic_load_n(&pool->aguardando, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_broadcast(&pool->cond_concluida);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+// Thread do pool: executa tarefas enquanto houver alguma em qualquer fila e
+// dorme quando todas estão vazias
+static void *thread_tarefas(void *arg) {
+    ThreadTarefas *thread = arg;
+    PoolTarefas *pool = thread->pool;
+    fila_propria = thread->indice;
+    
+    while (true) {
+        Tarefa *tarefa = buscar_tarefa(pool, thread->indice, &thread->semente);
+        if (tarefa != NULL) {
+            executar(pool, tarefa);
+            continue;
+        }
+        
+        // 'dormindo' sobe antes de conferir as filas e quem envia confere
+        // 'dormindo' depois de enfileirar: um dos dois vê o outro
+        pthread_mutex_lock(&pool->mutex);
+        __atomic_add_fetch(&pool->dormindo, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->enfileiradas, __ATOMIC_SEQ_CST) == 0 && !pool->encerrar) {
+            pthread_cond_wait(&pool->cond_trabalho, &pool->mutex);
+        }
+        __atomic_sub_fetch(&pool->dormindo, 1, __ATOMIC_SEQ_CST);
+        bool sair = pool->encerrar && __atomic_load_n(&pool->enfileiradas, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&pool->mutex);
+        
+        if (sair) {
+            break;
+        }
+    }
+    
+    return NULL;
+}
+
+// Cria as filas e as threads do pool
+bool tarefas_iniciar(PoolTarefas *pool, int num_threads) {
+    memset(pool, 0, sizeof(*pool));
+    if (num_threads < 1 || num_threads > MAX_THREADS_TAREFAS) {
+        fprintf(stderr, "Número de threads do pool inválido: %d (1 a %d).\n",
+                num_threads, MAX_THREADS_TAREFAS);
+        return false;
+    }
+    
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond_trabalho, NULL);
+    pthread_cond_init(&pool->cond_concluida, NULL);
+    for (int i = 0; i < MAX_THREADS_TAREFAS; i++) {
+        pthread_mutex_init(&pool->filas[i].mutex, NULL);
+    }
+    
+    // Todas as filas existem antes da primeira thread começar a roubar
+    pool->num_threads = num_threads;
+    for (int i = 0; i < num_threads; i++) {
+        ThreadTarefas *thread = &pool->threads[i];
+        thread->pool = pool;
+        thread->indice = i;
+        thread->semente = 0x9E3779B9u * (i + 1);
+        
+        if (pthread_create(&thread->thread, NULL, thread_tarefas, thread) != 0) {
+            perror("Erro ao criar thread do pool de tarefas");
+            tarefas_finalizar(pool);
+            return false;
+        }
+        thread->criada = true;
+    }
+    
+    return true;
+}
+
+// Envia uma tarefa ao pool. Fora dele, a tarefa vai para a fila indicada por
+// 'dica' (cada thread que envia costuma usar sempre a mesma); dentro, para a
+// fila da própria thread. Com a fila cheia, a tarefa é executada na hora.
+void tarefas_enviar(PoolTarefas *pool, Tarefa *tarefa, FuncaoTarefa funcao, void *contexto, int dica) {
+    tarefa->funcao = funcao;
+    tarefa->contexto = contexto;
+    __atomic_store_n(&tarefa->concluida, false, __ATOMIC_RELAXED);
+    
+    int indice = (fila_propria >= 0) ? fila_propria : (unsigned int)dica % pool->num_threads;
+    FilaTarefas *fila = &pool->filas[indice];
+    
+    pthread_mutex_lock(&fila->mutex);
+    if (fila->fim - fila->inicio == CAPACIDADE_FILA_TAREFAS) {
+        pthread_mutex_unlock(&fila->mutex);
+        __atomic_add_fetch(&pool->na_hora, 1, __ATOMIC_RELAXED);
+        executar(pool, tarefa);
+        return;
+    }
+    fila->itens[fila->fim % CAPACIDADE_FILA_TAREFAS] = tarefa;
+    fila->fim++;
+    __atomic_add_fetch(&pool->enfileiradas, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&fila->mutex);
+    
+    if (__atomic_load_n(&pool->dormindo, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_signal(&pool->cond_trabalho);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+// Espera a tarefa terminar, executando as que estiverem nas filas enquanto
+// isso. Só dorme quando todas as filas estão vazias: a tarefa esperada já
+// está em execução em outra thread.
+void tarefas_aguardar(PoolTarefas *pool, Tarefa *tarefa, int dica) {
+    unsigned int *semente;
+    if (fila_propria >= 0) {
+        semente = &pool->threads[fila_propria].semente;
+    } else {
+        if (semente_externa == 0) {
+            semente_externa = 0x85EBCA6Bu * (dica + 1) | 1;
+        }
+        semente = &semente_externa;
+    }
+    
+    while (!__atomic_load_n(&tarefa->concluida, __ATOMIC_ACQUIRE)) {
+        Tarefa *outra = buscar_tarefa(pool, fila_propria, semente);
+        if (outra != NULL) {
+            __atomic_add_fetch(&pool->ajudas, 1, __ATOMIC_RELAXED);
+            executar(pool, outra);
+            continue;
+        }
+        
+        pthread_mutex_lock(&pool->mutex);
+        __atomic_add_fetch(&pool->aguardando, 1, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&tarefa->concluida, __ATOMIC_SEQ_CST)) {
+            pthread_cond_wait(&pool->cond_concluida, &pool->mutex);
+        }
+        __atomic_sub_fetch(&pool->aguardando, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+// A tarefa já terminou (não espera)
+bool tarefas_pronta(const Tarefa *tarefa) {
+    return __atomic_load_n(&tarefa->concluida, __ATOMIC_ACQUIRE);
+}
+
+// Para as threads depois de esvaziar as filas e libera o pool
+void tarefas_finalizar(PoolTarefas *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->encerrar = true;
+    pthread_cond_broadcast(&pool->cond_trabalho);
+    pthread_mutex_unlock(&pool->mutex);
+    
+    for (int i = 0; i < pool->num_threads; i++) {
+        if (pool->threads[i].criada) {
+            pthread_join(pool->threads[i].thread, NULL);
+            pool->threads[i].criada = false;
+        }
+    }
+    
+    for (int i = 0; i < MAX_THREADS_TAREFAS; i++) {
+        pthread_mutex_destroy(&pool->filas[i].mutex);
+    }
+    pthread_cond_destroy(&pool->cond_concluida);
+    pthread_cond_destroy(&pool->cond_trabalho);
+    pthread_mutex_destroy(&pool->mutex);
+    pool->num_threads = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef TREASURE_TAREFAS_H
+#define TREASURE_TAREFAS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Pool de threads para o trabalho pesado de CPU de cada chunk (compressão,
+// paridades). Cada thread tem sua fila: tira tarefas do fim da própria fila
+// e, quando ela esvazia, rouba do início da fila de uma vítima sorteada. Quem
+// espera por uma tarefa executa tarefas pendentes enquanto isso, em vez de
+// dormir. A ordem dos resultados fica com quem envia as tarefas: ele as
+// guarda na ordem de envio e espera por cada uma nessa ordem.
+#define MAX_THREADS_TAREFAS 32
+#define CAPACIDADE_FILA_TAREFAS 256       // Tarefas por fila (potência de 2)
+
+typedef void (*FuncaoTarefa)(void *contexto);
+
+// Tarefa enviada ao pool. Fica com quem a enviou, que não pode reaproveitá-la
+// antes de tarefas_aguardar.
+typedef struct {
+    FuncaoTarefa funcao;
+    void *contexto;
+    bool concluida;
+} Tarefa;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    Tarefa *itens[CAPACIDADE_FILA_TAREFAS];
+    unsigned int inicio;              // Mais antiga: onde os ladrões pegam
+    unsigned int fim;                 // Mais nova: onde a dona pega
+} FilaTarefas;
+
+typedef struct PoolTarefas PoolTarefas;
+
+typedef struct {
+    PoolTarefas *pool;
+    int indice;
+    pthread_t thread;
+    bool criada;
+    unsigned int semente;             // Sorteio das vítimas
+} ThreadTarefas;
+
+struct PoolTarefas {
+    int num_threads;
+    ThreadTarefas threads[MAX_THREADS_TAREFAS];
+    FilaTarefas filas[MAX_THREADS_TAREFAS];
+    pthread_mutex_t mutex;            // Só para dormir e acordar
+    pthread_cond_t cond_trabalho;     // Há tarefas nas filas (ou o pool deve parar)
+    pthread_cond_t cond_concluida;    // Uma tarefa terminou
+    int enfileiradas;                 // Tarefas nas filas, somadas todas
+    int dormindo;                     // Threads do pool esperando cond_trabalho
+    int aguardando;                   // Threads esperando cond_concluida
+    bool encerrar;
+    
+    // Estatísticas
+    unsigned long executadas;
+    unsigned long roubadas;           // Tiradas da fila de outra thread
+    unsigned long ajudas;             // Executadas por quem esperava outra tarefa
+    unsigned long na_hora;            // Executadas no envio, com a fila cheia
+};
+
+bool tarefas_iniciar(PoolTarefas *pool, int num_threads);
+void tarefas_enviar(PoolTarefas *pool, Tarefa *tarefa, FuncaoTarefa funcao, void *contexto, int dica);
+void tarefas_aguardar(PoolTarefas *pool, Tarefa *tarefa, int dica);
+bool tarefas_pronta(const Tarefa *tarefa);
+void tarefas_finalizar(PoolTarefas *pool);
+
+#endif // TREASURE_TAREFAS_H
@@ -0,0 +1,675 @@
+#include "treasure_tela.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define ESTILO_NEGRITO 0x01
+#define ESTILO_ITALICO 0x02
+#define DESLOCAMENTO_COR 4            // Cor do texto: 0 padrão, 1 a 8 para as cores 30 a 37
+#define LIMPAR_TELA "\033[2J\033[H"
+
+static const CelulaTela celula_vazia = {' ', 0};
+static const CelulaTela celula_desconhecida = {0, 0}; // Difere de qualquer célula do quadro
+
+#define CELULA_MUDOU(novas, antigas, i) \
+    ((novas)[i].glifo != (antigas)[i].glifo || (novas)[i].estilo != (antigas)[i].estilo)
+
+static long long relogio_us() {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return agora.tv_sec * 1000000LL + agora.tv_nsec / 1000;
+}
+
+// Garante espaço para mais 'tam' bytes em um buffer que cresce dobrando
+static bool reservar(char **buffer, size_t *capacidade, size_t usado, size_t tam) {
+    if (usado + tam <= *capacidade) {
+        return true;
+    }
+    size_t nova = *capacidade ? *capacidade : 4096;
+    while (nova < usado + tam) {
+        nova *= 2;
+    }
+    char *novo = realloc(*buffer, nova);
+    if (novo == NULL) {
+        return false;
+    }
+    *buffer = novo;
+    *capacidade = nova;
+    return true;
+}
+
+static void emitir(Tela *tela, const char *dados, size_t tam) {
+    if (reservar(&tela->saida, &tela->cap_saida, tela->tam_saida, tam)) {
+        memcpy(tela->saida + tela->tam_saida, dados, tam);
+        tela->tam_saida += tam;
+    }
+}
+
+// Prepara a tela para escrever em 'fd'. Em um terminal, os quadros são
+// escritos por diferença.
+void tela_iniciar(Tela *tela, int fd) {
+    memset(tela, 0, sizeof(*tela));
+    tela->fd = fd;
+    tela->diferencial = isatty(fd);
+    tela->saida_original = -1;
+    tela->erro_original = -1;
+}
+
+void tela_finalizar(Tela *tela) {
+    tela_restaurar_mensagens(tela);
+    free(tela->texto);
+    free(tela->texto_anterior);
+    free(tela->linhas);
+    free(tela->linhas_anteriores);
+    free(tela->celulas);
+    free(tela->anteriores);
+    free(tela->saida);
+    memset(tela, 0, sizeof(*tela));
+}
+
+// Com os quadros escritos por diferença, leva as mensagens do programa
+// (stdout e, se for o terminal, stderr) para 'arquivo': uma linha de log no
+// terminal rolaria a tela e deixaria as próximas diferenças nas linhas
+// erradas. Os quadros continuam no terminal. Se o arquivo não puder ser
+// aberto, as mensagens ficam no terminal e os quadros passam a ser inteiros.
+void tela_desviar_mensagens(Tela *tela, const char *arquivo) {
+    if (!tela->diferencial || tela->fd != STDOUT_FILENO || tela->saida_original >= 0) {
+        return;
+    }
+    
+    int log = open(arquivo, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int saida = dup(STDOUT_FILENO);
+    int erro = isatty(STDERR_FILENO) ? dup(STDERR_FILENO) : -1;
+    if (log < 0 || saida < 0) {
+        perror("Erro ao abrir o arquivo de mensagens");
+        printf("Mensagens no terminal: a tela será redesenhada inteira.\n");
+        if (log >= 0) {
+            close(log);
+        }
+        if (saida >= 0) {
+            close(saida);
+        }
+        if (erro >= 0) {
+            close(erro);
+        }
+        tela->diferencial = false;
+        return;
+    }
+    
+    printf("Mensagens em %s enquanto a tela estiver aberta.\n", arquivo);
+    fflush(stdout);
+    fflush(stderr);
+    dup2(log, STDOUT_FILENO);
+    if (erro >= 0) {
+        dup2(log, STDERR_FILENO);
+    }
+    close(log);
+    
+    tela->fd = saida;
+    tela->saida_original = saida;
+    tela->erro_original = erro;
+}
+
+// Devolve as mensagens ao terminal, abaixo do último quadro
+void tela_restaurar_mensagens(Tela *tela) {
+    if (tela->saida_original < 0) {
+        return;
+    }
+    
+    fflush(stdout);
+    fflush(stderr);
+    dup2(tela->saida_original, STDOUT_FILENO);
+    close(tela->saida_original);
+    if (tela->erro_original >= 0) {
+        dup2(tela->erro_original, STDERR_FILENO);
+        close(tela->erro_original);
+    }
+    
+    tela->fd = STDOUT_FILENO;
+    tela->saida_original = -1;
+    tela->erro_original = -1;
+}
+
+// Acrescenta texto ao quadro em montagem (com '\n' e cores ANSI, como printf)
+void tela_printf(Tela *tela, const char *formato, ...) {
+    // Formata direto no buffer; só se não couber, cresce e formata de novo
+    size_t livre = tela->cap_texto - tela->tam_texto;
+    va_list args;
+    va_start(args, formato);
+    int tam = vsnprintf(tela->texto ? tela->texto + tela->tam_texto : NULL, livre, formato, args);
+    va_end(args);
+    if (tam <= 0) {
+        return;
+    }
+    
+    if ((size_t)tam >= livre) {
+        if (!reservar(&tela->texto, &tela->cap_texto, tela->tam_texto, tam + 1)) {
+            return;
+        }
+        va_start(args, formato);
+        vsnprintf(tela->texto + tela->tam_texto, tam + 1, formato, args);
+        va_end(args);
+    }
+    tela->tam_texto += tam;
+}
+
+// Microssegundos até o próximo quadro poder ser desenhado (0: já pode)
+long long tela_espera_us(const Tela *tela) {
+    if (tela->quadros == 0) {
+        return 0;
+    }
+    long long espera = tela->ultimo_quadro_us + INTERVALO_TELA_US - relogio_us();
+    return espera > 0 ? espera : 0;
+}
+
+// Aplica os parâmetros de uma sequência SGR (\033[...m) ao estilo
+static uint32_t aplicar_sgr(uint32_t estilo, const char *parametros, size_t tam) {
+    if (tam == 0) {
+        return 0;
+    }
+    
+    size_t i = 0;
+    while (i < tam) {
+        int valor = 0;
+        while (i < tam && parametros[i] != ';') {
+            valor = valor * 10 + (parametros[i] - '0');
+            i++;
+        }
+        i++; // Pula o ';'
+        
+        if (valor == 0) {
+            estilo = 0;
+        } else if (valor == 1) {
+            estilo |= ESTILO_NEGRITO;
+        } else if (valor == 3) {
+            estilo |= ESTILO_ITALICO;
+        } else if (valor == 22) {
+            estilo &= ~ESTILO_NEGRITO;
+        } else if (valor == 23) {
+            estilo &= ~ESTILO_ITALICO;
+        } else if (valor >= 30 && valor <= 37) {
+            estilo = (estilo & 0x0F) | ((valor - 29) << DESLOCAMENTO_COR);
+        } else if (valor == 39) {
+            estilo &= 0x0F;
+        }
+    }
+    return estilo;
+}
+
+// Percorre uma linha do quadro (sem o '\n'), célula por célula, a partir do
+// estilo com que ela começa. Sem 'destino', só mede a linha. Retorna o
+// estilo no fim da linha.
+static uint32_t percorrer_linha(const char *texto, size_t tam, uint32_t estilo, 
+                                CelulaTela *destino, int *largura) {
+    int coluna = 0;
+    
+    size_t i = 0;
+    while (i < tam) {
+        unsigned char c = texto[i];
+        
+        // Sequência ANSI: só as de estilo mudam as células
+        if (c == '\033' && i + 1 < tam && texto[i + 1] == '[') {
+            size_t inicio = i + 2;
+            size_t fim = inicio;
+            while (fim < tam && (texto[fim] < 0x40 || texto[fim] > 0x7E)) {
+                fim++;
+            }
+            if (fim < tam && texto[fim] == 'm') {
+                estilo = aplicar_sgr(estilo, texto + inicio, fim - inicio);
+            }
+            i = fim + 1;
+            continue;
+        }
+        
+        if (c == '\t') {
+            int proxima = (coluna / 8 + 1) * 8;
+            while (coluna < proxima) {
+                if (destino != NULL) {
+                    destino[coluna] = (CelulaTela){' ', estilo};
+                }
+                coluna++;
+            }
+        } else if (c >= 0x20) {
+            // Um caractere UTF-8 ocupa uma célula
+            int bytes = (c < 0x80) ? 1 : ((c & 0xE0) == 0xC0) ? 2 : ((c & 0xF0) == 0xE0) ? 3 :
+                        ((c & 0xF8) == 0xF0) ? 4 : 1;
+            if (i + bytes > tam) {
+                bytes = tam - i;
+            }
+            if (destino != NULL) {
+                uint32_t glifo = 0;
+                for (int b = 0; b < bytes; b++) {
+                    glifo |= (uint32_t)(unsigned char)texto[i + b] << (8 * b);
+                }
+                destino[coluna] = (CelulaTela){glifo, estilo};
+            }
+            coluna++;
+            i += bytes;
+            continue;
+        }
+        // Outros caracteres de controle não ocupam espaço
+        i++;
+    }
+    
+    *largura = coluna;
+    return estilo;
+}
+
+// Mede uma linha que mudou: a sua largura e o estilo em que termina. A
+// maior parte das linhas só tem ASCII imprimível, e cada byte é uma célula
+// no estilo com que a linha começa.
+static void medir_linha(const char *texto, LinhaTela *linha) {
+    const unsigned char *bytes = (const unsigned char *)texto + linha->inicio;
+    size_t i = 0;
+    while (i < linha->tam && bytes[i] >= 0x20 && bytes[i] < 0x80) {
+        i++;
+    }
+    
+    linha->simples = i == linha->tam;
+    if (linha->simples) {
+        linha->largura = linha->tam;
+        linha->estilo_fim = linha->estilo;
+    } else {
+        linha->estilo_fim = percorrer_linha(texto + linha->inicio, linha->tam, linha->estilo, 
+                                            NULL, &linha->largura);
+    }
+}
+
+// Divide o quadro novo em linhas e as compara com as do quadro anterior.
+// Só as linhas que mudaram são percorridas, para medir a sua largura e o
+// estilo em que terminam; as iguais repetem o que já foi medido. Retorna
+// false se faltar memória.
+static bool dividir_quadro(Tela *tela) {
+    const char *texto = tela->texto;
+    size_t tam_texto = tela->tam_texto;
+    int num_linhas = 0;
+    int colunas = 0;
+    uint32_t estilo = 0;
+    
+    size_t inicio = 0;
+    while (inicio < tam_texto) {
+        const char *fim = memchr(texto + inicio, '\n', tam_texto - inicio);
+        size_t tam = (fim != NULL) ? (size_t)(fim - texto) - inicio : tam_texto - inicio;
+        
+        if (num_linhas == tela->cap_linhas) {
+            int cap = tela->cap_linhas ? tela->cap_linhas * 2 : 64;
+            LinhaTela *linhas = realloc(tela->linhas, cap * sizeof(LinhaTela));
+            if (linhas == NULL) {
+                return false;
+            }
+            tela->linhas = linhas;
+            tela->cap_linhas = cap;
+        }
+        
+        LinhaTela *linha = &tela->linhas[num_linhas];
+        linha->inicio = inicio;
+        linha->tam = tam;
+        linha->estilo = estilo;
+        
+        // Da linha do cursor em diante, o que a tela mostra não é só o quadro
+        const LinhaTela *anterior = NULL;
+        if (tela->anteriores_validas && num_linhas < tela->num_anteriores && 
+            num_linhas < tela->linha_cursor_anterior) {
+            anterior = &tela->linhas_anteriores[num_linhas];
+        }
+        linha->igual = anterior != NULL && anterior->tam == tam && anterior->estilo == estilo &&
+                       memcmp(tela->texto_anterior + anterior->inicio, texto + inicio, tam) == 0;
+        if (linha->igual) {
+            linha->estilo_fim = anterior->estilo_fim;
+            linha->largura = anterior->largura;
+            linha->simples = anterior->simples;
+        } else {
+            medir_linha(texto, linha);
+        }
+        
+        estilo = linha->estilo_fim;
+        if (linha->largura > colunas) {
+            colunas = linha->largura;
+        }
+        num_linhas++;
+        inicio += tam + 1;
+    }
+    
+    // As células de uma linha, nova e anterior, para as diferenças (e uma
+    // a mais, para apagar o que estiver depois da linha)
+    int cap = (colunas > tela->colunas_anteriores ? colunas : tela->colunas_anteriores) + 1;
+    if (cap > tela->cap_celulas) {
+        CelulaTela *celulas = realloc(tela->celulas, cap * sizeof(CelulaTela));
+        if (celulas != NULL) {
+            tela->celulas = celulas;
+        }
+        CelulaTela *anteriores = realloc(tela->anteriores, cap * sizeof(CelulaTela));
+        if (anteriores != NULL) {
+            tela->anteriores = anteriores;
+        }
+        if (celulas == NULL || anteriores == NULL) {
+            return false;
+        }
+        tela->cap_celulas = cap;
+    }
+    
+    tela->num_linhas = num_linhas;
+    tela->colunas = colunas;
+    
+    // O cursor fica onde a escrita do quadro inteiro o deixaria
+    if (tam_texto == 0 || texto[tam_texto - 1] == '\n') {
+        tela->linha_cursor = num_linhas;
+        tela->coluna_cursor = 0;
+    } else {
+        tela->linha_cursor = num_linhas - 1;
+        tela->coluna_cursor = tela->linhas[num_linhas - 1].largura;
+    }
+    return true;
+}
+
+// Converte uma linha nas suas células, completando com células vazias até
+// 'colunas'
+static void converter_linha(const char *texto, const LinhaTela *linha, CelulaTela *destino, int colunas) {
+    int largura = 0;
+    if (linha != NULL && linha->simples) {
+        const unsigned char *bytes = (const unsigned char *)texto + linha->inicio;
+        for (largura = 0; largura < linha->largura; largura++) {
+            destino[largura] = (CelulaTela){bytes[largura], linha->estilo};
+        }
+    } else if (linha != NULL) {
+        percorrer_linha(texto + linha->inicio, linha->tam, linha->estilo, destino, &largura);
+    }
+    for (int i = largura; i < colunas; i++) {
+        destino[i] = celula_vazia;
+    }
+}
+
+// Sequência SGR completa do estilo (sempre a partir do padrão)
+static void emitir_estilo(Tela *tela, uint32_t estilo) {
+    char sgr[24];
+    int tam = snprintf(sgr, sizeof(sgr), "\033[0%s%s",
+                       (estilo & ESTILO_NEGRITO) ? ";1" : "", (estilo & ESTILO_ITALICO) ? ";3" : "");
+    if (estilo >> DESLOCAMENTO_COR) {
+        tam += snprintf(sgr + tam, sizeof(sgr) - tam, ";%d", 29 + (estilo >> DESLOCAMENTO_COR));
+    }
+    sgr[tam++] = 'm';
+    emitir(tela, sgr, tam);
+}
+
+static void emitir_glifo(Tela *tela, uint32_t glifo) {
+    char bytes[4];
+    int tam = 0;
+    do {
+        bytes[tam++] = glifo & 0xFF;
+        glifo >>= 8;
+    } while (glifo != 0 && tam < 4);
+    emitir(tela, bytes, tam);
+}
+
+// Escreve um número positivo em decimal. Mais barato que snprintf, que
+// pesaria nos quadros com poucas diferenças.
+static int formatar_numero(char *destino, int valor) {
+    char digitos[12];
+    int tam = 0;
+    do {
+        digitos[tam++] = '0' + valor % 10;
+        valor /= 10;
+    } while (valor > 0);
+    for (int i = 0; i < tam; i++) {
+        destino[i] = digitos[tam - 1 - i];
+    }
+    return tam;
+}
+
+static void mover_cursor(Tela *tela, int linha, int coluna) {
+    char sequencia[32] = "\033[";
+    int tam = 2;
+    tam += formatar_numero(sequencia + tam, linha + 1);
+    sequencia[tam++] = ';';
+    tam += formatar_numero(sequencia + tam, coluna + 1);
+    sequencia[tam++] = 'H';
+    emitir(tela, sequencia, tam);
+}
+
+// Escreve as células que mudaram em uma linha. Trechos alterados separados
+// por poucas células iguais são escritos de uma vez: reescrever as células
+// custa menos bytes que reposicionar o cursor.
+static void escrever_linha_celulas(Tela *tela, int linha, const LinhaTela *nova, 
+                                   const LinhaTela *anterior, uint32_t *estilo) {
+    int colunas = nova->largura;
+    if (anterior != NULL && anterior->largura > colunas) {
+        colunas = anterior->largura;
+    }
+    
+    // Depois do cursor do quadro anterior, o teclado pode ter ecoado o que
+    // foi digitado: essas células são reescritas e o resto da linha apagado
+    int eco = colunas;
+    if (linha >= tela->linha_cursor_anterior) {
+        eco = (linha == tela->linha_cursor_anterior) ? tela->coluna_cursor_anterior : 0;
+        colunas++;
+    }
+    
+    CelulaTela *novas = tela->celulas;
+    CelulaTela *antigas = tela->anteriores;
+    converter_linha(tela->texto, nova, novas, colunas);
+    converter_linha(tela->texto_anterior, anterior, antigas, colunas);
+    for (int coluna = eco; coluna < colunas; coluna++) {
+        antigas[coluna] = celula_desconhecida;
+    }
+    
+    // Depois da última célula não vazia, o resto da linha nova é vazio
+    int fim_linha = nova->largura;
+    while (fim_linha > 0 && novas[fim_linha - 1].glifo == ' ' && novas[fim_linha - 1].estilo == 0) {
+        fim_linha--;
+    }
+    
+    int coluna = 0;
+    while (coluna < colunas) {
+        if (!CELULA_MUDOU(novas, antigas, coluna)) {
+            coluna++;
+            continue;
+        }
+        
+        mover_cursor(tela, linha, coluna);
+        while (coluna < colunas) {
+            // O resto da linha fica vazio: apaga até o fim de uma vez
+            if (coluna >= fim_linha) {
+                if (*estilo != 0) {
+                    emitir_estilo(tela, 0);
+                    *estilo = 0;
+                }
+                emitir(tela, "\033[K", 3);
+                coluna = colunas;
+                break;
+            }
+            
+            if (novas[coluna].estilo != *estilo) {
+                emitir_estilo(tela, novas[coluna].estilo);
+                *estilo = novas[coluna].estilo;
+            }
+            emitir_glifo(tela, novas[coluna].glifo);
+            coluna++;
+            
+            // Próxima célula alterada: perto, o trecho continua
+            int proxima = coluna;
+            while (proxima < colunas && proxima - coluna <= DISTANCIA_JUNTAR_CELULAS &&
+                   !CELULA_MUDOU(novas, antigas, proxima)) {
+                proxima++;
+            }
+            if (proxima - coluna > DISTANCIA_JUNTAR_CELULAS || proxima >= colunas) {
+                coluna = proxima;
+                break;
+            }
+        }
+    }
+}
+
+// Escreve uma linha simples que mudou, contra a mesma linha do quadro
+// anterior, também simples e no mesmo estilo (ou inexistente). Cada byte é
+// uma célula: as diferenças são achadas nos próprios bytes e os trechos
+// são copiados do texto, com a mesma junção de trechos próximos.
+static void escrever_linha_simples(Tela *tela, int linha, const LinhaTela *nova, 
+                                   const LinhaTela *anterior, uint32_t *estilo) {
+    const char *novos = tela->texto + nova->inicio;
+    const char *antigos = anterior != NULL ? tela->texto_anterior + anterior->inicio : NULL;
+    int comum = 0;
+    if (anterior != NULL) {
+        comum = nova->largura < anterior->largura ? nova->largura : anterior->largura;
+    }
+    
+    int coluna = 0;
+    while (coluna < nova->largura) {
+        if (coluna < comum && novos[coluna] == antigos[coluna]) {
+            coluna++;
+            continue;
+        }
+        
+        // O trecho vai até a última diferença seguida de mais de
+        // DISTANCIA_JUNTAR_CELULAS bytes iguais (ou até o fim da linha nova)
+        int fim = coluna + 1;
+        for (int proxima = fim; proxima < nova->largura && proxima - fim <= DISTANCIA_JUNTAR_CELULAS; proxima++) {
+            if (proxima >= comum || novos[proxima] != antigos[proxima]) {
+                fim = proxima + 1;
+            }
+        }
+        
+        mover_cursor(tela, linha, coluna);
+        if (nova->estilo != *estilo) {
+            emitir_estilo(tela, nova->estilo);
+            *estilo = nova->estilo;
+        }
+        emitir(tela, novos + coluna, fim - coluna);
+        coluna = fim;
+    }
+    
+    // O que havia depois da linha nova: o fim da anterior ou o eco do teclado
+    if ((anterior != NULL && anterior->largura > nova->largura) || linha >= tela->linha_cursor_anterior) {
+        mover_cursor(tela, linha, nova->largura);
+        if (*estilo != 0) {
+            emitir_estilo(tela, 0);
+            *estilo = 0;
+        }
+        emitir(tela, "\033[K", 3);
+    }
+}
+
+// Monta a saída com só as células que mudaram, nas linhas que mudaram
+static void escrever_diferencas(Tela *tela) {
+    uint32_t estilo = 0;
+    
+    for (int linha = 0; linha < tela->num_linhas; linha++) {
+        const LinhaTela *nova = &tela->linhas[linha];
+        if (nova->igual) {
+            continue;
+        }
+        
+        const LinhaTela *anterior = NULL;
+        if (linha < tela->num_anteriores) {
+            anterior = &tela->linhas_anteriores[linha];
+        }
+        if (nova->simples && (anterior == NULL || (anterior->simples && anterior->estilo == nova->estilo))) {
+            escrever_linha_simples(tela, linha, nova, anterior, &estilo);
+        } else {
+            escrever_linha_celulas(tela, linha, nova, anterior, &estilo);
+        }
+    }
+    
+    if (estilo != 0) {
+        emitir_estilo(tela, 0);
+    }
+    
+    // Cursor no fim do texto, como depois de um quadro inteiro, e o que
+    // havia depois dele (linhas do quadro anterior, o eco do teclado)
+    // apagado
+    mover_cursor(tela, tela->linha_cursor, tela->coluna_cursor);
+    emitir(tela, "\033[J", 3);
+}
+
+// Indica se o quadro pode ser escrito por diferença: o terminal tem o mesmo
+// tamanho do quadro anterior (ao mudar de tamanho, ele redistribui o texto)
+// e o quadro cabe nele sem rolar a tela, mesmo com a linha que o eco do
+// teclado acrescenta abaixo do cursor.
+static bool cabe_no_terminal(Tela *tela) {
+    struct winsize tamanho;
+    if (ioctl(tela->fd, TIOCGWINSZ, &tamanho) == -1 || tamanho.ws_row == 0) {
+        return true; // Tamanho desconhecido
+    }
+    
+    bool mesmo_tamanho = tamanho.ws_row == tela->linhas_terminal && tamanho.ws_col == tela->colunas_terminal;
+    tela->linhas_terminal = tamanho.ws_row;
+    tela->colunas_terminal = tamanho.ws_col;
+    return mesmo_tamanho && tela->linha_cursor + 1 < tamanho.ws_row && tela->colunas <= tamanho.ws_col;
+}
+
+// Escreve o quadro montado com tela_printf, em um único write(), e começa
+// um quadro novo
+void tela_apresentar(Tela *tela) {
+    long long agora = relogio_us();
+    tela->tam_saida = 0;
+    
+    bool diferencial = tela->diferencial && tela->anteriores_validas;
+    if (tela->diferencial && !dividir_quadro(tela)) {
+        diferencial = false;
+        tela->diferencial = false; // Sem memória para as linhas: quadros inteiros
+    }
+    if (tela->diferencial && !cabe_no_terminal(tela)) {
+        diferencial = false;
+    }
+    
+    if (diferencial) {
+        escrever_diferencas(tela);
+    } else {
+        emitir(tela, LIMPAR_TELA, strlen(LIMPAR_TELA));
+        emitir(tela, tela->texto, tela->tam_texto);
+        tela->completos++;
+        
+        // As diferenças do próximo quadro supõem o terminal no estilo padrão
+        if (tela->diferencial && tela->num_linhas > 0 && tela->linhas[tela->num_linhas - 1].estilo_fim != 0) {
+            emitir_estilo(tela, 0);
+        }
+    }
+    
+    // O que já foi escrito com printf vem antes do quadro
+    fflush(stdout);
+    size_t escritos = 0;
+    while (escritos < tela->tam_saida) {
+        ssize_t n = write(tela->fd, tela->saida + escritos, tela->tam_saida - escritos);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        escritos += n;
+    }
+    
+    tela->quadros++;
+    tela->bytes_escritos += escritos;
+    tela->bytes_inteiros += strlen(LIMPAR_TELA) + tela->tam_texto;
+    tela->ultimo_quadro_us = agora;
+    
+    // O texto e as linhas novas passam a ser os da tela
+    if (tela->diferencial) {
+        char *texto = tela->texto_anterior;
+        size_t cap_texto = tela->cap_anterior;
+        tela->texto_anterior = tela->texto;
+        tela->cap_anterior = tela->cap_texto;
+        tela->texto = texto;
+        tela->cap_texto = cap_texto;
+        
+        LinhaTela *linhas = tela->linhas_anteriores;
+        int cap_linhas = tela->cap_linhas_anteriores;
+        tela->linhas_anteriores = tela->linhas;
+        tela->cap_linhas_anteriores = tela->cap_linhas;
+        tela->linhas = linhas;
+        tela->cap_linhas = cap_linhas;
+        
+        tela->num_anteriores = tela->num_linhas;
+        tela->colunas_anteriores = tela->colunas;
+        tela->linha_cursor_anterior = tela->linha_cursor;
+        tela->coluna_cursor_anterior = tela->coluna_cursor;
+        tela->anteriores_validas = escritos == tela->tam_saida;
+    }
+    tela->tam_texto = 0;
+}
@@ -0,0 +1,101 @@
+#ifndef TREASURE_TELA_H
+#define TREASURE_TELA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Desenho da tela por diferença. O quadro é montado em um buffer, com os
+// mesmos printf de antes, e dividido em linhas. Em um terminal, só as
+// linhas cujos bytes mudaram desde o quadro anterior são convertidas em
+// células (caractere e estilo), e só as células que mudaram são escritas,
+// com o cursor posicionado por sequências ANSI, em um único write(). Fora
+// de um terminal (saída redirecionada para um log), com o quadro maior que
+// o terminal ou depois que o terminal muda de tamanho, o quadro é escrito
+// inteiro, como antes.
+//
+// As posições só valem se nada mais escrever no terminal: enquanto os
+// quadros forem diferenciais, as mensagens do programa (stdout e stderr)
+// vão para um arquivo (tela_desviar_mensagens).
+#define INTERVALO_TELA_US 33000          // Intervalo mínimo entre dois quadros (~30 por segundo)
+#define DISTANCIA_JUNTAR_CELULAS 4       // Células iguais reescritas para evitar mover o cursor
+
+// Célula da tela: um caractere UTF-8 e o seu estilo
+typedef struct {
+    uint32_t glifo;               // Bytes do caractere, o primeiro no byte mais baixo
+    uint32_t estilo;              // ESTILO_* e a cor do texto
+} CelulaTela;
+
+// Linha do quadro. Duas linhas com os mesmos bytes e o mesmo estilo
+// inicial ocupam as mesmas células.
+typedef struct {
+    size_t inicio;                // Posição no texto do quadro
+    size_t tam;                   // Bytes, sem o '\n'
+    uint32_t estilo;              // Estilo no início da linha
+    uint32_t estilo_fim;          // Estilo no fim (o do início da próxima)
+    int largura;                  // Células ocupadas
+    bool simples;                 // Só ASCII imprimível: um byte por célula, sem mudar o estilo
+    bool igual;                   // Igual à mesma linha do quadro anterior
+} LinhaTela;
+
+typedef struct {
+    int fd;
+    bool diferencial;             // Saída em um terminal: só as diferenças
+    
+    // Quadro em montagem e o último escrito, com as suas linhas
+    char *texto;
+    size_t tam_texto;
+    size_t cap_texto;
+    char *texto_anterior;
+    size_t cap_anterior;
+    LinhaTela *linhas;
+    LinhaTela *linhas_anteriores;
+    int num_linhas;
+    int num_anteriores;
+    int cap_linhas;
+    int cap_linhas_anteriores;
+    int colunas;                  // Linha mais longa do quadro
+    int colunas_anteriores;
+    int linha_cursor;             // Onde o texto do quadro termina
+    int coluna_cursor;
+    int linha_cursor_anterior;    // Depois dele, o eco do teclado pode ter escrito
+    int coluna_cursor_anterior;
+    bool anteriores_validas;      // false: o próximo quadro é escrito inteiro
+    
+    // Células da linha que mudou, nova e anterior
+    CelulaTela *celulas;
+    CelulaTela *anteriores;
+    int cap_celulas;
+    
+    // Tamanho do terminal no último quadro
+    int linhas_terminal;
+    int colunas_terminal;
+    
+    // stdout e stderr originais, enquanto as mensagens vão para um
+    // arquivo (-1: não desviados)
+    int saida_original;
+    int erro_original;
+    
+    // Bytes do próximo write
+    char *saida;
+    size_t tam_saida;
+    size_t cap_saida;
+    
+    long long ultimo_quadro_us;
+    
+    // Estatísticas
+    unsigned long quadros;
+    unsigned long completos;
+    unsigned long long bytes_escritos;
+    unsigned long long bytes_inteiros; // O que teria sido escrito com todos os quadros inteiros
+} Tela;
+
+void tela_iniciar(Tela *tela, int fd);
+void tela_finalizar(Tela *tela);
+void tela_desviar_mensagens(Tela *tela, const char *arquivo);
+void tela_restaurar_mensagens(Tela *tela);
+void tela_printf(Tela *tela, const char *formato, ...) __attribute__((format(printf, 2, 3)));
+long long tela_espera_us(const Tela *tela);
+void tela_apresentar(Tela *tela);
+
+#endif // TREASURE_TELA_H